@@ -80,16 +80,30 @@
  * This file contains the following functions:
  *
  *   c_disort()...................Plane-parallel discrete ordinates radiative transfer program
+ *   c_disort_ws()................Same as c_disort(), using a caller-owned scratch workspace
+ *   c_disort_ws_suns()...........Same as c_disort_ws(), for several beam angles sharing one solution
+ *   c_disort_ws_surface()........Same as c_disort_ws(), for a black surface plus the response to the surface
+ *   c_disort_ws_jacobian().......Same as c_disort_ws(), plus the derivatives of the fluxes
+ *   c_disort_ws_cached().........Same as c_disort_ws(), reusing the beam solution of a beam cache if only
+ *                                temperatures changed
+ *   c_disort_ws_jacobian_cached()Same as c_disort_ws_jacobian(), reusing the beam solution of a beam cache
  *   c_bidir_reflectivity().......Supplies surface bi-directional reflectivity (Fortran name bdref).
  *   c_getmom()...................Calculate phase function Legendre expansion coefficients in various special
  *                                cases.
  *   c_asymmetric_matrix()........Solve eigenfunction problem for real asymmetric matrix known a priori
  *                                to have real eigenvalues (Fortran name asymtx).
+ *   c_symmetric_matrix().........Solve eigenfunction problem for real symmetric matrix (EISPACK names tred2, tql2).
  *   c_intensity_components().....Calculate the Fourier intensity components at the quadrature angles for azimuthal
  *                                expansion terms (mazim) in eq. SD(2), STWL(6) (Fortran name cmpint).
  *   c_fluxes()...................Calculate the radiative fluxes, mean intensity, and flux derivative with respect
  *                                to optical depth from the m=0 intensity components (the azimuthally-averaged
  *                                intensity).
+ *   c_absorption_only()..........Calculate fluxes and intensities in closed form when no layer scatters and the
+ *                                surface is Lambertian.
+ *   c_surface_response().........Calculate the response of the medium to a Lambertian surface, for the fluxes at
+ *                                any albedo in closed form.
+ *   c_flux_jacobian()............Calculate the derivatives of the fluxes with respect to the layer properties,
+ *                                the albedo and the temperatures by linearizing the m=0 solution.
  *   c_intensity_correction().....Correct intensity field by using Nakajima-Tanaka (1988) algorithm (Fortran name
  *                                intcor).
  *   c_secondary_scat()...........Calculate secondary scattered intensity of eq. STWL (A7) (Fortran name secsca).
@@ -102,10 +116,20 @@
  *   c_set_matrix()...............Calculate coefficient matrix for the set of equations obtained from the boundary
  *                                conditions and the continuity-of-intensity-at-layer-interface equations (Fortran
  *                                name setmtx).
+ *   c_block_factor().............L-U decompose the matrix of c_set_matrix() block by block, and estimate its
+ *                                condition.
+ *   c_block_solve()..............Solve the linear system of c_set_matrix() with the factors from c_block_factor().
  *   c_single_scat()..............Calculates single-scattered intensity from eqs. STWL (65b,d,e) (Fortran name
  *                                sinsca).
  *   c_solve_eigen()..............Solve eigenvalue/vector problem necessary to construct homogeneous part of
  *                                discrete ordinate solution; STWJ(8b), STWL(23f) (Fortran name soleig).
+ *   c_solve_eigen_symmetric()....Solve the reduced eigenvalue problem of c_solve_eigen() in symmetric form
+ *                                (ds->flag.symmetric_eigen).
+ *   c_eigen_cache_get()..........Look up the eigensolution of a layer in the eigen cache of the workspace.
+ *   c_eigen_cache_put()..........Store the eigensolution of a layer in the eigen cache of the workspace.
+ *   c_beam_cache_get()...........Restore the beam solution and factored matrix of a column from its beam cache.
+ *   c_beam_cache_put()...........Store them in the beam cache.
+ *   c_beam_cache_plk()...........Thermal particular solution of a layer from the unit solutions of the beam cache.
  *   c_solve0()...................Construct right-hand side vector -b- for general boundary conditions STWJ(17) and
  *                                solve system of eqns. obtained from the b.c.s and the
  *                                continuity-of-intensity-at-layer-interface eqns.
@@ -119,6 +143,7 @@
  *   c_interp_source()............Interpolate source functions to user angles, eq. STWL(30) (Fortran name terpso).
  *   c_upbeam()...................Find the incident-beam particular solution of SS(18), STWL(24a).
  *   c_upisot()...................Find the particular solution of thermal radiation of STWL(25).
+ *   c_upisot_unit()..............Same as c_upisot(), for unit thermal sources.
  *   c_user_intensities().........Compute intensity components at user output angles for azimuthal expansion terms
  *                                in eq. SD(2), STWL(6) (Fortran name usrint).
  *   c_xi_fun()...................Calculates Xi function of eq. STWL (72) (Fortran name xifunc).
@@ -166,6 +191,7 @@
  *   c_isamax()...................Return biggest absolute value among the array elements.
  *   c_twostr()...................Solve the radiative transfer equation in the two-stream approximation.
  *                                Based on the general-purpose algorithm DISORT, but both simplified and extended.
+ *   c_twostr_status()............Run c_twostr() and return a DS_* status code instead of exiting.
  *   c_chapman()..................Calculate the Chapman factor.
  *   c_twostr_check_inputs()......Check input dimensions and variables for two stream code (Fortran name tchekin).
  *   c_twostr_fluxes()............Calculate radiative fluxes, mean intensity, and flux derivative with respect to
@@ -184,6 +210,13 @@
  *   c_disort_state_free()........Free memory allocated by disort_state_alloc()
  *   c_disort_out_alloc_()........Dynamically allocate memory for disort output arrays
  *   c_disort_out_free()..........Free memory allocated by disort_out_alloc()
+ *   c_disort_workspace_alloc()...Allocate the scratch arena reused by c_disort_ws() across calls
+ *   c_disort_workspace_free()....Free memory allocated by disort_workspace_alloc()
+ *   c_disort_eigen_cache_alloc().Attach an eigen cache to a workspace, reused across c_disort_ws() calls
+ *   c_disort_beam_cache_alloc()..Allocate the beam cache of one column for c_disort_ws_cached()
+ *   c_disort_beam_cache_free()...Free memory allocated by c_disort_beam_cache_alloc()
+ *   c_disort_tables_alloc()......Build the quadrature and Legendre tables shared by all workspaces
+ *   c_disort_tables_free().......Free memory allocated by c_disort_tables_alloc()
  *   c_twostr_state_alloc().......Dynamically allocate memory for twostr input arrays
  *   c_twostr_state_free(0........Free memory allocated by twostr_state_alloc()
  *   c_twostr_out_alloc().........Dynamically allocate memory for twostr output arrays
@@ -198,11 +231,219 @@
  *  new intensity correction added by Robert Buras (LMU Munich)
  */
 
+#include <pthread.h>
+#include <setjmp.h>
+
 #include "cdisort.h"
 #include "locate.h"
 
+#if defined(DISORT_USE_LAPACK)
+/*
+ * With DISORT_USE_LAPACK, the LINPACK and BLAS-1 routines near the end of
+ * this file hand their work to an installed BLAS/LAPACK (reference LAPACK,
+ * OpenBLAS, MKL, ...), through the Fortran interface with 32-bit integers,
+ * for orders of at least DISORT_LAPACK_MIN_ORDER.  Factors from c_sgeco()/
+ * c_sgefa() and c_sgbco()/c_sgbfa() are then in LAPACK rather than LINPACK
+ * form, so they must only be passed on to c_sgesl() and c_sgbsl().  The
+ * condition estimators need more workspace, see LINPACK_WORK.
+ *
+ * Likewise, c_block_factor() factors each block with xGETRF, xTRSM and
+ * xGEMM for at least DISORT_LAPACK_MIN_BLOCK streams, leaving factors
+ * that only c_block_solve() understands, and c_asymmetric_matrix() and
+ * c_symmetric_matrix() call xGEEV and xSYEV for orders of at least
+ * DISORT_LAPACK_MIN_EIGEN.
+ */
+#include <stddef.h>
+
+double dasum_(int const *n,double const *x,int const *incx);
+void   daxpy_(int const *n,double const *a,double const *x,int const *incx,
+              double *y,int const *incy);
+double ddot_(int const *n,double const *x,int const *incx,
+             double const *y,int const *incy);
+void   dscal_(int const *n,double const *a,double *x,int const *incx);
+int    idamax_(int const *n,double const *x,int const *incx);
+void   dgetrf_(int const *m,int const *n,double *a,int const *lda,int *ipiv,
+               int *info);
+void   dgetrs_(char const *trans,int const *n,int const *nrhs,double const *a,
+               int const *lda,int const *ipiv,double *b,int const *ldb,
+               int *info,size_t trans_len);
+void   dgecon_(char const *norm,int const *n,double const *a,int const *lda,
+               double const *anorm,double *rcond,double *work,int *iwork,
+               int *info,size_t norm_len);
+void   dgbtrf_(int const *m,int const *n,int const *kl,int const *ku,
+               double *ab,int const *ldab,int *ipiv,int *info);
+void   dgbtrs_(char const *trans,int const *n,int const *kl,int const *ku,
+               int const *nrhs,double const *ab,int const *ldab,
+               int const *ipiv,double *b,int const *ldb,int *info,
+               size_t trans_len);
+void   dgbcon_(char const *norm,int const *n,int const *kl,int const *ku,
+               double const *ab,int const *ldab,int const *ipiv,
+               double const *anorm,double *rcond,double *work,int *iwork,
+               int *info,size_t norm_len);
+void   dlaswp_(int const *n,double *a,int const *lda,int const *k1,
+               int const *k2,int const *ipiv,int const *incx);
+void   dtrsm_(char const *side,char const *uplo,char const *transa,
+              char const *diag,int const *m,int const *n,double const *alpha,
+              double const *a,int const *lda,double *b,int const *ldb,
+              size_t side_len,size_t uplo_len,size_t transa_len,
+              size_t diag_len);
+void   dgemm_(char const *transa,char const *transb,int const *m,
+              int const *n,int const *k,double const *alpha,double const *a,
+              int const *lda,double const *b,int const *ldb,
+              double const *beta,double *c,int const *ldc,size_t transa_len,
+              size_t transb_len);
+void   dgeev_(char const *jobvl,char const *jobvr,int const *n,double *a,
+              int const *lda,double *wr,double *wi,double *vl,
+              int const *ldvl,double *vr,int const *ldvr,double *work,
+              int const *lwork,int *info,size_t jobvl_len,size_t jobvr_len);
+void   dsyev_(char const *jobz,char const *uplo,int const *n,double *a,
+              int const *lda,double *w,double *work,int const *lwork,
+              int *info,size_t jobz_len,size_t uplo_len);
+
+/* stride of all vector arguments, and the scalars of xTRSM and xGEMM */
+static int const    c_blas_inc  = 1;
+static double const c_blas_one  = 1.;
+static double const c_blas_mone = -1.;
+
+/*
+ * Smallest orders that go to LAPACK: of the dense systems (band width for
+ * band matrices), of the streams of the block tridiagonal system, and of
+ * the eigenvalue problems (nstr/2).  Below them, the cost of the calls
+ * is more than the BLAS kernels save, and the C code is used as without
+ * DISORT_USE_LAPACK.  Timings of tests/cdisort213/test_cdisort_linalg
+ * (one thread, microseconds; C / reference LAPACK / OpenBLAS):
+ *
+ *   order   sgeco+sgesl         block, 20 layers        asymmetric_matrix
+ *     16    3.4 /  9.5 /  8.5     130 /   149 /   136      53 /    83 /    77
+ *     32     14 /   22 /   19     845 /   664 /   632     372 /   382 /   392
+ *     64     80 /   60 /   67    6244 /  3207 /  3319    2317 /  1371 /  1999
+ *    128    499 /  179 /  297   44114 / 15019 / 20493   19327 / 11446 / 11855
+ *
+ * With these thresholds, c_disort() is unchanged up to 16 streams and about
+ * 25% faster with 64 and 128 streams.
+ */
+#ifndef DISORT_LAPACK_MIN_ORDER
+#define DISORT_LAPACK_MIN_ORDER 64
+#endif
+
+#ifndef DISORT_LAPACK_MIN_BLOCK
+#define DISORT_LAPACK_MIN_BLOCK 32
+#endif
+
+#ifndef DISORT_LAPACK_MIN_EIGEN
+#define DISORT_LAPACK_MIN_EIGEN 64
+#endif
+
+/* length of the z vector of c_sgeco() and c_sgbco(), in units of n */
+#define LINPACK_WORK 5
+#else
+#define LINPACK_WORK 1
+#endif
+
+/*
+ * Process-wide state. It is written once (guarded by pthread_once) or updated
+ * atomically; everything else lives in disort_state, disort_output and
+ * disort_workspace, so that concurrent calls on separate states are safe.
+ *
+ *   c_disort_self_test_flag...Runs the self-test once, before the first solve
+ *   c_disort_self_test_err....Its result; solves return DS_ERR_FATAL unless DS_OK
+ *   c_disort_callnum..........Number of surface calls so far
+ *   c_errmsg_jmp..............Per-thread return point of the running c_disort_ws()
+ *   c_nmug_gmu,c_nmug_gwt.....NMUG-point Gauss quadrature used for BRDF integrals
+ */
+static pthread_once_t
+  c_disort_self_test_flag = PTHREAD_ONCE_INIT;
+static int
+  c_disort_self_test_err = DS_OK;
+static int
+  c_disort_callnum = 0;
+static __thread jmp_buf
+  *c_errmsg_jmp = NULL;
+static pthread_once_t
+  c_nmug_flag = PTHREAD_ONCE_INIT;
+static double
+  c_nmug_gmu[NMUG],
+  c_nmug_gwt[NMUG];
+
+static void c_nmug_init(void)
+{
+  register int
+    k;
+  double
+    *gmu = c_nmug_gmu,
+    *gwt = c_nmug_gwt;
+
+  c_gaussian_quadrature(NMUG/2,gmu,gwt);
+  for (k = 1; k <= NMUG/2; k++) {
+    GMU(k+NMUG/2) = -GMU(k);
+    GWT(k+NMUG/2) =  GWT(k);
+  }
+
+  return;
+}
+
+/*
+ * Make sun isun of c_disort_ws_suns() the current one: set its beam angles in
+ * ds and point the arrays that depend on them at its slot in ws->sun
+ */
+static void c_sun_select(disort_state      *ds,
+                         disort_workspace  *ws,
+                         int                isun,
+                         double const      *phi0,
+                         double           **expbea,
+                         double           **ylm0,
+                         double           **zz,
+                         double           **zbeam,
+                         double           **phirad)
+{
+  double
+    *sun = ws->sun+isun*ws->sun_size;
+
+  ds->bc.umu0 = sun[0];
+  ds->bc.phi0 = phi0[isun];
+
+  *expbea = sun+1;
+  *ylm0   = *expbea+ws->nlyr+1;
+  *zz     = *ylm0+ws->nstr+1;
+  *zbeam  = *zz+ws->nlyr*ws->nstr;
+  *phirad = *zbeam+ws->nlyr*ws->numu;
+
+  return;
+}
+
+/*
+ * Grow the per-sun storage of ws to hold at least nsun suns.
+ * Returns 0 on success.
+ */
+static int c_sun_alloc(disort_workspace *ws,
+                       int               nsun)
+{
+  if (ws->sun_nmax >= nsun) {
+    return 0;
+  }
+
+  if (ws->sun) free(ws->sun);
+  if (ws->sun_conv) free(ws->sun_conv);
+  ws->sun_size = 1+(ws->nlyr+1)+(ws->nstr+1)+ws->nlyr*ws->nstr+ws->nlyr*ws->numu+ws->nphi;
+  ws->sun      = (double *)malloc(((size_t)nsun*ws->sun_size+ws->nlyr*ws->nstr*ws->numu)*sizeof(double));
+  ws->sun_conv = (int *)malloc(2*(size_t)nsun*sizeof(int));
+  if (!ws->sun || !ws->sun_conv) {
+    c_errmsg("disort_ws_suns--alloc error for sun storage",DS_WARNING);
+    if (ws->sun) free(ws->sun);
+    if (ws->sun_conv) free(ws->sun_conv);
+    ws->sun      = NULL;
+    ws->sun_conv = NULL;
+    ws->sun_nmax = 0;
+    return 1;
+  }
+  ws->sun_nmax = nsun;
+
+  return 0;
+}
+
 /*============================= c_disort() ==============================*/
 
+
 /*-------------------------------------------------------------------------------*
  * Plane-parallel discrete ordinates radiative transfer program                  *
  * C version                                                                     *
@@ -220,19 +461,24 @@
          +-c_disort_set-+-c_gaussian_quadrature
          +-c_print_inputs
          +-c_albtrans-+-c_legendre_poly
-         |            +-c_solve_eigen-+-c_asymmetric_matrix
+         |            +-c_solve_eigen-+-c_solve_eigen_symmetric-+-c_symmetric_matrix
+         |            |               +-c_asymmetric_matrix
          |            +-c_interp_eigenvec
          |            +-c_set_matrix
-         |            +-(c_sgbco)
-         |            +-c_solve1-+-(c_sgbsl)
+         |            +-c_block_factor-+-c_block_solve
+         |            +-c_solve1-+-c_block_solve
          |            +-c_atltrin
          |            +-c_albtrans_spherical
          |            +-c_print_albtrans
          +-c_planck_func1
+         +-c_absorption_only
          +-c_legendre_poly
          +-c_surface_bidir-+-c_gaussian_quadrature
          |                 +-c_bidir_reflectivity
-         +-c_solve_eigen-+-c_asymmetric_matrix
+         +-c_eigen_cache_get
+         +-c_solve_eigen-+-c_solve_eigen_symmetric-+-c_symmetric_matrix
+         |               +-c_asymmetric_matrix
+         +-c_eigen_cache_put
 	 +-c_set_coefficients_beam_source
 	 +-c_interp_coefficients_beam_source
          +-c_upbeam_pseudo_spherical-+-(c_sgeco)
@@ -246,9 +492,14 @@
          +-c_interp_eigenvec
          +-c_interp_source
          +-c_set_matrix
-         +-c_solve0-+-(c_sgbco)
-         |          +-(c_sgbsl)
+         +-c_block_factor-+-c_block_solve
+         +-c_solve0-+-c_block_solve
          +-c_fluxes
+         +-c_surface_response-+-c_solve1-+-c_block_solve
+         |                    +-c_albtrans_spherical
+         +-c_flux_jacobian-+-(c_sgefa)
+         |                 +-(c_sgesl)
+         |                 +-c_block_solve
          +-c_user_intensities
          +-c_intensity_components
          +-c_print_avg_intensities
@@ -261,6 +512,18 @@
          |                            +-calc_phase_squared
          +-c_print_intensities
 
+  c_disort_ws_suns-+-c_sun_alloc
+                   +-(the tree of c_disort above, through c_sun_select for each sun)
+
+  c_disort_ws_surface-+-(the tree of c_disort above, with c_surface_response)
+
+  c_disort_ws_jacobian-+-(the tree of c_disort above, with c_flux_jacobian)
+
+  c_disort_ws_cached-+-(the tree of c_disort above, with c_beam_cache_get, c_beam_cache_put,
+                        c_upisot_unit and c_beam_cache_plk)
+
+  c_disort_ws_jacobian_cached-+-(the tree of c_disort_ws_cached above, with c_flux_jacobian)
+
  +-------------------------------------------------------------------+
 
   Index conventions (for all loops and all variable descriptions):
@@ -293,8 +556,8 @@
    BEM(iq/2).........Bottom-boundary directional emissivity at computational angles.
    bplanck...........Intensity emitted from bottom boundary
    callnum...........Number of surface calls
-   CBAND()...........Matrix of left-hand side of the linear system eq. SC(5), scaled by eq. SC(12);
-                     in banded form required by LINPACK solution routines
+   CBLOCK()..........Matrix of left-hand side of the linear system eq. SC(5), scaled by eq. SC(12);
+                     in block form required by c_block_factor()
    CC(iq,iq).........C-sub-IJ in eq. SS(5)
    CH(lc)............The Chapman-factor to correct for pseudo-spherical geometry in the direct beam.
    CHTAU(lc).........The optical depth in spherical geometry.
@@ -332,12 +595,15 @@
    GC(iq,iq,lc)......Eigenvectors at polar quadrature angles, g in eq. SC(1)
    GU(iu,iq,lc)......Eigenvectors interpolated to user polar angles (g  in eqs. SC(3) and S1(8-9), i.e. g without the l factor)
    IPVT(lc*iq).......Integer vector of pivot indices for LINPACK routines
+   isun..............Index of the sun (beam angle) being solved, see c_disort_ws_suns()
    KK(iq,lc).........Eigenvalues of coeff. matrix in eq. SS(7)
-   kconv.............Counter in azimuth convergence test
+   KCONV(isun).......Counter in azimuth convergence test of each sun; sun_kconv[]
    LAYRU(lu).........Computational layer in which user output level UTAU(LU) is located
    LL(iq,lc).........Constants of integration L in eq. SC(1), obtained by solving scaled version of eq. SC(5)
    lyrcut............TRUE, radiation is assumed zero below layer ncut because of almost complete absorption
-   naz...............Number of azimuthal components considered
+   naz...............Number of azimuthal components considered, the largest NAZ(isun)
+   NAZ(isun).........Number of azimuthal components of each sun; sun_naz[]
+   nactive...........Number of suns whose azimuthal series has not converged yet
    ncut..............Computational layer number in which absorption optical depth first exceeds ABSCUT
    OPRIM(lc).........Single scattering albedo after delta-M scaling
    pass1.............TRUE on first entry, FALSE thereafter
@@ -393,26 +659,36 @@
 
 */ 
 
-int c_disort(disort_state  *ds,
-	      disort_output *out,
-        emission_func_t emi_func)
+static int c_disort_solve(disort_state     *ds,
+                          disort_output    *outs,
+                          int               nsun,
+                          double const     *umu0,
+                          double const     *phi0,
+                          disort_workspace *ws,
+                          emission_func_t   emi_func,
+                          disort_surface   *surf,
+                          disort_jacobian  *jac,
+                          disort_beam_cache *cache,
+                          int               self_testing)
 {
-  static int
-    self_tested = -1;
   int
     prntu0[2],
-    corint,deltam,scat_yes,compare,lyrcut,needdeltam,
-    iq,iu,j,kconv,l,lc,lev,lu,mazim,naz,ncol,ncos,ncut,nn;
-  static int
-    callnum=1;
+    cached,corint,deltam,scat_yes,lyrcut,needdeltam,
+    iq,iu,j,l,lc,lev,lu,mazim,naz,ncol,ncos,ncut,nn;
   int
-    ipvt[ds->nstr*ds->nlyr],
-    layru[ds->ntau];
+    callnum,tab_ylmu,isun,nactive,
+    kconv1,naz1;
+  int
+    *ipvt,*layru,*sun_kconv,*sun_naz;
+  disort_output
+    *out = outs;
+  disort_tables const
+    *tab;
   double
     angcos,azerr,azterm,bplanck,cosphi,delm0,
-    sgn,tplanck;
+    rcond,sgn,tplanck;
   double
-    *array,*b,*bdr,*bem,*cband,*cc,*ch,*chtau,
+    *array,*b,*bdr,*bem,*cblock,*cc,*ch,*chtau,
     *cmu,*cwt, *dtaucpr,*emu,*eval,*evecc,*expbea,
     *flyr,*gc,*gl,*gu,*kk,*ll,
     *oprim,*phasa,*phast,*phasm,*phirad,*pkag,
@@ -439,22 +715,10 @@ int c_disort(disort_state  *ds,
     ds->numu *= 2;
   }
 
-  if (self_tested == -1) {
-    int
-      prntu0_test[2] = {FALSE,FALSE};
-    disort_state
-      ds_test;
-    disort_output
-      out_test;
-    /*
-     * Set input values for self-test.
-     * Be sure self_test() sets all print flags off.
-     */
-    self_tested = 0;
-    compare     = FALSE;
-    c_self_test(compare,prntu0_test,&ds_test,&out_test);
-    c_disort(&ds_test,&out_test,emi_func);
-  }
+  /*
+   * Surface call counter shared by all threads; callnum is this call's number
+   */
+  callnum = __atomic_add_fetch(&c_disort_callnum,1,__ATOMIC_RELAXED);
 
   /*
    * Determine whether there is scattering or not
@@ -496,9 +760,26 @@ int c_disort(disort_state  *ds,
   prntu0[1] = FALSE;
 
   /*
-   * Allocate zeroed memory
+   * Check that the workspace is large enough, then zero it
+   */
+  if (ds->nlyr > ws->nlyr || ds->nstr > ws->nstr || ds->numu > ws->numu ||
+      ds->ntau > ws->ntau || ds->nphi > ws->nphi) {
+    c_errmsg("disort_ws--workspace is smaller than the dimensions of ds",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+  memset(ws->arena,0,ws->nbytes);
+
+  /*
+   * Use the shared tables if they were built for this nstr, and their YLMU
+   * if they were built for these user angles
    */
-  tauc = c_dbl_vector(0,ds->nlyr,"tauc");
+  tab      = (ws->tab && ws->tab->nstr == ds->nstr) ? ws->tab : NULL;
+  tab_ylmu = tab && !ds->flag.onlyfl && ds->flag.usrang && tab->numu == ds->numu &&
+             memcmp(tab->umu,ds->umu,ds->numu*sizeof(double)) == 0;
+
+  ipvt  = ws->ipvt;
+  layru = ws->layru;
+  tauc  = ws->tauc;
 
   for (lc = 1; lc <= ds->nlyr; lc++) {
     if(SSALB(lc) == 1.) {
@@ -507,11 +788,15 @@ int c_disort(disort_state  *ds,
     TAUC(lc) = TAUC(lc-1)+DTAUC(lc);
   }
 
-  /* Check input dimensions and variables */
-  int err = c_check_inputs(ds,scat_yes,deltam,corint,tauc,callnum);
-  if (err) {
-    free(tauc);
-    return err;
+  /* Check input dimensions and variables, with the beam angle of each sun */
+  for (isun = 0; isun < nsun; isun++) {
+    if (umu0) {
+      ds->bc.umu0 = umu0[isun];
+      ds->bc.phi0 = phi0[isun];
+    }
+    if (c_check_inputs(ds,scat_yes,deltam,corint,tauc,callnum)) {
+      return DS_ERR_INPUT;
+    }
   }
 
   /*-------------------------------------------------------------------------------------------*
@@ -520,39 +805,36 @@ int c_disort(disort_state  *ds,
 
   if (ds->flag.ibcnd == SPECIAL_BC) {
     /* 
-     * Allocate zeroed memory
+     * Use zeroed workspace memory
      */
-    array    = c_dbl_vector(0,ds->nstr*ds->nstr-1,"array");
-    b        = c_dbl_vector(0,ds->nstr*ds->nlyr-1,"b");
-    bdr      = c_dbl_vector(0,((ds->nstr/2)+1)*(ds->nstr/2)-1,"bdr");
-    cband    = c_dbl_vector(0,ds->nstr*ds->nlyr*(9*(ds->nstr/2)-2)-1,"cband");
-    ch       = c_dbl_vector(0,ds->nlyr-1,"ch");
-    chtau    = c_dbl_vector(0,(2*ds->nlyr+1)-1,"chtau");
-    cc       = c_dbl_vector(0,ds->nstr*ds->nstr-1,"cc");
-    cmu      = c_dbl_vector(0,ds->nstr-1,"cmu");
-    cwt      = c_dbl_vector(0,ds->nstr-1,"cwt");
-    dtaucpr  = c_dbl_vector(0,ds->nlyr-1,"dtaucpr");
-    eval     = c_dbl_vector(0,(ds->nstr/2)-1,"eval");
-    evecc    = c_dbl_vector(0,ds->nstr*ds->nstr-1,"evecc");
-    expbea   = c_dbl_vector(0,ds->nlyr,"expbea");
-    flyr     = c_dbl_vector(0,ds->nlyr-1,"flyr");
-    gc       = c_dbl_vector(0,ds->nlyr*ds->nstr*ds->nstr-1,"gc");
-    gl       = c_dbl_vector(0,ds->nlyr*(ds->nstr+1),"gl");
-    gu       = c_dbl_vector(0,ds->nlyr*ds->nstr*ds->numu-1,"gu");
-    kk       = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"kk");
-    ll       = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"ll");
-    oprim    = c_dbl_vector(0,ds->nlyr-1,"oprim");
-    taucpr   = c_dbl_vector(0,ds->nlyr,"taucpr");
-    utaupr   = c_dbl_vector(0,ds->ntau-1,"utaupr");
-    wk       = c_dbl_vector(0,ds->nstr-1,"wk");
-    ylmc     = c_dbl_vector(0,ds->nstr*(ds->nstr+1)-1,"ylmc");
-    ylmu     = c_dbl_vector(0,(ds->numu)*(ds->nstr+1)-1,"ylmu");
-    z        = c_dbl_vector(0,ds->nstr*ds->nlyr-1,"z");
-
-    ab       = (disort_pair *)calloc((ds->nstr/2)*(ds->nstr/2),sizeof(disort_pair));
-    if (!ab) {
-      c_errmsg("disort alloc error for ab", DS_ERROR);
-    }
+    array    = ws->array;
+    b        = ws->b;
+    bdr      = ws->bdr;
+    cblock   = ws->cblock;
+    ch       = ws->ch;
+    chtau    = ws->chtau;
+    cc       = ws->cc;
+    cmu      = ws->cmu;
+    cwt      = ws->cwt;
+    dtaucpr  = ws->dtaucpr;
+    eval     = ws->eval;
+    evecc    = ws->evecc;
+    expbea   = ws->expbea;
+    flyr     = ws->flyr;
+    gc       = ws->gc;
+    gl       = ws->gl;
+    gu       = ws->gu;
+    kk       = ws->kk;
+    ll       = ws->ll;
+    oprim    = ws->oprim;
+    taucpr   = ws->taucpr;
+    utaupr   = ws->utaupr;
+    wk       = ws->wk;
+    ylmc     = ws->ylmc;
+    ylmu     = ws->ylmu;
+    z        = ws->z;
+    ab       = ws->ab;
+
     /*
      * Zero output arrays
      */
@@ -570,25 +852,14 @@ int c_disort(disort_state  *ds,
     }
 
     /* Perform various setup operations */
-    c_disort_set(ds,ch,chtau,cmu,cwt,deltam,dtaucpr,expbea,flyr,gl,layru,&lyrcut,&ncut,&nn,&corint,oprim,tauc,taucpr,utaupr,emi_func);
+    c_disort_set(ds,tab,ch,chtau,cmu,cwt,deltam,dtaucpr,expbea,flyr,gl,layru,&lyrcut,&ncut,&nn,&corint,oprim,tauc,taucpr,utaupr,emi_func);
 
     /*  Print input information */
     if(ds->flag.prnt[0]) {
       c_print_inputs(ds,dtaucpr,scat_yes,deltam,corint,flyr,lyrcut,oprim,tauc,taucpr);
     }
 
-    c_albtrans(ds,out,ab,array,b,bdr,cband,cc,cmu,cwt,dtaucpr,eval,evecc,gl,gc,gu,ipvt,kk,ll,nn,taucpr,ylmc,ylmu,z,wk);
-
-    callnum++;
-
-    /*
-     * Free allocated memory
-     */
-    free(array), free(b),    free(bdr), free(cband),  free(cc),    free(ch);
-    free(chtau), free(cmu),  free(cwt), free(dtaucpr),free(eval),  free(evecc);
-    free(expbea),free(flyr), free(gc),  free(gl),     free(gu),    free(kk);
-    free(ll),    free(oprim),free(tauc),free(taucpr), free(utaupr),free(wk);
-    free(ylmc),  free(ylmu), free(z),   free(ab);
+    c_albtrans(ds,out,ab,array,b,bdr,cblock,cc,cmu,cwt,dtaucpr,eval,evecc,gl,gc,gu,ipvt,kk,ll,nn,taucpr,ylmc,ylmu,z,wk);
 
     return 0;
   }
@@ -598,75 +869,87 @@ int c_disort(disort_state  *ds,
    *--------------*/
 
   /* 
-   * Allocate zeroed memory
-   */
-  array   = c_dbl_vector(0,ds->nstr*ds->nstr-1,"array");
-  b       = c_dbl_vector(0,ds->nstr*ds->nlyr-1,"b");
-  bdr     = c_dbl_vector(0,((ds->nstr/2)+1)*(ds->nstr/2)-1,"bdr");
-  bem     = c_dbl_vector(0,(ds->nstr/2)-1,"bem");
-  cband   = c_dbl_vector(0,ds->nstr*ds->nlyr*(9*(ds->nstr/2)-2)-1,"cband");
-  cc      = c_dbl_vector(0,ds->nstr*ds->nstr-1,"cc");
-  ch      = c_dbl_vector(0,ds->nlyr-1,"ch");
-  chtau   = c_dbl_vector(0,(2*ds->nlyr+1)-1,"chtau");
-  cmu     = c_dbl_vector(0,ds->nstr-1,"cmu");
-  cwt     = c_dbl_vector(0,ds->nstr-1,"cwt");
-  dtaucpr = c_dbl_vector(0,ds->nlyr-1,"dtaucpr");
-  emu     = c_dbl_vector(0,ds->numu-1,"emu");
-  eval    = c_dbl_vector(0,(ds->nstr/2)-1,"eval");
-  evecc   = c_dbl_vector(0,ds->nstr*ds->nstr-1,"evecc");
-  expbea  = c_dbl_vector(0,ds->nlyr,"expbea");
-  flyr    = c_dbl_vector(0,ds->nlyr,"flyr");    // We need at least one element
-  gc      = c_dbl_vector(0,ds->nlyr*ds->nstr*ds->nstr-1,"gc");
-  gl      = c_dbl_vector(0,ds->nlyr*(ds->nstr+1),"gl");
-  gu      = c_dbl_vector(0,ds->nlyr*ds->nstr*ds->numu-1,"gu");
-  kk      = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"kk");
-  ll      = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"ll");
-  oprim   = c_dbl_vector(0,ds->nlyr-1,"oprim");
-  phasa   = c_dbl_vector(0,ds->nlyr-1,"phasa");
-  phast   = c_dbl_vector(0,ds->nlyr-1,"phast");
-  phasm   = c_dbl_vector(0,ds->nlyr-1,"phasm");
+   * Use zeroed workspace memory
+   */
+  array   = ws->array;
+  b       = ws->b;
+  bdr     = ws->bdr;
+  bem     = ws->bem;
+  cblock  = ws->cblock;
+  cc      = ws->cc;
+  ch      = ws->ch;
+  chtau   = ws->chtau;
+  cmu     = ws->cmu;
+  cwt     = ws->cwt;
+  dtaucpr = ws->dtaucpr;
+  emu     = ws->emu;
+  eval    = ws->eval;
+  evecc   = ws->evecc;
+  expbea  = ws->expbea;
+  flyr    = ws->flyr;
+  gc      = ws->gc;
+  gl      = ws->gl;
+  gu      = ws->gu;
+  kk      = ws->kk;
+  ll      = ws->ll;
+  oprim   = ws->oprim;
+  phasa   = ws->phasa;
+  phast   = ws->phast;
+  phasm   = ws->phasm;
   if (ds->nphi > 0) {
-    phirad = c_dbl_vector(0,ds->nphi-1,"phirad");
+    phirad = ws->phirad;
   }
   else {
     phirad = NULL;
   }
-  pkag   = c_dbl_vector(0,ds->nlyr,"pkag");
-  rmu    = c_dbl_vector(0,((ds->nstr/2)+1)*ds->numu-1,"rmu");
-  taucpr = c_dbl_vector(0,ds->nlyr,"taucpr");
-  u0c    = c_dbl_vector(0,ds->ntau*ds->nstr-1,"u0c");
-  utaupr = c_dbl_vector(0,ds->ntau-1,"utaupr");
-  uum    = c_dbl_vector(0,ds->ntau*ds->numu-1,"uum");
-  wk     = c_dbl_vector(0,ds->nstr-1,"wk");
-  xba    = c_dbl_vector(0,ds->nlyr,"xba");
-  ylm0   = c_dbl_vector(0,ds->nstr,"ylm0");
-  ylmc   = c_dbl_vector(0,ds->nstr*(ds->nstr+1)-1,"ylmc");
-  ylmu   = c_dbl_vector(0,ds->numu*(ds->nstr+1)-1,"ylmu");
-  z      = c_dbl_vector(0,ds->nstr*ds->nlyr-1,"z");
-  zbeam  = c_dbl_vector(0,ds->nlyr*ds->numu-1,"zbeam");
-  zbeama = c_dbl_vector(0,ds->nlyr,"zbeama");
-  zj     = c_dbl_vector(0,ds->nstr-1,"zj");
-  zjg    = c_dbl_vector(0,ds->nstr-1,"zjg");
-  zju    = c_dbl_vector(0,ds->numu,"zju");
-  zgu    = c_dbl_vector(0,ds->nlyr*ds->numu-1,"zgu");
-  zz     = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"zz");
-  zzg    = c_dbl_vector(0,ds->nlyr*ds->nstr-1,"zzg");
-  /*
-   * Using C structures facilitates cache-aware memory allocation, which can reduce
-   * cache misses and potentially speed up computer execution.
-   */
-  fl     = (disort_pair *)calloc(ds->ntau,sizeof(disort_pair));                  if (!fl)      c_errmsg("disort alloc error for fl", DS_ERROR);
-  plk    = (disort_pair *)calloc(ds->nlyr*ds->nstr,sizeof(disort_pair));         if (!plk)     c_errmsg("disort alloc error for plk",DS_ERROR);
-  ab     = (disort_pair *)calloc((ds->nstr/2)*(ds->nstr/2),sizeof(disort_pair)); if (!ab)      c_errmsg("disort alloc error for ab", DS_ERROR);
-  xr     = (disort_pair *)calloc(ds->nlyr,sizeof(disort_pair));                  if (!xr)      c_errmsg("disort alloc error for xr", DS_ERROR);
-  psi    = (disort_pair *)calloc(ds->nstr,sizeof(disort_pair));                  if (!psi)     c_errmsg("disort alloc error for psi",DS_ERROR);
-  xb     = (disort_pair *)calloc(ds->nlyr*ds->nstr,sizeof(disort_pair));         if (!xb)      c_errmsg("disort alloc error for xb",DS_ERROR);
-  zbs    = (disort_pair *)calloc(ds->nstr,sizeof(disort_pair));                  if (!zbs)     c_errmsg("disort alloc error for zbs",DS_ERROR);
-  zbeamsp= (disort_pair *)calloc(ds->nlyr*ds->nstr,sizeof(disort_pair));         if (!zbeamsp) c_errmsg("disort alloc error for zbeamsp",DS_ERROR);
-  zee    = (disort_pair *)calloc(ds->nstr,sizeof(disort_pair));                  if (!zee)     c_errmsg("disort alloc error for zee",DS_ERROR);
-  zu     = (disort_pair *)calloc(ds->nlyr*ds->numu,sizeof(disort_pair));         if (!zu)      c_errmsg("disort alloc error for zu", DS_ERROR);
-
-  zbu    = (disort_triplet *)calloc(ds->nlyr*ds->numu,sizeof(disort_triplet));   if (!zbu)     c_errmsg("disort alloc error for zbu", DS_ERROR);
+  pkag    = ws->pkag;
+  rmu     = ws->rmu;
+  taucpr  = ws->taucpr;
+  u0c     = ws->u0c;
+  utaupr  = ws->utaupr;
+  uum     = ws->uum;
+  wk      = ws->wk;
+  xba     = ws->xba;
+  ylm0    = ws->ylm0;
+  ylmc    = ws->ylmc;
+  ylmu    = ws->ylmu;
+  z       = ws->z;
+  zbeam   = ws->zbeam;
+  zbeama  = ws->zbeama;
+  zj      = ws->zj;
+  zjg     = ws->zjg;
+  zju     = ws->zju;
+  zgu     = ws->zgu;
+  zz      = ws->zz;
+  zzg     = ws->zzg;
+  fl      = ws->fl;
+  plk     = ws->plk;
+  ab      = ws->ab;
+  xr      = ws->xr;
+  psi     = ws->psi;
+  xb      = ws->xb;
+  zbs     = ws->zbs;
+  zbeamsp = ws->zbeamsp;
+  zee     = ws->zee;
+  zu      = ws->zu;
+  zbu     = ws->zbu;
+
+  /*
+   * With several suns, the arrays that depend on the beam angle are kept for
+   * each sun in ws->sun and selected by c_sun_select()
+   */
+  if (umu0) {
+    memset(ws->sun,0,nsun*ws->sun_size*sizeof(double));
+    for (isun = 0; isun < nsun; isun++) {
+      ws->sun[isun*ws->sun_size] = umu0[isun];
+    }
+    sun_naz   = ws->sun_conv;
+    sun_kconv = ws->sun_conv+nsun;
+  }
+  else {
+    sun_naz   = &naz1;
+    sun_kconv = &kconv1;
+  }
 
   /*
    * Zero output arrays
@@ -677,14 +960,27 @@ int c_disort(disort_state  *ds,
   if (!ds->flag.usrang || ds->flag.onlyfl) {
     memset(ds->umu,0,(ds->numu)*sizeof(double));
   }
-  memset(out->rad,0,ds->ntau*sizeof(disort_radiant));
-  if (ds->flag.onlyfl == FALSE) {
-    memset(out->uu,0,ds->numu*ds->ntau*ds->nphi*sizeof(double));
+  for (isun = 0; isun < nsun; isun++) {
+    out = outs+isun;
+    memset(out->rad,0,ds->ntau*sizeof(disort_radiant));
+    if (ds->flag.onlyfl == FALSE) {
+      memset(out->uu,0,ds->numu*ds->ntau*ds->nphi*sizeof(double));
+    }
   }
 
-  /* Perform various setup operations */
-  c_disort_set(ds,ch,chtau,cmu,cwt,deltam,dtaucpr,expbea,flyr,gl,layru,&lyrcut,&ncut,&nn,&corint,oprim,tauc,taucpr,utaupr,emi_func);
-
+  /*
+   * Perform various setup operations; only EXPBEA and the adjusted UMU0
+   * differ from sun to sun
+   */
+  for (isun = 0; isun < nsun; isun++) {
+    if (umu0) {
+      c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+    }
+    c_disort_set(ds,tab,ch,chtau,cmu,cwt,deltam,dtaucpr,expbea,flyr,gl,layru,&lyrcut,&ncut,&nn,&corint,oprim,tauc,taucpr,utaupr,emi_func);
+    if (umu0) {
+      ws->sun[isun*ws->sun_size] = ds->bc.umu0;
+    }
+  }
 
   /*  Print input information */
   if(ds->flag.prnt[0]) {
@@ -707,22 +1003,63 @@ int c_disort(disort_state  *ds,
   }
 
   /*
-   *--------  BEGIN LOOP TO SUM AZIMUTHAL COMPONENTS OF INTENSITY  ---------
-   *          (eq STWJ 5, STWL 6)
+   * Without scattering the streams decouple and have closed-form solutions;
+   * cblock serves as scratch space since no linear system is solved. The
+   * surface response and the flux derivatives need the factored matrix of the
+   * general case
+   */
+  if (!scat_yes && ds->flag.lamber && !ds->flag.spher && !ds->flag.general_source &&
+      !ds->flag.output_uum && !ds->flag.prnt[1] && !ds->flag.prnt[2] && !surf && !jac) {
+    for (isun = 0; isun < nsun; isun++) {
+      if (umu0) {
+        c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+      }
+      c_absorption_only(ds,outs+isun,bplanck,tplanck,cmu,cwt,dtaucpr,expbea,layru,lyrcut,
+                        ncut,nn,pkag,taucpr,utaupr,cblock,xr,fl,u0c);
+    }
+    return 0;
+  }
+
+  /*
+   * The beam solution and the factored matrix stored in the cache are reused
+   * if they were solved for the same inputs; only the thermal source is then
+   * recomputed. The cache only serves fluxes of one sun over a Lambertian
+   * surface, and their derivatives, which need nothing else of the
+   * eigensolutions
    */
-  kconv = 0;
-  naz   = ds->nstr-1;
+  if (cache && (!ds->flag.onlyfl || !ds->flag.lamber || ds->flag.spher ||
+                ds->flag.ibcnd != GENERAL_BC ||
+                ds->flag.general_source || umu0 || surf ||
+                cache->nlyr != ds->nlyr || cache->nstr != ds->nstr ||
+                cache->nmom != ds->nmom)) {
+    cache = NULL;
+  }
+  cached = cache ? c_beam_cache_get(ds,cache,cblock,gc,ipvt,kk,&ncol,zz) : FALSE;
 
   /*
-   * Azimuth-independent case
+   *--------  BEGIN LOOP TO SUM AZIMUTHAL COMPONENTS OF INTENSITY  ---------
+   *          (eq STWJ 5, STWL 6)
    */
-  if (ds->bc.fbeam == 0.                         || 
-      fabs(1.-ds->bc.umu0) < 1.e-5               || 
-      ds->flag.onlyfl                            || 
-      (ds->numu == 1 && fabs(1.-UMU(1)) < 1.e-5) || 
-      (ds->numu == 1 && fabs(1.+UMU(1)) < 1.e-5) || 
-      (ds->numu == 2 && fabs(1.+UMU(1)) < 1.e-5 && fabs(1.-UMU(2)) < 1.e-5)) {
-    naz = 0;
+  naz = 0;
+  for (isun = 0; isun < nsun; isun++) {
+    if (umu0) {
+      c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+    }
+    sun_kconv[isun] = 0;
+    sun_naz[isun]   = ds->nstr-1;
+
+    /*
+     * Azimuth-independent case
+     */
+    if (ds->bc.fbeam == 0.                         || 
+        fabs(1.-ds->bc.umu0) < 1.e-5               || 
+        ds->flag.onlyfl                            || 
+        (ds->numu == 1 && fabs(1.-UMU(1)) < 1.e-5) || 
+        (ds->numu == 1 && fabs(1.+UMU(1)) < 1.e-5) || 
+        (ds->numu == 2 && fabs(1.+UMU(1)) < 1.e-5 && fabs(1.-UMU(2)) < 1.e-5)) {
+      sun_naz[isun] = 0;
+    }
+    naz = IMAX(naz,sun_naz[isun]);
   }
 
   for (mazim = 0; mazim <= naz; mazim++) {
@@ -735,29 +1072,51 @@ int c_disort(disort_state  *ds,
 
     /*
      * Get normalized associated Legendre polynomials for
-     *   (a) incident beam angle cosine
+     *   (a) incident beam angle cosine of each sun
      *   (b) computational and user polar angle cosines
      */
     if (ds->bc.fbeam > 0.) {
-      ncos   = 1;
-      angcos = -ds->bc.umu0;
-      c_legendre_poly(ncos,mazim,ds->nstr,ds->nstr-1,&angcos,ylm0);
+      for (isun = 0; isun < nsun; isun++) {
+        if (mazim > sun_naz[isun] || sun_kconv[isun] >= 2) {
+          continue;
+        }
+        if (umu0) {
+          c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+        }
+        ncos   = 1;
+        angcos = -ds->bc.umu0;
+        c_legendre_poly(ncos,mazim,ds->nstr,ds->nstr-1,&angcos,ylm0);
+      }
     }
 
     if (!ds->flag.onlyfl && ds->flag.usrang) {
-      c_legendre_poly(ds->numu,mazim,ds->nstr,ds->nstr-1,ds->umu,ylmu);
+      if (tab_ylmu) {
+        ylmu = tab->ylmu+mazim*ds->numu*(ds->nstr+1);
+      }
+      else {
+        c_legendre_poly(ds->numu,mazim,ds->nstr,ds->nstr-1,ds->umu,ylmu);
+      }
     }
-    c_legendre_poly(nn,mazim,ds->nstr,ds->nstr-1,cmu,ylmc);
 
-    /*
-     * Get normalized associated Legendre polynomials with negative arguments from those with
-     * positive arguments; Dave/Armstrong eq. (15), STWL(59)
-     */
-    sgn = -1.;
-    for (l = mazim; l <= ds->nstr-1; l++) {
-      sgn *= -1.;
-      for (iq = nn+1; iq <= ds->nstr; iq++) {
-        YLMC(l,iq) = sgn*YLMC(l,iq-nn);
+    if (tab) {
+      /*
+       * The tables hold YLMC exactly as computed below; it is only read from here on
+       */
+      ylmc = tab->ylmc+mazim*ds->nstr*(ds->nstr+1);
+    }
+    else {
+      c_legendre_poly(nn,mazim,ds->nstr,ds->nstr-1,cmu,ylmc);
+
+      /*
+       * Get normalized associated Legendre polynomials with negative arguments from those with
+       * positive arguments; Dave/Armstrong eq. (15), STWL(59)
+       */
+      sgn = -1.;
+      for (l = mazim; l <= ds->nstr-1; l++) {
+        sgn *= -1.;
+        for (iq = nn+1; iq <= ds->nstr; iq++) {
+          YLMC(l,iq) = sgn*YLMC(l,iq-nn);
+        }
       }
     }
 
@@ -772,35 +1131,18 @@ int c_disort(disort_state  *ds,
     /*--------------  BEGIN LOOP ON COMPUTATIONAL LAYERS  ------------*/
     for (lc = 1; lc <= ncut; lc++) {
       /*
-       * Solve eigenfunction problem in eq. STWJ(8B), STWL(23f); return eigenvalues and eigenvectors
+       * Solve eigenfunction problem in eq. STWJ(8B), STWL(23f); return eigenvalues and eigenvectors.
+       * Layers with the same scaled phase function share them through the eigen cache, if any
        */
-      c_solve_eigen(ds,lc,ab,array,cmu,cwt,gl,mazim,nn,ylmc,cc,evecc,eval,kk,gc,wk);
-      /*
-       * Calculate particular solutions of eq. SS(18), STWL(24a) for incident beam source
-       */
-      if (ds->bc.fbeam > 0.) {
-	if ( ds->flag.spher == TRUE ) {
-	  /* Pseudo-spherical approach */
-	  c_set_coefficients_beam_source(ds,ch,chtau,cmu,delm0,ds->bc.fbeam,
-					 gl,lc,mazim,ds->nstr,
-					 taucpr,xba,xb,ylm0,ylmc,zj);
-	  
-	  if ( ds->flag.usrang == TRUE  ) {
-	    /* Get coefficients at umu for pseudo-spherical source */
-	    c_interp_coefficients_beam_source(ds,chtau,delm0,ds->bc.fbeam,
-					      gl,lc,mazim,ds->nstr,
-					      ds->numu,taucpr,zbu,
-					      xba,zju,ylm0,ylmu);
-	  }
-	  c_upbeam_pseudo_spherical(ds,lc,array,cc,cmu,ipvt,nn,wk,
-				    xb,xba,zbs,&zbsa,zbeamsp,zbeama);
-	}
-	else {
-	  /* Plane-parallel version */
-	  c_upbeam(ds,lc,array,cc,cmu,delm0,gl,ipvt,mazim,nn,wk,ylm0,ylmc,zj,zz);
-	}
+      if (cached) {
+        /*
+         * Eigensolutions and beam source are those of the beam cache
+         */
+      }
+      else if (!c_eigen_cache_get(ds,ws,lc,gl,mazim,cc,evecc,eval,kk,gc)) {
+        c_solve_eigen(ds,lc,ab,array,cmu,cwt,gl,mazim,nn,ylmc,cc,evecc,eval,kk,gc,wk);
+        c_eigen_cache_put(ds,ws,lc,gl,mazim,cc,evecc,eval,kk,gc);
       }
-
       /*
        * Calculate particular solutions of eq. SS(18), STWL(24a), KS(5) for 
        * general user specified source.
@@ -818,7 +1160,18 @@ int c_disort(disort_state  *ds,
           XR1(lc) = (PKAG(lc)-PKAG(lc-1))/DTAUCPR(lc);
         }
         XR0(lc) = PKAG(lc-1)-XR1(lc)*TAUCPR(lc-1);
-        c_upisot(ds,lc,array,cc,cmu,ipvt,nn,oprim,wk,xr,zee,plk);
+        if (cache) {
+          /*
+           * The thermal source from its response to unit XR0 and XR1, kept in the cache
+           */
+          if (!cached) {
+            c_upisot_unit(ds,lc,array,cc,cmu,ipvt,oprim,wk,cache->tu,cache->tw);
+          }
+          c_beam_cache_plk(ds,cache,lc,nn,xr,plk);
+        }
+        else {
+          c_upisot(ds,lc,array,cc,cmu,ipvt,nn,oprim,wk,xr,zee,plk);
+        }
       }
 
       if (!ds->flag.onlyfl && ds->flag.usrang) {
@@ -826,201 +1179,632 @@ int c_disort(disort_state  *ds,
          * Interpolate eigenvectors to user angles
          */
         c_interp_eigenvec(ds,lc,cwt,evecc,gl,gu,mazim,nn,wk,ylmc,ylmu);
+      }
+
+      for (isun = 0; isun < nsun; isun++) {
+        if (mazim > sun_naz[isun] || sun_kconv[isun] >= 2) {
+          continue;
+        }
+        if (umu0) {
+          c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+        }
         /*
-         * Interpolate source terms to user angles
+         * Calculate particular solutions of eq. SS(18), STWL(24a) for incident beam source
          */
-        c_interp_source(ds,lc,cwt,delm0,gl,mazim,oprim,ylm0,ylmc,ylmu,
-			psi,xr,zee,zj,zjg,zbeam,zbu,zbs,zbsa,zgu,zu);
+        if (ds->bc.fbeam > 0. && !cached) {
+          if ( ds->flag.spher == TRUE ) {
+            /* Pseudo-spherical approach */
+            c_set_coefficients_beam_source(ds,ch,chtau,cmu,delm0,ds->bc.fbeam,
+                                           gl,lc,mazim,ds->nstr,
+                                           taucpr,xba,xb,ylm0,ylmc,zj);
+            
+            if ( ds->flag.usrang == TRUE  ) {
+              /* Get coefficients at umu for pseudo-spherical source */
+              c_interp_coefficients_beam_source(ds,chtau,delm0,ds->bc.fbeam,
+                                                gl,lc,mazim,ds->nstr,
+                                                ds->numu,taucpr,zbu,
+                                                xba,zju,ylm0,ylmu);
+            }
+            c_upbeam_pseudo_spherical(ds,lc,array,cc,cmu,ipvt,nn,wk,
+                                      xb,xba,zbs,&zbsa,zbeamsp,zbeama);
+          }
+          else {
+            /* Plane-parallel version */
+            c_upbeam(ds,lc,array,cc,cmu,delm0,gl,ipvt,mazim,nn,wk,ylm0,ylmc,zj,zz);
+          }
+        }
+
+        if (!ds->flag.onlyfl && ds->flag.usrang) {
+          /*
+           * Interpolate source terms to user angles
+           */
+          c_interp_source(ds,lc,cwt,delm0,gl,mazim,oprim,ylm0,ylmc,ylmu,
+                          psi,xr,zee,zj,zjg,zbeam,zbu,zbs,zbsa,zgu,zu);
+        }
       }
     }
     /*-------------------  END LOOP ON COMPUTATIONAL LAYERS  ----------------*/
 
+    if (umu0 && !ds->flag.onlyfl && ds->flag.usrang) {
+      /*
+       * c_user_intensities() scales GU in place, so each sun starts from a copy
+       */
+      memcpy(ws->sun+nsun*ws->sun_size,gu,ds->nlyr*ds->nstr*ds->numu*sizeof(double));
+    }
+
     /*
      *
      * Set coefficient matrix of equations combining boundary and layer interface conditions
      */
-    c_set_matrix(ds,bdr,cband,cmu,cwt,delm0,dtaucpr,gc,kk,lyrcut,&ncol,ncut,taucpr,wk);
-
-    /*
-     * Solve for constants of integration in homogeneous solution (general boundary conditions)
-     */
-    c_solve0(ds,b,bdr,bem,bplanck,cband,cmu,cwt,expbea,ipvt,ll,lyrcut,
-	     mazim,ncol,ncut,nn,tplanck,taucpr,z,zbeamsp,zbeama,zz,zzg,plk);
-
-    /*
-     * Compute upward and downward fluxes
-     */
-    if (mazim == 0) {
-      c_fluxes(ds,out,ch,cmu,cwt,gc,kk,layru,ll,lyrcut,ncut,nn,PRNTU0(1),
-	       taucpr,utaupr,xr,zbeamsp,zbeama,zz,zzg,plk,fl,u0c);
-    }
+    if (!cached) {
+      c_set_matrix(ds,bdr,cblock,cmu,cwt,delm0,dtaucpr,gc,kk,lyrcut,&ncol,ncut,taucpr,wk);
 
-    if (ds->flag.onlyfl) {
       /*
-       * Save azimuthal-avg intensities at quadrature angles
+       * L-U decompose the coefficient matrix and test if it is nearly singular,
+       * unless the condition estimate is skipped
        */
-      for (lu = 1; lu <= ds->ntau; lu++) {
-        for (iq = 1; iq <= ds->nstr; iq++) {
-          U0U(iq,lu) = U0C(iq,lu);
-        }
+      c_block_factor(ds,cblock,ncut,nn,ipvt,ds->flag.skip_rcond ? NULL : &rcond,z);
+      if (!ds->flag.skip_rcond && 1.+rcond == 1.) {
+        c_errmsg("solve0--block_factor says matrix near singular",DS_WARNING);
+      }
+      if (cache) {
+        c_beam_cache_put(ds,cache,cblock,gc,ipvt,kk,ncol,zz);
       }
-      break;
     }
 
-    memset(uum,0,ds->numu*ds->ntau*sizeof(double));
+    /*
+     * The factored matrix is shared; each sun only has its own right-hand side
+     */
+    for (isun = 0; isun < nsun; isun++) {
+      if (mazim > sun_naz[isun] || sun_kconv[isun] >= 2) {
+        continue;
+      }
+      out = outs+isun;
+      if (umu0) {
+        c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+        if (!ds->flag.lamber && !lyrcut) {
+          /*
+           * The beam terms BDR(iq,0) and RMU(iu,0) depend on the sun
+           */
+          c_surface_bidir(ds,delm0,cmu,mazim,nn,bdr,emu,bem,rmu,callnum);
+        }
+      }
 
-    if (ds->flag.usrang) {
-      /*
-       * Compute azimuthal intensity components at user angles
-       */
-      c_user_intensities(ds,bplanck,cmu,cwt,delm0,dtaucpr,emu,expbea,
-			 gc,gu,kk,layru,ll,lyrcut,mazim,
-			 ncut,nn,rmu,taucpr,tplanck,utaupr,wk,
-			 zbu,zbeam,zbeamsp,
-			 zbeama,zgu,zu,zz,zzg,plk,uum);
-    }
-    else {
       /*
-       * Compute azimuthal intensity components at quadrature angles
+       * Solve for constants of integration in homogeneous solution (general boundary conditions)
        */
-      c_intensity_components(ds,gc,kk,layru,ll,lyrcut,mazim,ncut,nn,taucpr,utaupr,zz,plk,uum);
-    }
+      c_solve0(ds,b,bdr,bem,bplanck,cblock,cmu,cwt,expbea,ipvt,ll,lyrcut,
+	       mazim,ncol,ncut,nn,tplanck,taucpr,zbeamsp,zbeama,zz,zzg,plk);
 
-    if (mazim == 0) {
       /*
-       * Save azimuthally averaged intensities
+       * Compute upward and downward fluxes
        */
-      for (lu = 1; lu <= ds->ntau; lu++) {
-        for (iu = 1; iu <= ds->numu; iu++) {
-          U0U(iu,lu) = UUM(iu,lu);
-          for (j = 1; j <= ds->nphi; j++) {
-            UU(iu,lu,j) = UUM(iu,lu);
+      if (mazim == 0) {
+        c_fluxes(ds,out,ch,cmu,cwt,gc,kk,layru,ll,lyrcut,ncut,nn,PRNTU0(1),
+	         taucpr,utaupr,xr,zbeamsp,zbeama,zz,zzg,plk,fl,u0c);
+        if (surf) {
+          /*
+           * Response to the surface, from the same factored matrix; Z is free
+           * once the matrix is factored and holds its constants of integration
+           */
+          c_surface_response(ds,surf,bplanck,b,cblock,cmu,cwt,dtaucpr,expbea,gc,ipvt,kk,layru,
+                             ll,z,lyrcut,ncol,ncut,nn,taucpr,utaupr,zz,plk);
+        }
+        if (jac) {
+          /*
+           * Derivatives of the fluxes, from the same factored matrix
+           */
+          if (c_flux_jacobian(ds,jac,emi_func,bplanck,cblock,cmu,cwt,dtaucpr,expbea,flyr,gc,gl,
+                              ipvt,kk,ll,lyrcut,ncol,ncut,nn,taucpr,ylm0,ylmc,zz,xr,plk)) {
+            return DS_ERR_WORKSPACE;
           }
         }
       }
 
-      if ( ds->flag.output_uum)
-	for (lu = 1; lu <= ds->ntau; lu++) 
-	  for (iu = 1; iu <= ds->numu; iu++)
-            OUT_UUM(iu,lu,mazim) = UUM(iu,lu);
-      
-      /*
-       * Print azimuthally averaged intensities at user angles
-       */
-      if (PRNTU0(2)) {
-        c_print_avg_intensities(ds,out);
+      if (ds->flag.onlyfl) {
+        /*
+         * Save azimuthal-avg intensities at quadrature angles
+         */
+        for (lu = 1; lu <= ds->ntau; lu++) {
+          for (iq = 1; iq <= ds->nstr; iq++) {
+            U0U(iq,lu) = U0C(iq,lu);
+          }
+        }
+        sun_kconv[isun] = 2;
+        continue;
       }
 
-      if (naz > 0) {
-        memset(phirad,0,ds->nphi*sizeof(double));
-        for (j = 1; j <= ds->nphi; j++) {
-          PHIRAD(j) = (PHI(j)-ds->bc.phi0)*DEG;
+      memset(uum,0,ds->numu*ds->ntau*sizeof(double));
+
+      if (ds->flag.usrang) {
+        /*
+         * Compute azimuthal intensity components at user angles
+         */
+        if (umu0) {
+          memcpy(gu,ws->sun+nsun*ws->sun_size,ds->nlyr*ds->nstr*ds->numu*sizeof(double));
         }
+        c_user_intensities(ds,bplanck,cmu,cwt,delm0,dtaucpr,emu,expbea,
+			   gc,gu,kk,layru,ll,lyrcut,mazim,
+			   ncut,nn,rmu,taucpr,tplanck,utaupr,wk,
+			   zbu,zbeam,zbeamsp,
+			   zbeama,zgu,zu,zz,zzg,plk,uum);
       }
-    }
-    else {
-      /*
-       * Increment intensity by current azimuthal component (Fourier cosine series);  eq SD(2), STWL(6)
-       */
-      azerr = 0.;
-      for (j = 1; j <= ds->nphi; j++) {
-        cosphi = cos((double)mazim*PHIRAD(j));
+      else {
+        /*
+         * Compute azimuthal intensity components at quadrature angles
+         */
+        c_intensity_components(ds,gc,kk,layru,ll,lyrcut,mazim,ncut,nn,taucpr,utaupr,zz,plk,uum);
+      }
+
+      if (mazim == 0) {
+        /*
+         * Save azimuthally averaged intensities
+         */
         for (lu = 1; lu <= ds->ntau; lu++) {
           for (iu = 1; iu <= ds->numu; iu++) {
-            azterm       = UUM(iu,lu)*cosphi;
-            UU(iu,lu,j) += azterm;
-            azerr        = MAX(azerr,c_ratio(fabs(azterm),fabs(UU(iu,lu,j))));
+            U0U(iu,lu) = UUM(iu,lu);
+            for (j = 1; j <= ds->nphi; j++) {
+              UU(iu,lu,j) = UUM(iu,lu);
+            }
           }
         }
-      }
-      if ( ds->flag.output_uum)
-	for (lu = 1; lu <= ds->ntau; lu++) 
-	  for (iu = 1; iu <= ds->numu; iu++) 
-            OUT_UUM(iu,lu,mazim) = UUM(iu,lu);
-
-      if(azerr <= ds->accur) {
-        kconv++;
-      }
-      if (kconv >= 2) {
-        break;
-      }
-    }
-  }
-  /*--------------  END LOOP ON AZIMUTHAL COMPONENTS  ----------------*/
 
+        if ( ds->flag.output_uum)
+	  for (lu = 1; lu <= ds->ntau; lu++) 
+	    for (iu = 1; iu <= ds->numu; iu++)
+              OUT_UUM(iu,lu,mazim) = UUM(iu,lu);
+      
+        /*
+         * Print azimuthally averaged intensities at user angles
+         */
+        if (PRNTU0(2)) {
+          c_print_avg_intensities(ds,out);
+        }
 
+        if (sun_naz[isun] > 0) {
+          memset(phirad,0,ds->nphi*sizeof(double));
+          for (j = 1; j <= ds->nphi; j++) {
+            PHIRAD(j) = (PHI(j)-ds->bc.phi0)*DEG;
+          }
+        }
+      }
+      else {
+        /*
+         * Increment intensity by current azimuthal component (Fourier cosine series);  eq SD(2), STWL(6)
+         */
+        azerr = 0.;
+        for (j = 1; j <= ds->nphi; j++) {
+          cosphi = cos((double)mazim*PHIRAD(j));
+          for (lu = 1; lu <= ds->ntau; lu++) {
+            for (iu = 1; iu <= ds->numu; iu++) {
+              azterm       = UUM(iu,lu)*cosphi;
+              UU(iu,lu,j) += azterm;
+              azerr        = MAX(azerr,c_ratio(fabs(azterm),fabs(UU(iu,lu,j))));
+            }
+          }
+        }
+        if ( ds->flag.output_uum)
+	  for (lu = 1; lu <= ds->ntau; lu++) 
+	    for (iu = 1; iu <= ds->numu; iu++) 
+              OUT_UUM(iu,lu,mazim) = UUM(iu,lu);
+
+        if(azerr <= ds->accur) {
+          sun_kconv[isun]++;
+        }
+      }
+    }
 
-  for (iu = 1; iu <= ds->numu; iu++) {
-    lu = ds->ntau;
-    j =  1;
-  }
-  if (corint) {
     /*
-     * Apply Nakajima/Tanaka intensity corrections
+     * Stop once every sun has converged
      */
-    if (!ds->flag.old_intensity_correction && self_tested == 1) {
-      if (ds->flag.quiet==VERBOSE)
-	fprintf(stderr,"Using new intensity correction, with phase functions\n");
-      c_new_intensity_correction(ds,out,dither,flyr,layru,lyrcut,ncut,oprim,phasa,phast,phasm,phirad,tauc,taucpr,utaupr);
+    nactive = 0;
+    for (isun = 0; isun < nsun; isun++) {
+      if (mazim < sun_naz[isun] && sun_kconv[isun] < 2) {
+        nactive++;
+      }
     }
-    else {
-      if (ds->flag.quiet==VERBOSE) 
-	fprintf(stderr,"Using original intensity correction, with phase moments\n");
-      c_intensity_correction(ds,out,dither,flyr,layru,lyrcut,ncut,oprim,phasa,phast,phasm,phirad,tauc,taucpr,utaupr);
+    if (nactive == 0) {
+      break;
     }
   }
+  /*--------------  END LOOP ON AZIMUTHAL COMPONENTS  ----------------*/
 
-  
-  for (iu = 1; iu <= ds->numu; iu++) {
-    lu = ds->ntau;
-    j =  1;
-  }
 
 
-  if (ds->flag.prnt[2] && !ds->flag.onlyfl) {
-    /*
-     * Print intensities
-     */
-    c_print_intensities(ds,out);
+  for (isun = 0; isun < nsun; isun++) {
+    out = outs+isun;
+    if (umu0) {
+      c_sun_select(ds,ws,isun,phi0,&expbea,&ylm0,&zz,&zbeam,&phirad);
+    }
+    if (corint) {
+      /*
+       * Apply Nakajima/Tanaka intensity corrections
+       */
+      if (!ds->flag.old_intensity_correction && !self_testing) {
+        if (ds->flag.quiet==VERBOSE)
+	  fprintf(stderr,"Using new intensity correction, with phase functions\n");
+        c_new_intensity_correction(ds,out,dither,flyr,layru,lyrcut,ncut,oprim,phasa,phast,phasm,phirad,tauc,taucpr,utaupr);
+      }
+      else {
+        if (ds->flag.quiet==VERBOSE) 
+	  fprintf(stderr,"Using original intensity correction, with phase moments\n");
+        c_intensity_correction(ds,out,dither,flyr,layru,lyrcut,ncut,oprim,phasa,phast,phasm,phirad,tauc,taucpr,utaupr);
+      }
+    }
+
+    if (ds->flag.prnt[2] && !ds->flag.onlyfl) {
+      /*
+       * Print intensities
+       */
+      c_print_intensities(ds,out);
+    }
   }
 
-  if (self_tested == 0) {
-    /*
-     * Compare test case results with correct answers and abort if bad
-     */
-    compare = TRUE;
-    c_self_test(compare,prntu0,ds,out);
+  return 0;
+}
+
+/*
+ * Run the self-test exactly once per process, no matter how many threads
+ * enter c_disort_ws() concurrently (called through pthread_once), and keep
+ * its result in c_disort_self_test_err. A fatal error raised by the self-test
+ * solve returns here as it does to c_disort_guarded().
+ */
+static void c_disort_self_test_once(void)
+{
+  int
+    prntu0_test[2] = {FALSE,FALSE};
+  disort_state
+    ds_test;
+  disort_output
+    out_test;
+  disort_workspace
+    ws_test;
+  jmp_buf
+    env,
+    *prev_jmp;
+
+  /*
+   * Set input values for self-test.
+   * Be sure self_test() sets all print flags off.
+   */
+  c_self_test(FALSE,prntu0_test,&ds_test,&out_test);
+  if (c_disort_workspace_alloc(&ws_test,ds_test.nlyr,ds_test.nstr,ds_test.numu,ds_test.ntau,ds_test.nphi)) {
+    c_disort_out_free(&ds_test,&out_test);
+    c_disort_state_free(&ds_test);
+    c_disort_self_test_err = DS_ERR_WORKSPACE;
+    return;
+  }
 
-    self_tested = 1;
+  prev_jmp = c_errmsg_jmp;
+  if (setjmp(env)) {
+    c_errmsg_jmp = prev_jmp;
+    c_disort_workspace_free(&ws_test);
+    c_disort_out_free(&ds_test,&out_test);
+    c_disort_state_free(&ds_test);
+    c_disort_self_test_err = DS_ERR_FATAL;
+    return;
   }
+  c_errmsg_jmp = &env;
 
-  callnum++;
+  c_disort_solve(&ds_test,&out_test,1,NULL,NULL,&ws_test,c_planck_func2,NULL,NULL,NULL,TRUE);
 
-  /* 
-   * Free allocated memory
+  c_errmsg_jmp = prev_jmp;
+  c_disort_workspace_free(&ws_test);
+
+  /*
+   * Compare test case results with correct answers
    */
-  free(ab),free(array);
-  free(b),free(bdr),free(bem);
-  free(cband),free(cc),free(ch),free(chtau),free(cmu),free(cwt);
-  free(dtaucpr);
-  free(emu),free(eval),free(evecc),free(expbea);
-  free(flyr),free(fl);
-  free(gc),free(gl),free(gu);
-  free(kk);
-  free(ll);
-  free(oprim);
-  free(phasa),free(phast),free(phasm),free(phirad),free(pkag),free(plk),free(psi);
-  free(rmu);
-  free(tauc),free(taucpr);
-  free(u0c),free(utaupr),free(uum);
-  free(wk);
-  free(xb),free(xba),free(xr);
-  free(ylm0),free(ylmc),free(ylmu);
-  free(z),free(zbu),free(zbeam),free(zbeamsp),
-  free(zbeama),free(zbs),free(zj),free(zjg),free(zju),
-  free(zgu),free(zz),free(zzg),free(zee),free(zu);
+  c_disort_self_test_err = c_self_test(TRUE,prntu0_test,&ds_test,&out_test);
 
-  return 0;
+  return;
+}
+
+/*
+ * Runs the self-test on the first call and returns its result: DS_OK, or the
+ * DS_ERR_* code of the failure, after which no solve is attempted.
+ */
+static int c_disort_self_test(void)
+{
+  pthread_once(&c_disort_self_test_flag,c_disort_self_test_once);
+
+  return c_disort_self_test_err;
+}
+
+/*
+ * Runs c_disort_solve() for the c_disort_ws*() wrappers, after their own
+ * checks. A fatal error raised anywhere inside the solver by
+ * c_errmsg(...,DS_ERROR) returns here with DS_ERR_FATAL, invalidating cache
+ * if there is one; the return point of an enclosing call is restored on both
+ * paths.
+ */
+static int c_disort_guarded(disort_state      *ds,
+                            disort_output     *out,
+                            int                nsun,
+                            double const      *umu0,
+                            double const      *phi0,
+                            disort_workspace  *ws,
+                            emission_func_t    emi_func,
+                            disort_surface    *surf,
+                            disort_jacobian   *jac,
+                            disort_beam_cache *cache)
+{
+  int
+    err;
+  jmp_buf
+    env,
+    *prev_jmp;
+
+  prev_jmp = c_errmsg_jmp;
+  if (setjmp(env)) {
+    c_errmsg_jmp = prev_jmp;
+    if (cache) {
+      cache->valid = FALSE;
+    }
+    return DS_ERR_FATAL;
+  }
+  c_errmsg_jmp = &env;
+
+  err = c_disort_solve(ds,out,nsun,umu0,phi0,ws,emi_func,surf,jac,cache,FALSE);
+
+  c_errmsg_jmp = prev_jmp;
+
+  return err;
+}
+
+/*
+ * Same as c_disort(), but all scratch memory comes from ws, which must have
+ * been sized by c_disort_workspace_alloc() for at least the dimensions of ds.
+ *
+ * c_disort_ws() keeps no state between calls: concurrent calls are safe as
+ * long as each thread passes its own ds, out and ws.
+ *
+ * Returns DS_OK, or one of the DS_ERR_* codes. A fatal error raised anywhere
+ * inside the solver by c_errmsg(...,DS_ERROR) returns here with DS_ERR_FATAL
+ * instead of terminating the process; out is then undefined. Every call
+ * returns DS_ERR_FATAL without solving if the self-test failed.
+ */
+int c_disort_ws(disort_state     *ds,
+                disort_output    *out,
+                disort_workspace *ws,
+                emission_func_t   emi_func)
+{
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+
+  return c_disort_guarded(ds,out,1,NULL,NULL,ws,emi_func,NULL,NULL,NULL);
+}
+
+/*
+ * Same as c_disort_ws(), for nsun beam angles at once: sun isun has the beam
+ * cosine umu0[isun] and azimuth phi0[isun] (ds->bc.umu0 and ds->bc.phi0 are
+ * overwritten) and its results go to out[isun]. The eigensolutions, the
+ * thermal particular solution and the factored boundary-condition matrix do
+ * not depend on the beam angle and are computed once for all suns.
+ *
+ * Only general boundary conditions with a plane-parallel beam and no general
+ * source share this work; otherwise the suns are solved one after another.
+ * Returns as c_disort_ws(), for the first sun that fails.
+ */
+int c_disort_ws_suns(disort_state     *ds,
+                     disort_output    *out,
+                     int               nsun,
+                     double const     *umu0,
+                     double const     *phi0,
+                     disort_workspace *ws,
+                     emission_func_t   emi_func)
+{
+  int
+    err,isun;
+
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws_suns--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+  if (nsun < 1) {
+    c_errmsg("disort_ws_suns--nsun < 1",DS_WARNING);
+    return DS_ERR_INPUT;
+  }
+
+  if (ds->flag.ibcnd != GENERAL_BC || ds->flag.spher || ds->flag.general_source) {
+    for (isun = 0; isun < nsun; isun++) {
+      ds->bc.umu0 = umu0[isun];
+      ds->bc.phi0 = phi0[isun];
+      err = c_disort_ws(ds,out+isun,ws,emi_func);
+      if (err) {
+        return err;
+      }
+    }
+    return DS_OK;
+  }
+
+  if (c_sun_alloc(ws,nsun)) {
+    return DS_ERR_WORKSPACE;
+  }
+
+  return c_disort_guarded(ds,out,nsun,umu0,phi0,ws,emi_func,NULL,NULL,NULL);
+}
+
+/*
+ * Same as c_disort_ws(), for a black Lambertian surface (ds->bc.albedo is
+ * ignored), and in addition the response of the medium to its surface in
+ * surf, from which the fluxes for any albedo follow in closed form (see
+ * disort_surface). The response reuses the factored boundary-condition
+ * matrix with the isotropic illumination from below of c_albtrans().
+ * surf->up and surf->dn must hold ds->ntau values.
+ *
+ * Only general boundary conditions with a Lambertian surface, a
+ * plane-parallel beam and no general source are supported; otherwise
+ * DS_ERR_INPUT is returned.
+ */
+int c_disort_ws_surface(disort_state     *ds,
+                        disort_output    *out,
+                        disort_surface   *surf,
+                        disort_workspace *ws,
+                        emission_func_t   emi_func)
+{
+  int
+    err;
+  double
+    albedo;
+
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws_surface--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+  if (ds->flag.ibcnd != GENERAL_BC || !ds->flag.lamber || ds->flag.spher || ds->flag.general_source) {
+    c_errmsg("disort_ws_surface--needs a Lambertian surface, general b.c., no spher and no general source",DS_WARNING);
+    return DS_ERR_INPUT;
+  }
+
+  albedo        = ds->bc.albedo;
+  ds->bc.albedo = 0.;
+
+  err = c_disort_guarded(ds,out,1,NULL,NULL,ws,emi_func,surf,NULL,NULL);
+
+  ds->bc.albedo = albedo;
+
+  return err;
+}
+
+/*
+ * Same as c_disort_ws(), and in addition the derivatives of the up-flux and
+ * the total down-flux at the layer boundaries with respect to DTAUC, SSALB,
+ * PMOM, the albedo and TEMPER in jac (see disort_jacobian), from the
+ * linearized m=0 solution of c_flux_jacobian(). They cost one more solve
+ * with the factored boundary-condition matrix per flux, or a single one for
+ * the derivatives of a weighted sum of the fluxes if jac->seed is set. The
+ * derivatives with respect to TEMPER are zero unless ds->flag.planck.
+ *
+ * Only general boundary conditions with a Lambertian surface, a
+ * plane-parallel beam, no general source and output at the layer
+ * boundaries (ds->flag.usrtau = FALSE) are supported; otherwise
+ * DS_ERR_INPUT is returned.
+ */
+int c_disort_ws_jacobian(disort_state     *ds,
+                         disort_output    *out,
+                         disort_jacobian  *jac,
+                         disort_workspace *ws,
+                         emission_func_t   emi_func)
+{
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws_jacobian--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+  if (ds->flag.ibcnd != GENERAL_BC || !ds->flag.lamber || ds->flag.spher ||
+      ds->flag.general_source || ds->flag.usrtau) {
+    c_errmsg("disort_ws_jacobian--needs a Lambertian surface, general b.c., no spher, no general source and no usrtau",DS_WARNING);
+    return DS_ERR_INPUT;
+  }
+
+  return c_disort_guarded(ds,out,1,NULL,NULL,ws,emi_func,NULL,jac,NULL);
+}
+
+/*
+ * Same as c_disort_ws(), keeping the beam solution of the column in cache
+ * (see disort_beam_cache). If DTAUC, SSALB, PMOM, the beam and the albedo
+ * are those of the solution in cache, the eigenproblems, the beam particular
+ * solutions and the factorization of the boundary-condition matrix are
+ * skipped, and only the thermal source and the constants of integration are
+ * solved for; results are the same as those of c_disort_ws() up to round-off.
+ *
+ * The cache is used for fluxes only (ds->flag.onlyfl) with general boundary
+ * conditions, a Lambertian surface, a plane-parallel beam and no general
+ * source, and cache must have been allocated for the dimensions of ds; any
+ * other call solves as c_disort_ws() and leaves cache untouched.
+ */
+int c_disort_ws_cached(disort_state      *ds,
+                       disort_output     *out,
+                       disort_workspace  *ws,
+                       disort_beam_cache *cache,
+                       emission_func_t    emi_func)
+{
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws_cached--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+
+  return c_disort_guarded(ds,out,1,NULL,NULL,ws,emi_func,NULL,NULL,cache);
+}
+
+/*
+ * Same as c_disort_ws_jacobian(), keeping the beam solution of the column in
+ * cache as c_disort_ws_cached() does. A call for the inputs of the solution in
+ * cache skips the eigenproblems, the beam particular solutions and the
+ * factorization of the boundary-condition matrix, and costs the derivative
+ * solves of c_flux_jacobian() plus one solve for the constants of integration.
+ *
+ * The cache is used for fluxes only (ds->flag.onlyfl) and must have been
+ * allocated for the dimensions of ds; otherwise the call solves as
+ * c_disort_ws_jacobian() and leaves cache untouched.
+ */
+int c_disort_ws_jacobian_cached(disort_state      *ds,
+                                disort_output     *out,
+                                disort_jacobian   *jac,
+                                disort_workspace  *ws,
+                                disort_beam_cache *cache,
+                                emission_func_t    emi_func)
+{
+  if (c_disort_self_test()) {
+    return DS_ERR_FATAL;
+  }
+
+  if (!ws || !ws->arena) {
+    c_errmsg("disort_ws_jacobian_cached--workspace not allocated",DS_WARNING);
+    return DS_ERR_WORKSPACE;
+  }
+  if (ds->flag.ibcnd != GENERAL_BC || !ds->flag.lamber || ds->flag.spher ||
+      ds->flag.general_source || ds->flag.usrtau) {
+    c_errmsg("disort_ws_jacobian_cached--needs a Lambertian surface, general b.c., no spher, no general source and no usrtau",DS_WARNING);
+    return DS_ERR_INPUT;
+  }
+
+  return c_disort_guarded(ds,out,1,NULL,NULL,ws,emi_func,NULL,jac,cache);
+}
+
+/*
+ * Convenience wrapper that sizes a workspace for ds, runs c_disort_ws() and
+ * releases the workspace again. Callers that solve many problems with the same
+ * dimensions should allocate a disort_workspace once and call c_disort_ws().
+ */
+int c_disort(disort_state  *ds,
+	      disort_output *out,
+        emission_func_t emi_func)
+{
+  int
+    err;
+  disort_workspace
+    ws;
+
+  err = c_disort_workspace_alloc(&ws,ds->nlyr,ds->nstr,ds->numu,ds->ntau,ds->nphi);
+  if (err) {
+    return DS_ERR_WORKSPACE;
+  }
+  err = c_disort_ws(ds,out,&ws,emi_func);
+  c_disort_workspace_free(&ws);
+
+  return err;
 }
 
 /*============================= end of c_disort() =======================*/
@@ -1090,12 +1874,13 @@ double c_bidir_reflectivity ( double       wvnmlo,
   double
     ans, rmu, flxalb;
 
-  static double
+  /* Per-thread cache of the limiting mu of the last BRDF parameters */
+  static __thread double
     badmu, swvnmlo, swvnmhi, srho0, sk,
     stheta, ssigma, st1, st2, sscale;
 
 #if HAVE_BRDF
-    static double
+    static __thread double
     siso, svol, sgeo;
 #endif
 
@@ -1562,7 +2347,8 @@ void c_getmom(int    iphas,
 
    S C R A T C H   V A R I A B L E S:
 
-       wk    :  work area (dimension at least 2*m)
+       wk    :  work area (dimension at least 2*m; 5*m with
+                DISORT_USE_LAPACK)
        
    Called by- c_solve_eigen
    Calls- c_errmsg
@@ -1597,6 +2383,22 @@ void c_asymmetric_matrix(double *aa,
     c_errmsg("asymmetric_matrix--bad input variable(s)",DS_ERROR);
   }
 
+#if defined(DISORT_USE_LAPACK)
+  if (m >= DISORT_LAPACK_MIN_EIGEN) {
+    /*
+     * Right eigenvectors with LAPACK; the imaginary parts of the
+     * eigenvalues go to wk(1..m), and wk(m+1..5m) is its workspace
+     */
+    int
+      info,lwork = 4*m;
+
+    dgeev_("N","V",&m,aa,&ia,eval,wk,&x,&c_blas_inc,evec,&ievec,wk+m,&lwork,
+           &info,1,1);
+    *ier = info;
+    return;
+  }
+#endif
+
   /*
    * Handle 1x1 and 2x2 special cases
    */
@@ -2176,76 +2978,321 @@ S550:
 
 /*============================= end of c_asymmetric_matrix() ============*/
 
-/*============================= c_intensity_components() ================*/
+/*============================= c_symmetric_matrix() ====================*/
 
 /*
-    Calculates the Fourier intensity components at the quadrature
-    angles for azimuthal expansion terms (mazim) in eq. SD(2),STWL(6)
+  Solves eigenfunction problem for real symmetric matrix. The matrix is
+  reduced to tridiagonal form by Householder transformations (EISPACK
+  tred2), and the tridiagonal matrix is diagonalized by the implicit QL
+  method (EISPACK tql2), accumulating the transformations in aa. Only
+  the lower triangle of aa is referenced on input.
 
-    I N P U T    V A R I A B L E S:
+  References:
 
-       ds      :  Disort state variables
-       kk      :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
-       gc      :  Eigenvectors at polar quadrature angles in eq. SC(1)
-       ll      :  Constants of integration in eq. SC(1), obtained by solving scaled version of eq. SC(5);
-                  exponential term of eq. SC(12) not included
-       lyrcut  :  Logical flag for truncation of computational layer
-       mazim   :  Order of azimuthal component
-       ncut    :  Number of computational layer where absorption optical depth exceeds ABSCUT
-       nn      :  Order of double-Gauss quadrature (NSTR/2)
-       taucpr  :  Cumulative optical depth (delta-M-scaled)
-       utaupr  :  Optical depths of user output levels in delta-M coordinates;  equal to UTAU if no delta-M
-       zz      :  Beam source vectors in eq. SS(19), STWL(24b)
-       plk     :  Thermal source vectors z0,z1 by solving eq. SS(16), Y-sub-zero, Y-sub-one in STWL(26ab);
-                  plk[].zero, plk[].one (see cdisort.h)
+  Smith, B.T. et al., 1976: Matrix Eigensystem Routines -- EISPACK Guide,
+      Lecture Notes in Computer Science 6, Springer, Berlin
+  Wilkinson, J., and C. Reinsch, 1971: Handbook for Automatic Computation,
+      Vol. II, Linear Algebra, Springer, Berlin
 
-    O U T P U T   V A R I A B L E S:
+   I N P U T    V A R I A B L E S:
 
-       uum     :  Fourier components of the intensity in eq. SD(12) (at polar quadrature angles)
+       aa    :  input symmetric matrix, overwritten by its eigenvectors
+        m    :  order of aa
+       ia    :  first dimension of aa
 
-    I N T E R N A L   V A R I A B L E S:
+   O U T P U T    V A R I A B L E S:
 
-       fact    :  exp(-utaupr/umu0)
-       zint    :  intensity of m=0 case, in eq. SC(1)
+       aa    :  orthonormal eigenvectors (column j corresponds to EVAL(j))
+       eval  :  (unordered) eigenvalues of aa (dimension m)
+       ier   :  if != 0, signals that EVAL(ier) failed to converge
 
-   Called by- c_disort
+   S C R A T C H   V A R I A B L E S:
+
+       wk    :  work area (dimension at least m; 3*m with
+                DISORT_USE_LAPACK)
+
+   Called by- c_solve_eigen_symmetric
+   Calls- c_errmsg
  -------------------------------------------------------------------*/
 
-void c_intensity_components(disort_state *ds,
-                            double       *gc,
-                            double       *kk,
-                            int          *layru,
-                            double       *ll,
-                            int           lyrcut,
-                            int           mazim,
-                            int           ncut,
-                            int           nn,
-                            double       *taucpr,
-                            double       *utaupr,
-                            double       *zz,
-                            disort_pair  *plk,
-                            double       *uum)
+void c_symmetric_matrix(double *aa,
+                        double *eval,
+                        int     m,
+                        int     ia,
+                        int    *ier,
+                        double *wk)
 {
+  const int
+    maxit = 30;
   register int
-    iq,jq,lu,lyu;
-  register double
-    zint;
+    i,j,k,l,n;
+  int
+    iter;
+  double
+    c,c2,c3,dl1,el1,f,g,h,hh,p,r,s,s2,scale,tst1;
+
+  *ier = 0;
+  if (m < 1 || ia < m) {
+    c_errmsg("symmetric_matrix--bad input variable(s)",DS_ERROR);
+  }
+
+#if defined(DISORT_USE_LAPACK)
+  if (m >= DISORT_LAPACK_MIN_EIGEN) {
+    /*
+     * Eigenvectors with LAPACK, with wk(1..3m-1) as its workspace
+     */
+    int
+      info,lwork = 3*m-1;
+
+    dsyev_("V","L",&m,aa,&ia,eval,wk,&lwork,&info,1,1);
+    *ier = info;
+    return;
+  }
+#endif
 
   /*
-   * Loop over user levels
+   * Householder reduction to tridiagonal form; the diagonal is returned
+   * in EVAL and the subdiagonal in WK(2..m)
    */
-  for (lu = 1; lu <= ds->ntau; lu++) {
-    lyu = LAYRU(lu);
-    if (lyrcut && lyu > ncut) {
-      continue;
+  for (j = 1; j <= m; j++) {
+    EVAL(j) = AA(m,j);
+  }
+  for (i = m; i >= 2; i--) {
+    scale = 0.;
+    h     = 0.;
+    for (k = 1; k <= i-1; k++) {
+      scale += fabs(EVAL(k));
     }
-    for (iq = 1; iq <= ds->nstr; iq++) {
-      zint = 0.;
-      for (jq = 1; jq <= nn; jq++) {
-        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu  )));
+    if (scale == 0.) {
+      WK(i) = EVAL(i-1);
+      for (j = 1; j <= i-1; j++) {
+        EVAL(j) = AA(i-1,j);
+        AA(i,j) = 0.;
+        AA(j,i) = 0.;
       }
-      for (jq = nn+1; jq <=ds->nstr; jq++) {
-        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu-1)));
+    }
+    else {
+      for (k = 1; k <= i-1; k++) {
+        EVAL(k) /= scale;
+        h       += EVAL(k)*EVAL(k);
+      }
+      f = EVAL(i-1);
+      g = (f > 0.) ? -sqrt(h) : sqrt(h);
+      WK(i)      = scale*g;
+      h         -= f*g;
+      EVAL(i-1)  = f-g;
+      for (j = 1; j <= i-1; j++) {
+        WK(j) = 0.;
+      }
+      for (j = 1; j <= i-1; j++) {
+        f       = EVAL(j);
+        AA(j,i) = f;
+        g       = WK(j)+AA(j,j)*f;
+        for (k = j+1; k <= i-1; k++) {
+          g     += AA(k,j)*EVAL(k);
+          WK(k) += AA(k,j)*f;
+        }
+        WK(j) = g;
+      }
+      f = 0.;
+      for (j = 1; j <= i-1; j++) {
+        WK(j) /= h;
+        f     += WK(j)*EVAL(j);
+      }
+      hh = f/(h+h);
+      for (j = 1; j <= i-1; j++) {
+        WK(j) -= hh*EVAL(j);
+      }
+      for (j = 1; j <= i-1; j++) {
+        f = EVAL(j);
+        g = WK(j);
+        for (k = j; k <= i-1; k++) {
+          AA(k,j) -= f*WK(k)+g*EVAL(k);
+        }
+        EVAL(j) = AA(i-1,j);
+        AA(i,j) = 0.;
+      }
+    }
+    EVAL(i) = h;
+  }
+
+  /*
+   * Accumulate the transformations
+   */
+  for (i = 1; i <= m-1; i++) {
+    AA(m,i) = AA(i,i);
+    AA(i,i) = 1.;
+    h       = EVAL(i+1);
+    if (h != 0.) {
+      for (k = 1; k <= i; k++) {
+        EVAL(k) = AA(k,i+1)/h;
+      }
+      for (j = 1; j <= i; j++) {
+        g = 0.;
+        for (k = 1; k <= i; k++) {
+          g += AA(k,i+1)*AA(k,j);
+        }
+        for (k = 1; k <= i; k++) {
+          AA(k,j) -= g*EVAL(k);
+        }
+      }
+    }
+    for (k = 1; k <= i; k++) {
+      AA(k,i+1) = 0.;
+    }
+  }
+  for (j = 1; j <= m; j++) {
+    EVAL(j) = AA(m,j);
+    AA(m,j) = 0.;
+  }
+  AA(m,m) = 1.;
+
+  /*
+   * Implicit QL iterations on the tridiagonal matrix
+   */
+  for (i = 2; i <= m; i++) {
+    WK(i-1) = WK(i);
+  }
+  WK(m) = 0.;
+
+  f    = 0.;
+  tst1 = 0.;
+  for (l = 1; l <= m; l++) {
+    tst1 = MAX(tst1,fabs(EVAL(l))+fabs(WK(l)));
+    for (n = l; n < m; n++) {
+      if (fabs(WK(n)) <= DBL_EPSILON*tst1) {
+        break;
+      }
+    }
+    if (n > l) {
+      iter = 0;
+      do {
+        if (++iter > maxit) {
+          *ier = l;
+          return;
+        }
+        g       = EVAL(l);
+        p       = (EVAL(l+1)-g)/(2.*WK(l));
+        r       = sqrt(p*p+1.);
+        r       = (p < 0.) ? -r : r;
+        EVAL(l)   = WK(l)/(p+r);
+        EVAL(l+1) = WK(l)*(p+r);
+        dl1       = EVAL(l+1);
+        h         = g-EVAL(l);
+        for (i = l+2; i <= m; i++) {
+          EVAL(i) -= h;
+        }
+        f += h;
+
+        p   = EVAL(n);
+        c   = 1.;
+        c2  = c;
+        c3  = c;
+        el1 = WK(l+1);
+        s   = 0.;
+        s2  = 0.;
+        for (i = n-1; i >= l; i--) {
+          c3        = c2;
+          c2        = c;
+          s2        = s;
+          g         = c*WK(i);
+          h         = c*p;
+          r         = sqrt(p*p+WK(i)*WK(i));
+          WK(i+1)   = s*r;
+          s         = WK(i)/r;
+          c         = p/r;
+          p         = c*EVAL(i)-s*g;
+          EVAL(i+1) = h+s*(c*g+s*EVAL(i));
+          for (k = 1; k <= m; k++) {
+            h         = AA(k,i+1);
+            AA(k,i+1) = s*AA(k,i)+c*h;
+            AA(k,i)   = c*AA(k,i)-s*h;
+          }
+        }
+        p       = -s*s2*c3*el1*WK(l)/dl1;
+        WK(l)   = s*p;
+        EVAL(l) = c*p;
+      } while (fabs(WK(l)) > DBL_EPSILON*tst1);
+    }
+    EVAL(l) += f;
+    WK(l)    = 0.;
+  }
+
+  return;
+}
+
+/*============================= end of c_symmetric_matrix() =============*/
+
+/*============================= c_intensity_components() ================*/
+
+/*
+    Calculates the Fourier intensity components at the quadrature
+    angles for azimuthal expansion terms (mazim) in eq. SD(2),STWL(6)
+
+    I N P U T    V A R I A B L E S:
+
+       ds      :  Disort state variables
+       kk      :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
+       gc      :  Eigenvectors at polar quadrature angles in eq. SC(1)
+       ll      :  Constants of integration in eq. SC(1), obtained by solving scaled version of eq. SC(5);
+                  exponential term of eq. SC(12) not included
+       lyrcut  :  Logical flag for truncation of computational layer
+       mazim   :  Order of azimuthal component
+       ncut    :  Number of computational layer where absorption optical depth exceeds ABSCUT
+       nn      :  Order of double-Gauss quadrature (NSTR/2)
+       taucpr  :  Cumulative optical depth (delta-M-scaled)
+       utaupr  :  Optical depths of user output levels in delta-M coordinates;  equal to UTAU if no delta-M
+       zz      :  Beam source vectors in eq. SS(19), STWL(24b)
+       plk     :  Thermal source vectors z0,z1 by solving eq. SS(16), Y-sub-zero, Y-sub-one in STWL(26ab);
+                  plk[].zero, plk[].one (see cdisort.h)
+
+    O U T P U T   V A R I A B L E S:
+
+       uum     :  Fourier components of the intensity in eq. SD(12) (at polar quadrature angles)
+
+    I N T E R N A L   V A R I A B L E S:
+
+       fact    :  exp(-utaupr/umu0)
+       zint    :  intensity of m=0 case, in eq. SC(1)
+
+   Called by- c_disort
+ -------------------------------------------------------------------*/
+
+void c_intensity_components(disort_state *ds,
+                            double       *gc,
+                            double       *kk,
+                            int          *layru,
+                            double       *ll,
+                            int           lyrcut,
+                            int           mazim,
+                            int           ncut,
+                            int           nn,
+                            double       *taucpr,
+                            double       *utaupr,
+                            double       *zz,
+                            disort_pair  *plk,
+                            double       *uum)
+{
+  register int
+    iq,jq,lu,lyu;
+  register double
+    zint;
+
+  /*
+   * Loop over user levels
+   */
+  for (lu = 1; lu <= ds->ntau; lu++) {
+    lyu = LAYRU(lu);
+    if (lyrcut && lyu > ncut) {
+      continue;
+    }
+    for (iq = 1; iq <= ds->nstr; iq++) {
+      zint = 0.;
+      for (jq = 1; jq <= nn; jq++) {
+        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu  )));
+      }
+      for (jq = nn+1; jq <=ds->nstr; jq++) {
+        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu-1)));
       }
       UUM(iq,lu) = zint;
       if (ds->bc.fbeam > 0.) {
@@ -2484,127 +3531,1192 @@ void c_fluxes(disort_state  *ds,
 
 /*============================= end of c_fluxes() =======================*/
 
-/*============================= c_intensity_correction() ================*/
+/*============================= c_surface_response() ====================*/
 
 /*
-       Corrects intensity field by using Nakajima-Tanaka algorithm
-       (1988). For more details, see Section 3.6 of STWL NASA report.
-                I N P U T   V A R I A B L E S
+    Calculates the response of the medium to a Lambertian surface, for the
+    closed-form albedo dependence of c_disort_ws_surface(). Over a black
+    surface, a surface that sends up the extra flux dF adds dF times the
+    fluxes due to unit isotropic illumination from below (IHOM = BOT_ILLUM
+    in c_solve1()), which only needs one more right-hand side for the
+    factored matrix. Part sphalb of dF comes back down to the surface,
+    so that with albedo A the flux leaving it is set by
 
-       ds      Disort state variables
-       dither  small multiple of machine precision
-       flyr    separated fraction in delta-M method
-       layru   index of UTAU in multi-layered system
-       lyrcut  logical flag for truncation of computational layer
-       ncut    total number of computational layers considered
-       oprim   delta-M-scaled single-scatter albedo
-       phirad  azimuthal angles in radians
-       tauc    optical thickness at computational levels
-       taucpr  delta-M-scaled optical thickness
-       utaupr  delta-M-scaled version of UTAU
+       fs = A*(fdn+sphalb*(fs-femit-ffluor)) + (1-A)*femit + ffluor
 
-                O U T P U T   V A R I A B L E S
+    with the surface emission and fluor of c_solve0().
 
-       out->UU  corrected intensity field; UU(IU,LU,J)
-                 iu=1,ds->numu; lu=1,ds->ntau; j=1,ds->nphi
+    I N P U T    V A R I A B L E S:
 
-                I N T E R N A L   V A R I A B L E S
+       ds       :  Disort state variables
+       bplanck  :  Intensity emitted from bottom boundary
+       b        :  Scratch right-hand side for c_solve1()
+       cblock   :  Matrix of c_set_matrix() for a black surface, factored by c_block_factor()
+       cmu      :  Abscissae for Gauss quadrature over angle cosine
+       cwt      :  Weights for Gauss quadrature over angle cosine
+       dtaucpr  :  Computational-layer optical depths (delta-M-scaled)
+       expbea   :  Transmission of incident beam, EXP(-TAUCPR/UMU0)
+       gc       :  Eigenvectors at polar quadrature angles, SC(1)
+       ipvt     :  Pivot indices of the factored matrix
+       kk       :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
+       layru    :  Layer number of user level UTAU
+       ll       :  Constants of integration of the black-surface solution, from c_solve0()
+       lyrcut   :  Logical flag for truncation of comput. layer
+       ncol     :  Number of columns in CBLOCK
+       ncut     :  Number of computational layer where absorption optical depth exceeds ABSCUT
+       nn       :  Order of double-Gauss quadrature (NSTR/2)
+       taucpr   :  Cumulative optical depth (delta-M-scaled)
+       utaupr   :  Optical depths of user output levels in delta-M coordinates
+       zz       :  Beam source vectors in eq. SS(19), STWL(24b)
+       plk      :  Thermal source vectors z0,z1 by solving eq. SS(16), Y0,Y1 in STWL(26b,a)
 
-       ctheta  cosine of scattering angle
-       dtheta  angle (degrees) to define aureole region as
-                    direction of beam source +/- DTHETA
-       phasa   actual (exact) phase function
-       phasm   delta-M-scaled phase function
-       phast   phase function used in TMS correction; actual phase
-                    function divided by (1-FLYR*SSALB)
-       pl      ordinary Legendre polynomial of degree l, P-sub-l
-       plm1    ordinary Legendre polynomial of degree l-1, P-sub-(l-1)
-       plm2    ordinary Legendre polynomial of degree l-2, P-sub-(l-2)
-       theta0  incident zenith angle (degrees)
-       thetap  emergent angle (degrees)
-       ussndm  single-scattered intensity computed by using exact
-                   phase function and scaled optical depth
-                   (first term in STWL(68a))
-       ussp    single-scattered intensity from delta-M method
-                   (second term in STWL(68a))
-       duims   intensity correction term from IMS method
-                   (delta-I-sub-IMS in STWL(A.19))
+    O U T P U T    V A R I A B L E S:
+
+       surf     :  Response of the medium to the surface, see disort_surface in cdisort.h
+       llr      :  Constants of integration for unit illumination from below
 
    Called by- c_disort
-   Calls- c_single_scat, c_secondary_scat
+   Calls- c_solve1, c_albtrans_spherical
  -------------------------------------------------------------------*/
 
-void c_intensity_correction(disort_state  *ds,
-                            disort_output *out,
-                            double         dither,
-                            double        *flyr,
-                            int           *layru,
-                            int            lyrcut,
-                            int            ncut,
-                            double        *oprim,
-                            double        *phasa,
-                            double        *phast,
-                            double        *phasm,
-                            double        *phirad,
-                            double        *tauc,
-                            double        *taucpr,
-                            double        *utaupr)
+void c_surface_response(disort_state   *ds,
+                        disort_surface *surf,
+                        double          bplanck,
+                        double         *b,
+                        double         *cblock,
+                        double         *cmu,
+                        double         *cwt,
+                        double         *dtaucpr,
+                        double         *expbea,
+                        double         *gc,
+                        int            *ipvt,
+                        double         *kk,
+                        int            *layru,
+                        double         *ll,
+                        double         *llr,
+                        int             lyrcut,
+                        int             ncol,
+                        int             ncut,
+                        int             nn,
+                        double         *taucpr,
+                        double         *utaupr,
+                        double         *zz,
+                        disort_pair    *plk)
 {
   register int
-    iu,jp,k,lc,ltau,lu;
+    iq,jq,lu,lyu;
   double
-    ctheta,dtheta,duims,pl,plm1,plm2,
-    theta0=0,thetap=0,ussndm,ussp;
+    fisot,sphtrn,zint;
 
-  dtheta = 10.;
+  surf->femit  = M_PI*bplanck;
+  surf->ffluor = M_PI*ds->bc.fluor;
+  surf->fdn    = 0.;
+  surf->sphalb = 0.;
+  memset(surf->up,0,ds->ntau*sizeof(double));
+  memset(surf->dn,0,ds->ntau*sizeof(double));
+
+  if (lyrcut) {
+    /*
+     * The surface is ignored for a truncated bottom layer
+     */
+    return;
+  }
 
   /*
-   * Start loop over zenith angles
+   * Down-flux at the bottom, with the terms that the surface reflects in c_solve0()
    */
-  for (iu = 1; iu <= ds->numu; iu++) {
-    if (UMU(iu) < 0.) {
-      /*
-       * Calculate zenith angles of incident and emerging directions
-       */
-      theta0 = acos(-ds->bc.umu0)/DEG;
-      thetap = acos(UMU(iu))/DEG;
+  for (iq = 1; iq <= nn; iq++) {
+    zint = 0.;
+    for (jq = 1; jq <= nn; jq++) {
+      zint += GC(iq,jq,ncut)*LL(jq,ncut);
     }
-    /*
-     * Start loop over azimuth angles
-     */
-    for (jp = 1; jp <= ds->nphi; jp++) {
-      /*
-       * Calculate cosine of scattering angle, eq. STWL(4)
-       */
-      ctheta = -ds->bc.umu0*UMU(iu)+sqrt((1.-SQR(ds->bc.umu0))*(1.-SQR(UMU(iu))))*cos(PHIRAD(jp));
-       /*
-        * Initialize phase function                              
-        */
-      for (lc = 1; lc <= ncut; lc++) {
-        PHASA(lc) = 1.;
-        PHASM(lc) = 1.;
-      }
-      /*
-       * Initialize Legendre poly. recurrence
-       */
+    for (jq = nn+1; jq <= ds->nstr; jq++) {
+      zint += GC(iq,jq,ncut)*LL(jq,ncut)*exp(-KK(jq,ncut)*DTAUCPR(ncut));
+    }
+    zint       += ZZ(iq,ncut)*EXPBEA(ncut)+ZPLK0(iq,ncut)+ZPLK1(iq,ncut)*TAUCPR(ncut);
+    surf->fdn  += CWT(nn+1-iq)*CMU(nn+1-iq)*zint;
+  }
+  surf->fdn *= 2.*M_PI;
+  if (ds->bc.fbeam > 0.) {
+    surf->fdn += ds->bc.umu0*ds->bc.fbeam*EXPBEA(ncut);
+  }
 
-      plm1 = 1.;
-      plm2 = 0.;
-      for (k = 1; k <= ds->nmom; k++) {
-        /*
-         * Calculate Legendre polynomial of P-sub-l by upward recurrence
-         */
-        pl   = ((double)(2*k-1)*ctheta*plm1-(double)(k-1)*plm2)/k;
-        plm2 = plm1;
-        plm1 = pl;
+  /*
+   * Unit isotropic intensity from below, i.e. flux pi leaving the surface;
+   * from here on LL holds its constants of integration
+   */
+  fisot        = ds->bc.fisot;
+  ds->bc.fisot = 1.;
+  c_solve1(ds,cblock,BOT_ILLUM,ipvt,ncol,ncut,nn,b,llr);
+  ds->bc.fisot = fisot;
+  ll           = llr;
 
-        /*
-         * Calculate actual phase function
-         */
-        for (lc = 1; lc <= ncut; lc++) {
-          PHASA(lc) += (double)(2*k+1)*pl*PMOM(k,lc);
-        }
-        /*
+  c_albtrans_spherical(ds,cmu,cwt,gc,kk,ll,nn,taucpr,&sphtrn,&surf->sphalb);
+
+  /*
+   * Fluxes at the user levels as in c_fluxes(), per unit flux
+   */
+  for (lu = 1; lu <= ds->ntau; lu++) {
+    lyu = LAYRU(lu);
+    for (iq = 1; iq <= ds->nstr; iq++) {
+      zint = 0.;
+      for (jq = 1; jq <= nn; jq++) {
+        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu  )));
+      }
+      for (jq = nn+1; jq <= ds->nstr; jq++) {
+        zint += GC(iq,jq,lyu)*LL(jq,lyu)*exp(-KK(jq,lyu)*(UTAUPR(lu)-TAUCPR(lyu-1)));
+      }
+      if (iq <= nn) {
+        surf->dn[lu-1] += 2.*CWT(nn+1-iq)*CMU(nn+1-iq)*zint;
+      }
+      else {
+        surf->up[lu-1] += 2.*CWT(iq-nn)*CMU(iq-nn)*zint;
+      }
+    }
+  }
+
+  return;
+}
+
+/*============================= end of c_surface_response() =============*/
+
+/*============================= c_flux_jacobian() =======================*/
+
+/*
+    Calculates the derivatives of the up-flux and the total down-flux at
+    the layer boundaries with respect to the layer properties, the albedo
+    of a Lambertian surface and the level temperatures, by linearizing
+    the azimuthally-averaged (m=0) solution in the manner of Spurr (2002),
+    but in adjoint form.
+
+    At fixed constants of integration LL, the intensities at the top and
+    the bottom of layer lc depend only on the local parameters GL(l,lc),
+    DTAUCPR(lc), PKAG(lc-1) and PKAG(lc), and on the beam transmission
+    EXPBEA. Their partial derivatives follow from the perturbation of the
+    reduced eigenvalue problem of c_solve_eigen(), with
+    P = (alpha+beta)*(alpha-beta) = X diag(k^2) X^-1,
+
+       d(k^2) = diag(Q),  dX = X C,  C(i,j) = Q(i,j)/(k(j)^2-k(i)^2),
+       Q = X^-1 dP X,
+
+    where dP has rank one for each GL(l), and from those of the particular
+    solutions of c_upbeam() and c_upisot(). The derivative of a flux F is
+    then that at fixed LL minus lambda times the partial derivative of the
+    residuals R of the equations of c_set_matrix() and c_solve0(), where
+
+       CBLOCK^T lambda = dF/dLL
+
+    is solved with the factored matrix, once per flux. With jac->seed, the
+    right-hand side is instead the derivative of the sum of the fluxes
+    weighted by SEED, and one solve gives the derivatives of that sum, as
+    the reverse mode of automatic differentiation does. The derivatives with
+    respect to DTAUC, SSALB and PMOM follow from those with respect to
+    GL and DTAUCPR through the delta-M scaling of c_disort_set(). The
+    Planck function is differentiated with respect to temperature by a
+    central difference.
+
+    Reference:
+
+    Spurr, R.J.D., 2002: Simultaneous Derivation of Intensities and
+        Weighting Functions in a General Pseudo-Spherical Discrete
+        Ordinate Radiative Transfer Treatment, J. Quant. Spectrosc.
+        Radiat. Transfer 75, 129-175
+
+    I N P U T    V A R I A B L E S:
+
+       ds       :  Disort state variables
+       jac      :  Weights SEED of the fluxes, if jac->seed is not NULL
+       emi_func :  Emission function, integrated Planck function by default
+       bplanck  :  Intensity emitted from bottom boundary
+       cblock   :  Matrix of c_set_matrix(), factored by c_block_factor()
+       cmu      :  Abscissae for Gauss quadrature over angle cosine
+       cwt      :  Weights for Gauss quadrature over angle cosine
+       dtaucpr  :  Computational-layer optical depths (delta-M-scaled)
+       expbea   :  Transmission of incident beam, EXP(-TAUCPR/UMU0)
+       flyr     :  Truncated fraction in delta-M method
+       gc       :  Eigenvectors at polar quadrature angles, SC(1)
+       gl       :  Phase function Legendre coefficients multiplied by (2l+1) and single-scatter albedo
+       ipvt     :  Pivot indices of the factored matrix
+       kk       :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
+       ll       :  Constants of integration in eq. SC(1), obtained by solving scaled version of eq. SC(5)
+       lyrcut   :  Logical flag for truncation of comput. layer
+       ncol     :  Number of columns in CBLOCK
+       ncut     :  Number of computational layer where absorption optical depth exceeds ABSCUT
+       nn       :  Order of double-Gauss quadrature (NSTR/2)
+       taucpr   :  Cumulative optical depth (delta-M-scaled)
+       ylm0     :  Normalized associated Legendre polynomial at the beam angle
+       ylmc     :  Normalized associated Legendre polynomial at the quadrature angles
+       zz       :  Beam source vectors in eq. SS(19), STWL(24b)
+       xr       :  Expansion of thermal source function in eq. SS(14), STWL(24c)
+       plk      :  Thermal source vectors z0,z1 by solving eq. SS(16), Y0,Y1 in STWL(26b,a)
+
+    O U T P U T    V A R I A B L E S:
+
+       jac      :  Derivatives of the fluxes, see disort_jacobian in cdisort.h
+
+   Called by- c_disort
+   Calls- c_sgefa, c_sgesl, c_block_solve
+ -------------------------------------------------------------------*/
+
+#define JROW(iq)          ((iq) <= nn ? nn+(iq) : ds->nstr+1-(iq))
+#define TTOP(iq,c,lc)     ttop[iq-1+((c)+(lc-1)*nloc)*ds->nstr]
+#define TBOT(iq,c,lc)     tbot[iq-1+((c)+(lc-1)*nloc)*ds->nstr]
+#define WTOP(iq,lc)       wtop[iq-1+(lc-1)*ds->nstr]
+#define WBOT(iq,lc)       wbot[iq-1+(lc-1)*ds->nstr]
+#define XM(iq,jq)         xm[iq-1+(jq-1)*nn]
+#define XF(iq,jq)         xf[iq-1+(jq-1)*nn]
+#define SM(iq,jq)         sm[iq-1+(jq-1)*nn]
+#define AM(iq,jq)         am[iq-1+(jq-1)*nn]
+#define AP(iq,jq)         ap[iq-1+(jq-1)*nn]
+#define DX(iq,jq)         dx[iq-1+(jq-1)*nn]
+#define DGC(iq,jq)        dgc[iq-1+(jq-1)*ds->nstr]
+#define BA(iq,jq)         ba[iq-1+(jq-1)*ds->nstr]
+#define TA(iq,jq)         ta[iq-1+(jq-1)*ds->nstr]
+#define OUTW(iq,d)        outw[iq-1+(d)*ds->nstr]
+#define SEED(lu,d)        jac->seed[(d)+2*(lu-1)]
+#define JPROP(p,lc,q)     jac->prop[(q)+(ds->nstr+2)*(lc-1+ds->nlyr*(p))]
+#define JALB(p)           jac->albedo[p]
+#define JTEMP(p,lev)      jac->temper[(lev)+(ds->nlyr+1)*(p)]
+
+int c_flux_jacobian(disort_state    *ds,
+                    disort_jacobian *jac,
+                    emission_func_t  emi_func,
+                    double           bplanck,
+                    double          *cblock,
+                    double          *cmu,
+                    double          *cwt,
+                    double          *dtaucpr,
+                    double          *expbea,
+                    double          *flyr,
+                    double          *gc,
+                    double          *gl,
+                    int             *ipvt,
+                    double          *kk,
+                    double          *ll,
+                    int              lyrcut,
+                    int              ncol,
+                    int              ncut,
+                    int              nn,
+                    double          *taucpr,
+                    double          *ylm0,
+                    double          *ylmc,
+                    double          *zz,
+                    disort_pair     *xr,
+                    disort_pair     *plk)
+{
+  register int
+    c,d,iq,j,jq,k,l,lc,lev,lu,p;
+  int
+    info,nloc,npass,nterm,ns,top;
+  int
+    *ipx,*ipb,*ipt;
+  size_t
+    nbuf;
+  double
+    albedo,cfl,delta,dfac,dtc,dxr1,f,fbeam,om,sum,sumlb,tlo,umu0,wt,xr1;
+  double
+    *buf,*ttop,*tbot,*wtop,*wbot,*xm,*xf,*sm,*am,*ap,*dx,*dgc,*ba,*ta,
+    *lam,*alf,*bet,*dk,*dkk,*zj,*w,*v,*aa,*bb,*outw,*g,*sb,*sd,*u,*dbdt;
+  const double
+    hdt = 0.01;
+
+  ns     = ds->nstr;
+  nloc   = ns+3;
+  fbeam  = ds->bc.fbeam;
+  umu0   = ds->bc.umu0;
+  albedo = ds->bc.albedo;
+
+  npass  = jac->seed ? 1 : 2*ds->ntau;
+
+  memset(jac->prop,0,npass*ds->nlyr*(ns+2)*sizeof(double));
+  memset(jac->albedo,0,npass*sizeof(double));
+  memset(jac->temper,0,npass*(ds->nlyr+1)*sizeof(double));
+
+  /*
+   * Scratch space: the partial derivatives of the intensities at the top and the
+   * bottom of each layer with respect to GL(0..NSTR-1), DTAUCPR, PKAG(lc-1) and
+   * PKAG(lc) (columns c = 0..NSTR+2), and the vectors and matrices of one layer
+   */
+  nbuf = 2*(size_t)ncut*ns*nloc+2*(size_t)ncut*ns+6*nn*nn+3*ns*ns
+         +5*nn+8*ns+nloc+ncol+2*ncut+4+ds->nlyr+1;
+  buf  = (double *)calloc(nbuf,sizeof(double));
+  ipx  = (int *)malloc((nn+2*ns)*sizeof(int));
+  if (!buf || !ipx) {
+    c_errmsg("flux_jacobian--alloc error for scratch space",DS_WARNING);
+    free(buf);
+    free(ipx);
+    return 1;
+  }
+  ipb  = ipx+nn;
+  ipt  = ipb+ns;
+  ttop = buf;
+  tbot = ttop+ncut*ns*nloc;
+  wtop = tbot+ncut*ns*nloc;
+  wbot = wtop+ncut*ns;
+  xm   = wbot+ncut*ns;
+  xf   = xm+nn*nn;
+  sm   = xf+nn*nn;
+  am   = sm+nn*nn;
+  ap   = am+nn*nn;
+  dx   = ap+nn*nn;
+  dgc  = dx+nn*nn;
+  ba   = dgc+ns*ns;
+  ta   = ba+ns*ns;
+  lam  = ta+ns*ns;
+  alf  = lam+nn;
+  bet  = alf+nn;
+  dk   = bet+nn;
+  v    = dk+nn;
+  dkk  = v+ns;
+  zj   = dkk+ns;
+  w    = zj+ns;
+  aa   = w+ns;
+  bb   = aa+ns;
+  outw = bb+ns;
+  u    = outw+2*ns;
+  g    = u+nloc;
+  sb   = g+ncol;
+  sd   = sb+ncut+2;
+  dbdt = sd+ncut+2;
+
+  if (ds->flag.planck) {
+    /*
+     * One-sided below hdt: emi_func only ever sees temperatures >= 0, which
+     * c_check_inputs() guarantees for TEMPER
+     */
+    for (lev = 0; lev <= ds->nlyr; lev++) {
+      tlo       = MAX(TEMPER(lev)-hdt,0.);
+      dbdt[lev] = (emi_func(ds->wvnmlo,ds->wvnmhi,TEMPER(lev)+hdt)
+                  -emi_func(ds->wvnmlo,ds->wvnmhi,tlo))/(TEMPER(lev)+hdt-tlo);
+    }
+  }
+
+  cfl = 0.;
+  for (lc = 1; lc <= ncut; lc++) {
+    delta = DTAUCPR(lc);
+    xr1   = ds->flag.planck ? XR1(lc) : 0.;
+
+    /*
+     * Homogeneous solution at the top (aa) and the bottom (bb) of the layer,
+     * per eigenvector, as in c_fluxes()
+     */
+    for (jq = 1; jq <= nn; jq++) {
+      aa[jq-1] = LL(jq,lc)*exp(KK(jq,lc)*delta);
+      bb[jq-1] = LL(jq,lc);
+    }
+    for (jq = nn+1; jq <= ns; jq++) {
+      aa[jq-1] = LL(jq,lc);
+      bb[jq-1] = LL(jq,lc)*exp(-KK(jq,lc)*delta);
+    }
+
+    /*
+     * Factors alpha-beta and alpha+beta of c_solve_eigen(), the reduced eigenvectors
+     * X = (G+)-(G-) with eigenvalues k^2, and (G+)+(G-)
+     */
+    for (iq = 1; iq <= nn; iq++) {
+      for (jq = 1; jq <= nn; jq++) {
+        AM(iq,jq) = 0.;
+        AP(iq,jq) = 0.;
+        for (l = 0; l <= ns-1; l++) {
+          if (l%2) {
+            AM(iq,jq) += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
+          }
+          else {
+            AP(iq,jq) += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
+          }
+        }
+        AM(iq,jq) *= CWT(jq)/CMU(iq);
+        AP(iq,jq) *= CWT(jq)/CMU(iq);
+        XM(iq,jq)  = GC(nn+iq,nn+jq,lc)-GC(nn-iq+1,nn+jq,lc);
+        SM(iq,jq)  = GC(nn+iq,nn+jq,lc)+GC(nn-iq+1,nn+jq,lc);
+        XF(iq,jq)  = XM(iq,jq);
+      }
+      AM(iq,iq) -= 1./CMU(iq);
+      AP(iq,iq) -= 1./CMU(iq);
+      lam[iq-1]  = KK(nn+iq,lc)*KK(nn+iq,lc);
+    }
+    c_sgefa(xf,nn,nn,ipx,&info);
+
+    /*
+     * Coefficient matrices of c_upbeam() and c_upisot(), and the thermal particular
+     * solution Z0 = XR0 + XR1*W at the boundaries, W = (1-CC)^-1 CMU
+     */
+    for (iq = 1; iq <= ns; iq++) {
+      for (jq = 1; jq <= ns; jq++) {
+        sum = 0.;
+        for (l = 0; l <= ns-1; l++) {
+          sum += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
+        }
+        BA(iq,jq) = -.5*sum*CWT(jq);
+        TA(iq,jq) = -.5*sum*CWT(jq);
+      }
+      BA(iq,iq) += 1.+CMU(iq)/umu0;
+      TA(iq,iq) += 1.;
+      zj[iq-1]   = ZZ(JROW(iq),lc);
+      w[iq-1]    = CMU(iq);
+    }
+    if (fbeam > 0.) {
+      c_sgefa(ba,ns,ns,ipb,&info);
+    }
+    if (ds->flag.planck) {
+      c_sgefa(ta,ns,ns,ipt,&info);
+      c_sgesl(ta,ns,ns,ipt,w,0);
+    }
+
+    /*
+     * Columns c = l: GL(l). The derivative of alpha-beta (l odd) or alpha+beta
+     * (l even) is YLMC(l,i)*YLMC(l,j)*CWT(j)/CMU(i), so that dP = alf*bet^T
+     */
+    for (l = 0; l <= ns-1; l++) {
+      for (iq = 1; iq <= nn; iq++) {
+        if (l%2) {
+          sum = 0.;
+          for (k = 1; k <= nn; k++) {
+            sum += AP(iq,k)*YLMC(l,k)/CMU(k);
+          }
+          alf[iq-1] = sum;
+          bet[iq-1] = YLMC(l,iq)*CWT(iq);
+        }
+        else {
+          sum = 0.;
+          for (k = 1; k <= nn; k++) {
+            sum += YLMC(l,k)*CWT(k)*AM(k,iq);
+          }
+          alf[iq-1] = YLMC(l,iq)/CMU(iq);
+          bet[iq-1] = sum;
+        }
+      }
+      /*
+       * Q = (X^-1 alf)(X^T bet)^T
+       */
+      c_sgesl(xf,nn,nn,ipx,alf,0);
+      for (jq = 1; jq <= nn; jq++) {
+        sum = 0.;
+        for (iq = 1; iq <= nn; iq++) {
+          sum += bet[iq-1]*XM(iq,jq);
+        }
+        v[jq-1] = sum;
+      }
+      for (jq = 1; jq <= nn; jq++) {
+        dk[jq-1] = alf[jq-1]*v[jq-1]/(2.*KK(nn+jq,lc));
+        for (iq = 1; iq <= nn; iq++) {
+          DX(iq,jq) = 0.;
+        }
+        for (k = 1; k <= nn; k++) {
+          if (k == jq || fabs(lam[jq-1]-lam[k-1]) <= 1.e-10*(lam[jq-1]+lam[k-1])) {
+            continue;
+          }
+          dfac = alf[k-1]*v[jq-1]/(lam[jq-1]-lam[k-1]);
+          for (iq = 1; iq <= nn; iq++) {
+            DX(iq,jq) += XM(iq,k)*dfac;
+          }
+        }
+      }
+
+      /*
+       * d((G+)+(G-)) = (d(alpha-beta) X + (alpha-beta) dX)/k - ((G+)+(G-)) dk/k,
+       * and the eigenvectors of the full system as in c_solve_eigen()
+       */
+      for (jq = 1; jq <= nn; jq++) {
+        sum = 0.;
+        if (l%2) {
+          for (k = 1; k <= nn; k++) {
+            sum += YLMC(l,k)*CWT(k)*XM(k,jq);
+          }
+        }
+        for (iq = 1; iq <= nn; iq++) {
+          dfac = (l%2) ? YLMC(l,iq)/CMU(iq)*sum : 0.;
+          for (k = 1; k <= nn; k++) {
+            dfac += AM(iq,k)*DX(k,jq);
+          }
+          dfac = (dfac-SM(iq,jq)*dk[jq-1])/KK(nn+jq,lc);
+          DGC(nn+iq,  nn+jq  ) =  .5*(dfac+DX(iq,jq));
+          DGC(nn-iq+1,nn+jq  ) =  .5*(dfac-DX(iq,jq));
+          DGC(nn+iq,  nn-jq+1) = -DGC(nn-iq+1,nn+jq);
+          DGC(nn-iq+1,nn-jq+1) = -DGC(nn+iq,  nn+jq);
+        }
+        dkk[nn+jq-1] =  dk[jq-1];
+        dkk[nn-jq]   = -dk[jq-1];
+      }
+
+      for (iq = 1; iq <= ns; iq++) {
+        for (jq = 1; jq <= ns; jq++) {
+          TTOP(iq,l,lc) += DGC(iq,jq)*aa[jq-1];
+          TBOT(iq,l,lc) += DGC(iq,jq)*bb[jq-1];
+        }
+        for (jq = 1; jq <= nn; jq++) {
+          TTOP(iq,l,lc) += GC(iq,jq,lc)*aa[jq-1]*dkk[jq-1]*delta;
+        }
+        for (jq = nn+1; jq <= ns; jq++) {
+          TBOT(iq,l,lc) -= GC(iq,jq,lc)*bb[jq-1]*dkk[jq-1]*delta;
+        }
+      }
+
+      /*
+       * Particular solutions: the right-hand side of c_upbeam() and CC change by
+       * rank-one terms in YLMC(l,.)
+       */
+      if (fbeam > 0.) {
+        sum = 0.;
+        for (jq = 1; jq <= ns; jq++) {
+          sum += YLMC(l,jq)*CWT(jq)*zj[jq-1];
+        }
+        for (iq = 1; iq <= ns; iq++) {
+          v[iq-1] = YLMC(l,iq)*(fbeam*YLM0(l)/(4.*M_PI)+.5*sum);
+        }
+        c_sgesl(ba,ns,ns,ipb,v,0);
+        for (iq = 1; iq <= ns; iq++) {
+          TTOP(JROW(iq),l,lc) += v[iq-1]*EXPBEA(lc-1);
+          TBOT(JROW(iq),l,lc) += v[iq-1]*EXPBEA(lc);
+        }
+      }
+      if (ds->flag.planck) {
+        sum = 0.;
+        for (jq = 1; jq <= ns; jq++) {
+          sum += YLMC(l,jq)*CWT(jq)*w[jq-1];
+        }
+        for (iq = 1; iq <= ns; iq++) {
+          v[iq-1] = .5*YLMC(l,iq)*sum;
+        }
+        c_sgesl(ta,ns,ns,ipt,v,0);
+        for (iq = 1; iq <= ns; iq++) {
+          TTOP(JROW(iq),l,lc) += xr1*v[iq-1];
+          TBOT(JROW(iq),l,lc) += xr1*v[iq-1];
+        }
+      }
+    }
+
+    /*
+     * Column NSTR: DTAUCPR, through the exponentials and XR1
+     */
+    dxr1 = (ds->flag.planck && delta > 1.e-4) ? -xr1/delta : 0.;
+    for (iq = 1; iq <= ns; iq++) {
+      for (jq = 1; jq <= nn; jq++) {
+        TTOP(iq,ns,lc) += GC(iq,jq,lc)*aa[jq-1]*KK(jq,lc);
+      }
+      for (jq = nn+1; jq <= ns; jq++) {
+        TBOT(iq,ns,lc) -= GC(iq,jq,lc)*bb[jq-1]*KK(jq,lc);
+      }
+    }
+    for (iq = 1; iq <= ns; iq++) {
+      TTOP(JROW(iq),ns,lc) += dxr1*w[iq-1];
+      TBOT(JROW(iq),ns,lc) += dxr1*w[iq-1];
+    }
+
+    /*
+     * Columns NSTR+1 and NSTR+2: PKAG(lc-1) and PKAG(lc), through XR0 and XR1
+     */
+    if (ds->flag.planck) {
+      for (iq = 1; iq <= ns; iq++) {
+        if (delta > 1.e-4) {
+          TTOP(JROW(iq),ns+1,lc) =  1.-w[iq-1]/delta;
+          TTOP(JROW(iq),ns+2,lc) =  w[iq-1]/delta;
+          TBOT(JROW(iq),ns+1,lc) = -w[iq-1]/delta;
+          TBOT(JROW(iq),ns+2,lc) =  1.+w[iq-1]/delta;
+        }
+        else {
+          TTOP(JROW(iq),ns+1,lc) = 1.;
+          TBOT(JROW(iq),ns+1,lc) = 1.;
+        }
+      }
+    }
+
+    /*
+     * Down-flux at the bottom over 2*pi, for the albedo derivative
+     */
+    if (lc == ncut) {
+      for (iq = 1; iq <= nn; iq++) {
+        sum = ZZ(iq,lc)*EXPBEA(lc)+ZPLK0(iq,lc)+ZPLK1(iq,lc)*TAUCPR(lc);
+        for (jq = 1; jq <= ns; jq++) {
+          sum += GC(iq,jq,lc)*bb[jq-1];
+        }
+        cfl += CWT(nn+1-iq)*CMU(nn+1-iq)*sum;
+      }
+    }
+  }
+
+  /*
+   * Weights of the fluxes on the intensities at the top (d = 0 up, d = 1 down) of
+   * a layer
+   */
+  for (iq = 1; iq <= nn; iq++) {
+    OUTW(nn+iq,0) = 2.*M_PI*CWT(iq)*CMU(iq);
+    OUTW(nn+1-iq,1) = 2.*M_PI*CWT(iq)*CMU(iq);
+  }
+
+  /*
+   * One adjoint solve per flux, or a single one for the sum of the fluxes
+   * weighted by SEED; the flux at level lu is taken at the top of layer 1
+   * (lu = 1) or at the bottom of layer lu-1
+   */
+  for (p = 0; p < npass; p++) {
+    nterm = 0;
+    memset(g,0,ncol*sizeof(double));
+    memset(wtop,0,ncut*ns*sizeof(double));
+    memset(wbot,0,ncut*ns*sizeof(double));
+    memset(sd,0,(ncut+2)*sizeof(double));
+
+    for (lu = 1; lu <= ds->ntau; lu++) {
+      for (d = 0; d <= 1; d++) {
+        wt = jac->seed ? SEED(lu,d) : (p == d+2*(lu-1));
+        lev = lu-1;
+        if (wt == 0. || lev > ncut) {
+          /*
+           * No radiation reaches this level
+           */
+          continue;
+        }
+        nterm++;
+        top = (lev == 0);
+        lc  = top ? 1 : lev;
+        delta = DTAUCPR(lc);
+
+        for (jq = 1; jq <= ns; jq++) {
+          sum = 0.;
+          for (iq = 1; iq <= ns; iq++) {
+            sum += OUTW(iq,d)*GC(iq,jq,lc);
+          }
+          if (top && jq <= nn) {
+            sum *= exp(KK(jq,lc)*delta);
+          }
+          else if (!top && jq > nn) {
+            sum *= exp(-KK(jq,lc)*delta);
+          }
+          g[(lc-1)*ns+jq-1] += wt*sum;
+        }
+        for (iq = 1; iq <= ns; iq++) {
+          if (top) {
+            WTOP(iq,1) += wt*OUTW(iq,d);
+          }
+          else {
+            WBOT(iq,lev) += wt*OUTW(iq,d);
+          }
+        }
+        if (d == 1) {
+          sd[lev] += wt;
+        }
+      }
+    }
+    if (nterm == 0) {
+      continue;
+    }
+    c_block_solve(ds,cblock,ncut,nn,ipvt,g,1);
+
+    /*
+     * Weights of the intensities at the top and the bottom of each layer:
+     * the fluxes, less the residuals of the top boundary, the interfaces and
+     * the bottom boundary weighted by lambda
+     */
+    sumlb = 0.;
+    if (!lyrcut) {
+      for (iq = 1; iq <= nn; iq++) {
+        sumlb += g[ncol-nn+iq-1];
+      }
+    }
+    for (l = 1; l <= ncut; l++) {
+      for (iq = 1; iq <= ns; iq++) {
+        if (l == 1) {
+          WTOP(iq,l) += iq <= nn ? -g[nn-iq] : 0.;
+        }
+        else {
+          WTOP(iq,l) += g[nn+(l-2)*ns+iq-1];
+        }
+        if (l < ncut) {
+          WBOT(iq,l) -= g[nn+(l-1)*ns+iq-1];
+        }
+        else if (iq > nn) {
+          WBOT(iq,l) -= g[ncol-ns+iq-1];
+        }
+        else {
+          WBOT(iq,l) += 2.*albedo*CWT(nn+1-iq)*CMU(nn+1-iq)*sumlb;
+        }
+      }
+    }
+
+    /*
+     * EXPBEA(j) falls with the optical depth of all layers down to j; SB(lc)
+     * collects its weights over j >= lc
+     */
+    sb[ncut+1] = 0.;
+    for (j = ncut; j >= 1; j--) {
+      sum = 0.;
+      if (fbeam > 0.) {
+        for (iq = 1; iq <= ns; iq++) {
+          sum += WBOT(iq,j)*ZZ(iq,j);
+          if (j < ncut) {
+            sum += WTOP(iq,j+1)*ZZ(iq,j+1);
+          }
+        }
+        if (j == ncut) {
+          sum += albedo*umu0*fbeam/M_PI*sumlb;
+        }
+        sum += sd[j]*umu0*fbeam;
+      }
+      sb[j] = sb[j+1]+sum*EXPBEA(j);
+    }
+
+    for (l = 1; l <= ncut; l++) {
+      for (c = 0; c < nloc; c++) {
+        sum = 0.;
+        for (iq = 1; iq <= ns; iq++) {
+          sum += WTOP(iq,l)*TTOP(iq,c,l)+WBOT(iq,l)*TBOT(iq,c,l);
+        }
+        u[c] = sum;
+      }
+      if (fbeam > 0.) {
+        u[ns] -= sb[l]/umu0;
+      }
+
+      /*
+       * Delta-M scaling of c_disort_set(); with FLYR = 0 it is the identity
+       * and its derivative the one once PMOM(NSTR) turns it on
+       */
+      om   = SSALB(l);
+      f    = FLYR(l);
+      dtc  = DTAUC(l);
+      dfac = 1.-f*om;
+      JPROP(p,l,0) = u[ns]*dfac;
+      JPROP(p,l,1) = -u[ns]*f*dtc;
+      JPROP(p,l,ns+1) = -u[ns]*om*dtc;
+      for (k = 0; k <= ns-1; k++) {
+        JPROP(p,l,1)    += u[k]*(2*k+1)*(PMOM(k,l)-f)/(dfac*dfac);
+        JPROP(p,l,ns+1) += u[k]*(2*k+1)*om*(PMOM(k,l)*om-1.)/(dfac*dfac);
+        if (k > 0) {
+          JPROP(p,l,k+1) = u[k]*(2*k+1)*om/dfac;
+        }
+      }
+      if (ds->flag.planck) {
+        JTEMP(p,l-1) += u[ns+1]*dbdt[l-1];
+        JTEMP(p,l)   += u[ns+2]*dbdt[l];
+      }
+    }
+
+    if (!lyrcut) {
+      sum = -2.*cfl+bplanck;
+      if (fbeam > 0.) {
+        sum -= umu0*fbeam/M_PI*EXPBEA(ncut);
+      }
+      JALB(p) = -sum*sumlb;
+    }
+  }
+
+  free(buf);
+  free(ipx);
+
+  return 0;
+}
+
+#undef JROW
+#undef TTOP
+#undef TBOT
+#undef WTOP
+#undef WBOT
+#undef XM
+#undef XF
+#undef SM
+#undef AM
+#undef AP
+#undef DX
+#undef DGC
+#undef BA
+#undef TA
+#undef OUTW
+#undef SEED
+#undef JPROP
+#undef JALB
+#undef JTEMP
+
+/*============================= end of c_flux_jacobian() ================*/
+
+/*============================= c_absorption_only() =====================*/
+
+/*
+    Calculates fluxes and intensities for a purely absorbing atmosphere
+    (no layer scatters) above a Lambertian surface. Without scattering
+    the discrete-ordinate equations decouple into one equation per
+    stream, and for the thermal source XR0+XR1*TAU of eq. SS(14) each
+    has the closed-form solution
+
+       I(tau) = XR0+XR1*(tau+mu) + c*exp(-tau/mu)
+
+    The streams are swept downward from the top boundary and, after the
+    surface has reflected the downward flux, upward from the bottom.
+    The eigenvalue problem and the linear system are skipped; the
+    boundary conditions are those of c_solve0() and
+    c_user_intensities(), so results agree with the general case to
+    roundoff.
+
+    I N P U T    V A R I A B L E S:
+
+       ds       :  Disort state variables
+       bplanck  :  Intensity emitted from bottom boundary
+       tplanck  :  Intensity emitted from top boundary
+       cmu      :  Abscissae for Gauss quadrature over angle cosine
+       cwt      :  Weights for Gauss quadrature over angle cosine
+       dtaucpr  :  Computational-layer optical depths (delta-M-scaled)
+       expbea   :  Transmission of incident beam, EXP(-TAUCPR/UMU0)
+       layru    :  Layer number of user level UTAU
+       lyrcut   :  Logical flag for truncation of comput. layer
+       ncut     :  Number of computational layer where absorption optical depth exceeds ABSCUT
+       nn       :  Order of double-Gauss quadrature (NSTR/2)
+       pkag     :  Integrated Planck function at layer boundaries
+       taucpr   :  Cumulative optical depth (delta-M-scaled)
+       utaupr   :  Optical depths of user output levels in delta-M coordinates;  equal to UTAU if no delta-M
+       lev      :  Scratch space of at least (2*nn+1)*(ncut+1) doubles
+
+    O U T P U T    V A R I A B L E S:
+
+       out      :  Disort output variables
+       xr       :  Expansion of thermal source function, as in c_disort()
+       fl       :  fl[].zero: 'fldir' = direct-beam flux, fl[].one 'fldn' = diffuse down-flux
+       u0c      :  Azimuthally averaged intensities (at polar quadrature angles)
+
+   Called by- c_disort
+ -------------------------------------------------------------------*/
+
+#define LEVDN(lc,iq) lev[lc+(iq-1)*(ncut+1)]
+#define LEVUP(lc,iq) lev[lc+(nn+iq-1)*(ncut+1)]
+#define LEVU(lc)     lev[lc+2*nn*(ncut+1)]
+
+void c_absorption_only(disort_state  *ds,
+                       disort_output *out,
+                       double         bplanck,
+                       double         tplanck,
+                       double        *cmu,
+                       double        *cwt,
+                       double        *dtaucpr,
+                       double        *expbea,
+                       int           *layru,
+                       int            lyrcut,
+                       int            ncut,
+                       int            nn,
+                       double        *pkag,
+                       double        *taucpr,
+                       double        *utaupr,
+                       double        *lev,
+                       disort_pair   *xr,
+                       disort_pair   *fl,
+                       double        *u0c)
+{
+  register int
+    iq,iu,j,lc,lu,lyu;
+  double
+    bndint,dirint,fact,mu,plsorc,sum,surf;
+
+  memset(u0c,0,ds->ntau*ds->nstr*sizeof(double));
+  memset(fl,0,ds->ntau*sizeof(disort_pair));
+  memset(xr,0,ds->nlyr*sizeof(disort_pair));
+
+  /*
+   * Thermal source of each layer, as in c_disort()
+   */
+  if (ds->flag.planck) {
+    for (lc = 1; lc <= ncut; lc++) {
+      if (DTAUCPR(lc) > 1e-4) {
+        XR1(lc) = (PKAG(lc)-PKAG(lc-1))/DTAUCPR(lc);
+      }
+      XR0(lc) = PKAG(lc-1)-XR1(lc)*TAUCPR(lc-1);
+    }
+  }
+
+  /*
+   * Downward quadrature streams, from the top boundary
+   */
+  for (iq = 1; iq <= nn; iq++) {
+    mu           = CMU(iq);
+    LEVDN(0,iq)  = ds->bc.fisot+tplanck;
+    for (lc = 1; lc <= ncut; lc++) {
+      fact         = XR0(lc)-XR1(lc)*mu;
+      LEVDN(lc,iq) = fact+XR1(lc)*TAUCPR(lc)
+                    +(LEVDN(lc-1,iq)-fact-XR1(lc)*TAUCPR(lc-1))*exp(-DTAUCPR(lc)/mu);
+    }
+  }
+
+  /*
+   * Upward quadrature streams, from the bottom boundary of c_solve0()
+   */
+  surf = 0.;
+  if (!lyrcut) {
+    sum = 0.;
+    for (iq = 1; iq <= nn; iq++) {
+      sum += CWT(iq)*CMU(iq)*LEVDN(ncut,iq);
+    }
+    surf = 2.*ds->bc.albedo*sum+(1.-ds->bc.albedo)*bplanck;
+    if (ds->bc.fbeam > 0.) {
+      surf += ds->bc.albedo*ds->bc.umu0*ds->bc.fbeam/M_PI*EXPBEA(ncut);
+    }
+  }
+  for (iq = 1; iq <= nn; iq++) {
+    mu             = CMU(iq);
+    LEVUP(ncut,iq) = surf;
+    if (!lyrcut && ds->bc.fbeam > 0.) {
+      LEVUP(ncut,iq) += ds->bc.fluor;
+    }
+    for (lc = ncut; lc >= 1; lc--) {
+      fact             = XR0(lc)+XR1(lc)*mu;
+      LEVUP(lc-1,iq) = fact+XR1(lc)*TAUCPR(lc-1)
+                      +(LEVUP(lc,iq)-fact-XR1(lc)*TAUCPR(lc))*exp(-DTAUCPR(lc)/mu);
+    }
+  }
+
+  /*
+   * Intensities at user levels and fluxes; see c_fluxes()
+   */
+  for (lu = 1; lu <= ds->ntau; lu++) {
+    lyu = LAYRU(lu);
+
+    if (lyrcut && lyu > ncut) {
+      /*
+       * No radiation reaches this level
+       */
+      continue;
+    }
+
+    if (ds->bc.fbeam > 0.) {
+      fact       = exp(-UTAUPR(lu)/ds->bc.umu0);
+      RFLDIR(lu) = ds->bc.umu0*ds->bc.fbeam*exp(-UTAU(lu)/ds->bc.umu0);
+      dirint     = ds->bc.fbeam*fact;
+      FLDIR(lu)  = ds->bc.umu0*ds->bc.fbeam*fact;
+    }
+    else {
+      dirint     = 0.;
+      FLDIR(lu)  = 0.;
+      RFLDIR(lu) = 0.;
+    }
+
+    for (iq = 1; iq <= nn; iq++) {
+      mu         = CMU(nn+1-iq);
+      fact       = XR0(lyu)-XR1(lyu)*mu;
+      U0C(iq,lu) = fact+XR1(lyu)*UTAUPR(lu)
+                  +(LEVDN(lyu-1,nn+1-iq)-fact-XR1(lyu)*TAUCPR(lyu-1))
+                  *exp(-(UTAUPR(lu)-TAUCPR(lyu-1))/mu);
+      UAVG(lu)   += CWT(nn+1-iq)*U0C(iq,lu);
+      UAVGDN(lu) += CWT(nn+1-iq)*U0C(iq,lu);
+      FLDN(lu)   += CWT(nn+1-iq)*U0C(iq,lu)*mu;
+    }
+
+    for (iq = nn+1; iq <= ds->nstr; iq++) {
+      mu         = CMU(iq-nn);
+      fact       = XR0(lyu)+XR1(lyu)*mu;
+      U0C(iq,lu) = fact+XR1(lyu)*UTAUPR(lu)
+                  +(LEVUP(lyu,iq-nn)-fact-XR1(lyu)*TAUCPR(lyu))
+                  *exp(-(TAUCPR(lyu)-UTAUPR(lu))/mu);
+      UAVG(lu)   += CWT(iq-nn)*U0C(iq,lu);
+      UAVGUP(lu) += CWT(iq-nn)*U0C(iq,lu);
+      FLUP(lu)   += CWT(iq-nn)*U0C(iq,lu)*mu;
+    }
+    FLUP(lu)  *= 2.*M_PI;
+    FLDN(lu)  *= 2.*M_PI;
+    RFLDN(lu)  = FLDN(lu)+FLDIR(lu)-RFLDIR(lu);
+    UAVG(lu)   = (2.*M_PI*UAVG(lu)+dirint)/(4.*M_PI);
+    UAVGSO(lu) =  dirint / (4.*M_PI);
+    UAVGDN(lu) = (2.*M_PI*UAVGDN(lu) )/(4.*M_PI);
+    UAVGUP(lu) = (2.*M_PI*UAVGUP(lu) )/(4.*M_PI);
+    plsorc     = XR0(lyu)+XR1(lyu)*UTAUPR(lu);
+    DFDT(lu)   = (1.-SSALB(lyu))*4.*M_PI*(UAVG(lu)-plsorc);
+  }
+
+  if (ds->flag.onlyfl) {
+    for (lu = 1; lu <= ds->ntau; lu++) {
+      for (iq = 1; iq <= ds->nstr; iq++) {
+        U0U(iq,lu) = U0C(iq,lu);
+      }
+    }
+    return;
+  }
+
+  if (!ds->flag.usrang) {
+    /*
+     * User angles are the quadrature angles, see c_disort_set()
+     */
+    for (lu = 1; lu <= ds->ntau; lu++) {
+      for (iu = 1; iu <= ds->numu; iu++) {
+        U0U(iu,lu) = U0C(iu,lu);
+        for (j = 1; j <= ds->nphi; j++) {
+          UU(iu,lu,j) = U0C(iu,lu);
+        }
+      }
+    }
+    return;
+  }
+
+  /*
+   * Sweep each user angle through the layers, with the boundary conditions of
+   * c_user_intensities(); there is no azimuthal dependence
+   */
+  for (iu = 1; iu <= ds->numu; iu++) {
+    mu = fabs(UMU(iu));
+    if (UMU(iu) < 0.) {
+      LEVU(0) = ds->bc.fisot+tplanck;
+      for (lc = 1; lc <= ncut; lc++) {
+        fact     = XR0(lc)-XR1(lc)*mu;
+        LEVU(lc) = fact+XR1(lc)*TAUCPR(lc)
+                  +(LEVU(lc-1)-fact-XR1(lc)*TAUCPR(lc-1))*exp(-DTAUCPR(lc)/mu);
+      }
+    }
+    else {
+      LEVU(ncut) = 0.;
+      if (!lyrcut) {
+        LEVU(ncut) = surf+ds->bc.fluor;
+      }
+      for (lc = ncut; lc >= 1; lc--) {
+        fact       = XR0(lc)+XR1(lc)*mu;
+        LEVU(lc-1) = fact+XR1(lc)*TAUCPR(lc-1)
+                    +(LEVU(lc)-fact-XR1(lc)*TAUCPR(lc))*exp(-DTAUCPR(lc)/mu);
+      }
+    }
+
+    for (lu = 1; lu <= ds->ntau; lu++) {
+      lyu = LAYRU(lu);
+      if (lyrcut && lyu > ncut) {
+        U0U(iu,lu) = 0.;
+        continue;
+      }
+      if (UMU(iu) < 0.) {
+        fact   = XR0(lyu)-XR1(lyu)*mu;
+        bndint = (LEVU(lyu-1)-fact-XR1(lyu)*TAUCPR(lyu-1))*exp(-(UTAUPR(lu)-TAUCPR(lyu-1))/mu);
+      }
+      else {
+        fact   = XR0(lyu)+XR1(lyu)*mu;
+        bndint = (LEVU(lyu)-fact-XR1(lyu)*TAUCPR(lyu))*exp(-(TAUCPR(lyu)-UTAUPR(lu))/mu);
+      }
+      U0U(iu,lu) = fact+XR1(lyu)*UTAUPR(lu)+bndint;
+      for (j = 1; j <= ds->nphi; j++) {
+        UU(iu,lu,j) = U0U(iu,lu);
+      }
+    }
+  }
+
+  return;
+}
+
+#undef LEVDN
+#undef LEVUP
+#undef LEVU
+
+/*============================= end of c_absorption_only() ==============*/
+
+/*============================= c_intensity_correction() ================*/
+
+/*
+       Corrects intensity field by using Nakajima-Tanaka algorithm
+       (1988). For more details, see Section 3.6 of STWL NASA report.
+                I N P U T   V A R I A B L E S
+
+       ds      Disort state variables
+       dither  small multiple of machine precision
+       flyr    separated fraction in delta-M method
+       layru   index of UTAU in multi-layered system
+       lyrcut  logical flag for truncation of computational layer
+       ncut    total number of computational layers considered
+       oprim   delta-M-scaled single-scatter albedo
+       phirad  azimuthal angles in radians
+       tauc    optical thickness at computational levels
+       taucpr  delta-M-scaled optical thickness
+       utaupr  delta-M-scaled version of UTAU
+
+                O U T P U T   V A R I A B L E S
+
+       out->UU  corrected intensity field; UU(IU,LU,J)
+                 iu=1,ds->numu; lu=1,ds->ntau; j=1,ds->nphi
+
+                I N T E R N A L   V A R I A B L E S
+
+       ctheta  cosine of scattering angle
+       dtheta  angle (degrees) to define aureole region as
+                    direction of beam source +/- DTHETA
+       phasa   actual (exact) phase function
+       phasm   delta-M-scaled phase function
+       phast   phase function used in TMS correction; actual phase
+                    function divided by (1-FLYR*SSALB)
+       pl      ordinary Legendre polynomial of degree l, P-sub-l
+       plm1    ordinary Legendre polynomial of degree l-1, P-sub-(l-1)
+       plm2    ordinary Legendre polynomial of degree l-2, P-sub-(l-2)
+       theta0  incident zenith angle (degrees)
+       thetap  emergent angle (degrees)
+       ussndm  single-scattered intensity computed by using exact
+                   phase function and scaled optical depth
+                   (first term in STWL(68a))
+       ussp    single-scattered intensity from delta-M method
+                   (second term in STWL(68a))
+       duims   intensity correction term from IMS method
+                   (delta-I-sub-IMS in STWL(A.19))
+
+   Called by- c_disort
+   Calls- c_single_scat, c_secondary_scat
+ -------------------------------------------------------------------*/
+
+void c_intensity_correction(disort_state  *ds,
+                            disort_output *out,
+                            double         dither,
+                            double        *flyr,
+                            int           *layru,
+                            int            lyrcut,
+                            int            ncut,
+                            double        *oprim,
+                            double        *phasa,
+                            double        *phast,
+                            double        *phasm,
+                            double        *phirad,
+                            double        *tauc,
+                            double        *taucpr,
+                            double        *utaupr)
+{
+  register int
+    iu,jp,k,lc,ltau,lu;
+  double
+    ctheta,dtheta,duims,pl,plm1,plm2,
+    theta0=0,thetap=0,ussndm,ussp;
+
+  dtheta = 10.;
+
+  /*
+   * Start loop over zenith angles
+   */
+  for (iu = 1; iu <= ds->numu; iu++) {
+    if (UMU(iu) < 0.) {
+      /*
+       * Calculate zenith angles of incident and emerging directions
+       */
+      theta0 = acos(-ds->bc.umu0)/DEG;
+      thetap = acos(UMU(iu))/DEG;
+    }
+    /*
+     * Start loop over azimuth angles
+     */
+    for (jp = 1; jp <= ds->nphi; jp++) {
+      /*
+       * Calculate cosine of scattering angle, eq. STWL(4)
+       */
+      ctheta = -ds->bc.umu0*UMU(iu)+sqrt((1.-SQR(ds->bc.umu0))*(1.-SQR(UMU(iu))))*cos(PHIRAD(jp));
+       /*
+        * Initialize phase function                              
+        */
+      for (lc = 1; lc <= ncut; lc++) {
+        PHASA(lc) = 1.;
+        PHASM(lc) = 1.;
+      }
+      /*
+       * Initialize Legendre poly. recurrence
+       */
+
+      plm1 = 1.;
+      plm2 = 0.;
+      for (k = 1; k <= ds->nmom; k++) {
+        /*
+         * Calculate Legendre polynomial of P-sub-l by upward recurrence
+         */
+        pl   = ((double)(2*k-1)*ctheta*plm1-(double)(k-1)*plm2)/k;
+        plm2 = plm1;
+        plm1 = pl;
+
+        /*
+         * Calculate actual phase function
+         */
+        for (lc = 1; lc <= ncut; lc++) {
+          PHASA(lc) += (double)(2*k+1)*pl*PMOM(k,lc);
+        }
+        /*
          * Calculate delta-M transformed phase function
          */
         if (k <= ds->nstr-1) {
@@ -3464,6 +5576,7 @@ double calc_phase_squared (int           nphase,
     I N P U T  V A R I A B L E S
 
        ds         Disort state variables
+       tab        Shared tables for ds->nstr, see c_disort_tables_alloc(), or NULL
        deltam
        tauc
 
@@ -3477,7 +5590,8 @@ double calc_phase_squared (int           nphase,
        ds->numu
        ds->umu
   
-       cmu,cwt     computational polar angles and corresponding quadrature weights
+       cmu,cwt     computational polar angles and corresponding quadrature weights,
+                   copied from tab if given
        dtaucpr
        expbea      transmission of direct beam
        flyr        separated fraction in delta-m method
@@ -3495,26 +5609,27 @@ double calc_phase_squared (int           nphase,
 
  ---------------------------------------------------------------------*/
 
-void c_disort_set(disort_state *ds,
-                  double       *ch,
-                  double       *chtau,
-                  double       *cmu,
-                  double       *cwt,
-                  int           deltam,
-                  double       *dtaucpr,
-                  double       *expbea,
-                  double       *flyr,
-                  double       *gl,
-                  int          *layru,
-                  int          *lyrcut,
-                  int          *ncut,
-                  int          *nn,
-                  int          *corint,
-                  double       *oprim,
-                  double       *tauc,
-                  double       *taucpr,
-                  double       *utaupr,
-                  emission_func_t emi_func)
+void c_disort_set(disort_state        *ds,
+                  disort_tables const *tab,
+                  double              *ch,
+                  double              *chtau,
+                  double              *cmu,
+                  double              *cwt,
+                  int                  deltam,
+                  double              *dtaucpr,
+                  double              *expbea,
+                  double              *flyr,
+                  double              *gl,
+                  int                 *layru,
+                  int                 *lyrcut,
+                  int                 *ncut,
+                  int                 *nn,
+                  int                 *corint,
+                  double              *oprim,
+                  double              *tauc,
+                  double              *taucpr,
+                  double              *utaupr,
+                  emission_func_t      emi_func)
 {
   register int
     iq,iu,k,lc,lu;
@@ -3641,7 +5756,13 @@ void c_disort_set(disort_state *ds,
    * quadrature on the interval (0,1) (upward)
    */
   *nn = ds->nstr/2;
-  c_gaussian_quadrature(*nn,cmu,cwt);
+  if (tab) {
+    memcpy(cmu,tab->cmu,*nn*sizeof(double));
+    memcpy(cwt,tab->cwt,*nn*sizeof(double));
+  }
+  else {
+    c_gaussian_quadrature(*nn,cmu,cwt);
+  }
 
   /*
    * Downward (neg) angles and weights
@@ -3683,243 +5804,601 @@ void c_disort_set(disort_state *ds,
     for (iu = 1; iu <= ds->numu/2; iu++) {
       UMU(iu+ds->numu/2) = UMU(iu);
     }
-    for (iu = 1; iu <= ds->numu/2; iu++) {
-      UMU(iu) = -UMU((ds->numu/2)+1-iu);
+    for (iu = 1; iu <= ds->numu/2; iu++) {
+      UMU(iu) = -UMU((ds->numu/2)+1-iu);
+    }
+  }
+
+  return;
+}
+
+/*============================= end of c_disort_set() ===================*/
+
+/*============================= c_set_matrix() ==========================*/
+
+/*
+    Calculate coefficient matrix for the set of equations obtained from the
+    boundary conditions and the continuity-of-intensity-at-layer-interface equations.
+
+    Store in the block form required by c_block_factor()
+
+
+    I N P U T      V A R I A B L E S:
+
+       ds       :  Disort state variables
+       bdr      :  surface bidirectional reflectivity
+       cmu,cwt  :  abscissae, weights for Gauss quadrature over angle cosine
+       delm0    :  Kronecker delta, delta-sub-m0
+       gc       :  Eigenvectors at polar quadrature angles, SC(1)
+       kk       :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
+       lyrcut   :  Logical flag for truncation of computational layers
+       nn       :  Number of streams in a hemisphere (NSTR/2)
+       ncut     :  Total number of computational layers considered
+       taucpr   :  Cumulative optical depth (delta-M-scaled)
+
+   O U T P U T     V A R I A B L E S:
+
+       cblock   :  Left-hand side matrix of linear system eq. SC(5), scaled by eq. SC(12);
+                   in block form required by c_block_factor()
+       ncol     :  Number of columns (and rows) of the linear system
+
+
+   I N T E R N A L    V A R I A B L E S:
+
+       wk       :  Temporary storage for EXP evaluations
+
+
+   BLOCK STORAGE
+
+      The unknowns are the NSTR constants of integration of each layer,
+      and the equations are the NN top boundary conditions, the NSTR
+      continuity conditions at each layer interface, and the NN bottom
+      boundary conditions, in this order. Rows NSTR*(lc-1)+1 through
+      NSTR*(lc-1)+3*NN then only involve the unknowns of layers lc and
+      lc+1, and are stored in block lc, CBLOCK(1..3*NN,1..4*NN,lc):
+
+          block lc    columns of layer lc    columns of layer lc+1
+
+          1..NN       (*)                    0
+          NN+1..3*NN  interface lc           interface lc
+
+      (*) top boundary condition if lc = 1, otherwise zero; filled in
+          with the rows left over from block lc-1 by c_block_factor().
+
+      The last block holds the bottom boundary condition in rows
+      NN+1..2*NN instead, and has no columns of layer lc+1:
+
+          1..NN       (*)
+          NN+1..2*NN  bottom boundary
+
+   Called by- c_disort, c_albtrans
+ -------------------------------------------------------------------*/
+
+void c_set_matrix(disort_state *ds,
+                  double       *bdr,
+                  double       *cblock,
+                  double       *cmu,
+                  double       *cwt,
+                  double        delm0,
+                  double       *dtaucpr,
+                  double       *gc,
+                  double       *kk,
+                  int           lyrcut,
+                  int          *ncol,
+                  int           ncut,
+                  double       *taucpr,
+                  double       *wk)
+{
+  int
+    nn = ds->nstr/2;
+  register int
+    iq,jq,k,lc;
+  double
+    expa,sum;
+
+  memset(cblock,0,12*nn*nn*ncut*sizeof(double));
+
+  *ncol = ncut*ds->nstr;
+
+  /*
+   * Use continuity conditions of eq. STWJ(17) to form coefficient matrix in STWJ(20);
+   * employ scaling transformation STWJ(22)
+   */
+  for (lc = 1; lc <= ncut; lc++) {
+    for (iq = 1; iq <= nn; iq++) {
+      WK(iq) = exp(KK(iq,lc)*DTAUCPR(lc));
+    }
+    for (iq = 1; iq <= nn; iq++) {
+      for (jq = 1; jq <= ds->nstr; jq++) {
+        if (lc < ncut) {
+          CBLOCK(nn+jq,iq,lc) = GC(jq,iq,lc);
+        }
+        if (lc > 1) {
+          CBLOCK(nn+jq,ds->nstr+iq,lc-1) = -GC(jq,iq,lc)*WK(iq);
+        }
+      }
+    }
+
+    for (iq = nn+1; iq <= ds->nstr; iq++) {
+      for (jq = 1; jq <= ds->nstr; jq++) {
+        if (lc < ncut) {
+          CBLOCK(nn+jq,iq,lc) = GC(jq,iq,lc)*WK(ds->nstr+1-iq);
+        }
+        if (lc > 1) {
+          CBLOCK(nn+jq,ds->nstr+iq,lc-1) = -GC(jq,iq,lc);
+        }
+      }
+    }
+  }
+
+  /*
+   * Use top boundary condition of STWJ(20a) for first layer
+   */
+  for (iq = 1; iq <= nn; iq++) {
+    expa = exp(KK(iq,1)*TAUCPR(1));
+    for (jq = nn; jq >= 1; jq--) {
+      CBLOCK(nn+1-jq,iq,1) = GC(jq,iq,1)*expa;
+    }
+  }
+
+  for (iq = nn+1; iq <=ds->nstr; iq++) {
+    for (jq = nn; jq >= 1; jq--) {
+      CBLOCK(nn+1-jq,iq,1) = GC(jq,iq,1);
+    }
+  }
+
+  /*
+   * Use bottom boundary condition of STWJ(20c) for last layer
+   */
+  for (iq = 1; iq <= nn; iq++) {
+    for (jq = nn+1; jq <= ds->nstr; jq++) {
+      if (lyrcut || ( ds->flag.lamber && delm0 == 0. ) ) {
+        /*
+         * No azimuthal-dependent intensity if Lambert surface; 
+         * no intensity component if truncated bottom layer
+         */
+        CBLOCK(jq,iq,ncut) = GC(jq,iq,ncut);
+      }
+      else {
+        sum = 0.;
+        for (k = 1; k <= nn; k++) {
+          sum += CWT(k)*CMU(k)*BDR(jq-nn,k)*GC(nn+1-k,iq,ncut);
+        }
+        CBLOCK(jq,iq,ncut) = GC(jq,iq,ncut)-(1.+delm0)*sum;
+      }
+    }
+  }
+
+  for (iq = nn+1; iq <= ds->nstr; iq++) {
+    expa = WK(ds->nstr+1-iq);
+    for (jq = nn+1; jq <= ds->nstr; jq++) {
+      if (lyrcut || (ds->flag.lamber && delm0 == 0.)) {
+        CBLOCK(jq,iq,ncut) = GC(jq,iq,ncut)*expa;
+      }
+      else {
+        sum = 0.;
+        for (k = 1; k <= nn; k++) {
+          sum += CWT(k)*CMU(k)*BDR(jq-nn,k)*GC(nn+1-k,iq,ncut);
+        }
+        CBLOCK(jq,iq,ncut) = (GC(jq,iq,ncut)-(1.+delm0)*sum)*expa;
+      }
+    }
+  }
+
+  return;
+}
+
+/*============================= end of c_set_matrix() ===================*/
+
+/*============================= c_block_factor() ========================*/
+
+/*
+    L-U decompose the coefficient matrix set up by c_set_matrix(), using
+    Gaussian elimination with partial pivoting that only ever touches
+    the non-zero blocks of the matrix, and optionally estimate its
+    condition.
+
+    The boundary and continuity equations couple the 2*NN coefficients of
+    a layer only to those of the layers above and below, so that rows
+    NSTR*(lc-1)+1 to NSTR*(lc-1)+3*NN of the matrix have non-zeros in the
+    columns of layers lc and lc+1 only. Eliminating the 2*NN columns of
+    layer lc among these 3*NN rows leaves NN rows with non-zeros in the
+    columns of layer lc+1 only, which become the first NN rows of the
+    next block. Pivoting never leaves a block, so each block is a dense
+    3*NN x 4*NN matrix and there is no fill-in outside of it.
+
+    The condition estimate follows Hager (1984) and Higham (1988): it
+    maximizes ||A^-1 x||_1 over ||x||_1 = 1 with a few solves with A and
+    its transpose, at the cost of up to ten solves.
+
+    References:
+
+    Hager, W.W., 1984: Condition Estimates, SIAM J. Sci. Stat. Comput.
+        5, 311-316
+    Higham, N.J., 1988: FORTRAN Codes for Estimating the One-Norm of a
+        Real or Complex Matrix, with Applications to Condition
+        Estimation, ACM Trans. Math. Softw. 14, 381-396
+
+   I N P U T      V A R I A B L E S:
+
+       ds       :  Disort state variables
+       cblock   :  Coefficient matrix from c_set_matrix()
+       ncut     :  Total number of computational layers considered
+       nn       :  Number of streams in a hemisphere (NSTR/2)
+
+   O U T P U T     V A R I A B L E S:
+
+       cblock   :  Multipliers and upper triangular factor, for c_block_solve()
+       ipvt     :  Pivot indices, relative to the first row of each block
+       rcond    :  Estimate of the reciprocal condition of the matrix in
+                   the 1-norm, or 0 if it is exactly singular; not
+                   computed if rcond is NULL
+
+   S C R A T C H   V A R I A B L E S:
+
+       z        :  Work vector for the condition estimate (dimension NSTR*NCUT)
+
+   Called by- c_disort, c_albtrans
+   Calls- c_block_solve
+ -------------------------------------------------------------------*/
+
+void c_block_factor(disort_state *ds,
+                    double       *cblock,
+                    int           ncut,
+                    int           nn,
+                    int          *ipvt,
+                    double       *rcond,
+                    double       *z)
+{
+  const int
+    maxit = 5;
+  int
+    info,iter,jlast,n,ncblk,nrblk;
+  register int
+    i,j,l,lc,off;
+  int
+    k;
+#if defined(DISORT_USE_LAPACK)
+  int
+    ldc;
+#endif
+  double
+    anorm,est,sum,t,ztx;
+
+  n    = ncut*ds->nstr;
+  info = 0;
+#if defined(DISORT_USE_LAPACK)
+  ldc  = 3*nn;
+#endif
+
+  /*
+   * 1-norm of the matrix, before it is overwritten: sum the columns of
+   * layer lc over block lc and the rows of block lc-1 that reach them
+   */
+  anorm = 0.;
+  if (rcond) {
+    for (lc = 1; lc <= ncut; lc++) {
+      nrblk = (lc < ncut) ? 3*nn : 2*nn;
+      for (j = 1; j <= ds->nstr; j++) {
+        sum = 0.;
+        for (i = 1; i <= nrblk; i++) {
+          sum += fabs(CBLOCK(i,j,lc));
+        }
+        if (lc > 1) {
+          for (i = nn+1; i <= 3*nn; i++) {
+            sum += fabs(CBLOCK(i,ds->nstr+j,lc-1));
+          }
+        }
+        anorm = MAX(anorm,sum);
+      }
+    }
+  }
+
+  for (lc = 1; lc <= ncut; lc++) {
+    off   = (lc-1)*ds->nstr;
+    nrblk = (lc < ncut) ? 3*nn : 2*nn;
+    ncblk = (lc < ncut) ? 4*nn : 2*nn;
+#if defined(DISORT_USE_LAPACK)
+    if (ds->nstr >= DISORT_LAPACK_MIN_BLOCK) {
+      /*
+       * L-U decompose the columns of layer lc, with the rows exchanged
+       * across the whole block; then U and the rows left over in the
+       * columns of layer lc+1
+       */
+      dgetrf_(&nrblk,&ds->nstr,&CBLOCK(1,1,lc),&ldc,&IPVT(off+1),&k);
+      if (k > 0 && info == 0) {
+        info = off+k;
+      }
+      if (lc < ncut) {
+        dlaswp_(&ds->nstr,&CBLOCK(1,ds->nstr+1,lc),&ldc,&c_blas_inc,
+                &ds->nstr,&IPVT(off+1),&c_blas_inc);
+        dtrsm_("L","L","N","U",&ds->nstr,&ds->nstr,&c_blas_one,
+               &CBLOCK(1,1,lc),&ldc,&CBLOCK(1,ds->nstr+1,lc),&ldc,1,1,1,1);
+        dgemm_("N","N",&nn,&ds->nstr,&ds->nstr,&c_blas_mone,
+               &CBLOCK(ds->nstr+1,1,lc),&ldc,&CBLOCK(1,ds->nstr+1,lc),&ldc,
+               &c_blas_one,&CBLOCK(ds->nstr+1,ds->nstr+1,lc),&ldc,1,1);
+      }
+    }
+    else
+#endif
+    for (j = 1; j <= ds->nstr; j++) {
+      /*
+       * Find pivot among the remaining rows of the block
+       */
+      l = j;
+      for (i = j+1; i <= nrblk; i++) {
+        if (fabs(CBLOCK(i,j,lc)) > fabs(CBLOCK(l,j,lc))) {
+          l = i;
+        }
+      }
+      IPVT(off+j) = l;
+      if (CBLOCK(l,j,lc) == 0.) {
+        info = off+j;
+        continue;
+      }
+      if (l != j) {
+        for (k = j; k <= ncblk; k++) {
+          t              = CBLOCK(l,k,lc);
+          CBLOCK(l,k,lc) = CBLOCK(j,k,lc);
+          CBLOCK(j,k,lc) = t;
+        }
+      }
+      /*
+       * Compute (negative) multipliers and eliminate column j
+       */
+      t = -1./CBLOCK(j,j,lc);
+      for (i = j+1; i <= nrblk; i++) {
+        CBLOCK(i,j,lc) *= t;
+      }
+      for (k = j+1; k <= ncblk; k++) {
+        t = CBLOCK(j,k,lc);
+        if (t != 0.) {
+          for (i = j+1; i <= nrblk; i++) {
+            CBLOCK(i,k,lc) += t*CBLOCK(i,j,lc);
+          }
+        }
+      }
+    }
+    /*
+     * Rows left over from the elimination carry over to the next block
+     */
+    if (lc < ncut) {
+      for (k = 1; k <= ds->nstr; k++) {
+        for (i = 1; i <= nn; i++) {
+          CBLOCK(i,k,lc+1) = CBLOCK(2*nn+i,ds->nstr+k,lc);
+        }
+      }
+    }
+  }
+
+  if (!rcond) {
+    return;
+  }
+  if (info != 0 || anorm == 0.) {
+    *rcond = 0.;
+    return;
+  }
+
+  /*
+   * Estimate the 1-norm of the inverse, starting from x = (1/n,...,1/n)
+   */
+  est   = 0.;
+  jlast = 0;
+  for (iter = 1; iter <= maxit; iter++) {
+    for (i = 1; i <= n; i++) {
+      Z(i) = (jlast == 0) ? 1./n : (i == jlast ? 1. : 0.);
+    }
+    c_block_solve(ds,cblock,ncut,nn,ipvt,z,0);
+    sum = 0.;
+    for (i = 1; i <= n; i++) {
+      sum += fabs(Z(i));
+    }
+    if (iter > 1 && sum <= est) {
+      break;
+    }
+    est = sum;
+    for (i = 1; i <= n; i++) {
+      Z(i) = (Z(i) >= 0.) ? 1. : -1.;
+    }
+    c_block_solve(ds,cblock,ncut,nn,ipvt,z,1);
+    l   = 1;
+    ztx = 0.;
+    for (i = 1; i <= n; i++) {
+      if (fabs(Z(i)) > fabs(Z(l))) {
+        l = i;
+      }
+      ztx += Z(i);
+    }
+    ztx = (jlast == 0) ? ztx/n : Z(jlast);
+    if (fabs(Z(l)) <= ztx || l == jlast) {
+      break;
     }
+    jlast = l;
   }
 
+  *rcond = 1./(anorm*est);
+
   return;
 }
 
-/*============================= end of c_disort_set() ===================*/
+/*============================= end of c_block_factor() =================*/
 
-/*============================= c_set_matrix() ==========================*/
+/*============================= c_block_solve() =========================*/
 
 /*
-    Calculate coefficient matrix for the set of equations obtained from the
-    boundary conditions and the continuity-of-intensity-at-layer-interface equations.
-
-    Store in the special banded-matrix format required by LINPACK routines
+    Solve the linear system A*x = b (job = 0) or trans(A)*x = b (job != 0)
+    with the coefficient matrix A L-U decomposed by c_block_factor(). The
+    factorization may be reused for any number of right-hand sides.
 
-
-    I N P U T      V A R I A B L E S:
+   I N P U T      V A R I A B L E S:
 
        ds       :  Disort state variables
-       bdr      :  surface bidirectional reflectivity
-       cmu,cwt  :  abscissae, weights for Gauss quadrature over angle cosine
-       delm0    :  Kronecker delta, delta-sub-m0
-       gc       :  Eigenvectors at polar quadrature angles, SC(1)
-       kk       :  Eigenvalues of coeff. matrix in eq. SS(7), STWL(23b)
-       lyrcut   :  Logical flag for truncation of computational layers
-       nn       :  Number of streams in a hemisphere (NSTR/2)
+       cblock   :  Factorization from c_block_factor()
        ncut     :  Total number of computational layers considered
-       taucpr   :  Cumulative optical depth (delta-M-scaled)
+       nn       :  Number of streams in a hemisphere (NSTR/2)
+       ipvt     :  Pivot indices from c_block_factor()
+       b        :  Right-hand side vector (dimension NSTR*NCUT)
+       job      :  0 to solve A*x = b, otherwise trans(A)*x = b
 
    O U T P U T     V A R I A B L E S:
 
-       cband    :  Left-hand side matrix of linear system eq. SC(5), scaled by eq. SC(12); 
-                   in banded form required by LINPACK solution routines
-       ncol     :  Number of columns in cband
-
-
-   I N T E R N A L    V A R I A B L E S:
-
-       irow     :  Points to row in CBAND
-       jcol     :  Points to position in layer block
-       lda      :  Row dimension of CBAND
-       ncd      :  Number of diagonals below or above main diagonal
-       nshift   :  For positioning number of rows in band storage
-       wk       :  Temporary storage for EXP evaluations
-
-
-   BAND STORAGE
-
-      LINPACK requires band matrices to be input in a special
-      form where the elements of each diagonal are moved up or
-      down (in their column) so that each diagonal becomes a row.
-      (The column locations of diagonal elements are unchanged.)
-
-      Example:  if the original matrix is
-
-          11 12 13  0  0  0
-          21 22 23 24  0  0
-           0 32 33 34 35  0
-           0  0 43 44 45 46
-           0  0  0 54 55 56
-           0  0  0  0 65 66
-
-      then its LINPACK input form would be:
-
-           *  *  *  +  +  +  , * = not used
-           *  * 13 24 35 46  , + = used for pivoting
-           * 12 23 34 45 56
-          11 22 33 44 55 66
-          21 32 43 54 65  *
-
-      If A is a band matrix, the following program segment
-      will convert it to the form (ABD) required by LINPACK
-      band-matrix routines:
-
-        n  = (column dimension of a, abd)
-        ml = (band width below the diagonal)
-        mu = (band width above the diagonal)
-        m = ml+mu+1;
-        for (j = 1; j <= n; j++) {
-          i1 = IMAX(1,j-mu);
-          i2 = IMIN(n,j+ml);
-          for (i = i1; i <= i2; i++) {
-            k = i-j+m;
-            ABD(k,j) = A(i,j);
-          }
-        }
+       b        :  Solution vector x
 
-      This uses rows  ml+1 through  2*ml+mu+1  of ABD.
-      The total number of rows needed in ABD is 2*ml+mu+1.
-      In the example above, n = 6, ml = 1, mu = 2, and the
-      row dimension of ABD must be >= 5.
-
-   Called by- c_disort, c_albtrans
+   Called by- c_block_factor, c_solve0, c_solve1
  -------------------------------------------------------------------*/
 
-void c_set_matrix(disort_state *ds,
-                  double       *bdr,
-                  double       *cband,
-                  double       *cmu,
-                  double       *cwt,
-                  double        delm0,
-                  double       *dtaucpr,
-                  double       *gc,
-                  double       *kk,
-                  int           lyrcut,
-                  int          *ncol,
-                  int           ncut,
-                  double       *taucpr,
-                  double       *wk)
+void c_block_solve(disort_state *ds,
+                   double       *cblock,
+                   int           ncut,
+                   int           nn,
+                   int          *ipvt,
+                   double       *b,
+                   int           job)
 {
-  int
-    mi     = ds->nstr/2,
-    mi9m2  = 9*mi-2,
-    nnlyri = ds->nstr*ds->nlyr,
-    nn     = ds->nstr/2;
   register int
-    iq,irow,jcol,jq,k,lc,lda,ncd,nncol,nshift;
+    i,j,l,lc,nrblk,off;
   double
-    expa,sum;
-
-  memset(cband,0,mi9m2*nnlyri*sizeof(double));
-
-  ncd    = 3*nn-1;
-  lda    = 3*ncd+1;
-  nshift = lda-2*ds->nstr+1;
-  *ncol  = 0;
+    t;
+#if defined(DISORT_USE_LAPACK)
+  int
+    lapack;
 
   /*
-   * Use continuity conditions of eq. STWJ(17) to form coefficient matrix in STWJ(20);
-   * employ scaling transformation STWJ(22)
+   * Factors in LAPACK form: the row exchanges of a block apply to all of
+   * its columns, and the multipliers are not negated
    */
-  for (lc = 1; lc <= ncut; lc++) {
-    for (iq = 1; iq <= nn; iq++) {
-      WK(iq) = exp(KK(iq,lc)*DTAUCPR(lc));
-    }
-    jcol = 0;
-    for (iq = 1; iq <= nn; iq++) {
-      *ncol += 1;
-      irow   = nshift-jcol;
-      for (jq = 1; jq <= ds->nstr; jq++) {
-        CBAND(irow+ds->nstr,*ncol) =  GC(jq,iq,lc);
-        CBAND(irow,         *ncol) = -GC(jq,iq,lc)*WK(iq);
-        irow++;
-      }
-      jcol++;
-    }
+  lapack = ds->nstr >= DISORT_LAPACK_MIN_BLOCK;
+#endif
 
-    for (iq = nn+1; iq <= ds->nstr; iq++) {
-      *ncol += 1;
-      irow = nshift-jcol;
-      for (jq = 1; jq <= ds->nstr; jq++) {
-        CBAND(irow+ds->nstr,*ncol) =  GC(jq,iq,lc)*WK(ds->nstr+1-iq);
-        CBAND(irow,         *ncol) = -GC(jq,iq,lc);
-        irow++;
+  if (job == 0) {
+    /*
+     * Solve L*y = b, block by block from the top
+     */
+    for (lc = 1; lc <= ncut; lc++) {
+      off   = (lc-1)*ds->nstr;
+      nrblk = (lc < ncut) ? 3*nn : 2*nn;
+#if defined(DISORT_USE_LAPACK)
+      if (lapack) {
+        for (j = 1; j <= ds->nstr; j++) {
+          l = IPVT(off+j);
+          if (l != j) {
+            t        = B(off+l);
+            B(off+l) = B(off+j);
+            B(off+j) = t;
+          }
+        }
+        for (j = 1; j <= ds->nstr; j++) {
+          t = B(off+j);
+          for (i = j+1; i <= nrblk; i++) {
+            B(off+i) -= t*CBLOCK(i,j,lc);
+          }
+        }
+        continue;
+      }
+#endif
+      for (j = 1; j <= ds->nstr; j++) {
+        l = IPVT(off+j);
+        t = B(off+l);
+        if (l != j) {
+          B(off+l) = B(off+j);
+          B(off+j) = t;
+        }
+        for (i = j+1; i <= nrblk; i++) {
+          B(off+i) += t*CBLOCK(i,j,lc);
+        }
       }
-      jcol++;
-    }
-  }
-
-  /*
-   * Use top boundary condition of STWJ(20a) for first layer
-   */
-  jcol = 0;
-  for (iq = 1; iq <= nn; iq++) {
-    expa = exp(KK(iq,1)*TAUCPR(1));
-    irow = nshift-jcol+nn;
-    for (jq = nn; jq >= 1; jq--) {
-      CBAND(irow,jcol+1) = GC(jq,iq,1)*expa;
-      irow++;
     }
-    jcol++;
-  }
-
-  for (iq = nn+1; iq <=ds->nstr; iq++) {
-    irow = nshift-jcol+nn;
-    for (jq = nn; jq >= 1; jq--) {
-      CBAND(irow,jcol+1) = GC(jq,iq,1);
-      irow++;
+    /*
+     * Solve U*x = y, block by block from the bottom
+     */
+    for (lc = ncut; lc >= 1; lc--) {
+      off = (lc-1)*ds->nstr;
+      if (lc < ncut) {
+        for (l = 1; l <= ds->nstr; l++) {
+          t = B(off+ds->nstr+l);
+          for (i = 1; i <= ds->nstr; i++) {
+            B(off+i) -= t*CBLOCK(i,ds->nstr+l,lc);
+          }
+        }
+      }
+      for (j = ds->nstr; j >= 1; j--) {
+        B(off+j) /= CBLOCK(j,j,lc);
+        t = -B(off+j);
+        for (i = 1; i <= j-1; i++) {
+          B(off+i) += t*CBLOCK(i,j,lc);
+        }
+      }
     }
-    jcol++;
   }
-
-  /*
-   * Use bottom boundary condition of STWJ(20c) for last layer
-   */
-  nncol = *ncol-ds->nstr;
-  jcol  = 0;
-  for (iq = 1; iq <= nn; iq++) {
-    nncol++;
-    irow = nshift-jcol+ds->nstr;
-    for (jq = nn+1; jq <= ds->nstr; jq++) {
-      if (lyrcut || ( ds->flag.lamber && delm0 == 0. ) ) {
-        /*
-         * No azimuthal-dependent intensity if Lambert surface; 
-         * no intensity component if truncated bottom layer
-         */
-        CBAND(irow,nncol) = GC(jq,iq,ncut);
+  else {
+    /*
+     * Solve trans(U)*y = b, block by block from the top
+     */
+    for (lc = 1; lc <= ncut; lc++) {
+      off = (lc-1)*ds->nstr;
+      if (lc > 1) {
+        for (l = 1; l <= ds->nstr; l++) {
+          t = 0.;
+          for (i = 1; i <= ds->nstr; i++) {
+            t += CBLOCK(i,ds->nstr+l,lc-1)*B(off-ds->nstr+i);
+          }
+          B(off+l) -= t;
+        }
       }
-      else {
-        sum = 0.;
-        for (k = 1; k <= nn; k++) {
-          sum += CWT(k)*CMU(k)*BDR(jq-nn,k)*GC(nn+1-k,iq,ncut);
+      for (j = 1; j <= ds->nstr; j++) {
+        t = 0.;
+        for (i = 1; i <= j-1; i++) {
+          t += CBLOCK(i,j,lc)*B(off+i);
         }
-        CBAND(irow,nncol) = GC(jq,iq,ncut)-(1.+delm0)*sum;
+        B(off+j) = (B(off+j)-t)/CBLOCK(j,j,lc);
       }
-      irow++;
     }
-    jcol++;
-  }
-
-  for (iq = nn+1; iq <= ds->nstr; iq++) {
-    nncol++;
-    irow = nshift-jcol+ds->nstr;
-    expa = WK(ds->nstr+1-iq);
-    for (jq = nn+1; jq <= ds->nstr; jq++) {
-      if (lyrcut || (ds->flag.lamber && delm0 == 0.)) {
-        CBAND(irow,nncol) = GC(jq,iq,ncut)*expa;
+    /*
+     * Solve trans(L)*x = y, block by block from the bottom
+     */
+    for (lc = ncut; lc >= 1; lc--) {
+      off   = (lc-1)*ds->nstr;
+      nrblk = (lc < ncut) ? 3*nn : 2*nn;
+#if defined(DISORT_USE_LAPACK)
+      if (lapack) {
+        for (j = ds->nstr; j >= 1; j--) {
+          t = 0.;
+          for (i = j+1; i <= nrblk; i++) {
+            t += CBLOCK(i,j,lc)*B(off+i);
+          }
+          B(off+j) -= t;
+        }
+        for (j = ds->nstr; j >= 1; j--) {
+          l = IPVT(off+j);
+          if (l != j) {
+            t        = B(off+l);
+            B(off+l) = B(off+j);
+            B(off+j) = t;
+          }
+        }
+        continue;
       }
-      else {
-        sum = 0.;
-        for (k = 1; k <= nn; k++) {
-          sum += CWT(k)*CMU(k)*BDR(jq-nn,k)*GC(nn+1-k,iq,ncut);
+#endif
+      for (j = ds->nstr; j >= 1; j--) {
+        t = 0.;
+        for (i = j+1; i <= nrblk; i++) {
+          t += CBLOCK(i,j,lc)*B(off+i);
+        }
+        B(off+j) += t;
+        l = IPVT(off+j);
+        if (l != j) {
+          t        = B(off+l);
+          B(off+l) = B(off+j);
+          B(off+j) = t;
         }
-        CBAND(irow,nncol) = (GC(jq,iq,ncut)-(1.+delm0)*sum)*expa;
       }
-      irow++;
     }
-    jcol++;
   }
 
   return;
 }
 
-/*============================= end of c_set_matrix() ===================*/
+/*============================= end of c_block_solve() ==================*/
 
 /*============================= c_single_scat() =========================*/
 
@@ -4047,10 +6526,11 @@ double c_single_scat(double   dither,
                         problem: (alpha+beta)*(alpha-beta)
        gpplgm        :  (g+) + (g-) (cf. eqs. SS(10-11))
        gpmigm        :  (g+) - (g-) (cf. eqs. SS(10-11))
-       wk            :  Scratch array required by asymmetric_matrix
+       wk            :  Scratch array required by asymmetric_matrix and
+                        solve_eigen_symmetric
 
    Called by- c_disort, c_albtrans
-   Calls- c_asymmetric_matrix, c_errmsg
+   Calls- c_solve_eigen_symmetric, c_asymmetric_matrix, c_errmsg
  -------------------------------------------------------------------*/
 
 /*
@@ -4081,108 +6561,645 @@ void c_solve_eigen(disort_state *ds,
   register int
     iq,jq,kq,l;
   double
-    alpha,beta,gpmigm,gpplgm,sum;
+    alpha,beta,gpmigm,gpplgm,sum;
+
+  /*
+   * Find (real) eigenvalues and eigenvectors through the symmetric form of the
+   * reduced problem, if requested and the reduction applies
+   */
+  if (!ds->flag.symmetric_eigen ||
+      !c_solve_eigen_symmetric(ds,lc,ab,array,cmu,cwt,gl,mazim,nn,ylmc,cc,evecc,eval,wk)) {
+    /*
+     * Calculate quantities in eqs. SS(5-6), STWL(8b,15,23f)
+     */
+    for (iq = 1; iq <= nn; iq++) {
+      for (jq = 1; jq <= ds->nstr; jq++) {
+        sum = 0.;
+        for (l = mazim; l <= ds->nstr-1; l++) {
+          sum += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
+        }
+        CC(iq,jq) = .5*sum*CWT(jq);
+      }
+      for (jq = 1; jq <= nn; jq++) {
+        /*
+         * Fill remainder of array using symmetry relations  C(-mui,muj) = C(mui,-muj) and C(-mui,-muj) = C(mui,muj)
+         */
+        CC(iq+nn,jq   ) = CC(iq,jq+nn);
+        CC(iq+nn,jq+nn) = CC(iq,jq   );
+        /*
+         * Get factors of coeff. matrix of reduced eigenvalue problem
+         */
+        alpha      = CC(iq,jq   )/CMU(iq);
+        beta       = CC(iq,jq+nn)/CMU(iq);
+        AMB(iq,jq) = alpha-beta;
+        APB(iq,jq) = alpha+beta;
+      }
+      AMB(iq,iq) -= 1./CMU(iq);
+      APB(iq,iq) -= 1./CMU(iq);
+    }
+    /*
+     * Finish calculation of coefficient matrix of reduced eigenvalue problem: 
+     * get matrix product (alpha+beta)*(alpha-beta); SS(12),STWL(23f)
+     */
+    for (iq = 1; iq <= nn; iq++) {
+      for (jq = 1; jq <= nn; jq++) {
+        sum = 0.;
+        for (kq = 1; kq <= nn; kq++) {
+          sum += APB(iq,kq)*AMB(kq,jq);
+        }
+        ARRAY(iq,jq) = sum;
+      }
+    }
+
+    /*
+     * Find (real) eigenvalues and eigenvectors
+     */
+    c_asymmetric_matrix(array,evecc,eval,nn,ds->nstr/2,ds->nstr,&ier,wk);
+
+    if (ier > 0) {
+      fprintf(stderr,"\n\n asymmetric_matrix--eigenvalue no. %4d didn't converge.  Lower-numbered eigenvalues wrong.\n",ier);
+      c_errmsg("asymmetric_matrix--convergence problems",DS_ERROR);
+    }
+  }
+
+  for (iq = 1; iq <= nn; iq++) {
+    EVAL(iq)     = sqrt(fabs(EVAL(iq)));
+    KK(iq+nn,lc) = EVAL(iq);
+    /*
+     * Add negative eigenvalue
+     */
+    KK(nn+1-iq,lc) = -EVAL(iq);
+  }
+
+  /*
+   * Find eigenvectors (G+) + (G-) from SS(10) and store temporarily in APB array
+   */
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = 1; iq <= nn; iq++) {
+      sum = 0.;
+      for (kq = 1; kq <= nn; kq++) {
+        sum += AMB(iq,kq)*EVECC(kq,jq);
+      }
+      APB(iq,jq) = sum/EVAL(jq);
+    }
+  }
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = 1; iq <= nn; iq++) {
+      gpplgm = APB(  iq,jq);
+      gpmigm = EVECC(iq,jq);
+      /*
+       * Recover eigenvectors G+,G- from their sum and difference; stack them to get eigenvectors of full system
+       * SS(7) (JQ = eigenvector number)
+       */
+      EVECC(iq,   jq) = .5*(gpplgm+gpmigm);
+      EVECC(iq+nn,jq) = .5*(gpplgm-gpmigm);
+      /*
+       * Eigenvectors corresponding to negative eigenvalues (corresp. to reversing sign of 'k' in SS(10) )
+       */
+      gpplgm *= -1; 
+      EVECC(iq,   jq+nn)     = .5*(gpplgm+gpmigm);
+      EVECC(iq+nn,jq+nn)     = .5*(gpplgm-gpmigm);
+      GC(nn+iq,  nn+jq,  lc) = EVECC(iq,   jq   );
+      GC(nn-iq+1,nn+jq,  lc) = EVECC(iq+nn,jq   );
+      GC(nn+iq,  nn-jq+1,lc) = EVECC(iq,   jq+nn);
+      GC(nn-iq+1,nn-jq+1,lc) = EVECC(iq+nn,jq+nn);
+    }
+  }
+
+  return;
+}
+
+/*============================= end of c_solve_eigen() ==================*/
+
+/*============================= c_solve_eigen_symmetric() ===============*/
+
+/*
+   Same as c_solve_eigen() up to the square roots of the eigenvalues, but
+   solves the reduced eigenvalue problem (alpha+beta)*(alpha-beta) x = k^2 x
+   through a symmetric problem of the same order NN.
+
+   With M = diag(CMU), W = diag(CWT) and the sums over the Legendre terms
+   of even and odd parity
+
+       S+(i,j) = sum(l+mazim even) GL(l) YLMC(l,i) YLMC(l,j),
+       S-(i,j) = sum(l+mazim odd)  GL(l) YLMC(l,i) YLMC(l,j),
+
+   the factors of the reduced problem are similar to symmetric matrices,
+
+       alpha-beta = M^-1 (S- W - 1) = (MW)^(-1/2) R- (MW)^(1/2),
+       alpha+beta = M^-1 (S+ W - 1) = (MW)^(-1/2) R+ (MW)^(1/2),
+
+   with R+- = M^(-1/2) (W^(1/2) S+- W^(1/2) - 1) M^(-1/2). -R- is positive
+   definite except in degenerate cases. With its Cholesky factor
+   -R- = L L^T, the symmetric matrix H = L^T (-R+) L has the eigenvalues k^2
+   of the reduced problem, and an eigenvector y of H gives the eigenvector
+   x = (MW)^(-1/2) L^(-T) y of the reduced problem. The eigenvalues come out
+   real and non-negative up to roundoff.
+
+   Since YLMC(l,-mu) = (-1)^(l+mazim) YLMC(l,mu), S+ and S- also give CC at
+   a quarter of the cost of the direct sums in c_solve_eigen().
+
+   I N P U T     V A R I A B L E S:
+
+       see c_solve_eigen()
+
+   O U T P U T    V A R I A B L E S:
+
+       ab     :  Matrices AMB (alpha-beta), APB (alpha+beta)
+       cc     :  C-sub-ij in eq. SS(5); needed in SS(15&18)
+       eval   :  NN eigenvalues k^2 of the reduced problem
+       evecc  :  NN eigenvectors (G+) - (G-) of the reduced problem
+                 in its first NN rows and columns
+
+   S C R A T C H   V A R I A B L E S:
+
+       array  :  S-, the Cholesky factor L and scale factors
+       evecc  :  S+, -R+, (-R+)*L and H in its other blocks
+       wk     :  Scratch array required by symmetric_matrix
+
+   Returns TRUE on success, and FALSE if -R- is not positive definite
+   or the eigenvalues failed to converge; c_solve_eigen() then starts
+   over with c_asymmetric_matrix().
+
+   Called by- c_solve_eigen
+   Calls- c_symmetric_matrix
+ -------------------------------------------------------------------*/
+
+int c_solve_eigen_symmetric(disort_state *ds,
+                            int           lc,
+                            disort_pair  *ab,
+                            double       *array,
+                            double       *cmu,
+                            double       *cwt,
+                            double       *gl,
+                            int           mazim,
+                            int           nn,
+                            double       *ylmc,
+                            double       *cc,
+                            double       *evecc,
+                            double       *eval,
+                            double       *wk)
+{
+  int
+    ier;
+  register int
+    iq,jq,kq,l;
+  double
+    sm,sp,*rmu,*rmw,*rw;
 
   /*
-   * Calculate quantities in eqs. SS(5-6), STWL(8b,15,23f)
+   * Scale factors W^(1/2), M^(-1/2) and (MW)^(-1/2), past the
+   * NN x NN part of ARRAY
    */
+  rw  = array+nn*nn;
+  rmu = rw+nn;
+  rmw = rmu+nn;
   for (iq = 1; iq <= nn; iq++) {
-    for (jq = 1; jq <= ds->nstr; jq++) {
-      sum = 0.;
-      for (l = mazim; l <= ds->nstr-1; l++) {
-        sum += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
-      }
-      CC(iq,jq) = .5*sum*CWT(jq);
-    }
-    for (jq = 1; jq <= nn; jq++) {
-      /*
-       * Fill remainder of array using symmetry relations  C(-mui,muj) = C(mui,-muj) and C(-mui,-muj) = C(mui,muj)
-       */
+    rw[iq-1]  = sqrt(CWT(iq));
+    rmu[iq-1] = 1./sqrt(CMU(iq));
+    rmw[iq-1] = rmu[iq-1]/rw[iq-1];
+  }
+
+  /*
+   * S- in the lower triangle of ARRAY, S+ in that of EVECC, and CC, AMB
+   * and APB from them
+   */
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = jq; iq <= nn; iq++) {
+      sp = 0.;
+      sm = 0.;
+      for (l = mazim; l <= ds->nstr-2; l += 2) {
+        sp += GL(l,  lc)*YLMC(l,  iq)*YLMC(l,  jq);
+        sm += GL(l+1,lc)*YLMC(l+1,iq)*YLMC(l+1,jq);
+      }
+      if (l == ds->nstr-1) {
+        sp += GL(l,lc)*YLMC(l,iq)*YLMC(l,jq);
+      }
+      ARRAY(iq,jq) = sm;
+      EVECC(iq,jq) = sp;
+
+      CC(iq,   jq   ) = .5*(sp+sm)*CWT(jq);
+      CC(iq,   jq+nn) = .5*(sp-sm)*CWT(jq);
+      CC(jq,   iq   ) = .5*(sp+sm)*CWT(iq);
+      CC(jq,   iq+nn) = .5*(sp-sm)*CWT(iq);
       CC(iq+nn,jq   ) = CC(iq,jq+nn);
       CC(iq+nn,jq+nn) = CC(iq,jq   );
-      /*
-       * Get factors of coeff. matrix of reduced eigenvalue problem
-       */
-      alpha      = CC(iq,jq   )/CMU(iq);
-      beta       = CC(iq,jq+nn)/CMU(iq);
-      AMB(iq,jq) = alpha-beta;
-      APB(iq,jq) = alpha+beta;
+      CC(jq+nn,iq   ) = CC(jq,iq+nn);
+      CC(jq+nn,iq+nn) = CC(jq,iq   );
+
+      AMB(iq,jq) = sm*CWT(jq)/CMU(iq);
+      APB(iq,jq) = sp*CWT(jq)/CMU(iq);
+      AMB(jq,iq) = sm*CWT(iq)/CMU(jq);
+      APB(jq,iq) = sp*CWT(iq)/CMU(jq);
     }
-    AMB(iq,iq) -= 1./CMU(iq);
-    APB(iq,iq) -= 1./CMU(iq);
+    AMB(jq,jq) -= 1./CMU(jq);
+    APB(jq,jq) -= 1./CMU(jq);
   }
+
   /*
-   * Finish calculation of coefficient matrix of reduced eigenvalue problem: 
-   * get matrix product (alpha+beta)*(alpha-beta); SS(12),STWL(23f)
+   * Cholesky factor of -R-, in place of S-
    */
-  for (iq = 1; iq <= nn; iq++) {
-    for (jq = 1; jq <= nn; jq++) {
-      sum = 0.;
-      for (kq = 1; kq <= nn; kq++) {
-        sum += APB(iq,kq)*AMB(kq,jq);
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = jq; iq <= nn; iq++) {
+      ARRAY(iq,jq) = -rw[iq-1]*rw[jq-1]*ARRAY(iq,jq);
+    }
+    ARRAY(jq,jq) += 1.;
+    for (iq = jq; iq <= nn; iq++) {
+      ARRAY(iq,jq) *= rmu[iq-1]*rmu[jq-1];
+    }
+  }
+  for (jq = 1; jq <= nn; jq++) {
+    for (kq = 1; kq < jq; kq++) {
+      for (iq = jq; iq <= nn; iq++) {
+        ARRAY(iq,jq) -= ARRAY(iq,kq)*ARRAY(jq,kq);
       }
-      ARRAY(iq,jq) = sum;
+    }
+    if (ARRAY(jq,jq) <= 0.) {
+      return FALSE;
+    }
+    ARRAY(jq,jq) = sqrt(ARRAY(jq,jq));
+    for (iq = jq+1; iq <= nn; iq++) {
+      ARRAY(iq,jq) /= ARRAY(jq,jq);
     }
   }
 
   /*
-   * Find (real) eigenvalues and eigenvectors
+   * -R+ in place of S+, filled in by symmetry, and (-R+)*L below it
    */
-  c_asymmetric_matrix(array,evecc,eval,nn,ds->nstr/2,ds->nstr,&ier,wk);
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = jq; iq <= nn; iq++) {
+      EVECC(iq,jq) = -rw[iq-1]*rw[jq-1]*EVECC(iq,jq);
+    }
+    EVECC(jq,jq) += 1.;
+    for (iq = jq; iq <= nn; iq++) {
+      EVECC(iq,jq) *= rmu[iq-1]*rmu[jq-1];
+      EVECC(jq,iq)  = EVECC(iq,jq);
+    }
+  }
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = 1; iq <= nn; iq++) {
+      EVECC(iq+nn,jq) = 0.;
+    }
+    for (kq = jq; kq <= nn; kq++) {
+      for (iq = 1; iq <= nn; iq++) {
+        EVECC(iq+nn,jq) += EVECC(iq,kq)*ARRAY(kq,jq);
+      }
+    }
+  }
 
-  if (ier > 0) {
-    fprintf(stderr,"\n\n asymmetric_matrix--eigenvalue no. %4d didn't converge.  Lower-numbered eigenvalues wrong.\n",ier);
-    c_errmsg("asymmetric_matrix--convergence problems",DS_ERROR);
+  /*
+   * Lower triangle of H = L^T (-R+) L in the upper right block of EVECC
+   */
+  for (jq = 1; jq <= nn; jq++) {
+    for (iq = jq; iq <= nn; iq++) {
+      sp = 0.;
+      for (kq = iq; kq <= nn; kq++) {
+        sp += ARRAY(kq,iq)*EVECC(kq+nn,jq);
+      }
+      EVECC(iq,jq+nn) = sp;
+    }
   }
 
-  for (iq = 1; iq <= nn; iq++) {
-    EVAL(iq)     = sqrt(fabs(EVAL(iq)));
-    KK(iq+nn,lc) = EVAL(iq);
-    /*
-     * Add negative eigenvalue
-     */
-    KK(nn+1-iq,lc) = -EVAL(iq);
+  c_symmetric_matrix(evecc+nn*ds->nstr,eval,nn,ds->nstr,&ier,wk);
+  if (ier > 0) {
+    return FALSE;
   }
 
   /*
-   * Find eigenvectors (G+) + (G-) from SS(10) and store temporarily in APB array
+   * Eigenvectors x = (MW)^(-1/2) L^(-T) y of the reduced problem
    */
   for (jq = 1; jq <= nn; jq++) {
-    for (iq = 1; iq <= nn; iq++) {
-      sum = 0.;
-      for (kq = 1; kq <= nn; kq++) {
-        sum += AMB(iq,kq)*EVECC(kq,jq);
+    for (iq = nn; iq >= 1; iq--) {
+      sp = EVECC(iq,jq+nn);
+      for (kq = iq+1; kq <= nn; kq++) {
+        sp -= ARRAY(kq,iq)*EVECC(kq,jq+nn);
       }
-      APB(iq,jq) = sum/EVAL(jq);
+      EVECC(iq,jq+nn) = sp/ARRAY(iq,iq);
+      EVECC(iq,jq)    = EVECC(iq,jq+nn)*rmw[iq-1];
     }
   }
-  for (jq = 1; jq <= nn; jq++) {
-    for (iq = 1; iq <= nn; iq++) {
-      gpplgm = APB(  iq,jq);
-      gpmigm = EVECC(iq,jq);
-      /*
-       * Recover eigenvectors G+,G- from their sum and difference; stack them to get eigenvectors of full system
-       * SS(7) (JQ = eigenvector number)
-       */
-      EVECC(iq,   jq) = .5*(gpplgm+gpmigm);
-      EVECC(iq+nn,jq) = .5*(gpplgm-gpmigm);
-      /*
-       * Eigenvectors corresponding to negative eigenvalues (corresp. to reversing sign of 'k' in SS(10) )
-       */
-      gpplgm *= -1; 
-      EVECC(iq,   jq+nn)     = .5*(gpplgm+gpmigm);
-      EVECC(iq+nn,jq+nn)     = .5*(gpplgm-gpmigm);
-      GC(nn+iq,  nn+jq,  lc) = EVECC(iq,   jq   );
-      GC(nn-iq+1,nn+jq,  lc) = EVECC(iq+nn,jq   );
-      GC(nn+iq,  nn-jq+1,lc) = EVECC(iq,   jq+nn);
-      GC(nn-iq+1,nn-jq+1,lc) = EVECC(iq+nn,jq+nn);
+
+  return TRUE;
+}
+
+/*============================= end of c_solve_eigen_symmetric() ========*/
+
+/*============================= c_eigen_cache_*() =======================*/
+
+/*
+   Eigen cache of a workspace, see c_disort_eigen_cache_alloc().
+
+   The eigensolution of c_solve_eigen() depends on the layer only through
+   the delta-M scaled Legendre coefficients GL(mazim..nstr-1,lc), which
+   include the single-scattering albedo. Together with nstr, mazim and
+   ds->flag.symmetric_eigen they form the key of a cache entry, so that
+   layers, columns and wavelengths with the same scattering properties
+   solve the eigenproblem once. The optical depth is not part of the key.
+
+   The cache is direct-mapped: the hash of the key selects a slot, and a
+   miss overwrites it. A slot holds the full key, which is compared
+   exactly, so a hit returns the same numbers c_solve_eigen() would.
+
+   Slot layout (ws->nstr = N, in doubles):
+
+       3        :  nstr, mazim, symmetric_eigen
+       N        :  GL(mazim..nstr-1,lc)
+       N*N      :  CC
+       N*N      :  EVECC
+       N*N      :  GC(,,lc)
+       N        :  KK(,lc)
+       N/2      :  EVAL
+ -------------------------------------------------------------------*/
+
+#define EIG_SLOT_SIZE(n) (3+2*(n)+(n)/2+3*(n)*(n))
+
+/*
+ * FNV-1a hash of the cache key, never 0 (0 marks an empty slot)
+ */
+static unsigned long long c_eigen_cache_hash(disort_state *ds,
+                                             double       *gl,
+                                             int           lc,
+                                             int           mazim)
+{
+  int
+    head[3];
+  size_t
+    i;
+  unsigned char const
+    *p;
+  unsigned long long
+    h = 14695981039346656037ULL;
+
+  head[0] = ds->nstr;
+  head[1] = mazim;
+  head[2] = ds->flag.symmetric_eigen;
+
+  p = (unsigned char const *)head;
+  for (i = 0; i < sizeof(head); i++) {
+    h = (h^p[i])*1099511628211ULL;
+  }
+  p = (unsigned char const *)&GL(mazim,lc);
+  for (i = 0; i < (ds->nstr-mazim)*sizeof(double); i++) {
+    h = (h^p[i])*1099511628211ULL;
+  }
+
+  return h ? h : 1;
+}
+
+/*
+   Copy the eigensolution of layer lc for azimuthal order mazim from the
+   cache into cc, evecc, eval, KK(,lc) and GC(,,lc).
+
+   Returns TRUE on a hit. Returns FALSE if the key is not cached or ws has
+   no cache; c_solve_eigen() must then be called.
+
+   Called by- c_disort_solve
+ -------------------------------------------------------------------*/
+
+int c_eigen_cache_get(disort_state     *ds,
+                      disort_workspace *ws,
+                      int               lc,
+                      double           *gl,
+                      int               mazim,
+                      double           *cc,
+                      double           *evecc,
+                      double           *eval,
+                      double           *kk,
+                      double           *gc)
+{
+  int
+    nstr = ds->nstr,
+    ns   = ws->nstr,
+    islot;
+  unsigned long long
+    tag;
+  double
+    *slot;
+
+  if (ws->eig_nslot == 0) {
+    return FALSE;
+  }
+
+  tag   = c_eigen_cache_hash(ds,gl,lc,mazim);
+  islot = (int)(tag%(unsigned long long)ws->eig_nslot);
+  slot  = ws->eig+(size_t)islot*EIG_SLOT_SIZE(ns);
+
+  if (ws->eig_tag[islot] != tag              ||
+      slot[0] != nstr                        ||
+      slot[1] != mazim                       ||
+      slot[2] != ds->flag.symmetric_eigen    ||
+      memcmp(slot+3,&GL(mazim,lc),(nstr-mazim)*sizeof(double)) != 0) {
+    ws->eig_misses++;
+    return FALSE;
+  }
+
+  slot += 3+ns;
+  memcpy(cc,        slot,nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(evecc,     slot,nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(&GC(1,1,lc),slot,nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(&KK(1,lc), slot,nstr*sizeof(double));      slot += ns;
+  memcpy(eval,      slot,nstr/2*sizeof(double));
+
+  ws->eig_hits++;
+
+  return TRUE;
+}
+
+/*
+   Store the eigensolution of layer lc for azimuthal order mazim, as just
+   computed by c_solve_eigen(), in the cache. Does nothing if ws has no
+   cache.
+
+   Called by- c_disort_solve
+ -------------------------------------------------------------------*/
+
+void c_eigen_cache_put(disort_state     *ds,
+                       disort_workspace *ws,
+                       int               lc,
+                       double           *gl,
+                       int               mazim,
+                       double           *cc,
+                       double           *evecc,
+                       double           *eval,
+                       double           *kk,
+                       double           *gc)
+{
+  int
+    nstr = ds->nstr,
+    ns   = ws->nstr,
+    islot;
+  unsigned long long
+    tag;
+  double
+    *slot;
+
+  if (ws->eig_nslot == 0) {
+    return;
+  }
+
+  tag   = c_eigen_cache_hash(ds,gl,lc,mazim);
+  islot = (int)(tag%(unsigned long long)ws->eig_nslot);
+  slot  = ws->eig+(size_t)islot*EIG_SLOT_SIZE(ns);
+
+  ws->eig_tag[islot] = tag;
+  slot[0] = nstr;
+  slot[1] = mazim;
+  slot[2] = ds->flag.symmetric_eigen;
+  memcpy(slot+3,&GL(mazim,lc),(nstr-mazim)*sizeof(double));
+
+  slot += 3+ns;
+  memcpy(slot,cc,        nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(slot,evecc,     nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(slot,&GC(1,1,lc),nstr*nstr*sizeof(double)); slot += ns*ns;
+  memcpy(slot,&KK(1,lc), nstr*sizeof(double));      slot += ns;
+  memcpy(slot,eval,      nstr/2*sizeof(double));
+
+  return;
+}
+
+/*============================= end of c_eigen_cache_*() ================*/
+
+/*============================= c_beam_cache_*() ========================*/
+
+/*
+   Beam cache of a column, see c_disort_ws_cached().
+
+   The key holds the inputs of c_disort_solve() the stored solution
+   depends on, in doubles:
+
+       8              :  nlyr, nstr, nmom, symmetric_eigen, planck,
+                         UMU0 (as adjusted by c_disort_set), fbeam, albedo
+       nlyr*(nmom+3)  :  DTAUC(lc), SSALB(lc), PMOM(0..nmom,lc) of each layer
+
+   It is compared exactly, so a hit returns the same eigensolutions, beam
+   solutions and factored matrix a solve would.
+ -------------------------------------------------------------------*/
+
+#define BEAM_KEY_SIZE(nlyr,nmom) (8+(nlyr)*((nmom)+3))
+
+/*
+   Write the key of ds after the stored one and compare them. On a match,
+   copy the stored solution into cblock, GC, ipvt, KK, ncol and ZZ.
+
+   Returns TRUE on a hit, FALSE otherwise; the solution must then be
+   computed and stored with c_beam_cache_put().
+
+   Called by- c_disort_solve
+ -------------------------------------------------------------------*/
+
+int c_beam_cache_get(disort_state      *ds,
+                     disort_beam_cache *cache,
+                     double            *cblock,
+                     double            *gc,
+                     int               *ipvt,
+                     double            *kk,
+                     int               *ncol,
+                     double            *zz)
+{
+  int
+    nn   = ds->nstr/2,
+    nkey = BEAM_KEY_SIZE(ds->nlyr,ds->nmom),
+    k,lc;
+  double
+    *key = cache->key+nkey;
+
+  key[0] = ds->nlyr;
+  key[1] = ds->nstr;
+  key[2] = ds->nmom;
+  key[3] = ds->flag.symmetric_eigen;
+  key[4] = ds->flag.planck;
+  key[5] = ds->bc.umu0;
+  key[6] = ds->bc.fbeam;
+  key[7] = ds->bc.albedo;
+  key += 8;
+  for (lc = 1; lc <= ds->nlyr; lc++) {
+    *key++ = DTAUC(lc);
+    *key++ = SSALB(lc);
+    for (k = 0; k <= ds->nmom; k++) {
+      *key++ = PMOM(k,lc);
     }
   }
 
+  if (!cache->valid || memcmp(cache->key,cache->key+nkey,nkey*sizeof(double)) != 0) {
+    cache->misses++;
+    return FALSE;
+  }
+
+  memcpy(cblock,cache->cblock,12*nn*nn*ds->nlyr*sizeof(double));
+  memcpy(gc,    cache->gc,    ds->nstr*ds->nstr*ds->nlyr*sizeof(double));
+  memcpy(ipvt,  cache->ipvt,  ds->nstr*ds->nlyr*sizeof(int));
+  memcpy(kk,    cache->kk,    ds->nstr*ds->nlyr*sizeof(double));
+  memcpy(zz,    cache->zz,    ds->nstr*ds->nlyr*sizeof(double));
+  *ncol = cache->ncol;
+
+  cache->hits++;
+
+  return TRUE;
+}
+
+/*
+   Store the solution just computed by c_disort_solve() under the key
+   written by c_beam_cache_get(). The unit thermal solutions were already
+   written to cache->tu and cache->tw by c_upisot_unit().
+
+   Called by- c_disort_solve
+ -------------------------------------------------------------------*/
+
+void c_beam_cache_put(disort_state      *ds,
+                      disort_beam_cache *cache,
+                      double            *cblock,
+                      double            *gc,
+                      int               *ipvt,
+                      double            *kk,
+                      int                ncol,
+                      double            *zz)
+{
+  int
+    nn   = ds->nstr/2,
+    nkey = BEAM_KEY_SIZE(ds->nlyr,ds->nmom);
+
+  memcpy(cache->key,cache->key+nkey,nkey*sizeof(double));
+  memcpy(cache->cblock,cblock,12*nn*nn*ds->nlyr*sizeof(double));
+  memcpy(cache->gc,    gc,    ds->nstr*ds->nstr*ds->nlyr*sizeof(double));
+  memcpy(cache->ipvt,  ipvt,  ds->nstr*ds->nlyr*sizeof(int));
+  memcpy(cache->kk,    kk,    ds->nstr*ds->nlyr*sizeof(double));
+  memcpy(cache->zz,    zz,    ds->nstr*ds->nlyr*sizeof(double));
+  cache->ncol  = ncol;
+  cache->valid = TRUE;
+
   return;
 }
 
-/*============================= end of c_solve_eigen() ==================*/
+/*
+   Thermal particular solution ZPLK0(,lc), ZPLK1(,lc) for the expansion
+   coefficients XR0(lc), XR1(lc) of the thermal source, from the unit
+   solutions of c_upisot_unit(); replaces c_upisot().
+
+   Called by- c_disort_solve
+ -------------------------------------------------------------------*/
+
+void c_beam_cache_plk(disort_state      *ds,
+                      disort_beam_cache *cache,
+                      int                lc,
+                      int                nn,
+                      disort_pair       *xr,
+                      disort_pair       *plk)
+{
+  int
+    iq;
+  double
+    *u = cache->tu+(lc-1)*ds->nstr,
+    *w = cache->tw+(lc-1)*ds->nstr;
+
+  for (iq = 1; iq <= 2*nn; iq++) {
+    ZPLK1(iq,lc) = XR1(lc)*u[iq-1];
+    ZPLK0(iq,lc) = XR0(lc)*u[iq-1]+XR1(lc)*w[iq-1];
+  }
+
+  return;
+}
+
+/*============================= end of c_beam_cache_*() =================*/
 
 /*============================= c_solve0() ==============================*/
 
@@ -4199,15 +7216,16 @@ void c_solve_eigen(disort_state *ds,
        bdr      :  Surface bidirectional reflectivity
        bem      :  Surface bidirectional emissivity
        bplanck  :  Bottom boundary thermal emission
-       cband    :  Left-hand side matrix of linear system eq. SC(5),
-                   scaled by eq. SC(12); in banded form required
-                   by LINPACK solution routines
+       cblock   :  Left-hand side matrix of linear system eq. SC(5),
+                   scaled by eq. SC(12); L-U decomposed by
+                   c_block_factor()
        cmu,cwt  :  Abscissae, weights for Gauss quadrature
                    over angle cosine
        expbea   :  Transmission of incident beam, EXP(-TAUCPR/UMU0)
+       ipvt     :  Pivot indices from c_block_factor()
        lyrcut   :  Logical flag for truncation of computational layers
        mazim    :  Order of azimuthal component
-       ncol     :  Number of columns in CBAND
+       ncol     :  Number of columns of the linear system
        nn       :  Order of double-Gauss quadrature (NSTR/2)
        ncut     :  Total number of computational layers considered
        tplanck  :  Top boundary thermal emission
@@ -4220,20 +7238,16 @@ void c_solve_eigen(disort_state *ds,
     O U T P U T     V A R I A B L E S:
 
        b        :  Right-hand side vector of eq. SC(5) going into
-                   sgbsl; returns as solution vector of eq. SC(12),
+                   c_block_solve; returns as solution vector of eq. SC(12),
                    constants of integration without exponential term
       ll        :  Permanent storage for B, but re-ordered
 
    I N T E R N A L    V A R I A B L E S:
 
-       ipvt     :  Integer vector of pivot indices
        it       :  Pointer for position in  B
-       ncd      :  Number of diagonals below or above main diagonal
-       rcond    :  Indicator of singularity for cband
-       z        :  Scratch array required by sgbco
 
    Called by- c_disort
-   Calls- c_sgbco, c_errmsg, c_sgbsl
+   Calls- c_errmsg, c_block_solve
  +-------------------------------------------------------------------*/
 
 void c_solve0(disort_state *ds,
@@ -4241,7 +7255,7 @@ void c_solve0(disort_state *ds,
               double       *bdr,
               double       *bem,
               double        bplanck,
-              double       *cband,
+              double       *cblock,
               double       *cmu,
               double       *cwt,
               double       *expbea,
@@ -4254,7 +7268,6 @@ void c_solve0(disort_state *ds,
               int           nn,
               double        tplanck,
               double       *taucpr,
-              double       *z,
               disort_pair  *zbeamsp,
 	      double       *zbeama,
               double       *zz,
@@ -4262,9 +7275,9 @@ void c_solve0(disort_state *ds,
               disort_pair  *plk)
 {
   register int
-    ipnt,iq,it,jq,lc,ncd;
+    ipnt,iq,it,jq,lc;
   double
-    rcond,sum,diff;
+    sum,diff;
   
   memset(b,0,ds->nstr*ds->nlyr*sizeof(double));
   
@@ -4524,30 +7537,11 @@ void c_solve0(disort_state *ds,
   }
 
   /*
-   * Find L-U (lower/upper triangular) decomposition of band matrix
-   * CBAND and test if it is nearly singular (note: CBAND is
-   * destroyed) (CBAND is in LINPACK packed format)
-   */
-  rcond = 0.;
-  ncd   = 3*nn-1;
-  c_sgbco(cband,(9*(ds->nstr/2)-2),ncol,ncd,ncd,ipvt,&rcond,z);
-
-  if (1.+rcond == 1.) {
-    c_errmsg("solve0--sgbco says matrix near singular",DS_WARNING);
-  }
-
-  /*
-   * Solve linear system with coeff matrix CBAND and R.H. side(s) B
-   * after CBAND has been L-U decomposed. Solution is returned in B.
-   */
-
-  c_sgbsl(cband,(9*(ds->nstr/2)-2),ncol,ncd,ncd,ipvt,b,0);
-
-  /*
-   * Zero CBAND (it may contain 'foreign' elements upon returning from
-   * LINPACK); necessary to prevent errors
+   * Solve linear system with coeff matrix CBLOCK and R.H. side(s) B
+   * after CBLOCK has been L-U decomposed. Solution is returned in B.
+   * CBLOCK is left intact for further right-hand sides.
    */
-  memset(cband,0,(9*(ds->nstr/2)-2)*(ds->nstr*ds->nlyr)*sizeof(double));
+  c_block_solve(ds,cblock,ncut,nn,ipvt,b,0);
 
   for (lc = 1; lc <= ncut; lc++) {
     ipnt = lc*ds->nstr-nn;
@@ -4604,23 +7598,15 @@ void c_surface_bidir(disort_state *ds,
                      double       *rmu,
 		     int           callnum)
 {
-  static int
-    pass1 = TRUE;
   register int
     iq,iu,jg,jq,k;
   double
     dref,sum;
-  static double
-    gmu[NMUG],gwt[NMUG];
-  
-  if (pass1) {
-    pass1 = FALSE;
-    c_gaussian_quadrature(NMUG/2,gmu,gwt);
-    for (k = 1; k <= NMUG/2; k++) {
-      GMU(k+NMUG/2) = -GMU(k);
-      GWT(k+NMUG/2) =  GWT(k);
-    }
-  }
+  const double
+    *gmu = c_nmug_gmu,
+    *gwt = c_nmug_gwt;
+
+  pthread_once(&c_nmug_flag,c_nmug_init);
 
   memset(bdr,0,(ds->nstr/2)*((ds->nstr/2)+1)*sizeof(double));
   memset(bem,0,(ds->nstr/2)*sizeof(double));
@@ -5104,10 +8090,8 @@ void c_set_coefficients_beam_source(disort_state *ds,
     iq,k;
   double 
     deltat,sum,q0a,q2a,q0,q2;
-  static double
-    big;
-
-  big    = sqrt(DBL_MAX)/1.e+10;
+  const double
+    big = sqrt(DBL_MAX)/1.e+10;
 
   /*     Calculate x-sub-zero in STWJ(6d)   */
 
@@ -5552,29 +8536,107 @@ void c_upisot(disort_state *ds,
     Z1(iq) = WK(iq);
   }
 
-  for (iq = 1; iq <= ds->nstr; iq++) {
-    Z0(iq) = (1.-OPRIM(lc))*XR0(lc)+CMU(iq)*Z1(iq);
+  for (iq = 1; iq <= ds->nstr; iq++) {
+    Z0(iq) = (1.-OPRIM(lc))*XR0(lc)+CMU(iq)*Z1(iq);
+  }
+
+  for (iq = 1; iq <= ds->nstr; iq++) {
+    /* Need to use WK() as a buffer, since Z0 is part of a structure */
+    WK(iq) = Z0(iq);
+  }
+  c_sgesl(array,ds->nstr,ds->nstr,ipvt,wk,0);
+  for (iq = 1; iq <= ds->nstr; iq++) {
+    Z0(iq) = WK(iq);
+  }
+  for (iq = 1; iq <= nn; iq++) {
+    ZPLK0(nn+iq,  lc) = Z0(iq   );
+    ZPLK1(nn+iq,  lc) = Z1(iq   );
+    ZPLK0(nn-iq+1,lc) = Z0(iq+nn);
+    ZPLK1(nn-iq+1,lc) = Z1(iq+nn);
+  }
+
+  return;
+}
+
+/*============================= end of c_upisot() =======================*/
+
+/*============================= c_upisot_unit() =========================*/
+
+/*
+    Same as c_upisot(), for the unit sources XR0 = 1, XR1 = 0 and
+    XR0 = 0, XR1 = 1. c_upisot() is linear in XR0 and XR1, so that
+
+       ZPLK1(iq,lc) = XR1(lc)*TU(iq,lc)
+       ZPLK0(iq,lc) = XR0(lc)*TU(iq,lc)+XR1(lc)*TW(iq,lc)
+
+    for any XR0, XR1, see c_beam_cache_plk().
+
+    O U T P U T    V A R I A B L E S:
+
+       tu     :  TU(iq,lc), (nstr,nlyr), in the order of plk
+       tw     :  TW(iq,lc), (nstr,nlyr), in the order of plk
+
+   Called by- c_disort_solve
+   Calls- c_sgeco, c_errmsg, c_sgesl
+ -------------------------------------------------------------------*/
+
+void c_upisot_unit(disort_state *ds,
+                   int           lc,
+                   double       *array,
+                   double       *cc,
+                   double       *cmu,
+                   int          *ipvt,
+                   double       *oprim,
+                   double       *wk,
+                   double       *tu,
+                   double       *tw)
+{
+  register int
+    iq,jq;
+  int
+    nn = ds->nstr/2;
+  double
+    rcond,
+    *u = tu+(lc-1)*ds->nstr,
+    *w = tw+(lc-1)*ds->nstr;
+
+  for (iq = 1; iq <= ds->nstr; iq++) {
+    for (jq = 1; jq <= ds->nstr; jq++) {
+      ARRAY(iq,jq) = -CC(iq,jq);
+    }
+    ARRAY(iq,iq) += 1.;
+  }
+  rcond = 0.;
+  c_sgeco(array,ds->nstr,ds->nstr,ipvt,&rcond,wk);
+
+  if (1.+rcond == 1.) {
+    c_errmsg("upisot_unit--sgeco says matrix near singular",DS_WARNING);
   }
 
+  /*
+   * Z1 for XR1 = 1, which is also Z0 for XR0 = 1; then the part of Z0 due to XR1 = 1
+   */
   for (iq = 1; iq <= ds->nstr; iq++) {
-    /* Need to use WK() as a buffer, since Z0 is part of a structure */
-    WK(iq) = Z0(iq);
+    WK(iq) = 1.-OPRIM(lc);
   }
   c_sgesl(array,ds->nstr,ds->nstr,ipvt,wk,0);
+  for (iq = 1; iq <= nn; iq++) {
+    u[nn+iq-1] = WK(iq   );
+    u[nn-iq]   = WK(iq+nn);
+  }
   for (iq = 1; iq <= ds->nstr; iq++) {
-    Z0(iq) = WK(iq);
+    WK(iq) *= CMU(iq);
   }
+  c_sgesl(array,ds->nstr,ds->nstr,ipvt,wk,0);
   for (iq = 1; iq <= nn; iq++) {
-    ZPLK0(nn+iq,  lc) = Z0(iq   );
-    ZPLK1(nn+iq,  lc) = Z1(iq   );
-    ZPLK0(nn-iq+1,lc) = Z0(iq+nn);
-    ZPLK1(nn-iq+1,lc) = Z1(iq+nn);
+    w[nn+iq-1] = WK(iq   );
+    w[nn-iq]   = WK(iq+nn);
   }
 
   return;
 }
 
-/*============================= end of c_upisot() =======================*/
+/*============================= end of c_upisot_unit() ==================*/
 
 /*============================= c_user_intensities() ====================*/
 
@@ -6268,23 +9330,15 @@ double c_dref(double       wvnmlo,
 	      disort_brdf *brdf,
 	      int          callnum )
 {
-  static int
-    pass1 = TRUE;
   register int
     jg,k;
   double
     ans,sum;
-  static double
-    gmu[NMUG],gwt[NMUG];
+  const double
+    *gmu = c_nmug_gmu,
+    *gwt = c_nmug_gwt;
 
-  if (pass1) {
-    pass1 = FALSE;
-    c_gaussian_quadrature(NMUG/2,gmu,gwt);
-    for (k = 1; k <= NMUG/2; k++) {
-      GMU(k+NMUG/2) = -GMU(k);
-      GWT(k+NMUG/2) =  GWT(k);
-    }
-  }
+  pthread_once(&c_nmug_flag,c_nmug_init);
 
   if (fabs(mu) > 1.) {
     c_errmsg("dref--input argument error(s)",DS_ERROR);
@@ -6495,25 +9549,17 @@ double c_planck_func1(double wnumlo,
     i,k,m,mmax,n,smallv;
   int
     converged;
-  static int
-    initialized = FALSE;
   const double
     vcp[7] = {10.25,5.7,3.9,2.9,2.3,1.9,0.0};
   double
     del,ex,exm,hh,mv,oldval,
     val,val0,vsq,d[2],p[2],v[2],
     ans;
-  static double
-    vmax,sigdpi,conc;
-
-  if (!initialized) {
-    vmax   = log(DBL_MAX);
-    sigdpi = SIGMA/M_PI;
+  const double
+    vmax   = log(DBL_MAX),
+    sigdpi = SIGMA/M_PI,
     conc   = 15./pow(M_PI,4.);
 
-    initialized = TRUE;
-  }
-
   if (t < 0. || wnumhi <= wnumlo || wnumlo < 0.) {
     c_errmsg("planck_func1--temperature or wavenums. wrong",DS_ERROR);
   }
@@ -6987,20 +10033,13 @@ void c_gaussian_quadrature(int    m,
                            double *gmu,
                            double *gwt)
 {
-  static int
-    initialized = FALSE;
   register int
     iter,k,lim,nn,np1;
   double
     cona,t,en,nnp1,p=0,p2pri,pm1,pm2,ppr,
     prod,tmp,x,xi;
-  static double
-    tol;
-
-  if (!initialized) {
-    tol         = 10.*DBL_EPSILON;
-    initialized = TRUE;
-  }
+  const double
+    tol = 10.*DBL_EPSILON;
 
   if (m < 1) {
     c_errmsg("gaussian_quadrature--Bad value of m",DS_ERROR);
@@ -7105,22 +10144,14 @@ void c_gaussian_quadrature(int    m,
 double c_ratio(double a,
              double b)
 {
-  static int
-    initialized = FALSE;
-  static double
-    tiny,huge,powmax,powmin;
+  const double
+    tiny   = DBL_MIN,
+    huge   = DBL_MAX,
+    powmax = log10(DBL_MAX),
+    powmin = log10(DBL_MIN);
   double
     ans,absa,absb,powa,powb;
 
-  if(!initialized) {
-    tiny   = DBL_MIN;
-    huge   = DBL_MAX;
-    powmax = log10(huge);
-    powmin = log10(tiny);
-   
-    initialized = TRUE;
-  }
-
   if (c_fcmp(b,0.) == 0) {
     ans = 1.+a;
   }
@@ -7249,7 +10280,10 @@ int c_fcmp(double x1,
 /*
  * If  compare is FALSE, set up self-test disort_state ds_test.
  * If  compare is TRUE, compare self-test results with correct
- * answers, abort if error, and free self-test memory.
+ * answers and free self-test memory.
+ *
+ * Returns DS_OK, DS_ERR_FATAL if the results differ from the correct
+ * answers, or DS_ERR_INPUT if compare is not recognized.
  *
  * (See file 'DISORT.txt' for variable definitions.)
  *
@@ -7263,10 +10297,10 @@ int c_fcmp(double x1,
  * Calls- c_errmsg
  */
 
-void c_self_test(int            compare,
-                 int           *prntu0,
-                 disort_state  *ds,
-                 disort_output *out)
+int c_self_test(int            compare,
+                int           *prntu0,
+                disort_state  *ds,
+                disort_output *out)
 {
   const double
     acc = 1.e-4;
@@ -7335,7 +10369,7 @@ void c_self_test(int            compare,
     UTAU(1) =  0.5;
     PHI(1)  = 90.0;
 
-    return;
+    return DS_OK;
   }
   else if (compare == TRUE) {
     /*
@@ -7372,14 +10406,15 @@ void c_self_test(int            compare,
     c_disort_state_free(ds);
 
     if (!ok) {
-      c_errmsg("DISORT--self-test failed",DS_ERROR);
+      fprintf(stderr,"\n ******* ERROR >>>>>>  DISORT--self-test failed\n");
+      return DS_ERR_FATAL;
     }
 
-    return;
+    return DS_OK;
   }
   else {
     fprintf(stderr,"**error--self_test(): compare=%d not recognized\n",compare);
-    exit(1);
+    return DS_ERR_INPUT;
   }
 }
 
@@ -7423,19 +10458,18 @@ void c_self_test(int            compare,
 
     I N T E R N A L   V A R I A B L E S:
 
-       ncd         number of diagonals below/above main diagonal
-       rcond       estimate of the reciprocal condition of matrix CBAND; for system  CBAND*X = B, relative
-                   perturbations in CBAND and B of size epsilon may cause relative perturbations in X of size
+       rcond       estimate of the reciprocal condition of matrix CBLOCK; for system  CBLOCK*X = B, relative
+                   perturbations in CBLOCK and B of size epsilon may cause relative perturbations in X of size
                    epsilon/RCOND.  If RCOND is so small that
                           1.0 + RCOND .eq. 1.0
-                   is true, then CBAND may be singular to working precision.
-       cband       Left-hand side matrix of linear system eq. SC(5), scaled by eq. SC(12);
-                   in banded form required by LINPACK solution routines
-       ncol        number of columns in CBAND matrix
+                   is true, then CBLOCK may be singular to working precision.
+       cblock      Left-hand side matrix of linear system eq. SC(5), scaled by eq. SC(12);
+                   in block form required by c_block_factor()
+       ncol        number of columns in CBLOCK matrix
        ipvt        INTEGER vector of pivot indices (most others documented in DISORT)
   
    Called by- c_disort
-   Calls- c_legendre_poly, c_sgbco, c_solve_eigen, c_interp_eigenvec, c_set_matrix, c_solve1,
+   Calls- c_legendre_poly, c_block_factor, c_solve_eigen, c_interp_eigenvec, c_set_matrix, c_solve1,
           c_albtrans_intensity, c_albtrans_spherical, c_print_albtrans
  --------------------------------------------------------------------------------------*/
 
@@ -7445,7 +10479,7 @@ void c_albtrans(disort_state  *ds,
                 double        *array,
                 double        *b,
                 double        *bdr,
-                double        *cband,
+                double        *cblock,
                 double        *cc,
                 double        *cmu,
                 double        *cwt,
@@ -7468,7 +10502,7 @@ void c_albtrans(disort_state  *ds,
   int
     lyrcut,ncol;
   register int
-    iq,iu,l,lc,mazim,ncd,ncut;
+    iq,iu,l,lc,mazim,ncut;
   double
     delm0,rcond,sgn,sphalb,sphtrn;
 
@@ -7522,27 +10556,26 @@ void c_albtrans(disort_state  *ds,
   /*------------------  END LOOP ON COMPUTATIONAL LAYERS  ---------------*/
 
   /*
-   * Set coefficient matrix (CBAND) of equations
+   * Set coefficient matrix (CBLOCK) of equations
    * combining boundary and layer interface
-   * conditions (in band-storage mode required by
-   * LINPACK routines)
+   * conditions (in the block form required by
+   * c_block_factor)
    */
-  c_set_matrix(ds,bdr,cband,cmu,cwt,delm0,dtaucpr,gc,kk,lyrcut,&ncol,ncut,taucpr,wk);
+  c_set_matrix(ds,bdr,cblock,cmu,cwt,delm0,dtaucpr,gc,kk,lyrcut,&ncol,ncut,taucpr,wk);
 
   /*
-   * LU-decompose the coeff. matrix (LINPACK)
+   * LU-decompose the coeff. matrix, once for both illuminations
    */
-  ncd = 3*nn-1;
-  c_sgbco(cband,(9*(ds->nstr/2)-2),ncol,ncd,ncd,ipvt,&rcond,z);
-  if (1.+rcond == 1.) {
-    c_errmsg("albtrans--sgbco says matrix near singular",DS_WARNING);
+  c_block_factor(ds,cblock,ncut,nn,ipvt,ds->flag.skip_rcond ? NULL : &rcond,z);
+  if (!ds->flag.skip_rcond && 1.+rcond == 1.) {
+    c_errmsg("albtrans--block_factor says matrix near singular",DS_WARNING);
   }
 
   /*
    * First, illuminate from top; if only one layer, this will give us everything
    * Solve for constants of integration in homogeneous solution
    */
-  c_solve1(ds,cband,TOP_ILLUM,ipvt,ncol,ncut,nn,b,ll);
+  c_solve1(ds,cblock,TOP_ILLUM,ipvt,ncol,ncut,nn,b,ll);
 
   /*
    * Compute azimuthally-averaged intensity at user angles; gives albedo if multi-layer (eq. 9 of Ref S2);
@@ -7570,7 +10603,7 @@ void c_albtrans(disort_state  *ds,
     /*
      * Second, illuminate from bottom (if multiple layers)
      */
-    c_solve1(ds,cband,BOT_ILLUM,ipvt,ncol,ncut,nn,b,ll);
+    c_solve1(ds,cblock,BOT_ILLUM,ipvt,ncol,ncut,nn,b,ll);
     c_albtrans_intensity(ds,out,gu,kk,ll,nn,taucpr,wk);
     /*
      * Get beam-incidence transmissivities from reciprocity principle
@@ -7784,19 +10817,19 @@ void c_print_albtrans(disort_state  *ds,
      I N P U T      V A R I A B L E S:
 
        ds       :  Disort state variables
-       cband    :  Left-hand side matrix of banded linear system
+       cblock   :  Left-hand side matrix of block linear system
                    eq. SC(5), scaled by eq. SC(12); assumed already
-                   in LU-decomposed form, ready for LINPACK solver
+                   in LU-decomposed form by c_block_factor()
        ihom     :  Direction-of-illumination flag (TOP_ILLUM, top; BOT_ILLUM, bottom)
        ipvt     :
-       ncol     :  Number of columns in CBAND
+       ncol     :  Number of columns in CBLOCK
        ncut     :
        nn       :  Order of double-Gauss quadrature (NSTR/2)
 
     O U T P U T     V A R I A B L E S:
 
        b        :  Right-hand side vector of eq. SC(5) going into
-                   sgbsl; returns as solution vector of eq.
+                   c_block_solve; returns as solution vector of eq.
                    SC(12), constants of integration without
                    exponential term
        ll       :  permanent storage for -b-, but re-ordered
@@ -7805,15 +10838,14 @@ void c_print_albtrans(disort_state  *ds,
     I N T E R N A L    V A R I A B L E S:
 
        ipvt     :  INTEGER vector of pivot indices
-       ncd      :  Number of diagonals below or above main diagonal
 
-   Called by- c_albtrans
-   Calls- c_sgbsl
+   Called by- c_albtrans, c_surface_response
+   Calls- c_block_solve
  +-------------------------------------------------------------------+
 */
 
 void c_solve1(disort_state *ds,
-              double       *cband,
+              double       *cblock,
               int           ihom,
               int          *ipvt,
               int           ncol,
@@ -7823,7 +10855,7 @@ void c_solve1(disort_state *ds,
               double       *ll)
 {
   register int
-    i,ipnt,iq,lc,ncd;
+    i,ipnt,iq,lc;
 
   memset(b,0,ds->nstr*ds->nlyr*sizeof(double));
 
@@ -7846,8 +10878,7 @@ void c_solve1(disort_state *ds,
     c_errmsg("solve1---unrecognized ihom",DS_ERROR);
   }
 
-  ncd = 3*nn-1;
-  c_sgbsl(cband,(9*(ds->nstr/2)-2),ncol,ncd,ncd,ipvt,b,0);
+  c_block_solve(ds,cblock,ncut,nn,ipvt,b,0);
   for (lc = 1; lc <= ncut; lc++) {
     ipnt = lc*ds->nstr-nn;
     for (iq = 1; iq <= nn; iq++) {
@@ -7890,7 +10921,7 @@ void c_solve1(disort_state *ds,
 
        zint    :  Intensity of m=0 case, in eq. SC(1)
 
-   Called by- c_albtrans
+   Called by- c_albtrans, c_surface_response
  --------------------------------------------------------------------*/
 
 void c_albtrans_spherical(disort_state *ds,
@@ -7948,7 +10979,10 @@ void c_albtrans_spherical(disort_state *ds,
 /*============================= c_errmsg() ===============================*/
 
 /*
- * Print out a warning or error message;  abort if type == DS_ERROR
+ * Print out a warning or error message. On type == DS_ERROR, return to the
+ * c_disort_ws*() or c_twostr_status() call running on this thread, which then
+ * reports DS_ERR_FATAL; outside of those, e.g. below a direct call of
+ * c_twostr(), exit the process.
  */
 
 #define MAX_WARNINGS 100
@@ -7956,23 +10990,28 @@ void c_albtrans_spherical(disort_state *ds,
 void c_errmsg(char const *messag,
               int   type)
 {
+  /* Shared by all threads, hence updated atomically */
   static int
-    warning_limit = FALSE,
     num_warnings  = 0;
+  int
+    nwarn;
 
   if (type == DS_ERROR) {
     fprintf(stderr,"\n ******* ERROR >>>>>>  %s\n",messag);
+    if (c_errmsg_jmp) {
+      longjmp(*c_errmsg_jmp,1);
+    }
     exit(1);
   }
 
-  if (warning_limit) return;
+  if (__atomic_load_n(&num_warnings,__ATOMIC_RELAXED) > MAX_WARNINGS) return;
 
-  if (++num_warnings <= MAX_WARNINGS) {
+  nwarn = __atomic_add_fetch(&num_warnings,1,__ATOMIC_RELAXED);
+  if (nwarn <= MAX_WARNINGS) {
     fprintf(stderr,"\n ******* WARNING >>>>>>  %s\n",messag);
   }
-  else {
+  else if (nwarn == MAX_WARNINGS+1) {
     fprintf(stderr,"\n\n >>>>>>  TOO MANY WARNING MESSAGES --  ','They will no longer be printed  <<<<<<<\n\n");
-    warning_limit = TRUE;
   }
 
   return;
@@ -7985,8 +11024,8 @@ void c_errmsg(char const *messag,
 /*============================= c_write_bad_var() ========================*/
 
 /*
-   Write name of erroneous variable and return TRUE; count and abort
-   if too many errors.
+   Write name of erroneous variable and return TRUE; count and stop
+   printing if too many errors.
 
    Input : quiet  = VERBOSE or QUIET
            varnam = name of erroneous variable to be written
@@ -7997,14 +11036,17 @@ int c_write_bad_var(int   quiet,
 {
   const int
     maxmsg = 50;
+  /* Shared by all threads, hence updated atomically */
   static int
     nummsg = 0;
+  int
+    num;
 
-  nummsg++;
-  if (quiet != QUIET) {
+  num = __atomic_add_fetch(&nummsg,1,__ATOMIC_RELAXED);
+  if (quiet != QUIET && num <= maxmsg) {
     fprintf(stderr,"\n ****  Input variable %s in error  ****\n",varnam);
-    if (nummsg == maxmsg) {
-      c_errmsg("Too many input errors.  Aborting...",DS_ERROR);
+    if (num == maxmsg) {
+      c_errmsg("Too many input errors. They will no longer be printed",DS_WARNING);
     }
   }
 
@@ -8039,7 +11081,10 @@ int c_write_too_small_dim(int   quiet,
 /*============================= end of c_write_too_small_dim =============*/
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
- Call tree:
+ Call tree (with DISORT_USE_LAPACK, and for orders of at least
+ DISORT_LAPACK_MIN_ORDER, the factorizations, solves and condition estimates
+ go to dgbtrf/dgbtrs/dgbcon and dgetrf/dgetrs/dgecon instead, and the BLAS-1
+ routines to their BLAS counterparts):
 
    c_sgbco
        c_sasum
@@ -8113,6 +11158,8 @@ int c_write_too_small_dim(int   quiet,
                 unimportant. If A is close to a singular matrix, then
                 z is an approximate null vector in the sense that
                 norm(a*z) = rcond*norm(a)*norm(z).
+                With DISORT_USE_LAPACK, z is workspace of
+                double[LINPACK_WORK*n] for dgbcon.
 
      Band storage:
            If A is a band matrix, the following program segment
@@ -8187,6 +11234,23 @@ void c_sgbco(double *abd,
       l--;
     }
   }
+
+#if defined(DISORT_USE_LAPACK)
+  if (ml+mu+1 >= DISORT_LAPACK_MIN_ORDER) {
+    /*
+     * factor and estimate with LAPACK; z holds 3n doubles and n ints
+     */
+    dgbtrf_(&n,&n,&ml,&mu,abd,&lda,ipvt,&info);
+    if (info != 0 || anorm == 0.) {
+      *rcond = 0.;
+      return;
+    }
+    dgbcon_("1",&n,&ml,&mu,abd,&lda,ipvt,&anorm,rcond,z,(int *)(z+3*n),&info,
+            1);
+    return;
+  }
+#endif
+
   /*
    * factor
    */
@@ -8378,6 +11442,13 @@ void c_sgbfa(double *abd,
   double
     t;
 
+#if defined(DISORT_USE_LAPACK)
+  if (ml+mu+1 >= DISORT_LAPACK_MIN_ORDER) {
+    dgbtrf_(&n,&n,&ml,&mu,abd,&lda,ipvt,info);
+    return;
+  }
+#endif
+
   m     = ml+mu+1;
   *info = 0;
   /*
@@ -8512,6 +11583,16 @@ void c_sgbsl(double *abd,
   double
     t;
 
+#if defined(DISORT_USE_LAPACK)
+  if (ml+mu+1 >= DISORT_LAPACK_MIN_ORDER) {
+    int
+      info,nrhs = 1;
+
+    dgbtrs_(job == 0 ? "N" : "T",&n,&ml,&mu,&nrhs,abd,&lda,ipvt,b,&n,&info,1);
+    return;
+  }
+#endif
+
   m   = mu+ml+1;
   nm1 = n-1;
   if (job == 0) {
@@ -8612,6 +11693,8 @@ void c_sgbsl(double *abd,
                 unimportant. If A is close to a singular matrix, then z 
                 is an approximate null vector in the sense that
                 norm(A*Z) = rcond*norm(A)*norm(Z) .
+                With DISORT_USE_LAPACK, z is workspace of
+                double(LINPACK_WORK*n) for dgecon.
  ------------------------------------------------------------------*/
 
 void c_sgeco(double *a,
@@ -8636,6 +11719,21 @@ void c_sgeco(double *a,
     anorm = MAX(anorm,c_sasum(n,&A(1,j)));
   }
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    /*
+     * factor and estimate with LAPACK; z holds 4n doubles and n ints
+     */
+    dgetrf_(&n,&n,a,&lda,ipvt,&info);
+    if (info != 0 || anorm == 0.) {
+      *rcond = 0.;
+      return;
+    }
+    dgecon_("1",&n,a,&lda,&anorm,rcond,z,(int *)(z+4*n),&info,1);
+    return;
+  }
+#endif
+
   /*
    * factor
    */
@@ -8803,6 +11901,13 @@ void c_sgefa(double *a,
   double
     t;
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    dgetrf_(&n,&n,a,&lda,ipvt,info);
+    return;
+  }
+#endif
+
   /*
    * Gaussian elimination with partial pivoting
    */
@@ -8906,6 +12011,16 @@ void c_sgesl(double *a,
   double
     t;
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    int
+      info,nrhs = 1;
+
+    dgetrs_(job == 0 ? "N" : "T",&n,&nrhs,a,&lda,ipvt,b,&n,&info,1);
+    return;
+  }
+#endif
+
   nm1 = n-1;
   if (job == 0) {
     /*
@@ -8978,6 +12093,12 @@ double c_sasum(int     n,
   double
     ans;
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    return dasum_(&n,sx,&c_blas_inc);
+  }
+#endif
+
   ans = 0.;
   if (n <= 0) {
     return ans;
@@ -9037,6 +12158,13 @@ void c_saxpy(int     n,
     return;
   }
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    daxpy_(&n,&sa,sx,&c_blas_inc,sy,&c_blas_inc);
+    return;
+  }
+#endif
+
   m = n%4;
   if (m != 0) {
     /*
@@ -9087,6 +12215,12 @@ double c_sdot(int     n,
   double
     ans;
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    return ddot_(&n,sx,&c_blas_inc,sy,&c_blas_inc);
+  }
+#endif
+
   ans = 0.;
   if (n <= 0) {
     return ans;
@@ -9142,6 +12276,14 @@ void c_sscal(int    n,
   if (n <= 0) {
     return;
   }
+
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    dscal_(&n,&sa,sx,&c_blas_inc);
+    return;
+  }
+#endif
+
   m = n%4;
   if (m != 0) {
     /*
@@ -9186,6 +12328,12 @@ int c_isamax(int     n,
   double
    smax,xmag;
 
+#if defined(DISORT_USE_LAPACK)
+  if (n >= DISORT_LAPACK_MIN_ORDER) {
+    return idamax_(&n,sx,&c_blas_inc);
+  }
+#endif
+
   if (n <= 0) {
     ans = 0;
   }
@@ -9714,6 +12862,50 @@ void c_twostr(disort_state  *ds,
 
 /*============================= end of c_twostr() ========================*/
 
+/*============================= c_twostr_status() ========================*/
+
+/*
+ * Runs c_twostr() and reports failures through the return code instead of
+ * terminating the process: DS_ERR_INPUT if c_twostr_check_inputs() flagged
+ * an error in ierror, DS_ERR_FATAL if c_errmsg(...,DS_ERROR) was raised.
+ * The local arrays of c_twostr() are not released after a fatal error.
+ */
+int c_twostr_status(disort_state  *ds,
+                    disort_output *out,
+                    int            deltam,
+                    double        *gg,
+                    double         radius,
+                    emission_func_t emi_func)
+{
+  int
+    ierr,
+    ierror[TWOSTR_NERR];
+  jmp_buf
+    env,
+    *prev_jmp;
+
+  prev_jmp = c_errmsg_jmp;
+  if (setjmp(env)) {
+    c_errmsg_jmp = prev_jmp;
+    return DS_ERR_FATAL;
+  }
+  c_errmsg_jmp = &env;
+
+  c_twostr(ds,out,deltam,gg,ierror,radius,emi_func);
+
+  c_errmsg_jmp = prev_jmp;
+
+  for (ierr = 0; ierr < TWOSTR_NERR; ierr++) {
+    if (ierror[ierr] != 0) {
+      return DS_ERR_INPUT;
+    }
+  }
+
+  return DS_OK;
+}
+
+/*============================= end of c_twostr_status() =================*/
+
 /*============================= c_chapman() ==============================*/
 
 /*
@@ -10241,28 +13433,20 @@ void c_twostr_solns(disort_state *ds,
 {
   register int
     lc;
-  static int
-    initialized = FALSE;
-  static double
-    big,large,small,little;
+  /*
+   * The calculation of the particular solutions require some care; small,little,
+     big, and large have been set so that no problems should occur in double precision.
+   */
+  const double
+    small  = 1.e+30*DBL_MIN,
+    little = 1.e+20*DBL_MIN,
+    big    = sqrt(DBL_MAX)/1.e+10,
+    large  = log(DBL_MAX)-20.;
   double
     q_1,q_2,qq,q0a,q0,q1a,q2a,q1,q2,
     deltat,denomb,z0p,z0m,arg,sgn,fact3,denomp,
     beta,fact1,fact2;
 
-  if (!initialized) {
-    /*
-     * The calculation of the particular solutions require some care; small,little,
-       big, and large have been set so that no problems should occur in double precision.
-     */
-    small  = 1.e+30*DBL_MIN;
-    little = 1.e+20*DBL_MIN;
-    big    = sqrt(DBL_MAX)/1.e+10;
-    large  = log(DBL_MAX)-20.;
-
-    initialized = TRUE;
-  }
-
   /*----------------  Begin loop on computational layers  ---------------------*/
 
   for (lc = 1; lc <= ncut; lc++) {
@@ -10633,19 +13817,14 @@ void c_twostr_set(disort_state *ds,
                   double       *utaupr,
                   emission_func_t emi_func)
 {
-  static int
-    firstpass = TRUE;
   register int
     lc,lu,lev;
   double
     zenang,abstau,chtau_tmp,f,tempc,taup,
     abscut = 10.;
 
-  if (firstpass) {
-    firstpass = FALSE;
-    ds->nstr  = 2;
-    *nn       = ds->nstr/2;
-  }
+  ds->nstr  = 2;
+  *nn       = ds->nstr/2;
 
   if (!ds->flag.usrtau) {
     /*
@@ -11065,25 +14244,17 @@ double __attribute__((weak)) c_planck_func2(double wnumlo,
 {
   register int
     m,n,smallv,k,i,mmax;
-  static int
-    initialized = FALSE;
   double
     ans,del,val,val0,oldval,exm,
     ex,mv,vsq,wvn,arg,hh,
     d[2],p[2],v[2];
   const double
     vcp[7] = {10.25,5.7,3.9,2.9,2.3,1.9,0.0};
-  static double
-    sigdpi,vmax,conc,c1;
-
-  if (!initialized) {
-    sigdpi = SIGMA/M_PI;
-    vmax   = log(DBL_MAX);
-    conc   = 15./pow(M_PI,4.);
-    c1     = 1.1911e-8;  
-
-    initialized = TRUE;
-  }
+  const double
+    sigdpi = SIGMA/M_PI,
+    vmax   = log(DBL_MAX),
+    conc   = 15./pow(M_PI,4.),
+    c1     = 1.1911e-8;
   if (t < 0. || wnumhi < wnumlo || wnumlo < 0.) {
     c_errmsg("planck_func2--temperature or wavenumbers wrong",DS_ERROR);
   }
@@ -11418,6 +14589,374 @@ void c_disort_out_free(disort_state  *ds,
 
 /*============================= end of c_disort_out_free() ==============*/
 
+/*============================= c_disort_workspace_alloc() ==============*/
+
+/*
+ * Assign the workspace pointers to consecutive slices of base (or only count
+ * the bytes when base is NULL). Doubles and pairs come first, so that every
+ * slice stays 8-byte aligned; the integer arrays are placed at the end.
+ */
+static size_t c_disort_workspace_carve(disort_workspace *ws,
+                                       char             *base)
+{
+  const int
+    nlyr = ws->nlyr,
+    nstr = ws->nstr,
+    numu = ws->numu,
+    ntau = ws->ntau,
+    nphi = ws->nphi,
+    nn   = ws->nstr/2;
+  size_t
+    off = 0;
+
+#define CARVE(name,type,len) \
+  ws->name = base ? (type *)(base+off) : NULL; \
+  off += (size_t)IMAX(len,1)*sizeof(type)
+
+  CARVE(array,double,nstr*nstr);
+  CARVE(b,double,nstr*nlyr);
+  CARVE(bdr,double,(nn+1)*nn);
+  CARVE(bem,double,nn);
+  CARVE(cblock,double,12*nn*nn*nlyr);
+  CARVE(cc,double,nstr*nstr);
+  CARVE(ch,double,nlyr);
+  CARVE(chtau,double,2*nlyr+1);
+  CARVE(cmu,double,nstr);
+  CARVE(cwt,double,nstr);
+  CARVE(dtaucpr,double,nlyr);
+  CARVE(emu,double,numu);
+  CARVE(eval,double,nn);
+  CARVE(evecc,double,nstr*nstr);
+  CARVE(expbea,double,nlyr+1);
+  CARVE(flyr,double,nlyr+1);
+  CARVE(gc,double,nlyr*nstr*nstr);
+  CARVE(gl,double,nlyr*(nstr+1)+1);
+  CARVE(gu,double,nlyr*nstr*numu);
+  CARVE(kk,double,nlyr*nstr);
+  CARVE(ll,double,nlyr*nstr);
+  CARVE(oprim,double,nlyr);
+  CARVE(phasa,double,nlyr);
+  CARVE(phast,double,nlyr);
+  CARVE(phasm,double,nlyr);
+  CARVE(phirad,double,nphi);
+  CARVE(pkag,double,nlyr+1);
+  CARVE(rmu,double,(nn+1)*numu);
+  CARVE(tauc,double,nlyr+1);
+  CARVE(taucpr,double,nlyr+1);
+  CARVE(u0c,double,ntau*nstr);
+  CARVE(utaupr,double,ntau);
+  CARVE(uum,double,ntau*numu);
+  CARVE(wk,double,LINPACK_WORK*nstr);
+  CARVE(xba,double,nlyr+1);
+  CARVE(ylm0,double,nstr+1);
+  CARVE(ylmc,double,nstr*(nstr+1));
+  CARVE(ylmu,double,numu*(nstr+1));
+  CARVE(z,double,nstr*nlyr);
+  CARVE(zbeam,double,nlyr*numu);
+  CARVE(zbeama,double,nlyr+1);
+  CARVE(zj,double,nstr);
+  CARVE(zjg,double,nstr);
+  CARVE(zju,double,numu+1);
+  CARVE(zgu,double,nlyr*numu);
+  CARVE(zz,double,nlyr*nstr);
+  CARVE(zzg,double,nlyr*nstr);
+  CARVE(ab,disort_pair,nn*nn);
+  CARVE(fl,disort_pair,ntau);
+  CARVE(plk,disort_pair,nlyr*nstr);
+  CARVE(xr,disort_pair,nlyr);
+  CARVE(psi,disort_pair,nstr);
+  CARVE(xb,disort_pair,nlyr*nstr);
+  CARVE(zbeamsp,disort_pair,nlyr*nstr);
+  CARVE(zbs,disort_pair,nstr);
+  CARVE(zee,disort_pair,nstr);
+  CARVE(zu,disort_pair,nlyr*numu);
+  CARVE(zbu,disort_triplet,nlyr*numu);
+  CARVE(ipvt,int,nstr*nlyr);
+  CARVE(layru,int,ntau);
+
+#undef CARVE
+
+  return off;
+}
+
+/*
+ * Allocate the scratch arena used by c_disort_ws() as a single block.
+ *
+ * The arena holds at most nlyr layers, nstr streams, numu user polar angles,
+ * ntau user optical depths and nphi azimuthal angles. Since c_disort_ws() may
+ * reset numu to nstr (doubling it for SPECIAL_BC) and ntau to nlyr+1, those
+ * are accounted for here. Returns 0 on success.
+ */
+int c_disort_workspace_alloc(disort_workspace *ws,
+                             int               nlyr,
+                             int               nstr,
+                             int               numu,
+                             int               ntau,
+                             int               nphi)
+{
+  memset(ws,0,sizeof(disort_workspace));
+
+  if (nlyr < 1 || nstr < 2) {
+    c_errmsg("disort_workspace_alloc--nlyr < 1 or nstr < 2",DS_WARNING);
+    return 1;
+  }
+
+  ws->nlyr = nlyr;
+  ws->nstr = nstr;
+  ws->numu = 2*IMAX(numu,nstr);
+  ws->ntau = IMAX(ntau,nlyr+1);
+  ws->nphi = IMAX(nphi,1);
+
+  ws->nbytes = c_disort_workspace_carve(ws,NULL);
+  ws->arena  = (char *)calloc(ws->nbytes,1);
+  if (!ws->arena) {
+    c_errmsg("disort_workspace_alloc--alloc error for arena",DS_WARNING);
+    return 1;
+  }
+  c_disort_workspace_carve(ws,ws->arena);
+
+  return 0;
+}
+
+/*============================= end of c_disort_workspace_alloc() =======*/
+
+/*============================= c_disort_workspace_free() ===============*/
+
+/*
+ * Free memory allocated by c_disort_workspace_alloc()
+ */
+void c_disort_workspace_free(disort_workspace *ws)
+{
+  if (ws->arena) free(ws->arena);
+  if (ws->eig_tag) free(ws->eig_tag);
+  if (ws->eig) free(ws->eig);
+  if (ws->sun) free(ws->sun);
+  if (ws->sun_conv) free(ws->sun_conv);
+  memset(ws,0,sizeof(disort_workspace));
+
+  return;
+}
+
+/*============================= end of c_disort_workspace_free() ========*/
+
+/*============================= c_disort_eigen_cache_alloc() ============*/
+
+/*
+ * Attach an eigen cache of nslot entries to a workspace allocated by
+ * c_disort_workspace_alloc(), replacing any previous one. c_disort_ws() then
+ * reuses the eigensolution of every layer whose scaled phase function it has
+ * seen before, see c_eigen_cache_get(). The cache and its hit and miss counts
+ * persist across calls until c_disort_workspace_free(). nslot = 0 removes
+ * the cache. Each slot takes about 3*nstr*nstr doubles. Returns 0 on success.
+ */
+int c_disort_eigen_cache_alloc(disort_workspace *ws,
+                               int               nslot)
+{
+  if (ws->eig_tag) free(ws->eig_tag);
+  if (ws->eig) free(ws->eig);
+  ws->eig_tag    = NULL;
+  ws->eig        = NULL;
+  ws->eig_nslot  = 0;
+  ws->eig_hits   = 0;
+  ws->eig_misses = 0;
+
+  if (nslot <= 0) {
+    return 0;
+  }
+
+  if (!ws->arena) {
+    c_errmsg("disort_eigen_cache_alloc--workspace not allocated",DS_WARNING);
+    return 1;
+  }
+
+  ws->eig_tag = (unsigned long long *)calloc(nslot,sizeof(unsigned long long));
+  ws->eig     = (double *)malloc((size_t)nslot*EIG_SLOT_SIZE(ws->nstr)*sizeof(double));
+  if (!ws->eig_tag || !ws->eig) {
+    c_errmsg("disort_eigen_cache_alloc--alloc error for eigen cache",DS_WARNING);
+    if (ws->eig_tag) free(ws->eig_tag);
+    if (ws->eig) free(ws->eig);
+    ws->eig_tag = NULL;
+    ws->eig     = NULL;
+    return 1;
+  }
+  ws->eig_nslot = nslot;
+
+  return 0;
+}
+
+/*============================= end of c_disort_eigen_cache_alloc() =====*/
+
+/*============================= c_disort_beam_cache_alloc() =============*/
+
+/*
+ * Allocate the beam cache of one column for c_disort_ws_cached() and
+ * c_disort_ws_jacobian_cached(), sized for ds->nlyr, ds->nstr and ds->nmom;
+ * the cache holds no solution yet. It takes about (3*nlyr+2)*nstr*nstr
+ * doubles. Returns 0 on success.
+ */
+int c_disort_beam_cache_alloc(disort_beam_cache  *cache,
+                              disort_state const *ds)
+{
+  int
+    nn = ds->nstr/2;
+  size_t
+    nkey = BEAM_KEY_SIZE(ds->nlyr,ds->nmom),
+    nv   = (size_t)ds->nstr*ds->nlyr;
+
+  memset(cache,0,sizeof(disort_beam_cache));
+  cache->nlyr = ds->nlyr;
+  cache->nstr = ds->nstr;
+  cache->nmom = ds->nmom;
+
+  cache->ipvt   = (int *)malloc(nv*sizeof(int));
+  cache->key    = (double *)malloc(2*nkey*sizeof(double));
+  cache->cblock = (double *)malloc((size_t)12*nn*nn*ds->nlyr*sizeof(double));
+  cache->gc     = (double *)malloc(nv*ds->nstr*sizeof(double));
+  cache->kk     = (double *)malloc(nv*sizeof(double));
+  cache->zz     = (double *)malloc(nv*sizeof(double));
+  cache->tu     = (double *)malloc(nv*sizeof(double));
+  cache->tw     = (double *)malloc(nv*sizeof(double));
+  if (!cache->ipvt || !cache->key || !cache->cblock || !cache->gc ||
+      !cache->kk || !cache->zz || !cache->tu || !cache->tw) {
+    c_errmsg("disort_beam_cache_alloc--alloc error for beam cache",DS_WARNING);
+    c_disort_beam_cache_free(cache);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Free memory allocated by c_disort_beam_cache_alloc().
+ */
+void c_disort_beam_cache_free(disort_beam_cache *cache)
+{
+  if (cache->ipvt) free(cache->ipvt);
+  if (cache->key) free(cache->key);
+  if (cache->cblock) free(cache->cblock);
+  if (cache->gc) free(cache->gc);
+  if (cache->kk) free(cache->kk);
+  if (cache->zz) free(cache->zz);
+  if (cache->tu) free(cache->tu);
+  if (cache->tw) free(cache->tw);
+  memset(cache,0,sizeof(disort_beam_cache));
+
+  return;
+}
+
+/*============================= end of c_disort_beam_cache_alloc() ======*/
+
+/*============================= c_disort_tables_alloc() =================*/
+
+/*
+ * Build the tables of c_disort_ws() that depend only on ds->nstr and, when
+ * intensities are computed at user angles, on ds->umu: the Gauss quadrature
+ * CMU, CWT and the normalized associated Legendre polynomials YLMC and YLMU
+ * for every azimuthal order. They are filled exactly as c_disort_ws() fills
+ * them, so results do not change.
+ *
+ * Point disort_workspace.tab of any number of workspaces at tab. The tables
+ * are only read, so threads can share them; they are used by every call
+ * whose nstr matches, and YLMU by every call whose user angles also match.
+ * Returns 0 on success.
+ */
+int c_disort_tables_alloc(disort_tables      *tab,
+                          disort_state const *ds)
+{
+  int
+    nstr = ds->nstr,
+    nn   = ds->nstr/2,
+    numu = 0,
+    mazim,iq,l;
+  size_t
+    nylmc,nylmu;
+  double
+    sgn;
+  double
+    *cmu,*ylmc,*ylmu;
+
+  memset(tab,0,sizeof(disort_tables));
+
+  if (nstr < 2) {
+    c_errmsg("disort_tables_alloc--nstr < 2",DS_WARNING);
+    return 1;
+  }
+  if (!ds->flag.onlyfl && ds->flag.usrang) {
+    numu = ds->numu;
+  }
+
+  nylmc = (size_t)nstr*(nstr+1);
+  nylmu = (size_t)numu*(nstr+1);
+
+  tab->nstr = nstr;
+  tab->numu = numu;
+  tab->cmu  = (double *)calloc(nn,sizeof(double));
+  tab->cwt  = (double *)calloc(nn,sizeof(double));
+  tab->umu  = (double *)calloc(IMAX(numu,1),sizeof(double));
+  tab->ylmc = (double *)calloc(nstr*nylmc,sizeof(double));
+  tab->ylmu = (double *)calloc(IMAX(nstr*nylmu,1),sizeof(double));
+  if (!tab->cmu || !tab->cwt || !tab->umu || !tab->ylmc || !tab->ylmu) {
+    c_errmsg("disort_tables_alloc--alloc error for tables",DS_WARNING);
+    c_disort_tables_free(tab);
+    return 1;
+  }
+
+  c_gaussian_quadrature(nn,tab->cmu,tab->cwt);
+  if (numu > 0) {
+    memcpy(tab->umu,ds->umu,numu*sizeof(double));
+  }
+
+  /*
+   * The recurrences for order mazim start from order mazim-1, so each order
+   * is computed in place of the previous one and then copied, as in c_disort_solve()
+   */
+  cmu = tab->cmu;
+  for (mazim = 0; mazim < nstr; mazim++) {
+    ylmc = tab->ylmc+mazim*nylmc;
+    ylmu = tab->ylmu+mazim*nylmu;
+    if (mazim > 0) {
+      memcpy(ylmc,ylmc-nylmc,nylmc*sizeof(double));
+      memcpy(ylmu,ylmu-nylmu,nylmu*sizeof(double));
+    }
+
+    if (numu > 0) {
+      c_legendre_poly(numu,mazim,nstr,nstr-1,tab->umu,ylmu);
+    }
+    c_legendre_poly(nn,mazim,nstr,nstr-1,cmu,ylmc);
+
+    sgn = -1.;
+    for (l = mazim; l <= nstr-1; l++) {
+      sgn *= -1.;
+      for (iq = nn+1; iq <= nstr; iq++) {
+        YLMC(l,iq) = sgn*YLMC(l,iq-nn);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*============================= end of c_disort_tables_alloc() ==========*/
+
+/*============================= c_disort_tables_free() ==================*/
+
+/*
+ * Free memory allocated by c_disort_tables_alloc()
+ */
+void c_disort_tables_free(disort_tables *tab)
+{
+  if (tab->cmu)  free(tab->cmu);
+  if (tab->cwt)  free(tab->cwt);
+  if (tab->umu)  free(tab->umu);
+  if (tab->ylmc) free(tab->ylmc);
+  if (tab->ylmu) free(tab->ylmu);
+  memset(tab,0,sizeof(disort_tables));
+
+  return;
+}
+
+/*============================= end of c_disort_tables_free() ===========*/
+
 /*============================= c_twostr_state_alloc() ==================*/
 
 /*
@@ -11535,7 +15074,7 @@ double *c_dbl_vector(int  nl,
 
   if (nh < nl) {
     fprintf(stderr,"\n\n**error:%s, variable %s, range (%d,%d)\n","dbl_vector",name,nl,nh);
-    exit(1);
+    c_errmsg("dbl_vector--bad range",DS_ERROR);
   }
 
   nl_safe  = (nl < 0) ? nl : 0;
@@ -11575,7 +15114,7 @@ int *c_int_vector(int  nl,
 
   if (nh < nl) {
     fprintf(stderr,"\n\n**error:%s, variable %s, range (%d,%d)\n","int_vector",name,nl,nh);
-    exit(1);
+    c_errmsg("int_vector--bad range",DS_ERROR);
   }
 
   nl_safe  = (nl < 0) ? nl : 0;
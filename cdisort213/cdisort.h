@@ -71,7 +71,9 @@ typedef struct {
     intensity_correction,      /* apply intensity correction                           */
     old_intensity_correction,  /* use original intensity correction routine            */
     general_source,      /* Include solution for a general user specified source term. */         
-    output_uum; /* TRUE=> uum is returned as a seperate output                         */
+    output_uum, /* TRUE=> uum is returned as a seperate output                         */
+    symmetric_eigen, /* TRUE=> solve the reduced eigenproblem in symmetric form        */
+    skip_rcond; /* TRUE=> skip the condition estimate of the linear system            */
 } disort_flag;
 
 typedef struct {
@@ -196,6 +198,73 @@ typedef struct disort_output {
 		  allocated space or used otherwise)                                   */
 } disort_output;
 
+/*
+ * Response of the medium to a Lambertian surface, from c_disort_ws_surface().
+ * The solution is for a black surface; with albedo A the surface instead
+ * sends up the flux
+ *
+ *   fs = (A*(fdn-sphalb*(femit+ffluor)) + (1-A)*femit + ffluor)/(1-A*sphalb)
+ *
+ * and the up- and down-flux at user level lu grow by (fs-femit-ffluor)*UP(lu)
+ * and (fs-femit-ffluor)*DN(lu). All fluxes are zero if the layers were cut.
+ */
+typedef struct disort_surface {
+  double
+    fdn,       /* Down-flux (direct + diffuse) reaching the black surface              */
+    femit,     /* Thermal flux emitted by the black surface, pi*B(btemp)               */
+    ffluor,    /* Flux of the bottom-boundary isotropic illumination, pi*fluor         */
+    sphalb,    /* Spherical albedo of the medium for illumination from below           */
+    *up,       /* Up-flux at user level UP(lu) per unit flux leaving the surface       */
+    *dn;       /* Diffuse down-flux at user level DN(lu) per unit flux likewise        */
+} disort_surface;
+
+/*
+ * Derivatives of the fluxes at the layer boundaries from c_disort_ws_jacobian(),
+ * for the up-flux FLUP (d = 0) and the total down-flux RFLDIR+RFLDN (d = 1) at
+ * level lu = 1..ntau; all zero at levels below a cut of the layers.
+ *
+ * If seed is not NULL, prop, albedo and temper hold instead the derivatives of
+ * the sum of SEED(lu,d) times the fluxes, without the leading (ntau,2).
+ */
+typedef struct disort_jacobian {
+  double
+    *prop,     /* PROP(lu,d,lc,q) with respect to DTAUC (q = 0), SSALB (q = 1) and
+                  PMOM(k) (q = k+1, k = 1..nstr), (ntau,2,nlyr,nstr+2)               */
+    *albedo,   /* ALBEDO(lu,d) with respect to the Lambertian albedo, (ntau,2)         */
+    *temper,   /* TEMPER(lu,d,lev) with respect to TEMPER(lev), (ntau,2,nlyr+1)        */
+    *seed;     /* Weights SEED(lu,d) of the fluxes, (ntau,2), or NULL                  */
+} disort_jacobian;
+
+/*
+ * Beam solution of one column kept from one c_disort_ws_cached() or
+ * c_disort_ws_jacobian_cached() call to the next: the eigensolutions, the
+ * beam particular solutions and the factored matrix of c_set_matrix(),
+ * together with the thermal particular solutions for unit Planck sources. They depend on the optical properties, the beam
+ * and the albedo but not on the temperatures, so that a call which only
+ * changes TEMPER, btemp, ttemp, temis or fisot reuses them and only solves
+ * for the new right-hand side.
+ */
+typedef struct disort_beam_cache {
+  int
+    nlyr,      /* Number of layers the cache was allocated for                    */
+    nstr,      /* Number of streams                                               */
+    nmom,      /* Number of phase function moments                                */
+    valid,     /* TRUE once a solution is stored                                  */
+    ncol,      /* Number of columns of the stored matrix                          */
+    *ipvt;     /* Pivot indices of c_block_factor()                               */
+  long
+    hits,      /* Calls that reused the stored solution                           */
+    misses;    /* Calls that solved and stored it                                 */
+  double
+    *key,      /* Inputs of the stored solution, then those of the current call   */
+    *cblock,   /* Factored matrix CBLOCK                                          */
+    *gc,       /* Eigenvectors GC                                                 */
+    *kk,       /* Eigenvalues KK                                                  */
+    *zz,       /* Beam particular solutions ZZ                                    */
+    *tu,       /* Thermal particular solution TU(iq,lc) for XR0 = 1, XR1 = 0      */
+    *tw;       /* Its part TW(iq,lc) linear in tau for XR0 = 0, XR1 = 1           */
+} disort_beam_cache;
+
 typedef struct {
   double
     zero,
@@ -242,6 +311,87 @@ typedef struct {
     zp_a;   /* Alfa coefficient in Eq. KST(22) for thermal source                             */
 } twostr_xyz;
 
+/*
+ * Read-only tables that depend only on nstr and the user polar angles, built
+ * once by c_disort_tables_alloc() and shared by the workspaces of all threads
+ * through disort_workspace.tab. c_disort_ws() then skips the Gauss quadrature
+ * and the Legendre polynomials at the quadrature and user angles.
+ */
+typedef struct disort_tables {
+  int
+    nstr,      /* Number of streams the tables were built for                     */
+    numu;      /* Number of user polar angles of ylmu, 0 if ylmu was not built    */
+  double
+    *cmu,      /* Gauss quadrature abscissae on (0,1), CMU(iq), iq = 1..nstr/2    */
+    *cwt,      /* Corresponding quadrature weights, CWT(iq)                       */
+    *umu,      /* User polar angle cosines ylmu was built for, UMU(iu)            */
+    *ylmc,     /* YLMC(l,iq) of azimuthal order mazim at ylmc+mazim*nstr*(nstr+1) */
+    *ylmu;     /* YLMU(l,iu) of azimuthal order mazim at ylmu+mazim*numu*(nstr+1) */
+} disort_tables;
+
+/*
+ * Scratch arena for c_disort_ws()
+ *
+ * All internal arrays of c_disort() are carved out of a single block that is
+ * allocated once by c_disort_workspace_alloc() and zeroed (not reallocated)
+ * at the start of every c_disort_ws() call. A workspace may be reused for any
+ * disort_state whose dimensions do not exceed the ones it was sized for, but
+ * it must not be shared by two concurrent calls.
+ */
+typedef struct disort_workspace {
+  int
+    nlyr,      /* Maximum number of computational layers                          */
+    nstr,      /* Maximum number of streams                                       */
+    numu,      /* Maximum number of polar angles (incl. SPECIAL_BC doubling)      */
+    ntau,      /* Maximum number of output optical depths                         */
+    nphi;      /* Maximum number of azimuthal angles                              */
+  size_t
+    nbytes;    /* Size of the arena in bytes                                      */
+  char
+    *arena;    /* Single block backing all of the pointers below                  */
+  disort_tables const
+    *tab;      /* Optional shared tables, set by the caller and not owned         */
+  int
+    *ipvt,*layru;
+  double
+    *array,*b,*bdr,*bem,*cblock,*cc,*ch,*chtau,
+    *cmu,*cwt,*dtaucpr,*emu,*eval,*evecc,*expbea,
+    *flyr,*gc,*gl,*gu,*kk,*ll,
+    *oprim,*phasa,*phast,*phasm,*phirad,*pkag,
+    *rmu,*tauc,*taucpr,*u0c,*utaupr,*uum,
+    *wk,*xba,*ylm0,*ylmc,*ylmu,
+    *z,*zbeam,*zbeama,*zj,*zjg,*zju,*zgu,*zz,*zzg;
+  disort_pair
+    *ab,*fl,*plk,*xr,*psi,*xb,*zbeamsp,*zbs,*zee,*zu;
+  disort_triplet
+    *zbu;
+  /*
+   * Optional eigen cache, see c_disort_eigen_cache_alloc(). It is allocated
+   * apart from the arena, so that it survives from one c_disort_ws() call to
+   * the next.
+   */
+  int
+    eig_nslot;   /* Number of slots, 0 if there is no cache                       */
+  long
+    eig_hits,    /* Layers whose eigensolution was taken from the cache           */
+    eig_misses;  /* Layers whose eigensolution was computed and stored            */
+  unsigned long long
+    *eig_tag;    /* Hash of the key held by each slot, 0 if the slot is empty     */
+  double
+    *eig;        /* Key and eigensolution of each slot                            */
+  /*
+   * Per-sun storage of c_disort_ws_suns(), also apart from the arena. It
+   * grows to the largest number of suns asked for.
+   */
+  int
+    sun_nmax,    /* Number of suns the storage holds, 0 if none                   */
+    *sun_conv;   /* NAZ of each sun, followed by KCONV of each sun                */
+  size_t
+    sun_size;    /* Doubles per sun in sun                                        */
+  double
+    *sun;        /* UMU0, EXPBEA, YLM0, ZZ, ZBEAM and PHIRAD of each sun, then GU */
+} disort_workspace;
+
 /*
  * Array shift macros
  * Using unit-offset shift macros to match Fortran version
@@ -261,6 +411,7 @@ typedef struct {
 #define BEM(iq)          bem[iq-1]
 
 #define CBAND(irow,ncol) cband[irow-1+(ncol-1)*(9*(ds->nstr/2)-2)]
+#define CBLOCK(irow,jcol,lc) cblock[irow-1+(jcol-1)*(3*(ds->nstr/2))+(lc-1)*12*(ds->nstr/2)*(ds->nstr/2)]
 #define CC(iq,jq)        cc[iq-1+(jq-1)*ds->nstr]
 #define CH(lc)           ch[lc-1]
 #define CHTAU(ls)        chtau[ls]
@@ -444,6 +595,19 @@ typedef struct {
 #define DS_WARNING 0
 #define DS_ERROR   1
 
+/*
+ * Return codes of c_disort(), the c_disort_ws*() calls and c_twostr_status()
+ *
+ * Only these entry points are safe to embed in a host process: they report
+ * every failure, including a failed self-test, through their return code.
+ * Any other call that reaches c_errmsg(...,DS_ERROR), such as c_twostr()
+ * itself, exits the process.
+ */
+#define DS_OK            0  /* success                                          */
+#define DS_ERR_INPUT     1  /* c_check_inputs() rejected the input              */
+#define DS_ERR_WORKSPACE 2  /* workspace missing or smaller than ds             */
+#define DS_ERR_FATAL     3  /* c_errmsg(...,DS_ERROR) was raised during the solve */
+
 #define VERBOSE 0
 #define QUIET   1
 
@@ -544,12 +708,79 @@ double c_planck_func2(double wnumlo,
                       double wnumhi,
                       double t);
 
+/*
+ * Band-integrated emission (wnumlo, wnumhi, t). The solvers call it only
+ * after their input checks, with t >= 0 and 0 <= wnumlo <= wnumhi. It must
+ * not raise c_errmsg(...,DS_ERROR) itself when it is (or calls) C++ code,
+ * such as a thunk forwarding to a std::function: the longjmp back to
+ * c_disort_ws() would skip the C++ frames in between.
+ */
 typedef double(*emission_func_t)(double, double, double);
 
 int c_disort(disort_state  *ds,
               disort_output *out,
               emission_func_t emi_func);
 
+int c_disort_ws(disort_state     *ds,
+                disort_output    *out,
+                disort_workspace *ws,
+                emission_func_t   emi_func);
+
+int c_disort_ws_suns(disort_state     *ds,
+                     disort_output    *out,
+                     int               nsun,
+                     double const     *umu0,
+                     double const     *phi0,
+                     disort_workspace *ws,
+                     emission_func_t   emi_func);
+
+int c_disort_ws_surface(disort_state     *ds,
+                        disort_output    *out,
+                        disort_surface   *surf,
+                        disort_workspace *ws,
+                        emission_func_t   emi_func);
+
+int c_disort_ws_jacobian(disort_state     *ds,
+                         disort_output    *out,
+                         disort_jacobian  *jac,
+                         disort_workspace *ws,
+                         emission_func_t   emi_func);
+
+int c_disort_ws_cached(disort_state      *ds,
+                       disort_output     *out,
+                       disort_workspace  *ws,
+                       disort_beam_cache *cache,
+                       emission_func_t    emi_func);
+
+int c_disort_ws_jacobian_cached(disort_state      *ds,
+                                disort_output     *out,
+                                disort_jacobian   *jac,
+                                disort_workspace  *ws,
+                                disort_beam_cache *cache,
+                                emission_func_t    emi_func);
+
+int c_disort_workspace_alloc(disort_workspace *ws,
+                             int               nlyr,
+                             int               nstr,
+                             int               numu,
+                             int               ntau,
+                             int               nphi);
+
+void c_disort_workspace_free(disort_workspace *ws);
+
+int c_disort_eigen_cache_alloc(disort_workspace *ws,
+                               int               nslot);
+
+int c_disort_beam_cache_alloc(disort_beam_cache  *cache,
+                              disort_state const *ds);
+
+void c_disort_beam_cache_free(disort_beam_cache *cache);
+
+int c_disort_tables_alloc(disort_tables      *tab,
+                          disort_state const *ds);
+
+void c_disort_tables_free(disort_tables *tab);
+
 double c_bidir_reflectivity ( double       wvnmlo,
 			      double       wvnmhi,
 			      double       mu,
@@ -592,6 +823,13 @@ void c_asymmetric_matrix(double *aa,
                          int    *ier,
                          double *wk);
 
+void c_symmetric_matrix(double *aa,
+                        double *eval,
+                        int     m,
+                        int     ia,
+                        int    *ier,
+                        double *wk);
+
 void c_intensity_components(disort_state *ds,
                             double       *gc,
                             double       *kk,
@@ -631,6 +869,76 @@ void c_fluxes(disort_state  *ds,
               disort_pair   *fl,
               double        *u0c);
 
+void c_surface_response(disort_state   *ds,
+                        disort_surface *surf,
+                        double          bplanck,
+                        double         *b,
+                        double         *cblock,
+                        double         *cmu,
+                        double         *cwt,
+                        double         *dtaucpr,
+                        double         *expbea,
+                        double         *gc,
+                        int            *ipvt,
+                        double         *kk,
+                        int            *layru,
+                        double         *ll,
+                        double         *llr,
+                        int             lyrcut,
+                        int             ncol,
+                        int             ncut,
+                        int             nn,
+                        double         *taucpr,
+                        double         *utaupr,
+                        double         *zz,
+                        disort_pair    *plk);
+
+int c_flux_jacobian(disort_state    *ds,
+                    disort_jacobian *jac,
+                    emission_func_t  emi_func,
+                    double           bplanck,
+                    double          *cblock,
+                    double          *cmu,
+                    double          *cwt,
+                    double          *dtaucpr,
+                    double          *expbea,
+                    double          *flyr,
+                    double          *gc,
+                    double          *gl,
+                    int             *ipvt,
+                    double          *kk,
+                    double          *ll,
+                    int              lyrcut,
+                    int              ncol,
+                    int              ncut,
+                    int              nn,
+                    double          *taucpr,
+                    double          *ylm0,
+                    double          *ylmc,
+                    double          *zz,
+                    disort_pair     *xr,
+                    disort_pair     *plk);
+
+void c_absorption_only(disort_state  *ds,
+                       disort_output *out,
+                       double         bplanck,
+                       double         tplanck,
+                       double        *cmu,
+                       double        *cwt,
+                       double        *dtaucpr,
+                       double        *expbea,
+                       int           *layru,
+                       int            lyrcut,
+                       int            ncut,
+                       int            nn,
+                       double        *pkag,
+                       double        *taucpr,
+                       double        *utaupr,
+                       double        *lev,
+                       disort_pair   *xr,
+                       disort_pair   *fl,
+                       double        *u0c);
+
 void c_intensity_correction(disort_state  *ds,
                             disort_output *out,
                             double         dither,
@@ -704,30 +1012,31 @@ double calc_phase_squared (int           nphase,
 			   int          *neg_phas,
 			   double        norm_phas);
 
-void c_disort_set(disort_state *ds,
-                  double       *ch,
-                  double       *chtau,
-                  double       *cmu,
-                  double       *cwt,
-                  int           deltam,
-                  double       *dtaucpr,
-                  double       *expbea,
-                  double       *flyr,
-                  double       *gl,
-                  int          *layru,
-                  int          *lyrcut,
-                  int          *ncut,
-                  int          *nn,
-                  int          *corint,
-                  double       *oprim,
-                  double       *tauc,
-                  double       *taucpr,
-                  double       *utaupr,
-                  emission_func_t emi_func);
+void c_disort_set(disort_state        *ds,
+                  disort_tables const *tab,
+                  double              *ch,
+                  double              *chtau,
+                  double              *cmu,
+                  double              *cwt,
+                  int                  deltam,
+                  double              *dtaucpr,
+                  double              *expbea,
+                  double              *flyr,
+                  double              *gl,
+                  int                 *layru,
+                  int                 *lyrcut,
+                  int                 *ncut,
+                  int                 *nn,
+                  int                 *corint,
+                  double              *oprim,
+                  double              *tauc,
+                  double              *taucpr,
+                  double              *utaupr,
+                  emission_func_t      emi_func);
 
 void c_set_matrix(disort_state *ds,
                   double       *bdr,
-                  double       *cband,
+                  double       *cblock,
                   double       *cmu,
                   double       *cwt,
                   double        delm0,
@@ -740,6 +1049,22 @@ void c_set_matrix(disort_state *ds,
                   double       *taucpr,
                   double       *wk);
 
+void c_block_factor(disort_state *ds,
+                    double       *cblock,
+                    int           ncut,
+                    int           nn,
+                    int          *ipvt,
+                    double       *rcond,
+                    double       *z);
+
+void c_block_solve(disort_state *ds,
+                   double       *cblock,
+                   int           ncut,
+                   int           nn,
+                   int          *ipvt,
+                   double       *b,
+                   int           job);
+
 double c_single_scat(double   dither,
                      int      layru,
                      int      nlyr,
@@ -768,12 +1093,74 @@ void c_solve_eigen(disort_state *ds,
                    double       *gc,
                    double       *wk);
 
+int c_solve_eigen_symmetric(disort_state *ds,
+                            int           lc,
+                            disort_pair  *ab,
+                            double       *array,
+                            double       *cmu,
+                            double       *cwt,
+                            double       *gl,
+                            int           mazim,
+                            int           nn,
+                            double       *ylmc,
+                            double       *cc,
+                            double       *evecc,
+                            double       *eval,
+                            double       *wk);
+
+int c_eigen_cache_get(disort_state     *ds,
+                      disort_workspace *ws,
+                      int               lc,
+                      double           *gl,
+                      int               mazim,
+                      double           *cc,
+                      double           *evecc,
+                      double           *eval,
+                      double           *kk,
+                      double           *gc);
+
+void c_eigen_cache_put(disort_state     *ds,
+                       disort_workspace *ws,
+                       int               lc,
+                       double           *gl,
+                       int               mazim,
+                       double           *cc,
+                       double           *evecc,
+                       double           *eval,
+                       double           *kk,
+                       double           *gc);
+
+int c_beam_cache_get(disort_state      *ds,
+                     disort_beam_cache *cache,
+                     double            *cblock,
+                     double            *gc,
+                     int               *ipvt,
+                     double            *kk,
+                     int               *ncol,
+                     double            *zz);
+
+void c_beam_cache_put(disort_state      *ds,
+                      disort_beam_cache *cache,
+                      double            *cblock,
+                      double            *gc,
+                      int               *ipvt,
+                      double            *kk,
+                      int                ncol,
+                      double            *zz);
+
+void c_beam_cache_plk(disort_state      *ds,
+                      disort_beam_cache *cache,
+                      int                lc,
+                      int                nn,
+                      disort_pair       *xr,
+                      disort_pair       *plk);
+
 void c_solve0(disort_state *ds,
               double       *b,
               double       *bdr,
               double       *bem,
               double        bplanck,
-              double       *cband,
+              double       *cblock,
               double       *cmu,
               double       *cwt,
               double       *expbea,
@@ -786,7 +1173,6 @@ void c_solve0(disort_state *ds,
               int           nn,
               double        tplanck,
               double       *taucpr,
-              double       *z,
 	      disort_pair  *zbeamsp,
 	      double       *zbeama,
               double       *zz,
@@ -926,6 +1312,17 @@ void c_upisot(disort_state *ds,
               disort_pair  *zee,
               disort_pair  *plk);
 
+void c_upisot_unit(disort_state *ds,
+                   int           lc,
+                   double       *array,
+                   double       *cc,
+                   double       *cmu,
+                   int          *ipvt,
+                   double       *oprim,
+                   double       *wk,
+                   double       *tu,
+                   double       *tw);
+
 void c_user_intensities(disort_state   *ds,
                         double          bplanck,
                         double         *cmu,
@@ -1004,10 +1401,10 @@ double c_ratio(double a,
 int c_fcmp(double x1,
            double x2);
 
-void c_self_test(int            compare,
-                 int           *prntu0,
-                 disort_state  *ds,
-                 disort_output *out);
+int c_self_test(int            compare,
+                int           *prntu0,
+                disort_state  *ds,
+                disort_output *out);
 
 void c_albtrans(disort_state  *ds,
                 disort_output *out,
@@ -1015,7 +1412,7 @@ void c_albtrans(disort_state  *ds,
                 double        *array,
                 double        *b,
                 double        *bdr,
-                double        *cband,
+                double        *cblock,
                 double        *cc,
                 double        *cmu,
                 double        *cwt,
@@ -1048,7 +1445,7 @@ void c_print_albtrans(disort_state  *ds,
                       disort_output *out);
 
 void c_solve1(disort_state *ds,
-              double       *cband,
+              double       *cblock,
               int           ihom,
               int          *ipvt,
               int           ncol,
@@ -1151,6 +1548,13 @@ void c_twostr(disort_state  *ds,
               double         radius,
               emission_func_t emi_func);
 
+int c_twostr_status(disort_state  *ds,
+                    disort_output *out,
+                    int            deltam,
+                    double        *gg,
+                    double         radius,
+                    emission_func_t emi_func);
+
 double c_chapman(int     lc,
                  double  taup,
                  double *tauc,
@@ -85,6 +85,10 @@ Examples:
        - turn on general source
      * - 'output_uum'
        - output azimuthal components of the intensity
+     * - 'symmetric_eigen'
+       - solve the eigenvalue problem in its symmetric form of half size
+     * - 'skip_rcond'
+       - skip the condition estimate of the boundary-value system
      * - 'print-input'
        - print input parameters
      * - 'print-fluxes'
@@ -323,6 +327,320 @@ Examples:
   >>> print(op)
         )")
 
+      .ADD_OPTION(bool, disort::DisortOptions, pooled, R"(
+Set or get whether disort states are pooled per thread
+
+By default, one disort state and output is kept for each (wave, column),
+which :meth:`Disort.gather_flx` and :meth:`Disort.gather_rad` read from.
+With pooled states, only one disort state per thread is allocated and
+memory no longer grows with ``nwave * ncol``; the fluxes returned by
+``forward`` are then the only outputs, unless buffers are given to
+:meth:`Disort.set_gather_buffers`.
+
+Args:
+  pooled (bool, optional): whether to pool disort states
+
+Returns:
+  pydisort.DisortOptions | bool: class object if argument is not empty, otherwise the pooled flag
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().nwave(5000).ncol(256).pooled(True)
+  >>> print(op)
+        )")
+
+      .ADD_OPTION(std::string, disort::DisortOptions, solver, R"(
+Set or get the radiative transfer solver
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Solver
+    - Description
+  * - 'disort'
+    - discrete ordinates with ``ds().nstr`` streams (default)
+  * - 'twostr'
+    - two-stream approximation, fluxes only
+
+The two-stream solver takes the same inputs and returns the same output
+layout, at a fraction of the cost per column. It only uses the first phase
+function moment (the asymmetry factor) and sets the 'onlyfl' flag.
+
+Args:
+  solver (str, optional): name of the solver
+
+Returns:
+  pydisort.DisortOptions | str: class object if argument is not empty, otherwise the solver
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().solver("twostr")
+        )")
+
+      .ADD_OPTION(std::string, disort::DisortOptions, schedule, R"(
+Set or get the order in which threads solve the columns
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Schedule
+    - Description
+  * - 'static'
+    - fixed blocks of columns per thread (default)
+  * - 'dynamic'
+    - idle threads take the next column
+  * - 'cost'
+    - like 'dynamic', starting from the columns of highest estimated cost
+
+Columns with scattering layers, a beam source or azimuthal harmonics cost
+more to solve; the dynamic schedules keep threads busy at the tail of a run.
+See :meth:`Disort.schedule_stats` for the resulting load balance.
+
+Args:
+  schedule (str, optional): name of the schedule
+
+Returns:
+  pydisort.DisortOptions | str: class object if argument is not empty, otherwise the schedule
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().ncol(256).schedule("cost")
+        )")
+
+      .ADD_OPTION(std::string, disort::DisortOptions, engine, R"(
+Set or get the engine that solves the columns on CPU
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Engine
+    - Description
+  * - 'cdisort'
+    - one column at a time with c_disort (default)
+  * - 'batched'
+    - :meth:`lanes` columns in lockstep, fluxes only
+
+The batched engine vectorizes the eigenvalue problem, the particular
+solutions and the linear system across columns of the same size. It needs a
+Lambertian surface in plane-parallel geometry. Unlike c_disort, it does not
+cut off layers below an absorption optical depth of 10. Runs that need
+intensities, and columns that fail its input checks, are solved with
+c_disort. Without the 'onlyfl' flag this includes every forward call that
+gathers radiances, as the default outputs do; pass ``outputs=output_flux``
+or set 'onlyfl' to use the batched engine.
+:meth:`Disort.schedule_stats` counts the columns it solved.
+
+Only the batched engine has kernels compiled for 4, 8, 16 and 32 streams;
+'cdisort', and every column that falls back to c_disort, solves any number
+of streams with the same code.
+
+Args:
+  engine (str, optional): name of the engine
+
+Returns:
+  pydisort.DisortOptions | str: class object if argument is not empty, otherwise the engine
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().flags("lamber,onlyfl").engine("batched")
+        )")
+
+      .ADD_OPTION(int, disort::DisortOptions, lanes, R"(
+Set or get the number of columns solved together by the batched engine
+
+Args:
+  lanes (int, optional): 4, 8 or 16
+
+Returns:
+  pydisort.DisortOptions | int: class object if argument is not empty, otherwise the number of lanes
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().engine("batched").lanes(16)
+        )")
+
+      .ADD_OPTION(bool, disort::DisortOptions, planck_table, R"(
+Set or get whether thermal emission is tabulated
+
+When set together with the 'planck' flag, the emission function is evaluated
+once per wave bin on the temperature grid given by :meth:`planck_tgrid` and
+interpolated afterwards. Temperatures outside of the grid fall back to the
+emission function. The interpolation error is below 1e-5 relative with the
+default grid.
+
+Args:
+  planck_table (bool, optional): whether to tabulate thermal emission
+
+Returns:
+  pydisort.DisortOptions | bool: class object if argument is not empty, otherwise the planck_table flag
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().flags("planck").planck_table(True)
+        )")
+
+      .ADD_OPTION(std::vector<double>, disort::DisortOptions, planck_tgrid,
+                  R"(
+Set or get the temperature grid of the emission table
+
+Args:
+  planck_tgrid (list[float], optional): [tmin, tmax, dt] in K
+
+Returns:
+  pydisort.DisortOptions | list[float]: class object if argument is not empty, otherwise the temperature grid
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().planck_tgrid([100., 400., 0.5])
+        )")
+
+      .ADD_OPTION(int, disort::DisortOptions, eigen_cache, R"(
+Set or get the number of eigensolutions cached per thread
+
+Layers with the same delta-M scaled single-scattering albedo and phase moments
+share one eigendecomposition across layers, columns, wave bins and forward
+calls. Results are identical to the uncached solver. Each entry takes about
+3 * nstr * nstr doubles. 0 disables the cache. See
+:meth:`Disort.eigen_cache_stats` for the hits and misses.
+
+Args:
+  eigen_cache (int, optional): number of cache entries per thread
+
+Returns:
+  pydisort.DisortOptions | int: class object if argument is not empty, otherwise the number of cache entries
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().eigen_cache(256)
+        )")
+
+      .ADD_OPTION(bool, disort::DisortOptions, beam_cache, R"(
+Set or get whether each column keeps its beam solution between forward calls
+
+A column whose optical properties, beam and albedo are the same as in the
+previous call then reuses its eigensolutions, beam source and factored
+boundary-condition matrix, and only solves for the thermal source of the new
+temperatures (``temf``, ``btemp``, ``ttemp``, ``temis``, ``fisot``). Results
+equal those of the uncached solver up to round-off. Each column keeps about
+3 * nlyr * nstr * nstr doubles. Needs solver 'disort' and ``pooled(False)``;
+only fluxes of one sun are served from the cache. See
+:meth:`Disort.beam_cache_stats` for the hits and misses.
+
+Args:
+  beam_cache (bool, optional): whether to keep the beam solutions
+
+Returns:
+  pydisort.DisortOptions | bool: class object if argument is not empty, otherwise the flag
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().beam_cache(True)
+        )")
+
+      .ADD_OPTION(bool, disort::DisortOptions, incremental, R"(
+Set or get whether forward only solves the columns whose inputs changed
+
+Each (wave, column) pair keeps a fingerprint of its optical properties,
+boundary conditions and temperatures together with its last outputs. A column
+whose inputs are bit-identical to those of its last solve returns these
+outputs without being solved. Needs ``pooled(False)``. Calls with several
+suns, :meth:`Disort.forward_albedo` and :meth:`Disort.forward_jacobian` solve
+every column, and columns are solved one at a time rather than by the batched
+engine. See :meth:`Disort.incremental_stats` for the dirty fraction.
+
+Args:
+  incremental (bool, optional): whether to skip unchanged columns
+
+Returns:
+  pydisort.DisortOptions | bool: class object if argument is not empty, otherwise the flag
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().incremental(True)
+        )")
+
+      .ADD_OPTION(double, disort::DisortOptions, reuse_tol, R"(
+Set or get the relative change of the inputs below which a column is not solved again
+
+A column whose ``dtauc``, ``ssalb``, phase moments, boundary conditions and
+temperatures each changed by at most ``reuse_tol`` times their largest
+magnitude since the last time it was solved returns the outputs of that solve.
+The reference is the last solve, not the last call, so that slow drifts
+eventually trigger a new solve. 0 solves every column. Needs
+``pooled(False)`` and applies to the same calls as
+:meth:`DisortOptions.incremental`. See :meth:`Disort.incremental_stats` for
+the fraction of reused columns.
+
+Args:
+  reuse_tol (float, optional): largest relative change of a reused column
+
+Returns:
+  pydisort.DisortOptions | float: class object if argument is not empty, otherwise the tolerance
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().reuse_tol(1.e-3)
+        )")
+
+      .ADD_OPTION(bool, disort::DisortOptions, reuse_correct, R"(
+Set or get whether the fluxes of reused columns are corrected to first order
+
+Each solve then also computes the derivatives of the fluxes, at the cost of
+:meth:`Disort.forward_jacobian`. A reused column adds these derivatives times
+the change of ``prop``, ``albedo`` and ``temf`` since its solve to its up and
+down flux. Other outputs are not corrected. Has the requirements of
+:meth:`Disort.forward_jacobian`.
+
+Args:
+  reuse_correct (bool, optional): whether to correct reused fluxes
+
+Returns:
+  pydisort.DisortOptions | bool: class object if argument is not empty, otherwise the flag
+
+Examples:
+
+.. code-block:: python
+
+  >>> import pydisort
+  >>> op = pydisort.DisortOptions().reuse_tol(1.e-2).reuse_correct(True)
+        )")
+
       .ADD_OPTION(disort_state, disort::DisortOptions, ds, R"(
 Set disort state for disort
 
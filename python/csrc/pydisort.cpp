@@ -10,12 +10,45 @@
 // disort
 #include <disort/disort.hpp>
 #include <disort/disort_formatter.hpp>
+#include <disort/disort_plan.hpp>
 
 namespace py = pybind11;
 
 void bind_disort_options(py::module &m);
 void bind_cdisort(py::module &m);
 
+// get disort boundary conditions from python keyword arguments
+std::map<std::string, torch::Tensor> bc_from_kwargs(const py::kwargs &kwargs) {
+  std::map<std::string, torch::Tensor> bc;
+  for (auto item : kwargs) {
+    auto key = py::cast<std::string>(item.first);
+    auto value = py::cast<torch::Tensor>(item.second);
+    bc.emplace(std::move(key), std::move(value));
+  }
+
+  for (auto &[key, value] : bc) {
+    std::vector<std::string> items = {"fbeam", "albedo", "fluor", "fisot",
+                                      "temis"};
+
+    // broadcast dimensions to (nwave, ncol)
+    if (std::find(items.begin(), items.end(), key) != items.end()) {
+      while (value.dim() < 2) {
+        value = value.unsqueeze(0);
+      }
+    }
+  }
+
+  return bc;
+}
+
+// broadcast dimensions to (nwave, ncol, nlyr, nprop)
+torch::Tensor broadcast_prop(torch::Tensor prop) {
+  while (prop.dim() < 4) {
+    prop = prop.unsqueeze(0);
+  }
+  return prop;
+}
+
 PYBIND11_MODULE(pydisort, m) {
   m.attr("__name__") = "pydisort";
   m.doc() = R"(
@@ -31,6 +64,12 @@ Python bindings for DISORT (Discrete Ordinates Radiative Transfer) Program.
   m.attr("iuavgup") = 6;
   m.attr("iuavgso") = 7;
 
+  m.attr("output_flux") = disort::output::FLUX;
+  m.attr("output_dfdt") = disort::output::DFDT;
+  m.attr("output_uavg") = disort::output::UAVG;
+  m.attr("output_rad") = disort::output::RAD;
+  m.attr("output_gather") = disort::output::GATHER;
+
   bind_cdisort(m);
   bind_disort_options(m);
 
@@ -102,8 +141,14 @@ Examples:
       .def("gather_flx", &disort::DisortImpl::gather_flx, R"(
 Gather all disort flux outputs
 
+The outputs are written in place while ``forward`` runs, so this returns
+the kept tensor without copying. It is overwritten by the next ``forward``
+with ``output_gather``.
+
 Returns:
-  torch.Tensor: Disort flux outputs (nwave, ncol, nlvl = nlyr + 1, 8)
+  torch.Tensor: Disort flux outputs (nwave, ncol, ntau, 8),
+  where ntau = nlvl = nlyr + 1 unless 'usrtau' is set,
+  or (nwave, ncol, nsun, ntau, 8) with several suns per column
 
 Examples:
 
@@ -125,8 +170,12 @@ Examples:
       .def("gather_rad", &disort::DisortImpl::gather_rad, R"(
 Gather all disort radiation outputs
 
+Like :meth:`gather_flx`, this returns the kept tensor without copying.
+It is overwritten by the next ``forward`` with ``output_rad``.
+
 Returns:
-  torch.Tensor: Disort radiation outputs (nwave, ncol, nlvl = nlyr + 1, 6)
+  torch.Tensor: Disort radiation outputs (nwave, ncol, nphi, ntau, numu),
+  or (nwave, ncol, nsun, nphi, ntau, numu) with several suns per column
 
 Examples:
 
@@ -164,38 +213,199 @@ Examples:
                [0.0134, 0.0263, 0.1159, 0.0000, 0.0000, 0.0000]]]]])
         )")
 
+      .def("set_gather_buffers", &disort::DisortImpl::set_gather_buffers,
+           py::arg("flx"), py::arg("rad") = py::none(), R"(
+Let ``forward`` write gathered outputs into caller-owned tensors
+
+Both tensors must be contiguous, on the CPU and of the same dtype as ``prop``.
+This also makes :meth:`gather_flx` and :meth:`gather_rad` available
+with pooled states.
+
+Args:
+  flx (torch.Tensor): flux outputs (nwave, ncol, ntau, 8)
+  rad (Optional[torch.Tensor]): radiance outputs (nwave, ncol, nphi, ntau, numu)
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = torch.empty((nwave, ncol, nlyr + 1, 8), dtype=torch.float64)
+    >>> ds.set_gather_buffers(flx)
+    >>> ds.forward(prop, **bc)
+    >>> flx[..., pydisort.iflup]  # filled in place
+        )")
+
+      .def("gather_status", &disort::DisortImpl::gather_status, R"(
+Gather the disort return status of the last forward call
+
+A column that could not be solved does not stop the others; its fluxes are
+set to NaN and its status is non-zero:
+
+.. list-table::
+  :widths: 10 40
+  :header-rows: 1
+
+  * - Status
+    - Description
+  * - 0
+    - success
+  * - 1
+    - input rejected by disort (see printed messages unless 'quiet')
+  * - 2
+    - internal workspace too small
+  * - 3
+    - fatal error raised inside disort
+
+Returns:
+  torch.Tensor: status code (nwave, ncol), dtype int32
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = ds.forward(tau, **bc)
+    >>> failed = ds.gather_status() != 0
+        )")
+
+      .def("schedule_stats", &disort::DisortImpl::schedule_stats, R"(
+Load balance of the threads in the last forward call
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Key
+    - Description
+  * - 'nthreads'
+    - number of threads
+  * - 'wall'
+    - wall time of the kernel in seconds
+  * - 'busy_max', 'busy_mean'
+    - longest and mean busy time of a thread in seconds
+  * - 'imbalance'
+    - busy_max / busy_mean, 1 when perfectly balanced
+  * - 'idle'
+    - fraction of thread time not spent solving columns
+  * - 'ncol_min', 'ncol_max'
+    - fewest and most columns solved by a thread
+  * - 'ncol_batched'
+    - columns solved by the batched engine
+
+Returns:
+  Dict[str, float]: load balance statistics
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = ds.forward(prop, **bc)
+    >>> ds.schedule_stats()["imbalance"]
+        )")
+
+      .def("eigen_cache_stats", &disort::DisortImpl::eigen_cache_stats, R"(
+Use of the eigen cache in the last forward call
+
+See :meth:`DisortOptions.eigen_cache`. Counts are summed over all threads.
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Key
+    - Description
+  * - 'hits'
+    - layers whose eigensolution was taken from the cache
+  * - 'misses'
+    - layers whose eigensolution was computed
+  * - 'hit_rate'
+    - hits / (hits + misses), 0 without lookups
+
+Returns:
+  Dict[str, float]: eigen cache statistics
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = ds.forward(prop, **bc)
+    >>> ds.eigen_cache_stats()["hit_rate"]
+        )")
+
+      .def("beam_cache_stats", &disort::DisortImpl::beam_cache_stats, R"(
+Use of the beam cache in the last forward call
+
+See :meth:`DisortOptions.beam_cache`. Counts are summed over all columns.
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Key
+    - Description
+  * - 'hits'
+    - columns that reused their beam solution
+  * - 'misses'
+    - columns that solved and stored it
+  * - 'hit_rate'
+    - hits / (hits + misses), 0 without lookups
+
+Returns:
+  Dict[str, float]: beam cache statistics
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = ds.forward(prop, **bc)
+    >>> ds.beam_cache_stats()["hit_rate"]
+        )")
+
+      .def("incremental_stats", &disort::DisortImpl::incremental_stats, R"(
+Columns solved by the last forward call
+
+See :meth:`DisortOptions.incremental` and :meth:`DisortOptions.reuse_tol`.
+Without them, every column is dirty.
+
+.. list-table::
+  :widths: 15 40
+  :header-rows: 1
+
+  * - Key
+    - Description
+  * - 'ncol'
+    - number of (wave, column) pairs
+  * - 'dirty'
+    - columns whose inputs changed and were solved
+  * - 'dirty_fraction'
+    - dirty / ncol
+  * - 'reused'
+    - columns that returned a solve within reuse_tol
+  * - 'reused_fraction'
+    - reused / ncol
+
+Returns:
+  Dict[str, float]: incremental statistics
+
+Examples:
+
+  .. code-block:: python
+
+    >>> flx = ds.forward(prop, **bc)
+    >>> ds.incremental_stats()["dirty_fraction"]
+        )")
+
       .def(
           "forward",
           [](disort::DisortImpl &self, torch::Tensor prop, std::string bname,
-             torch::optional<torch::Tensor> temf, const py::kwargs &kwargs) {
-            // get bc from kwargs
-            std::map<std::string, torch::Tensor> bc;
-            for (auto item : kwargs) {
-              auto key = py::cast<std::string>(item.first);
-              auto value = py::cast<torch::Tensor>(item.second);
-              bc.emplace(std::move(key), std::move(value));
-            }
-
-            for (auto &[key, value] : bc) {
-              std::vector<std::string> items = {"fbeam", "albedo", "fluor",
-                                                "fisot", "temis"};
-
-              // broadcast dimensions to (nwave, ncol)
-              if (std::find(items.begin(), items.end(), key) != items.end()) {
-                while (value.dim() < 2) {
-                  value = value.unsqueeze(0);
-                }
-              }
-            }
-
-            // broadcast dimensions to (nwave, ncol, nlyr, nprop)
-            while (prop.dim() < 4) {
-              prop = prop.unsqueeze(0);
-            }
-
-            return self.forward(prop, &bc, bname, temf);
+             torch::optional<torch::Tensor> temf, int outputs,
+             const py::kwargs &kwargs) {
+            auto bc = bc_from_kwargs(kwargs);
+            return self.forward(broadcast_prop(prop), &bc, bname, temf,
+                                outputs);
           },
           py::arg("prop"), py::arg("bname") = "", py::arg("temf") = py::none(),
+          py::arg("outputs") = disort::output::FLUX | disort::output::RAD |
+                               disort::output::GATHER,
           R"(
 Calculate radiative flux or intensity
 
@@ -209,10 +419,10 @@ The dimensions of each recognized key in ``kwargs`` are:
     - Shape
     - Description
   * - <band> + "umu0"
-    - (ncol,)
+    - (ncol,) or (ncol, nsun)
     - cosine of solar zenith angle
   * - <band> + "phi0"
-    - (ncol,)
+    - (ncol,) or (ncol, nsun)
     - azimuthal angle of solar beam
   * - <band> + "fbeam"
     - (nwave, ncol)
@@ -239,6 +449,9 @@ The dimensions of each recognized key in ``kwargs`` are:
 Some keys can have a prefix band name, ``<band>``. If the prefix is an non-empty string,
 a slash "/" is automatically appended to it, such that the key looks like ``B1/umu0``.
 ``btemp`` and ``ttemp`` do not have a band name prefix.
+With ``umu0`` of shape (ncol, nsun), each column is solved for nsun beam angles at once,
+sharing the homogeneous solution and the factored boundary-condition matrix.
+A ``phi0`` of shape (ncol,) is then used for every sun.
 If the values are short of wave or column dimensions, they are automatically broadcasted to be the shape of 1.
 
 Args:
@@ -247,10 +460,47 @@ Args:
     If the name is not empty, a slash "/" is automatically appended to it.
   temf (Optional[torch.Tensor]): Temperature at each level (ncol, nlvl = nlyr + 1),
     default is None. If not None, the temperature is used to calculate the Planck function.
+  outputs (int): Bitwise or of the quantities to compute, default is
+    ``output_flux | output_rad | output_gather``. The selected quantities are returned in this order:
+
+    .. list-table::
+      :widths: 15 10 30
+      :header-rows: 1
+
+      * - Flag
+        - Size
+        - Returned values
+      * - ``output_flux``
+        - 2
+        - upward and downward flux
+      * - ``output_dfdt``
+        - 1
+        - flux divergence
+      * - ``output_uavg``
+        - 4
+        - uavg, uavgdn, uavgup, uavgso
+      * - ``output_rad``
+        - 0
+        - intensities at user angles, see :meth:`gather_rad`
+      * - ``output_gather``
+        - 0
+        - all eight radiant quantities, see :meth:`gather_flx`
+
+    Without ``output_rad``, intensities are not computed at all.
   kwargs (Dict[str, torch.Tensor]): keyword arguments of disort boundary conditions, see keys listed above
 
 Returns:
-  torch.Tensor: Radiative flux or intensity, shape (nwave, ncol, nlvl, nrad)
+  torch.Tensor: Selected outputs, shape (nwave, ncol, nlvl, nout),
+  or (nwave, ncol, nsun, nlvl, nout) with several suns per column
+
+If ``prop``, the ``albedo`` or ``temf`` requires a gradient, the fluxes are differentiable
+with respect to them. ``loss.backward()`` then runs a linearized DISORT with a single adjoint
+solve per column, instead of two :meth:`forward` per input for finite differences. Columns
+that :meth:`forward` solved for fluxes only, without ``output_rad``, keep their eigensolutions
+and factored matrix until then, about ``3 * nlyr * nstr * nstr`` doubles each, so that the
+backward pass does not solve them again. This needs ``outputs`` of ``output_flux``, possibly
+with ``output_rad`` and ``output_gather``, and the same configuration as
+:meth:`forward_jacobian`.
 
 Examples:
   .. code-block:: python
@@ -271,5 +521,173 @@ Examples:
             [0.0000, 2.3273],
             [0.0000, 1.7241],
             [0.0000, 1.1557]]]])
+        )")
+
+      .def(
+          "forward_albedo",
+          [](disort::DisortImpl &self, torch::Tensor prop,
+             torch::Tensor albedo, std::string bname,
+             torch::optional<torch::Tensor> temf, const py::kwargs &kwargs) {
+            auto bc = bc_from_kwargs(kwargs);
+            return self.forward_albedo(broadcast_prop(prop), &bc, albedo,
+                                       bname, temf);
+          },
+          py::arg("prop"), py::arg("albedo"), py::arg("bname") = "",
+          py::arg("temf") = py::none(),
+          R"(
+Calculate radiative flux for many Lambertian surface albedos at once
+
+The atmosphere is solved once over a black surface, together with its spherical albedo
+and flux response to illumination from below. The fluxes for each albedo then follow
+in closed form and agree with :meth:`forward` to roundoff, at a fraction of the cost of
+one :meth:`forward` per albedo.
+
+Needs the ``lamber`` flag and one sun per column, and does not support ``spher``.
+An ``albedo`` keyword argument is not used. The gather buffers are left unchanged.
+
+Args:
+  prop (torch.Tensor): Optical properties at each level (nwave, ncol, nlyr, nprop)
+  albedo (torch.Tensor): Surface albedos (nalb,), or (nalb, nwave, ncol)
+  bname (str): Name of the radiation band, see :meth:`forward`
+  temf (Optional[torch.Tensor]): Temperature at each level (ncol, nlvl = nlyr + 1)
+  kwargs (Dict[str, torch.Tensor]): boundary conditions, see :meth:`forward`
+
+Returns:
+  torch.Tensor: Upward and downward flux, shape (nalb, nwave, ncol, nlvl, 2)
+
+Examples:
+  .. code-block:: python
+
+    >>> import torch
+    >>> from pydisort import DisortOptions, Disort
+    >>> op = DisortOptions().flags("onlyfl,lamber")
+    >>> op.ds().nlyr = 4
+    >>> op.ds().nstr = 4
+    >>> op.ds().nmom = 4
+    >>> op.ds().nphase = 4
+    >>> ds = Disort(op)
+    >>> tau = torch.tensor([0.1, 0.2, 0.3, 0.4]).unsqueeze(-1)
+    >>> albedo = torch.linspace(0.0, 1.0, 11)
+    >>> flx = ds.forward_albedo(tau, albedo, fbeam=torch.tensor([3.14159]))
+    >>> flx.shape
+    torch.Size([11, 1, 1, 5, 2])
+        )")
+
+      .def(
+          "forward_jacobian",
+          [](disort::DisortImpl &self, torch::Tensor prop, std::string bname,
+             torch::optional<torch::Tensor> temf, const py::kwargs &kwargs) {
+            auto bc = bc_from_kwargs(kwargs);
+            return self.forward_jacobian(broadcast_prop(prop), &bc, bname,
+                                         temf);
+          },
+          py::arg("prop"), py::arg("bname") = "", py::arg("temf") = py::none(),
+          R"(
+Calculate radiative flux and its analytic derivatives with respect to the inputs
+
+Each column is solved once by a linearized DISORT, which gives the derivatives of the
+upward and downward flux at every level with respect to the optical properties of
+every layer, the surface albedo and the temperature at every level, at a few times
+the cost of one :meth:`forward`, instead of two per input for finite differences.
+
+Needs the ``lamber`` flag and one sun per column, and does not support ``spher`` or
+``usrtau``. The gather buffers are left unchanged. Derivatives with respect to phase
+function moments beyond ``nstr`` are zero, and those with respect to ``temf`` are
+zero without the ``planck`` flag.
+
+Args:
+  prop (torch.Tensor): Optical properties at each level (nwave, ncol, nlyr, nprop)
+  bname (str): Name of the radiation band, see :meth:`forward`
+  temf (Optional[torch.Tensor]): Temperature at each level (ncol, nlvl = nlyr + 1)
+  kwargs (Dict[str, torch.Tensor]): boundary conditions, see :meth:`forward`
+
+Returns:
+  Dict[str, torch.Tensor]: with keys
+
+    - ``flux``: upward and downward flux, shape (nwave, ncol, nlvl, 2)
+    - ``prop``: derivatives with respect to ``prop``, shape (nwave, ncol, nlvl, 2, nlyr, nprop)
+    - ``albedo``: derivatives with respect to the albedo, shape (nwave, ncol, nlvl, 2)
+    - ``temf``: derivatives with respect to ``temf``, shape (nwave, ncol, nlvl, 2, nlvl)
+
+Examples:
+  .. code-block:: python
+
+    >>> import torch
+    >>> from pydisort import DisortOptions, Disort
+    >>> op = DisortOptions().flags("onlyfl,lamber")
+    >>> op.ds().nlyr = 4
+    >>> op.ds().nstr = 4
+    >>> op.ds().nmom = 4
+    >>> op.ds().nphase = 4
+    >>> ds = Disort(op)
+    >>> tau = torch.tensor([0.1, 0.2, 0.3, 0.4]).unsqueeze(-1)
+    >>> jac = ds.forward_jacobian(tau, fbeam=torch.tensor([3.14159]))
+    >>> jac["prop"].shape
+    torch.Size([1, 1, 5, 2, 4, 1])
         )");
+  py::class_<disort::DisortPlan>(m, "DisortPlan")
+      .def(py::init([](std::shared_ptr<disort::DisortImpl> disort,
+                       torch::Tensor prop, std::string bname,
+                       torch::optional<torch::Tensor> temf, int outputs,
+                       const py::kwargs &kwargs) {
+             return disort::DisortPlan(disort, broadcast_prop(prop),
+                                       bc_from_kwargs(kwargs), bname, temf,
+                                       outputs);
+           }),
+           py::arg("disort"), py::arg("prop"), py::arg("bname") = "",
+           py::arg("temf") = py::none(),
+           py::arg("outputs") = disort::output::FLUX | disort::output::RAD |
+                                disort::output::GATHER,
+           R"(
+Validate the inputs of :meth:`Disort.forward` once and replay it cheaply
+
+The plan keeps the validated configuration, the completed boundary
+conditions and the iteration layout. :meth:`run` only checks that the
+inputs still have the planned shapes. Updating the planned tensors in place
+(``prop.copy_(...)``) or passing new tensors with the planned strides avoids
+rebuilding anything between runs.
+
+Args:
+  disort (Disort): module to run
+  prop (torch.Tensor): optical properties (nwave, ncol, nlyr, nprop)
+  bname (str): name of the radiation band
+  temf (Optional[torch.Tensor]): temperature at each level (ncol, nlvl)
+  outputs (int): output selection, see :meth:`Disort.forward`
+  kwargs (Dict[str, torch.Tensor]): boundary conditions, see :meth:`Disort.forward`
+
+Examples:
+
+  .. code-block:: python
+
+    >>> plan = DisortPlan(ds, prop, temf=temf, btemp=btemp)
+    >>> for step in range(nsteps):
+    >>>     prop.copy_(new_prop)
+    >>>     flx = plan.run(prop, temf=temf, btemp=btemp)
+          )")
+
+      .def(
+          "run",
+          [](disort::DisortPlan &self, torch::Tensor prop,
+             torch::optional<torch::Tensor> temf,
+             torch::optional<torch::Tensor> out, const py::kwargs &kwargs) {
+            return self.run(broadcast_prop(prop), bc_from_kwargs(kwargs), temf,
+                            out);
+          },
+          py::arg("prop"), py::arg("temf") = py::none(),
+          py::arg("out") = py::none(), R"(
+Replay the planned forward call with new inputs of the same shapes
+
+Args:
+  prop (torch.Tensor): optical properties (nwave, ncol, nlyr, nprop)
+  temf (Optional[torch.Tensor]): temperature at each level, if planned
+  out (Optional[torch.Tensor]): contiguous output (nwave, ncol, nlvl, nout)
+  kwargs (Dict[str, torch.Tensor]): boundary conditions with the planned keys
+
+Returns:
+  torch.Tensor: selected outputs (nwave, ncol, nlvl, nout), a view of ``out``
+  or of the output buffer of the plan, which the next run overwrites; clone
+  it to keep it
+          )")
+
+      .def_property_readonly("outputs", &disort::DisortPlan::outputs);
 }
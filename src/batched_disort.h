@@ -0,0 +1,1126 @@
+#pragma once
+
+// C/C++
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// disort
+#include <cdisort213/cdisort.h>
+
+namespace disort {
+
+//! flux-only discrete ordinate solver for W columns in lockstep
+/*!
+ * Solves the azimuthally averaged (m = 0) problem of c_disort for W columns
+ * of the same nlyr, nstr and ntau at once. Every array keeps the column
+ * (lane) index innermost, so the inner loops run over W independent columns
+ * and vectorize across them.
+ *
+ * The steps follow c_disort with a Lambertian surface in plane-parallel
+ * geometry:
+ * - delta-M scaling of the layers (c_disort_set)
+ * - the eigenvalue problem (c_solve_eigen), reduced to a symmetric problem
+ *   of size nstr/2 and solved by cyclic Jacobi rotations
+ * - the beam and thermal particular solutions (c_upbeam, c_upisot), from
+ *   the same reduction
+ * - the boundary and interface conditions (c_set_matrix, c_solve0), solved
+ *   by block-tridiagonal elimination with one nstr x nstr block per layer
+ * - fluxes and mean intensities (c_fluxes)
+ *
+ * Unlike c_disort, layers below an absorption optical depth of 10 are solved
+ * rather than cut off.
+ *
+ * With NSTR > 0, the number of streams is a compile-time constant: all loops
+ * over streams have fixed trip counts and unroll, and the per-layer scratch
+ * (nn x nn and nstr x nstr matrices of all lanes) is held in fixed-size
+ * arrays inside the solver instead of heap vectors. NSTR = 0 is the generic
+ * solver for any even nstr.
+ */
+template <int W, int NSTR = 0>
+class BatchedDisort {
+ public:
+  //! Constructor to size the solver for W columns
+  /*!
+   * \param nlyr number of layers
+   * \param nstr number of streams (even), equal to NSTR if NSTR > 0
+   * \param ntau number of output levels
+   */
+  BatchedDisort(int nlyr, int nstr, int ntau);
+
+  //! layer optical depth (nlyr, W)
+  std::vector<double> dtauc;
+
+  //! single scattering albedo (nlyr, W)
+  std::vector<double> ssalb;
+
+  //! phase function moments 0..nstr (nlyr, nstr + 1, W), moment 0 is unused
+  std::vector<double> pmom;
+
+  //! emission at the levels (nlyr + 1, W), read if planck
+  std::vector<double> pkag;
+
+  //! output optical depths (ntau, W), read if usrtau
+  std::vector<double> utau;
+
+  //! boundary conditions of each lane, see disort_bc
+  double umu0[W], fbeam[W], albedo[W], fisot[W], fluor[W];
+
+  //! emission of the top (times temis) and bottom boundaries
+  double tplanck[W], bplanck[W];
+
+  //! delta-M scaling with moment nstr, which c_disort always applies
+  bool deltam = true;
+
+  //! whether pkag, tplanck and bplanck are set
+  bool planck = false;
+
+  //! whether utau is set, otherwise outputs are at the layer boundaries
+  bool usrtau = false;
+
+  //! solve all lanes
+  /*!
+   * \param rad output (ntau,) of each lane
+   * \param status DS_OK, or DS_ERR_INPUT for a lane that failed the input
+   *        checks; its output is left untouched
+   */
+  void solve(disort_radiant *const *rad, int *status);
+
+  int nlyr() const { return nlyr_; }
+  int nstr() const { return ns_(); }
+  int ntau() const { return ntau_; }
+
+ private:
+  //! fixed-size array of N elements if NSTR > 0, otherwise a vector
+  template <typename T, int N>
+  using scratch_t = std::conditional_t<(NSTR > 0), std::array<T, N>,
+                                       std::vector<T>>;
+
+  static constexpr int NN = NSTR / 2;
+
+  int nlyr_, nstr_, ntau_, nn_;
+
+  //! number of streams and half of it, constants if NSTR > 0
+  int ns_() const { return NSTR > 0 ? NSTR : nstr_; }
+  int nh_() const { return NSTR > 0 ? NN : nn_; }
+
+  //! size a scratch vector; arrays have their size already
+  template <typename V>
+  static void size_(V &v, int n) {
+    if constexpr (NSTR == 0) v.resize(n);
+  }
+
+  //! quadrature angles, weights and Legendre polynomials P_l(cmu) (nstr, nn)
+  std::vector<double> cmu_, cwt_, ylmc_;
+
+  //! delta-M scaled layers
+  std::vector<double> oprim_, dtaucpr_, taucpr_, tauc_, flyr_, gl_;
+
+  //! eigenvalues and their layer transmission exp(-k dtaucpr) (nlyr, nn, W),
+  //! upward/downward eigenvector components (nlyr, nn, nn, W)
+  std::vector<double> kk_, ek_, gup_, gdn_;
+
+  //! beam and thermal particular solutions (nlyr, nn, W)
+  std::vector<double> zbup_, zbdn_, z0up_, z0dn_, z1up_, z1dn_;
+
+  //! thermal source expansion (nlyr, W)
+  std::vector<double> xr0_, xr1_;
+
+  //! scratch of the eigenvalue problem (nn, nn, W)
+  scratch_t<double, NN * NN * W> sp_{}, sm_{}, lp_{}, lm_{}, hh_{}, yy_{};
+
+  //! block-tridiagonal system (nlyr, nstr, nstr, W) and (nlyr, nstr, W)
+  std::vector<double> xx_, yv_;
+
+  //! diagonal and off-diagonal block of one layer (nstr, nstr, W)
+  scratch_t<double, NSTR * NSTR * W> fb_{}, ub_{};
+  scratch_t<int, NSTR * W> piv_{};
+
+  //! lane scratch vectors (nstr, W)
+  scratch_t<double, NSTR * W> v0_{}, v1_{}, v2_{}, v3_{};
+
+  //! beam cosine of each lane, moved off the quadrature angles
+  double mu0_[W];
+
+  //! check the inputs of each lane as c_check_inputs does
+  void check_(int *status);
+
+  //! delta-M scaling, cumulative optical depths and the thermal source
+  void scale_();
+
+  //! eigenvalues and eigenvectors of layer lc
+  void eigen_(int lc);
+
+  //! beam and thermal particular solutions of layer lc
+  void particular_(int lc);
+
+  //! assemble and solve the block-tridiagonal system for the coefficients
+  void system_();
+
+  //! fluxes of lane l
+  void fluxes_(int l, disort_radiant *rad);
+
+  //! helpers operating on all lanes of nn x nn matrices
+  void cholesky_(double *a) const;
+  void chol_solve_(double const *ll, double *x) const;
+  void jacobi_(double *h, double *y) const;
+
+  //! LU with partial pivoting of an nstr x nstr block, per lane
+  void lu_(double *a, int *piv) const;
+  void lu_solve_(double const *a, int const *piv, double *b, int nrhs,
+                 int ldb) const;
+};
+
+template <int W, int NSTR>
+BatchedDisort<W, NSTR>::BatchedDisort(int nlyr, int nstr, int ntau)
+    : nlyr_(nlyr), nstr_(nstr), ntau_(ntau), nn_(nstr / 2) {
+  if (NSTR > 0 && nstr != NSTR) {
+    throw std::invalid_argument("BatchedDisort: nstr does not match NSTR");
+  }
+
+  int const n = ns_(), nn = nh_();
+
+  dtauc.assign(nlyr * W, 0.);
+  ssalb.assign(nlyr * W, 0.);
+  pmom.assign(nlyr * (n + 1) * W, 0.);
+  pkag.assign((nlyr + 1) * W, 0.);
+  utau.assign(ntau * W, 0.);
+
+  for (int l = 0; l < W; ++l) {
+    umu0[l] = 1.;
+    fbeam[l] = albedo[l] = fisot[l] = fluor[l] = 0.;
+    tplanck[l] = bplanck[l] = 0.;
+  }
+
+  cmu_.resize(nn);
+  cwt_.resize(nn);
+  c_gaussian_quadrature(nn, cmu_.data(), cwt_.data());
+
+  ylmc_.resize(n * nn);
+  for (int q = 0; q < nn; ++q) {
+    double p0 = 1., p1 = cmu_[q];
+    ylmc_[q] = p0;
+    if (n > 1) ylmc_[nn + q] = p1;
+    for (int k = 2; k < n; ++k) {
+      double p2 = ((2 * k - 1) * cmu_[q] * p1 - (k - 1) * p0) / k;
+      ylmc_[k * nn + q] = p2;
+      p0 = p1;
+      p1 = p2;
+    }
+  }
+
+  oprim_.resize(nlyr * W);
+  dtaucpr_.resize(nlyr * W);
+  flyr_.resize(nlyr * W);
+  taucpr_.resize((nlyr + 1) * W);
+  tauc_.resize((nlyr + 1) * W);
+  gl_.resize(nlyr * n * W);
+
+  kk_.resize(nlyr * nn * W);
+  ek_.resize(nlyr * nn * W);
+  gup_.resize(nlyr * nn * nn * W);
+  gdn_.resize(nlyr * nn * nn * W);
+
+  for (auto *z : {&zbup_, &zbdn_, &z0up_, &z0dn_, &z1up_, &z1dn_}) {
+    z->resize(nlyr * nn * W);
+  }
+  xr0_.resize(nlyr * W);
+  xr1_.resize(nlyr * W);
+
+  for (auto *z : {&sp_, &sm_, &lp_, &lm_, &hh_, &yy_}) size_(*z, nn * nn * W);
+
+  xx_.resize(nlyr * n * n * W);
+  yv_.resize(nlyr * n * W);
+  size_(fb_, n * n * W);
+  size_(ub_, n * n * W);
+  size_(piv_, n * W);
+
+  for (auto *z : {&v0_, &v1_, &v2_, &v3_}) size_(*z, n * W);
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::solve(disort_radiant *const *rad, int *status) {
+  check_(status);
+  scale_();
+
+  for (int lc = 0; lc < nlyr_; ++lc) {
+    eigen_(lc);
+    particular_(lc);
+  }
+
+  system_();
+
+  for (int l = 0; l < W; ++l) {
+    if (status[l] == DS_OK) fluxes_(l, rad[l]);
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::check_(int *status) {
+  int const n = ns_();
+
+  for (int l = 0; l < W; ++l) {
+    bool ok = albedo[l] >= 0. && albedo[l] <= 1. && fisot[l] >= 0. &&
+              fbeam[l] >= 0. && (fbeam[l] == 0. || (umu0[l] > 0. &&
+                                                    umu0[l] <= 1.));
+
+    for (int lc = 0; lc < nlyr_; ++lc) {
+      ok = ok && dtauc[lc * W + l] >= 0. && ssalb[lc * W + l] >= 0. &&
+           ssalb[lc * W + l] <= 1.;
+      for (int k = 1; k <= n; ++k) {
+        double p = pmom[(lc * (n + 1) + k) * W + l];
+        ok = ok && p >= -1. && p <= 1.;
+      }
+    }
+
+    status[l] = ok ? DS_OK : DS_ERR_INPUT;
+
+    // c_disort_set moves a beam that falls on a quadrature angle
+    mu0_[l] = fbeam[l] > 0. ? umu0[l] : 1.;
+    if (fbeam[l] > 0.) {
+      for (int q = 0; q < nh_(); ++q) {
+        if (std::abs(mu0_[l] - cmu_[q]) / std::abs(mu0_[l]) < 1.e-4) {
+          mu0_[l] = (1. + 1.e-4) * cmu_[q];
+        }
+      }
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::scale_() {
+  int const n = ns_();
+  double const dither = 100. * DBL_EPSILON;
+
+  for (int l = 0; l < W; ++l) {
+    tauc_[l] = 0.;
+    taucpr_[l] = 0.;
+  }
+
+  for (int lc = 0; lc < nlyr_; ++lc) {
+    double *om = &ssalb[lc * W];
+    double const *pn = &pmom[(lc * (n + 1) + n) * W];
+    double f[W];
+
+    for (int l = 0; l < W; ++l) {
+      if (om[l] == 1.) om[l] = 1. - dither;
+
+      // delta-M scaling; no scaling is the same as f = 0
+      double fl = f[l] = deltam ? pn[l] : 0.;
+      oprim_[lc * W + l] = om[l] * (1. - fl) / (1. - fl * om[l]);
+      dtaucpr_[lc * W + l] = (1. - fl * om[l]) * dtauc[lc * W + l];
+      flyr_[lc * W + l] = fl;
+      tauc_[(lc + 1) * W + l] = tauc_[lc * W + l] + dtauc[lc * W + l];
+      taucpr_[(lc + 1) * W + l] =
+          taucpr_[lc * W + l] + dtaucpr_[lc * W + l];
+    }
+
+    for (int k = 0; k < n; ++k) {
+      double const *pk = &pmom[(lc * (n + 1) + k) * W];
+      double *gk = &gl_[(lc * n + k) * W];
+      for (int l = 0; l < W; ++l) {
+        double p = k == 0 ? 1. : pk[l];
+        gk[l] = (2 * k + 1) * oprim_[lc * W + l] * (p - f[l]) / (1. - f[l]);
+      }
+    }
+
+    // linear-in-optical-depth thermal source, as in c_disort
+    for (int l = 0; l < W; ++l) {
+      double x1 = 0.;
+      if (planck && dtaucpr_[lc * W + l] > 1.e-4) {
+        x1 = (pkag[(lc + 1) * W + l] - pkag[lc * W + l]) /
+             dtaucpr_[lc * W + l];
+      }
+      xr1_[lc * W + l] = x1;
+      xr0_[lc * W + l] =
+          planck ? pkag[lc * W + l] - x1 * taucpr_[lc * W + l] : 0.;
+    }
+  }
+}
+
+/*
+ * The reduced eigenproblem of c_solve_eigen is
+ *
+ *   (alpha + beta)(alpha - beta) x = k^2 x,
+ *   alpha -/+ beta = M^-1 (S-/+ W - I),
+ *
+ * with M = diag(cmu), W = diag(cwt) and S-/+ the odd/even Legendre sums of
+ * the phase function. Writing R-/+ = M^-1/2 (W^1/2 S-/+ W^1/2 - I) M^-1/2,
+ * both symmetric and negative definite for ssalb < 1, and -R- = L L^T, the
+ * product is similar to the symmetric matrix H = L^T (-R+) L:
+ *
+ *   x = (M W)^-1/2 L^-T y,  H y = k^2 y.
+ */
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::eigen_(int lc) {
+  int const n = ns_(), nn = nh_();
+  double const *gl = &gl_[lc * n * W];
+
+  for (int i = 0; i < nn; ++i) {
+    for (int j = 0; j < nn; ++j) {
+      double *sp = &sp_[(i * nn + j) * W];
+      double *sm = &sm_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) sp[l] = sm[l] = 0.;
+
+      for (int k = 0; k < n; ++k) {
+        double pp = ylmc_[k * nn + i] * ylmc_[k * nn + j];
+        double *s = k % 2 == 0 ? sp : sm;
+        for (int l = 0; l < W; ++l) s[l] += gl[k * W + l] * pp;
+      }
+
+      double wij = std::sqrt(cwt_[i] * cwt_[j]);
+      double mij = std::sqrt(cmu_[i] * cmu_[j]);
+      double *lp = &lp_[(i * nn + j) * W];
+      double *lm = &lm_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) {
+        lp[l] = ((i == j) - wij * sp[l]) / mij;
+        lm[l] = ((i == j) - wij * sm[l]) / mij;
+      }
+    }
+  }
+
+  cholesky_(lm_.data());
+
+  // H = L^T (-R+) L
+  for (int i = 0; i < nn; ++i) {
+    for (int j = 0; j < nn; ++j) {
+      double *t = &v0_[j * W];
+      for (int l = 0; l < W; ++l) t[l] = 0.;
+      for (int k = j; k < nn; ++k) {
+        double const *a = &lp_[(i * nn + k) * W];
+        double const *b = &lm_[(k * nn + j) * W];
+        for (int l = 0; l < W; ++l) t[l] += a[l] * b[l];
+      }
+    }
+    for (int j = 0; j < nn; ++j) {
+      double *t = &hh_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) t[l] = v0_[j * W + l];
+    }
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    for (int j = 0; j < nn; ++j) {
+      double *t = &v1_[j * W];
+      for (int l = 0; l < W; ++l) t[l] = 0.;
+      for (int k = i; k < nn; ++k) {
+        double const *a = &lm_[(k * nn + i) * W];
+        double const *b = &hh_[(k * nn + j) * W];
+        for (int l = 0; l < W; ++l) t[l] += a[l] * b[l];
+      }
+    }
+    for (int j = 0; j < nn; ++j) {
+      double *t = &sp_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) t[l] = v1_[j * W + l];
+    }
+  }
+
+  // sp_ holds H now, the even sums are rebuilt below
+  jacobi_(sp_.data(), yy_.data());
+
+  double *kk = &kk_[lc * nn * W];
+  for (int j = 0; j < nn; ++j) {
+    for (int l = 0; l < W; ++l) {
+      kk[j * W + l] = std::sqrt(std::abs(sp_[(j * nn + j) * W + l]));
+    }
+  }
+
+  // restore the odd sums for alpha - beta
+  for (int i = 0; i < nn; ++i) {
+    for (int j = 0; j < nn; ++j) {
+      double *sm = &sm_[(i * nn + j) * W];
+      double *sp = &sp_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) sm[l] = sp[l] = 0.;
+      for (int k = 0; k < n; ++k) {
+        double pp = ylmc_[k * nn + i] * ylmc_[k * nn + j];
+        double *s = k % 2 == 0 ? sp : sm;
+        for (int l = 0; l < W; ++l) s[l] += gl[k * W + l] * pp;
+      }
+    }
+  }
+
+  // eigenvectors (G+) - (G-) = x and (G+) + (G-) = (alpha - beta) x / k
+  for (int j = 0; j < nn; ++j) {
+    double *x = v0_.data();
+    for (int i = 0; i < nn; ++i) {
+      for (int l = 0; l < W; ++l) x[i * W + l] = yy_[(i * nn + j) * W + l];
+    }
+
+    // L^T v = y
+    for (int i = nn - 1; i >= 0; --i) {
+      for (int k = i + 1; k < nn; ++k) {
+        double const *a = &lm_[(k * nn + i) * W];
+        for (int l = 0; l < W; ++l) x[i * W + l] -= a[l] * x[k * W + l];
+      }
+      double const *d = &lm_[(i * nn + i) * W];
+      for (int l = 0; l < W; ++l) x[i * W + l] /= d[l];
+    }
+
+    for (int i = 0; i < nn; ++i) {
+      double s = 1. / std::sqrt(cmu_[i] * cwt_[i]);
+      for (int l = 0; l < W; ++l) x[i * W + l] *= s;
+    }
+
+    for (int i = 0; i < nn; ++i) {
+      double *s = &v1_[i * W];
+      for (int l = 0; l < W; ++l) s[l] = -x[i * W + l];
+      for (int q = 0; q < nn; ++q) {
+        double const *sm = &sm_[(i * nn + q) * W];
+        for (int l = 0; l < W; ++l) s[l] += sm[l] * cwt_[q] * x[q * W + l];
+      }
+
+      double *gu = &gup_[((lc * nn + i) * nn + j) * W];
+      double *gd = &gdn_[((lc * nn + i) * nn + j) * W];
+      for (int l = 0; l < W; ++l) {
+        double sum = s[l] / (cmu_[i] * kk[j * W + l]);
+        gu[l] = .5 * (sum + x[i * W + l]);
+        gd[l] = .5 * (sum - x[i * W + l]);
+      }
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::particular_(int lc) {
+  int const n = ns_(), nn = nh_();
+  double const *gl = &gl_[lc * n * W];
+  double const *kk = &kk_[lc * nn * W];
+
+  // beam: Zd solves ((alpha+beta)(alpha-beta) - s^2) Zd = r with s = 1/umu0
+  // and Zs = umu0 (M^-1 Qd + (alpha-beta) Zd)
+  double *qs = v0_.data(), *qd = v1_.data();
+  double plm[W], pl0[W], pl1[W];
+  for (int l = 0; l < W; ++l) {
+    pl0[l] = 1.;
+    pl1[l] = mu0_[l];
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    for (int l = 0; l < W; ++l) qs[i * W + l] = qd[i * W + l] = 0.;
+  }
+
+  for (int k = 0; k < n; ++k) {
+    for (int l = 0; l < W; ++l) {
+      if (k == 0) {
+        plm[l] = 1.;
+      } else if (k == 1) {
+        plm[l] = mu0_[l];
+      } else {
+        plm[l] = ((2 * k - 1) * mu0_[l] * pl1[l] - (k - 1) * pl0[l]) / k;
+        pl0[l] = pl1[l];
+        pl1[l] = plm[l];
+      }
+    }
+
+    double *q = k % 2 == 0 ? qs : qd;
+    double sgn = k % 2 == 0 ? 1. : -1.;
+    for (int i = 0; i < nn; ++i) {
+      double y = sgn * ylmc_[k * nn + i] / (2. * M_PI);
+      for (int l = 0; l < W; ++l) {
+        q[i * W + l] += fbeam[l] * gl[k * W + l] * y * plm[l];
+      }
+    }
+  }
+
+  // r = -s M^-1 Qs - (alpha+beta) M^-1 Qd, with alpha+beta from the even
+  // sums in sp_
+  double *a = v2_.data(), *r = v3_.data();
+  for (int i = 0; i < nn; ++i) {
+    for (int l = 0; l < W; ++l) a[i * W + l] = qd[i * W + l] / cmu_[i];
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    for (int l = 0; l < W; ++l) {
+      r[i * W + l] = (-qs[i * W + l] / mu0_[l] + a[i * W + l]) / cmu_[i];
+    }
+    for (int q = 0; q < nn; ++q) {
+      double const *sp = &sp_[(i * nn + q) * W];
+      for (int l = 0; l < W; ++l) {
+        r[i * W + l] -= sp[l] * cwt_[q] * a[q * W + l] / cmu_[i];
+      }
+    }
+  }
+
+  // Zd = (M W)^-1/2 L^-T Y (K - s^2)^-1 Y^T L^T (M W)^1/2 r
+  for (int i = 0; i < nn; ++i) {
+    double s = std::sqrt(cmu_[i] * cwt_[i]);
+    for (int l = 0; l < W; ++l) r[i * W + l] *= s;
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    double *t = &qs[i * W];
+    for (int l = 0; l < W; ++l) t[l] = 0.;
+    for (int k = i; k < nn; ++k) {
+      double const *lm = &lm_[(k * nn + i) * W];
+      for (int l = 0; l < W; ++l) t[l] += lm[l] * r[k * W + l];
+    }
+  }
+
+  for (int j = 0; j < nn; ++j) {
+    double *t = &r[j * W];
+    for (int l = 0; l < W; ++l) t[l] = 0.;
+    for (int i = 0; i < nn; ++i) {
+      double const *y = &yy_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) t[l] += y[l] * qs[i * W + l];
+    }
+    for (int l = 0; l < W; ++l) {
+      double s2 = 1. / (mu0_[l] * mu0_[l]);
+      t[l] /= kk[j * W + l] * kk[j * W + l] - s2;
+    }
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    double *t = &qs[i * W];
+    for (int l = 0; l < W; ++l) t[l] = 0.;
+    for (int j = 0; j < nn; ++j) {
+      double const *y = &yy_[(i * nn + j) * W];
+      for (int l = 0; l < W; ++l) t[l] += y[l] * r[j * W + l];
+    }
+  }
+
+  for (int i = nn - 1; i >= 0; --i) {
+    for (int k = i + 1; k < nn; ++k) {
+      double const *lm = &lm_[(k * nn + i) * W];
+      for (int l = 0; l < W; ++l) qs[i * W + l] -= lm[l] * qs[k * W + l];
+    }
+    double const *d = &lm_[(i * nn + i) * W];
+    for (int l = 0; l < W; ++l) qs[i * W + l] /= d[l];
+  }
+
+  for (int i = 0; i < nn; ++i) {
+    double s = 1. / std::sqrt(cmu_[i] * cwt_[i]);
+    for (int l = 0; l < W; ++l) qs[i * W + l] *= s;
+  }
+
+  // qs holds Zd
+  for (int i = 0; i < nn; ++i) {
+    double *up = &zbup_[(lc * nn + i) * W];
+    double *dn = &zbdn_[(lc * nn + i) * W];
+    for (int l = 0; l < W; ++l) {
+      double s = -qs[i * W + l];
+      for (int q = 0; q < nn; ++q) {
+        s += sm_[(i * nn + q) * W + l] * cwt_[q] * qs[q * W + l];
+      }
+      double zs = mu0_[l] * (a[i * W + l] + s / cmu_[i]);
+      double zd = qs[i * W + l];
+      bool on = fbeam[l] > 0.;
+      up[l] = on ? .5 * (zs + zd) : 0.;
+      dn[l] = on ? .5 * (zs - zd) : 0.;
+    }
+  }
+
+  // thermal: Z1 and Z0 solve (I - CC) Z1 = (1 - oprim) xr1 and
+  // (I - CC) Z0 = (1 - oprim) xr0 + M Z1 (c_upisot). Since (I - CC) 1 =
+  // (1 - oprim) 1, Z1 = xr1 and Z0 = xr0 plus an odd part, Z0d = (M W)^-1/2
+  // (-R-)^-1 (W/M)^1/2 (2 M xr1), which stays well conditioned as ssalb -> 1
+  double const *x0 = &xr0_[lc * W];
+  double const *x1 = &xr1_[lc * W];
+
+  for (int i = 0; i < nn; ++i) {
+    double s = std::sqrt(cwt_[i] / cmu_[i]);
+    for (int l = 0; l < W; ++l) qd[i * W + l] = 2. * cmu_[i] * x1[l] * s;
+  }
+  chol_solve_(lm_.data(), qd);
+
+  for (int i = 0; i < nn; ++i) {
+    double s = .5 / std::sqrt(cmu_[i] * cwt_[i]);
+    int k = (lc * nn + i) * W;
+    for (int l = 0; l < W; ++l) {
+      double zd = planck ? qd[i * W + l] * s : 0.;
+      z1up_[k + l] = z1dn_[k + l] = x1[l];
+      z0up_[k + l] = x0[l] + zd;
+      z0dn_[k + l] = x0[l] - zd;
+    }
+  }
+}
+
+/*
+ * Unknowns of layer lc are the coefficients A_j of exp(-k_j (tau - top))
+ * and B_j of exp(-k_j (bottom - tau)). Row block lc holds the downward
+ * components at the top of the layer (top boundary or continuity with the
+ * layer above) and the upward components at the bottom of the layer
+ * (continuity with the layer below or the surface), so that the system is
+ * block tridiagonal with the layer above coupling to the first nn rows and
+ * the layer below to the last nn rows.
+ */
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::system_() {
+  int const n = ns_(), nn = nh_(), nlyr = nlyr_;
+
+  for (int lc = 0; lc < nlyr; ++lc) {
+    for (int j = 0; j < nn; ++j) {
+      double const *k = &kk_[(lc * nn + j) * W];
+      double *e = &ek_[(lc * nn + j) * W];
+      for (int l = 0; l < W; ++l) e[l] = std::exp(-k[l] * dtaucpr_[lc * W + l]);
+    }
+  }
+
+  auto expk = [&](int lc, int j, int l) { return ek_[(lc * nn + j) * W + l]; };
+
+  // particular solution of layer lc at cumulative optical depth level lev
+  auto part_up = [&](int lc, int i, int lev, int l) {
+    double t = taucpr_[lev * W + l];
+    int k = (lc * nn + i) * W + l;
+    return zbup_[k] * std::exp(-t / mu0_[l]) + z0up_[k] + z1up_[k] * t;
+  };
+
+  auto part_dn = [&](int lc, int i, int lev, int l) {
+    double t = taucpr_[lev * W + l];
+    int k = (lc * nn + i) * W + l;
+    return zbdn_[k] * std::exp(-t / mu0_[l]) + z0dn_[k] + z1dn_[k] * t;
+  };
+
+  // The columns of mode j are combined as p = (A + B) / 2 and
+  // q = (A - B) / 2. Near conservative scattering (k -> 0), the columns of
+  // A and B are large and nearly opposite, while those of p and q are not.
+  auto mix = [&](double *m, int rows) {
+    for (int r = 0; r < rows; ++r) {
+      for (int j = 0; j < nn; ++j) {
+        double *a = &m[(r * n + j) * W];
+        double *b = &m[(r * n + nn + j) * W];
+        for (int l = 0; l < W; ++l) {
+          double s = a[l] + b[l], d = a[l] - b[l];
+          a[l] = s;
+          b[l] = d;
+        }
+      }
+    }
+  };
+
+  for (int lc = 0; lc < nlyr; ++lc) {
+    double *f = fb_.data();
+    double *u = ub_.data();
+    double *y = &yv_[lc * n * W];
+
+    std::fill(fb_.begin(), fb_.end(), 0.);
+    std::fill(ub_.begin(), ub_.end(), 0.);
+
+    // diagonal block, downward rows at the top of the layer
+    for (int i = 0; i < nn; ++i) {
+      for (int j = 0; j < nn; ++j) {
+        double const *gu = &gup_[((lc * nn + i) * nn + j) * W];
+        double const *gd = &gdn_[((lc * nn + i) * nn + j) * W];
+        for (int l = 0; l < W; ++l) {
+          f[(i * n + j) * W + l] = gd[l];
+          f[(i * n + nn + j) * W + l] = -expk(lc, j, l) * gu[l];
+        }
+      }
+    }
+
+    // diagonal block, upward rows at the bottom of the layer
+    for (int i = 0; i < nn; ++i) {
+      for (int j = 0; j < nn; ++j) {
+        double const *gu = &gup_[((lc * nn + i) * nn + j) * W];
+        double const *gd = &gdn_[((lc * nn + i) * nn + j) * W];
+        for (int l = 0; l < W; ++l) {
+          double ra = 0., rb = 0.;
+          if (lc == nlyr - 1) {
+            // Lambertian surface: upward = 2 albedo sum(cwt cmu downward)
+            for (int q = 0; q < nn; ++q) {
+              int k = ((lc * nn + q) * nn + j) * W + l;
+              ra += cwt_[q] * cmu_[q] * gdn_[k];
+              rb += cwt_[q] * cmu_[q] * gup_[k];
+            }
+            ra *= 2. * albedo[l];
+            rb *= 2. * albedo[l];
+          }
+          f[((nn + i) * n + j) * W + l] = expk(lc, j, l) * (gu[l] - ra);
+          f[((nn + i) * n + nn + j) * W + l] = -(gd[l] - rb);
+        }
+      }
+    }
+
+    // right-hand side
+    for (int i = 0; i < nn; ++i) {
+      for (int l = 0; l < W; ++l) {
+        double r;
+        if (lc == 0) {
+          r = fisot[l] + tplanck[l] - part_dn(0, i, 0, l);
+        } else {
+          r = part_dn(lc - 1, i, lc, l) - part_dn(lc, i, lc, l);
+        }
+        y[i * W + l] = r;
+      }
+    }
+
+    for (int i = 0; i < nn; ++i) {
+      for (int l = 0; l < W; ++l) {
+        double r;
+        if (lc < nlyr - 1) {
+          r = part_up(lc + 1, i, lc + 1, l) - part_up(lc, i, lc + 1, l);
+        } else {
+          double sum = 0.;
+          for (int q = 0; q < nn; ++q) {
+            sum += cwt_[q] * cmu_[q] * part_dn(lc, q, nlyr, l);
+          }
+          double expb = std::exp(-taucpr_[nlyr * W + l] / mu0_[l]);
+          r = 2. * albedo[l] * sum - part_up(lc, i, nlyr, l) +
+              (1. - albedo[l]) * bplanck[l];
+          if (fbeam[l] > 0.) {
+            r += albedo[l] * mu0_[l] * fbeam[l] / M_PI * expb + fluor[l];
+          }
+        }
+        y[(nn + i) * W + l] = r;
+      }
+    }
+
+    mix(f, n);
+
+    // eliminate the coupling to the layer above: only the first nn rows
+    if (lc > 0) {
+      double const *xp = &xx_[(lc - 1) * n * n * W];
+      double const *yp = &yv_[(lc - 1) * n * W];
+
+      // sub-diagonal block, layer lc - 1 at its bottom
+      for (int i = 0; i < nn; ++i) {
+        for (int j = 0; j < nn; ++j) {
+          int m = ((lc - 1) * nn + i) * nn + j;
+          for (int l = 0; l < W; ++l) {
+            u[(i * n + j) * W + l] = -expk(lc - 1, j, l) * gdn_[m * W + l];
+            u[(i * n + nn + j) * W + l] = gup_[m * W + l];
+          }
+        }
+      }
+      mix(u, nn);
+
+      // accumulate each entry over k in registers
+      for (int i = 0; i < nn; ++i) {
+        for (int c = 0; c <= n; ++c) {
+          double *d = c < n ? &f[(i * n + c) * W] : &y[i * W];
+          double acc[W];
+          for (int l = 0; l < W; ++l) acc[l] = d[l];
+          for (int k = 0; k < n; ++k) {
+            double const *sub = &u[(i * n + k) * W];
+            double const *x = c < n ? &xp[(k * n + c) * W] : &yp[k * W];
+            for (int l = 0; l < W; ++l) acc[l] -= sub[l] * x[l];
+          }
+          for (int l = 0; l < W; ++l) d[l] = acc[l];
+        }
+      }
+    }
+
+    lu_(f, piv_.data());
+    lu_solve_(f, piv_.data(), y, 1, 1);
+
+    // super-diagonal block: the last nn rows couple to layer lc + 1
+    if (lc < nlyr - 1) {
+      std::fill(ub_.begin(), ub_.end(), 0.);
+      for (int i = 0; i < nn; ++i) {
+        for (int j = 0; j < nn; ++j) {
+          int m = ((lc + 1) * nn + i) * nn + j;
+          for (int l = 0; l < W; ++l) {
+            u[((nn + i) * n + j) * W + l] = -gup_[m * W + l];
+            u[((nn + i) * n + nn + j) * W + l] =
+                expk(lc + 1, j, l) * gdn_[m * W + l];
+          }
+        }
+      }
+      mix(u + nn * n * W, nn);
+      lu_solve_(f, piv_.data(), u, n, n);
+      std::copy(ub_.begin(), ub_.end(), xx_.begin() + lc * n * n * W);
+    }
+  }
+
+  // back substitution, x_lc = y_lc - X_lc x_lc+1
+  for (int lc = nlyr - 2; lc >= 0; --lc) {
+    double *y = &yv_[lc * n * W];
+    double const *x = &xx_[lc * n * n * W];
+    double const *yn = &yv_[(lc + 1) * n * W];
+    for (int i = 0; i < n; ++i) {
+      for (int c = 0; c < n; ++c) {
+        for (int l = 0; l < W; ++l) {
+          y[i * W + l] -= x[(i * n + c) * W + l] * yn[c * W + l];
+        }
+      }
+    }
+  }
+
+  // back to the coefficients, A = p + q and B = p - q
+  for (int lc = 0; lc < nlyr; ++lc) {
+    for (int j = 0; j < nn; ++j) {
+      double *p = &yv_[(lc * n + j) * W];
+      double *q = &yv_[(lc * n + nn + j) * W];
+      for (int l = 0; l < W; ++l) {
+        double a = p[l] + q[l], b = p[l] - q[l];
+        p[l] = a;
+        q[l] = b;
+      }
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::fluxes_(int l, disort_radiant *rad) {
+  int const n = ns_(), nn = nh_(), nlyr = nlyr_;
+
+  for (int lu = 0; lu < ntau_; ++lu) {
+    // output level and its layer, as in c_disort_set
+    double ut = usrtau ? utau[lu * W + l] : tauc_[lu * W + l];
+    int lc = 0;
+    while (lc < nlyr - 1 &&
+           !(ut >= tauc_[lc * W + l] && ut <= tauc_[(lc + 1) * W + l])) {
+      ++lc;
+    }
+
+    double utp = taucpr_[lc * W + l] +
+                 (1. - ssalb[lc * W + l] * flyr_[lc * W + l]) *
+                     (ut - tauc_[lc * W + l]);
+
+    double const *y = &yv_[lc * n * W];
+    double top = taucpr_[lc * W + l], bot = taucpr_[(lc + 1) * W + l];
+
+    double fact = 0., dirint = 0., fldir = 0., rfldir = 0.;
+    if (fbeam[l] > 0.) {
+      fact = std::exp(-utp / mu0_[l]);
+      rfldir = mu0_[l] * fbeam[l] * std::exp(-ut / mu0_[l]);
+      dirint = fbeam[l] * fact;
+      fldir = mu0_[l] * fbeam[l] * fact;
+    }
+
+    double flup = 0., fldn = 0., sup = 0., sdn = 0.;
+    for (int i = 0; i < nn; ++i) {
+      int z = (lc * nn + i) * W + l;
+      double iup = zbup_[z] * fact + z0up_[z] + z1up_[z] * utp;
+      double idn = zbdn_[z] * fact + z0dn_[z] + z1dn_[z] * utp;
+
+      for (int j = 0; j < nn; ++j) {
+        int m = ((lc * nn + i) * nn + j) * W + l;
+        double k = kk_[(lc * nn + j) * W + l];
+        double ca = y[j * W + l] * std::exp(-k * (utp - top));
+        double cb = y[(nn + j) * W + l] * std::exp(-k * (bot - utp));
+        iup += ca * gup_[m] - cb * gdn_[m];
+        idn += ca * gdn_[m] - cb * gup_[m];
+      }
+
+      flup += cwt_[i] * cmu_[i] * iup;
+      fldn += cwt_[i] * cmu_[i] * idn;
+      sup += cwt_[i] * iup;
+      sdn += cwt_[i] * idn;
+    }
+
+    auto &r = rad[lu];
+    r.rfldir = rfldir;
+    r.flup = 2. * M_PI * flup;
+    r.rfldn = 2. * M_PI * fldn + fldir - rfldir;
+    r.uavg = (2. * M_PI * (sup + sdn) + dirint) / (4. * M_PI);
+    r.uavgso = dirint / (4. * M_PI);
+    r.uavgdn = sdn / 2.;
+    r.uavgup = sup / 2.;
+
+    double plsorc = xr0_[lc * W + l] + xr1_[lc * W + l] * utp;
+    r.dfdt = (1. - ssalb[lc * W + l]) * 4. * M_PI * (r.uavg - plsorc);
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::cholesky_(double *a) const {
+  int const nn = nh_();
+  double const tiny = std::numeric_limits<double>::min();
+
+  for (int j = 0; j < nn; ++j) {
+    double *d = &a[(j * nn + j) * W];
+    for (int k = 0; k < j; ++k) {
+      double const *x = &a[(j * nn + k) * W];
+      for (int l = 0; l < W; ++l) d[l] -= x[l] * x[l];
+    }
+    for (int l = 0; l < W; ++l) d[l] = std::sqrt(std::max(d[l], tiny));
+
+    for (int i = j + 1; i < nn; ++i) {
+      double *x = &a[(i * nn + j) * W];
+      for (int k = 0; k < j; ++k) {
+        double const *p = &a[(i * nn + k) * W];
+        double const *q = &a[(j * nn + k) * W];
+        for (int l = 0; l < W; ++l) x[l] -= p[l] * q[l];
+      }
+      for (int l = 0; l < W; ++l) x[l] /= d[l];
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::chol_solve_(double const *ll, double *x) const {
+  int const nn = nh_();
+
+  for (int i = 0; i < nn; ++i) {
+    for (int k = 0; k < i; ++k) {
+      double const *a = &ll[(i * nn + k) * W];
+      for (int l = 0; l < W; ++l) x[i * W + l] -= a[l] * x[k * W + l];
+    }
+    double const *d = &ll[(i * nn + i) * W];
+    for (int l = 0; l < W; ++l) x[i * W + l] /= d[l];
+  }
+
+  for (int i = nn - 1; i >= 0; --i) {
+    for (int k = i + 1; k < nn; ++k) {
+      double const *a = &ll[(k * nn + i) * W];
+      for (int l = 0; l < W; ++l) x[i * W + l] -= a[l] * x[k * W + l];
+    }
+    double const *d = &ll[(i * nn + i) * W];
+    for (int l = 0; l < W; ++l) x[i * W + l] /= d[l];
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::jacobi_(double *h, double *y) const {
+  int const nn = nh_();
+
+  for (int i = 0; i < nn; ++i) {
+    for (int j = 0; j < nn; ++j) {
+      for (int l = 0; l < W; ++l) y[(i * nn + j) * W + l] = i == j;
+    }
+  }
+
+  for (int sweep = 0; sweep < 50; ++sweep) {
+    // stop once the off-diagonal part of every lane is negligible
+    bool done = true;
+    for (int l = 0; l < W && done; ++l) {
+      double off = 0., diag = 0.;
+      for (int i = 0; i < nn; ++i) {
+        diag += h[(i * nn + i) * W + l] * h[(i * nn + i) * W + l];
+        for (int j = i + 1; j < nn; ++j) {
+          off += h[(i * nn + j) * W + l] * h[(i * nn + j) * W + l];
+        }
+      }
+      done = !(off > 1.e-30 * diag);
+    }
+    if (done) break;
+
+    for (int p = 0; p < nn - 1; ++p) {
+      for (int q = p + 1; q < nn; ++q) {
+        double c[W], s[W];
+        for (int l = 0; l < W; ++l) {
+          double apq = h[(p * nn + q) * W + l];
+          double app = h[(p * nn + p) * W + l];
+          double aqq = h[(q * nn + q) * W + l];
+          double theta = (aqq - app) / (2. * apq);
+          double t = (theta >= 0. ? 1. : -1.) /
+                     (std::abs(theta) + std::sqrt(theta * theta + 1.));
+          t = apq != 0. && std::isfinite(theta) ? t : 0.;
+          c[l] = 1. / std::sqrt(t * t + 1.);
+          s[l] = t * c[l];
+        }
+
+        // H <- J^T H J, Y <- Y J
+        for (int k = 0; k < nn; ++k) {
+          double *hp = &h[(k * nn + p) * W];
+          double *hq = &h[(k * nn + q) * W];
+          double *yp = &y[(k * nn + p) * W];
+          double *yq = &y[(k * nn + q) * W];
+          for (int l = 0; l < W; ++l) {
+            double a = hp[l], b = hq[l];
+            hp[l] = c[l] * a - s[l] * b;
+            hq[l] = s[l] * a + c[l] * b;
+            a = yp[l];
+            b = yq[l];
+            yp[l] = c[l] * a - s[l] * b;
+            yq[l] = s[l] * a + c[l] * b;
+          }
+        }
+        for (int k = 0; k < nn; ++k) {
+          double *hp = &h[(p * nn + k) * W];
+          double *hq = &h[(q * nn + k) * W];
+          for (int l = 0; l < W; ++l) {
+            double a = hp[l], b = hq[l];
+            hp[l] = c[l] * a - s[l] * b;
+            hq[l] = s[l] * a + c[l] * b;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::lu_(double *a, int *piv) const {
+  int const n = ns_();
+
+  for (int k = 0; k < n; ++k) {
+    // pivot of each lane
+    double best[W];
+    for (int l = 0; l < W; ++l) {
+      best[l] = std::abs(a[(k * n + k) * W + l]);
+      piv[k * W + l] = k;
+    }
+    for (int i = k + 1; i < n; ++i) {
+      double const *x = &a[(i * n + k) * W];
+      for (int l = 0; l < W; ++l) {
+        bool b = std::abs(x[l]) > best[l];
+        best[l] = b ? std::abs(x[l]) : best[l];
+        piv[k * W + l] = b ? i : piv[k * W + l];
+      }
+    }
+
+    // row swaps differ between lanes
+    for (int l = 0; l < W; ++l) {
+      int p = piv[k * W + l];
+      if (p == k) continue;
+      for (int j = 0; j < n; ++j) {
+        std::swap(a[(k * n + j) * W + l], a[(p * n + j) * W + l]);
+      }
+    }
+
+    double inv[W];
+    for (int l = 0; l < W; ++l) inv[l] = 1. / a[(k * n + k) * W + l];
+
+    for (int i = k + 1; i < n; ++i) {
+      double *m = &a[(i * n + k) * W];
+      for (int l = 0; l < W; ++l) m[l] *= inv[l];
+      for (int j = k + 1; j < n; ++j) {
+        double const *u = &a[(k * n + j) * W];
+        double *x = &a[(i * n + j) * W];
+        for (int l = 0; l < W; ++l) x[l] -= m[l] * u[l];
+      }
+    }
+  }
+}
+
+template <int W, int NSTR>
+void BatchedDisort<W, NSTR>::lu_solve_(double const *a, int const *piv,
+                                       double *b, int nrhs, int ldb) const {
+  int const n = ns_();
+
+  for (int k = 0; k < n; ++k) {
+    for (int l = 0; l < W; ++l) {
+      int p = piv[k * W + l];
+      if (p == k) continue;
+      for (int c = 0; c < nrhs; ++c) {
+        std::swap(b[(k * ldb + c) * W + l], b[(p * ldb + c) * W + l]);
+      }
+    }
+  }
+
+  // substitutions accumulate each entry over k in registers
+  for (int i = 1; i < n; ++i) {
+    for (int c = 0; c < nrhs; ++c) {
+      double *x = &b[(i * ldb + c) * W];
+      double acc[W];
+      for (int l = 0; l < W; ++l) acc[l] = x[l];
+      for (int k = 0; k < i; ++k) {
+        double const *m = &a[(i * n + k) * W];
+        double const *z = &b[(k * ldb + c) * W];
+        for (int l = 0; l < W; ++l) acc[l] -= m[l] * z[l];
+      }
+      for (int l = 0; l < W; ++l) x[l] = acc[l];
+    }
+  }
+
+  for (int i = n - 1; i >= 0; --i) {
+    double const *d = &a[(i * n + i) * W];
+    for (int c = 0; c < nrhs; ++c) {
+      double *x = &b[(i * ldb + c) * W];
+      double acc[W];
+      for (int l = 0; l < W; ++l) acc[l] = x[l];
+      for (int k = i + 1; k < n; ++k) {
+        double const *u = &a[(i * n + k) * W];
+        double const *z = &b[(k * ldb + c) * W];
+        for (int l = 0; l < W; ++l) acc[l] -= u[l] * z[l];
+      }
+      for (int l = 0; l < W; ++l) x[l] = acc[l] / d[l];
+    }
+  }
+}
+
+}  // namespace disort
@@ -1,10 +1,18 @@
 // C/C++
+#include <algorithm>
+#include <chrono>
 #include <map>
+#include <numeric>
+
+// torch
+#include <ATen/Parallel.h>
 
 // disort
 #include "disort.hpp"
 #include "disort_dispatch.hpp"
 #include "disort_formatter.hpp"
+#include "disort_function.hpp"
+#include "disort_impl.h"
 #include "vectorize.hpp"
 
 namespace disort {
@@ -23,6 +31,8 @@ DisortOptions::DisortOptions() {
   ds().flag.old_intensity_correction = false;
   ds().flag.general_source = false;
   ds().flag.output_uum = false;
+  ds().flag.symmetric_eigen = false;
+  ds().flag.skip_rcond = false;
   for (int i = 0; i < 5; ++i) {
     ds().flag.prnt[i] = false;
   }
@@ -73,6 +83,10 @@ void DisortOptions::set_flags(std::string const &str) {
       ds().flag.general_source = true;
     } else if (dstr[i] == "output_uum") {
       ds().flag.output_uum = true;
+    } else if (dstr[i] == "symmetric_eigen") {
+      ds().flag.symmetric_eigen = true;
+    } else if (dstr[i] == "skip_rcond") {
+      ds().flag.skip_rcond = true;
     } else if (dstr[i] == "print-input") {
       ds().flag.prnt[0] = true;
     } else if (dstr[i] == "print-fluxes") {
@@ -110,6 +124,68 @@ void DisortImpl::reset() {
   TORCH_CHECK(options.ds().nmom >= options.ds().nstr,
               "DisortImpl: ds.nmom < ds.nstr");
 
+  TORCH_CHECK(options.solver() == "disort" || options.solver() == "twostr",
+              "DisortImpl: unknown solver '", options.solver(), "'");
+
+  // the two-stream solver does not compute intensities
+  if (options.solver() == "twostr") {
+    options.ds().flag.onlyfl = true;
+  }
+
+  TORCH_CHECK(options.schedule() == "static" ||
+                  options.schedule() == "dynamic" ||
+                  options.schedule() == "cost",
+              "DisortImpl: unknown schedule '", options.schedule(), "'");
+
+  TORCH_CHECK(options.engine() == "cdisort" || options.engine() == "batched",
+              "DisortImpl: unknown engine '", options.engine(), "'");
+
+  TORCH_CHECK(options.eigen_cache() >= 0,
+              "DisortImpl: eigen_cache must be non-negative");
+
+  if (options.beam_cache()) {
+    TORCH_CHECK(options.solver() == "disort" && !options.pooled(),
+                "DisortImpl: the beam cache needs solver 'disort' and "
+                "pooled = false");
+  }
+
+  TORCH_CHECK(!options.incremental() || !options.pooled(),
+              "DisortImpl: incremental needs pooled = false");
+
+  TORCH_CHECK(options.reuse_tol() >= 0.,
+              "DisortImpl: reuse_tol must be non-negative");
+  TORCH_CHECK(options.reuse_tol() == 0. || !options.pooled(),
+              "DisortImpl: reuse_tol needs pooled = false");
+
+  if (options.reuse_tol() > 0. && options.reuse_correct()) {
+    auto const &flag = options.ds().flag;
+    TORCH_CHECK(options.solver() == "disort" && flag.lamber && !flag.spher &&
+                    !flag.usrtau && !flag.general_source &&
+                    flag.ibcnd == GENERAL_BC,
+                "DisortImpl: reuse_correct needs solver 'disort', a "
+                "lambertian surface, plane-parallel geometry, general "
+                "boundary conditions and usrtau = false");
+  }
+
+  if (options.engine() == "batched") {
+    auto const &flag = options.ds().flag;
+    TORCH_CHECK(options.lanes() == 4 || options.lanes() == 8 ||
+                    options.lanes() == 16,
+                "DisortImpl: lanes must be 4, 8 or 16");
+    TORCH_CHECK(options.solver() == "disort",
+                "DisortImpl: the batched engine needs solver 'disort'");
+    TORCH_CHECK(flag.lamber && !flag.spher && !flag.general_source &&
+                    flag.ibcnd == GENERAL_BC,
+                "DisortImpl: the batched engine needs a lambertian surface, "
+                "plane-parallel geometry and general boundary conditions");
+    if (!flag.onlyfl) {
+      TORCH_WARN(
+          "DisortImpl: the batched engine solves fluxes only; without "
+          "onlyfl, forward calls that return or gather radiances (the "
+          "default outputs) run c_disort");
+    }
+  }
+
   if (options.ds().flag.planck) {
     TORCH_CHECK(options.wave_lower().size() == options.nwave(),
                 "DisortImpl: wave_lower.size() != nwave");
@@ -118,73 +194,212 @@ void DisortImpl::reset() {
   }
 
   if (allocated_) {
-    for (int i = 0; i < options.nwave() * options.ncol(); ++i) {
-      c_disort_state_free(&ds_[i]);
-      c_disort_out_free(&ds_[i], &ds_out_[i]);
-    }
+    free_states_();
+    free_workspace_();
+  }
+
+  twostr_ = options.solver() == "twostr";
+
+  planck_table_.reset();
+  if (options.planck_table() && options.ds().flag.planck) {
+    planck_table_ = std::make_shared<PlanckTable>(
+        options.emission(), options.wave_lower(), options.wave_upper(),
+        options.planck_tgrid());
+  }
+  status_.assign(options.nwave() * options.ncol(), DS_OK);
+  fingerprint_.assign(options.incremental() ? status_.size() : 0, 0);
+  dirty_.assign(status_.size(), 1);
+  reuse_inp_ = torch::Tensor();
+  reuse_jac_ = torch::Tensor();
+  reuse_tmp_ = torch::Tensor();
+  reuse_valid_.assign(status_.size(), 0);
+  reused_.assign(status_.size(), 0);
+
+  flx_buf_ = torch::Tensor();
+  rad_buf_ = torch::Tensor();
+  user_buffers_ = false;
+
+  if (options.pooled()) {
+    alloc_states_(at::get_num_threads());
+  } else {
+    alloc_states_(options.nwave() * options.ncol());
   }
 
-  ds_.resize(options.nwave() * options.ncol());
-  ds_out_.resize(options.nwave() * options.ncol());
+  allocated_ = true;
 
-  for (int i = 0; i < options.nwave() * options.ncol(); ++i) {
-    ds_[i] = options.ds();
-    c_disort_state_alloc(&ds_[i]);
-    c_disort_out_alloc(&ds_[i], &ds_out_[i]);
+  alloc_workspace_(at::get_num_threads());
+}
 
-    if (ds_[i].flag.usrtau) {
+DisortImpl::~DisortImpl() {
+  if (allocated_) {
+    free_states_();
+    free_workspace_();
+  }
+  allocated_ = false;
+}
+
+void DisortImpl::alloc_states_(int nstate) {
+  for (int i = ds_.size(); i < nstate; ++i) {
+    ds_.push_back(options.ds());
+    ds_out_.emplace_back();
+
+    auto &ds = ds_.back();
+    if (twostr_) {
+      c_twostr_state_alloc(&ds);
+      c_twostr_out_alloc(&ds, &ds_out_.back());
+    } else {
+      c_disort_state_alloc(&ds);
+      c_disort_out_alloc(&ds, &ds_out_.back());
+    }
+
+    if (ds.flag.usrtau) {
       for (int j = 0; j < options.user_tau().size(); ++j)
-        ds_[i].utau[j] = options.user_tau()[j];
+        ds.utau[j] = options.user_tau()[j];
     }
 
-    if (ds_[i].flag.usrang) {
+    if (ds.flag.usrang && !twostr_) {
       for (int j = 0; j < options.user_mu().size(); ++j)
-        ds_[i].umu[j] = options.user_mu()[j];
+        ds.umu[j] = options.user_mu()[j];
 
       for (int j = 0; j < options.user_phi().size(); ++j)
-        ds_[i].phi[j] = options.user_phi()[j];
+        ds.phi[j] = options.user_phi()[j];
     }
 
-    if (ds_[i].flag.planck) {
-      ds_[i].wvnmlo = options.wave_lower()[i / options.ncol()];
-      ds_[i].wvnmhi = options.wave_upper()[i / options.ncol()];
+    // pooled states get their wave bin from the kernel
+    if (ds.flag.planck) {
+      int n = options.pooled() ? 0 : i / options.ncol();
+      ds.wvnmlo = options.wave_lower()[n];
+      ds.wvnmhi = options.wave_upper()[n];
     } else {
-      ds_[i].wvnmlo = 0.;
-      ds_[i].wvnmhi = 1.;
+      ds.wvnmlo = 0.;
+      ds.wvnmhi = 1.;
     }
-  }
 
-  allocated_ = true;
+    if (options.beam_cache() && !twostr_) {
+      beam_.emplace_back();
+      int err = c_disort_beam_cache_alloc(&beam_.back(), &ds);
+      TORCH_CHECK(err == 0, "DisortImpl: failed to allocate beam cache");
+    }
+  }
 }
 
-DisortImpl::~DisortImpl() {
-  if (allocated_) {
-    for (int i = 0; i < options.nwave() * options.ncol(); ++i) {
+void DisortImpl::free_states_() {
+  for (int i = 0; i < ds_.size(); ++i) {
+    if (twostr_) {
+      c_twostr_state_free(&ds_[i]);
+      c_twostr_out_free(&ds_[i], &ds_out_[i]);
+    } else {
       c_disort_state_free(&ds_[i]);
       c_disort_out_free(&ds_[i], &ds_out_[i]);
     }
   }
-  allocated_ = false;
+  for (auto &cache : beam_) c_disort_beam_cache_free(&cache);
+  for (auto &so : sun_out_) {
+    for (int s = 1; s < so.size(); ++s) c_disort_out_free(&ds_[0], &so[s]);
+  }
+  ds_.clear();
+  ds_out_.clear();
+  beam_.clear();
+  sun_out_.clear();
 }
 
-torch::Tensor DisortImpl::gather_flx() const {
-  TORCH_CHECK(allocated_, "DisortImpl::gather_flx: DisortImpl not allocated");
+void DisortImpl::alloc_sun_outputs_(int nthreads, int nsun) {
+  if (sun_out_.size() < nthreads) sun_out_.resize(nthreads);
+
+  // all states share the output dimensions
+  for (auto &so : sun_out_) {
+    if (so.empty()) so.emplace_back();
+    while (so.size() < nsun) {
+      so.emplace_back();
+      c_disort_out_alloc(&ds_[0], &so.back());
+    }
+  }
+}
+
+void DisortImpl::alloc_workspace_(int nthreads) {
+  // c_twostr manages its own scratch memory
+  if (twostr_) return;
+
+  auto const &ds = options.ds();
+
+  // all states share nstr and the user angles, see disort_impl.h
+  if (tables_.nstr == 0) {
+    int err = c_disort_tables_alloc(&tables_, &ds_[0]);
+    TORCH_CHECK(err == 0, "DisortImpl: failed to allocate disort tables");
+  }
+
+  for (int i = ws_.size(); i < nthreads; ++i) {
+    ws_.emplace_back();
+    int err = c_disort_workspace_alloc(&ws_.back(), ds.nlyr, ds.nstr, ds.numu,
+                                       ds.ntau, ds.nphi);
+    TORCH_CHECK(err == 0, "DisortImpl: failed to allocate disort workspace");
+    err = c_disort_eigen_cache_alloc(&ws_.back(), options.eigen_cache());
+    TORCH_CHECK(err == 0, "DisortImpl: failed to allocate eigen cache");
+    ws_.back().tab = &tables_;
+  }
+}
+
+void DisortImpl::free_workspace_() {
+  for (auto &ws : ws_) c_disort_workspace_free(&ws);
+  ws_.clear();
+  c_disort_tables_free(&tables_);
+}
 
-  int nlyr = options.ds().nlyr;
-  auto result = torch::empty({options.nwave() * options.ncol(), nlyr + 1, 8},
-                             result_options_);
+std::vector<int64_t> DisortImpl::flx_shape_(int nsun) const {
+  if (nsun > 1) {
+    return {options.nwave(), options.ncol(), nsun, ds().ntau, 8};
+  }
+  return {options.nwave(), options.ncol(), ds().ntau, 8};
+}
 
-  for (int i = 0; i < options.nwave() * options.ncol(); ++i) {
-    auto var = torch::from_blob(&ds_out_[i].rad[0].rfldir, {nlyr + 1, 8},
-                                {8, 1}, result_options_.dtype(torch::kFloat64));
-    result[i].copy_(var);
+std::vector<int64_t> DisortImpl::rad_shape_(int nsun) const {
+  if (nsun > 1) {
+    return {options.nwave(),   options.ncol(),     nsun, options.ds().nphi,
+            options.ds().ntau, options.ds().numu};
   }
+  return {options.nwave(), options.ncol(), options.ds().nphi,
+          options.ds().ntau, options.ds().numu};
+}
 
-  if (options.upward()) {
-    return result.view({options.nwave(), options.ncol(), nlyr + 1, 8}).flip(2);
+int DisortImpl::nsun_(std::map<std::string, torch::Tensor> const &bc) {
+  auto const &umu0 = bc.at("umu0");
+  return umu0.dim() == 2 ? umu0.size(1) : 1;
+}
+
+void DisortImpl::set_gather_buffers(torch::Tensor flx,
+                                    torch::optional<torch::Tensor> rad) {
+  TORCH_CHECK(flx.device().is_cpu() && flx.is_contiguous(),
+              "DisortImpl::set_gather_buffers: flx is not a contiguous CPU "
+              "tensor");
+  TORCH_CHECK(flx.sizes() == flx_shape_(),
+              "DisortImpl::set_gather_buffers: flx.sizes() != (nwave, ncol, "
+              "ntau, 8)");
+  flx_buf_ = flx;
+
+  if (rad.has_value()) {
+    TORCH_CHECK(options.ds().flag.onlyfl == false,
+                "DisortImpl::set_gather_buffers: ds.onlyfl == true");
+    TORCH_CHECK(rad.value().device().is_cpu() && rad.value().is_contiguous(),
+                "DisortImpl::set_gather_buffers: rad is not a contiguous CPU "
+                "tensor");
+    TORCH_CHECK(rad.value().sizes() == rad_shape_(),
+                "DisortImpl::set_gather_buffers: rad.sizes() != (nwave, ncol, "
+                "nphi, ntau, numu)");
+    rad_buf_ = rad.value();
   } else {
-    return result.view({options.nwave(), options.ncol(), nlyr + 1, 8});
+    rad_buf_ = torch::Tensor();
   }
+
+  user_buffers_ = true;
+}
+
+torch::Tensor DisortImpl::gather_flx() const {
+  TORCH_CHECK(allocated_, "DisortImpl::gather_flx: DisortImpl not allocated");
+  TORCH_CHECK(flx_buf_.defined(),
+              "DisortImpl::gather_flx: no flux buffer, pooled states need "
+              "set_gather_buffers()");
+
+  return flx_buf_;
 }
 
 torch::Tensor DisortImpl::gather_rad() const {
@@ -193,44 +408,33 @@ torch::Tensor DisortImpl::gather_rad() const {
   TORCH_CHECK(options.ds().flag.onlyfl == false,
               "DisortImpl::gather_rad: ds.onlyfl == true");
 
-  int nphi = options.ds().nphi;
-  int ntau = options.ds().ntau;
-  int numu = options.ds().numu;
+  TORCH_CHECK(rad_buf_.defined(),
+              "DisortImpl::gather_rad: no radiance buffer, pooled states "
+              "need set_gather_buffers()");
 
-  auto result = torch::empty(
-      {options.nwave() * options.ncol(), nphi, ntau, numu}, result_options_);
+  return rad_buf_;
+}
 
-  for (int i = 0; i < options.nwave() * options.ncol(); ++i) {
-    auto var = torch::from_blob(ds_out_[i].uu, {nphi, ntau, numu},
-                                {ntau * numu, numu, 1},
-                                result_options_.dtype(torch::kFloat64));
-    result[i].copy_(var);
-  }
+torch::Tensor DisortImpl::gather_status() const {
+  TORCH_CHECK(allocated_,
+              "DisortImpl::gather_status: DisortImpl not allocated");
+
+  auto result = torch::from_blob(const_cast<int *>(status_.data()),
+                                 {options.nwave(), options.ncol()},
+                                 torch::TensorOptions().dtype(torch::kInt32));
 
-  return result.view({options.nwave(), options.ncol(), nphi, ntau, numu});
+  return result.clone();
 }
 
-//! \note Counting Disort Index
-//! Example, il = 0, iu = 2, ds_.nlyr = 6, partition in to 3 blocks
-//! face id   -> 0 - 1 - 2 - 3 - 4 - 5 - 6
-//! cell id   -> | 0 | 1 | 2 | 3 | 4 | 5 |
-//! disort id -> 6 - 5 - 4 - 3 - 2 - 1 - 0
-//! blocks    -> ---------       *       *
-//!           ->  r = 0  *       *       *
-//!           ->         ---------       *
-//!           ->           r = 1 *       *
-//!           ->                 ---------
-//!           ->                   r = 2
-//! block r = 0 gets, 6 - 5 - 4
-//! block r = 1 gets, 4 - 3 - 2
-//! block r = 2 gets, 2 - 1 - 0
-torch::Tensor DisortImpl::forward(torch::Tensor prop,
-                                  std::map<std::string, torch::Tensor> *bc,
-                                  std::string bname,
-                                  torch::optional<torch::Tensor> temf) {
+torch::Tensor DisortImpl::check_inputs_(
+    torch::Tensor prop, std::map<std::string, torch::Tensor> *bc,
+    std::string bname, torch::optional<torch::Tensor> temf, int outputs) {
   TORCH_CHECK(options.ds().flag.ibcnd == 0,
               "DisortImpl::forward: ds.ibcnd != 0");
 
+  TORCH_CHECK(!(outputs & output::RAD) || !options.ds().flag.onlyfl,
+              "DisortImpl::forward: output::RAD requested with ds.onlyfl");
+
   // check dimensions
   TORCH_CHECK(prop.dim() == 4, "DisortImpl::forward: prop.dim() != 4");
 
@@ -253,27 +457,41 @@ torch::Tensor DisortImpl::forward(torch::Tensor prop,
     bname += "/";
   }
 
-  // check bc
+  // check bc, umu0 and phi0 may list several suns per column
   if (bc->find(bname + "umu0") != bc->end()) {
-    TORCH_CHECK(bc->at(bname + "umu0").dim() == 1,
-                "DisortImpl::forward: bc->umu0.dim() != 1");
-    TORCH_CHECK(bc->at(bname + "umu0").size(0) == ncol,
+    auto umu0 = bc->at(bname + "umu0");
+    TORCH_CHECK(umu0.dim() == 1 || umu0.dim() == 2,
+                "DisortImpl::forward: bc->umu0.dim() != 1 or 2");
+    TORCH_CHECK(umu0.size(0) == ncol,
                 "DisortImpl::forward: bc->umu0.size(0) != ncol");
-    (*bc)["umu0"] = bc->at(bname + "umu0");
+    TORCH_CHECK(umu0.dim() == 1 || umu0.size(1) > 0,
+                "DisortImpl::forward: bc->umu0.size(1) == 0");
+    (*bc)["umu0"] = umu0;
   } else {
-    (*bc)["umu0"] = torch::ones({1, ncol}, prop.options());
+    (*bc)["umu0"] = torch::ones({ncol}, prop.options());
   }
 
+  int nsun = nsun_(*bc);
+
   if (bc->find(bname + "phi0") != bc->end()) {
-    TORCH_CHECK(bc->at(bname + "phi0").dim() == 1,
-                "DisortImpl::forward: bc->phi0.dim() != 1");
-    TORCH_CHECK(bc->at(bname + "phi0").size(0) == ncol,
+    auto phi0 = bc->at(bname + "phi0");
+    TORCH_CHECK(phi0.dim() == 1 || phi0.dim() == 2,
+                "DisortImpl::forward: bc->phi0.dim() != 1 or 2");
+    TORCH_CHECK(phi0.size(0) == ncol,
                 "DisortImpl::forward: bc->phi0.size(0) != ncol");
-    (*bc)["phi0"] = bc->at(bname + "phi0");
+    TORCH_CHECK(phi0.dim() == 1 || bc->at("umu0").dim() == 2,
+                "DisortImpl::forward: bc->phi0.dim() == 2 but "
+                "bc->umu0.dim() == 1");
+    TORCH_CHECK(phi0.dim() == 1 || phi0.size(1) == nsun,
+                "DisortImpl::forward: bc->phi0.size(1) != bc->umu0.size(1)");
+    (*bc)["phi0"] = phi0;
   } else {
-    (*bc)["phi0"] = torch::zeros({1, ncol}, prop.options());
+    (*bc)["phi0"] = torch::zeros({ncol}, prop.options());
   }
 
+  TORCH_CHECK(bc->at("umu0").dim() == 1 || !twostr_,
+              "DisortImpl::forward: several suns need c_disort, not twostr");
+
   if (bc->find(bname + "fbeam") != bc->end()) {
     TORCH_CHECK(bc->at(bname + "fbeam").dim() == 2,
                 "DisortImpl::forward: bc->fbeam.dim() != 2");
@@ -368,44 +586,519 @@ torch::Tensor DisortImpl::forward(torch::Tensor prop,
     tem = torch::empty({ncol, nlyr + 1}, prop.options());
   }
 
-  auto flx = torch::zeros({nwave, ncol, ds().ntau, 2}, prop.options());
+  return tem;
+}
+
+at::TensorIterator DisortImpl::make_iter_(
+    torch::Tensor flx, torch::Tensor prop,
+    std::map<std::string, torch::Tensor> const &bc, torch::Tensor tem,
+    torch::Tensor index) const {
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int nlyr = prop.size(2);
+
+  // the suns of a column are contiguous, see disort_impl
+  int nsun = nsun_(bc);
+  auto umu0 = bc.at("umu0").reshape({ncol, nsun}).contiguous();
+  auto phi0 = bc.at("phi0").view({ncol, -1}).expand({ncol, nsun}).contiguous();
+
+  return at::TensorIteratorConfig()
+      .resize_outputs(false)
+      .check_all_same_dtype(true)
+      .declare_static_shape(flx.sizes(), /*squash_dims=*/{2, 3})
+      .add_output(flx)
+      .add_input(prop)
+      .add_owned_input(
+          umu0.view({1, ncol, nsun, 1}).expand({nwave, ncol, nsun, 1}))
+      .add_owned_input(
+          phi0.view({1, ncol, nsun, 1}).expand({nwave, ncol, nsun, 1}))
+      .add_owned_input(bc.at("fbeam").view({nwave, ncol, 1, 1}))
+      .add_owned_input(bc.at("albedo").view({nwave, ncol, 1, 1}))
+      .add_owned_input(bc.at("fluor").view({nwave, ncol, 1, 1}))
+      .add_owned_input(bc.at("fisot").view({nwave, ncol, 1, 1}))
+      .add_owned_input(bc.at("temis").view({nwave, ncol, 1, 1}))
+      .add_owned_input(
+          bc.at("btemp").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
+      .add_owned_input(
+          bc.at("ttemp").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
+      .add_owned_input(
+          tem.view({1, ncol, nlyr + 1, 1}).expand({nwave, ncol, nlyr + 1, 1}))
+      .add_input(index)
+      .build();
+}
+
+void DisortImpl::run_kernel_(at::TensorIterator &iter, int outputs, int nsun,
+                             void *surf, void *jac, void const *seed,
+                             disort_beam_cache *cache) {
+  auto prop_options = iter.input(0).options();
+
+  // the number of threads may have changed since reset()
+  alloc_workspace_(at::get_num_threads());
+
+  TORCH_CHECK(!user_buffers_ || nsun == 1,
+              "DisortImpl::forward: set_gather_buffers() buffers hold one "
+              "sun per column");
+
+  // outputs gathered by the kernel, in their final layout
+  bool gather = outputs & output::GATHER;
+  bool want_rad = outputs & output::RAD;
+
+  if (gather && !options.pooled() && !user_buffers_ &&
+      (!flx_buf_.defined() || flx_buf_.dtype() != iter.dtype() ||
+       flx_buf_.sizes() != flx_shape_(nsun))) {
+    flx_buf_ = torch::empty(flx_shape_(nsun), prop_options);
+  }
+
+  if (want_rad && !options.ds().flag.onlyfl &&
+      (!rad_buf_.defined() ||
+       (!user_buffers_ && (rad_buf_.dtype() != iter.dtype() ||
+                           rad_buf_.sizes() != rad_shape_(nsun))))) {
+    rad_buf_ = torch::empty(rad_shape_(nsun), prop_options);
+  }
+
+  DisortOutputs out;
+  out.mask = outputs;
+  out.umu = options.user_mu().data();
+  out.ntau = ds().ntau;
+  out.nphi = options.ds().nphi;
+  out.numu = options.ds().numu;
+  out.nsun = nsun;
+  if (nsun > 1) {
+    alloc_sun_outputs_(at::get_num_threads(), nsun);
+    out.sun_out = sun_out_.data();
+  }
+  out.surf = surf;
+  out.jac = jac;
+  out.seed = seed;
+  out.cache = cache != nullptr ? cache
+              : beam_.empty()  ? nullptr
+                               : beam_.data();
+
+  // the outputs kept in ds_out_ are those of one sun over the real surface
+  bool keep = nsun == 1 && surf == nullptr && jac == nullptr;
+  dirty_.assign(status_.size(), 1);
+  reused_.assign(status_.size(), 0);
+  if (!fingerprint_.empty()) {
+    if (keep) {
+      out.fingerprint = fingerprint_.data();
+      out.dirty = dirty_.data();
+    } else {
+      std::fill(fingerprint_.begin(), fingerprint_.end(), 0);
+    }
+  }
+
+  DisortReuse reuse;
+  if (options.reuse_tol() > 0. && !keep) {
+    std::fill(reuse_valid_.begin(), reuse_valid_.end(), 0);
+  } else if (options.reuse_tol() > 0.) {
+    int64_t ncol = status_.size();
+    int64_t nlyr = ds().nlyr;
+    int64_t nprop = iter.input(0).size(-1);
+    int64_t njac = ds().ntau * 2 * (nlyr * nprop + nlyr + 2);
+
+    // a new layout of the inputs forgets the solves
+    if (!reuse_inp_.defined() || reuse_inp_.dtype() != iter.dtype() ||
+        reuse_inp_.size(1) != disort_ninputs(nlyr, nprop)) {
+      reuse_inp_ =
+          torch::empty({ncol, disort_ninputs(nlyr, nprop)}, prop_options);
+      if (options.reuse_correct()) {
+        reuse_jac_ = torch::empty({ncol, njac}, prop_options);
+      }
+      std::fill(reuse_valid_.begin(), reuse_valid_.end(), 0);
+    }
+
+    if (!reuse_tmp_.defined() || reuse_tmp_.dtype() != iter.dtype() ||
+        reuse_tmp_.size(0) < at::get_num_threads() ||
+        reuse_tmp_.size(1) != reuse_inp_.size(1)) {
+      reuse_tmp_ = torch::empty({at::get_num_threads(), reuse_inp_.size(1)},
+                                prop_options);
+    }
+
+    reuse.tol = options.reuse_tol();
+    reuse.inputs = reuse_inp_.data_ptr();
+    reuse.scratch = reuse_tmp_.data_ptr();
+    reuse.valid = reuse_valid_.data();
+    reuse.reused = reused_.data();
+    if (reuse_jac_.defined()) reuse.jac = reuse_jac_.data_ptr();
+    out.dirty = dirty_.data();
+  }
+
+  if (gather && flx_buf_.defined()) {
+    TORCH_CHECK(flx_buf_.dtype() == iter.dtype(),
+                "DisortImpl::forward: flux buffer dtype != prop.dtype");
+    out.flx = flx_buf_.data_ptr();
+  }
+
+  if (want_rad && rad_buf_.defined()) {
+    TORCH_CHECK(rad_buf_.dtype() == iter.dtype(),
+                "DisortImpl::forward: radiance buffer dtype != prop.dtype");
+    out.rad = rad_buf_.data_ptr();
+  }
+
+  DisortPool pool;
+  if (options.pooled()) {
+    alloc_states_(at::get_num_threads());
+    pool.ncol = options.ncol();
+    pool.wave_lower = options.wave_lower().data();
+    pool.wave_upper = options.wave_upper().data();
+  }
+
+  DisortSchedule schedule;
+  if (options.schedule() == "dynamic") {
+    schedule.mode = DisortSchedule::DYNAMIC;
+  } else if (options.schedule() == "cost") {
+    schedule.mode = DisortSchedule::COST;
+  }
+
+  // cached eigensolutions are kept, only the counts restart
+  for (auto &ws : ws_) ws.eig_hits = ws.eig_misses = 0;
+  for (auto &cache : beam_) cache.hits = cache.misses = 0;
+
+  busy_.assign(at::get_num_threads(), 0.);
+  ncol_done_.assign(at::get_num_threads(), 0);
+  ncol_batched_.assign(at::get_num_threads(), 0);
+  schedule.busy = busy_.data();
+  schedule.ncol = ncol_done_.data();
+  schedule.batched = ncol_batched_.data();
+
+  // plain function pointers are handed to disort as they are
+  DisortEmission emission;
+  emission.ncol = options.ncol();
+  auto func = options.emission().target<double (*)(double, double, double)>();
+
+  if (planck_table_ != nullptr) {
+    emission.func = nullptr;
+    emission.source.table = planck_table_.get();
+  } else if (func != nullptr) {
+    emission.func = *func;
+  } else {
+    TORCH_CHECK(options.emission(), "DisortImpl::forward: emission is empty");
+    emission.func = nullptr;
+    emission.source.func = &options.emission();
+  }
+
+  // the batched engine solves fluxes only, radiances (also those of the
+  // default outputs) need c_disort
+  DisortBatch batch;
+  if (options.engine() == "batched" &&
+      (options.ds().flag.onlyfl || !want_rad)) {
+    batch.lanes = options.lanes();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  at::native::call_disort(iter.device_type(), iter, options.upward(), twostr_,
+                          ds_.data(), ds_out_.data(), ws_.data(),
+                          status_.data(), options.pooled() ? &pool : nullptr,
+                          out, emission, batch, schedule, reuse);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  wall_ = elapsed.count();
+}
+
+std::map<std::string, double> DisortImpl::schedule_stats() const {
+  std::map<std::string, double> stats;
+  int nthreads = busy_.size();
+
+  stats["nthreads"] = nthreads;
+  stats["wall"] = wall_;
+  if (nthreads == 0) return stats;
+
+  double busy_sum = std::accumulate(busy_.begin(), busy_.end(), 0.);
+  stats["busy_max"] = *std::max_element(busy_.begin(), busy_.end());
+  stats["busy_mean"] = busy_sum / nthreads;
+  stats["imbalance"] =
+      busy_sum > 0. ? stats["busy_max"] / stats["busy_mean"] : 1.;
+  stats["idle"] = wall_ > 0. ? 1. - busy_sum / (nthreads * wall_) : 0.;
+  stats["ncol_min"] = *std::min_element(ncol_done_.begin(), ncol_done_.end());
+  stats["ncol_max"] = *std::max_element(ncol_done_.begin(), ncol_done_.end());
+  stats["ncol_batched"] =
+      std::accumulate(ncol_batched_.begin(), ncol_batched_.end(), 0);
+
+  return stats;
+}
+
+std::map<std::string, double> DisortImpl::eigen_cache_stats() const {
+  std::map<std::string, double> stats;
+  double hits = 0., misses = 0.;
+
+  for (auto const &ws : ws_) {
+    hits += ws.eig_hits;
+    misses += ws.eig_misses;
+  }
+
+  stats["hits"] = hits;
+  stats["misses"] = misses;
+  stats["hit_rate"] = hits + misses > 0. ? hits / (hits + misses) : 0.;
+
+  return stats;
+}
+
+std::map<std::string, double> DisortImpl::beam_cache_stats() const {
+  std::map<std::string, double> stats;
+  double hits = 0., misses = 0.;
+
+  for (auto const &cache : beam_) {
+    hits += cache.hits;
+    misses += cache.misses;
+  }
+
+  stats["hits"] = hits;
+  stats["misses"] = misses;
+  stats["hit_rate"] = hits + misses > 0. ? hits / (hits + misses) : 0.;
+
+  return stats;
+}
+
+std::map<std::string, double> DisortImpl::incremental_stats() const {
+  std::map<std::string, double> stats;
+  double ncol = dirty_.size();
+  double dirty = std::accumulate(dirty_.begin(), dirty_.end(), 0.);
+
+  stats["ncol"] = ncol;
+  stats["dirty"] = dirty;
+  stats["dirty_fraction"] = ncol > 0. ? dirty / ncol : 0.;
+  stats["reused"] = std::accumulate(reused_.begin(), reused_.end(), 0.);
+  stats["reused_fraction"] = ncol > 0. ? stats["reused"] / ncol : 0.;
+
+  return stats;
+}
+
+//! \note Counting Disort Index
+//! Example, il = 0, iu = 2, ds_.nlyr = 6, partition in to 3 blocks
+//! face id   -> 0 - 1 - 2 - 3 - 4 - 5 - 6
+//! cell id   -> | 0 | 1 | 2 | 3 | 4 | 5 |
+//! disort id -> 6 - 5 - 4 - 3 - 2 - 1 - 0
+//! blocks    -> ---------       *       *
+//!           ->  r = 0  *       *       *
+//!           ->         ---------       *
+//!           ->           r = 1 *       *
+//!           ->                 ---------
+//!           ->                   r = 2
+//! block r = 0 gets, 6 - 5 - 4
+//! block r = 1 gets, 4 - 3 - 2
+//! block r = 2 gets, 2 - 1 - 0
+torch::Tensor DisortImpl::forward(torch::Tensor prop,
+                                  std::map<std::string, torch::Tensor> *bc,
+                                  std::string bname,
+                                  torch::optional<torch::Tensor> temf,
+                                  int outputs) {
+  auto tem = check_inputs_(prop, bc, bname, temf, outputs);
+
+  // differentiable fluxes, see DisortFunction
+  bool grad = prop.requires_grad() || bc->at("albedo").requires_grad() ||
+              (temf.has_value() && temf.value().requires_grad());
+  if (at::GradMode::is_enabled() && grad) {
+    TORCH_CHECK((outputs & ~(output::RAD | output::GATHER)) == output::FLUX,
+                "DisortImpl::forward: gradients need outputs == "
+                "output::FLUX, possibly with output::RAD and output::GATHER");
+    check_jacobian_("forward", prop);
+    TORCH_CHECK(nsun_(*bc) == 1,
+                "DisortImpl::forward: gradients with several suns per column "
+                "are not supported");
+    auto band = bname.empty() || bname.back() == '/' ? bname : bname + "/";
+    for (auto const &[key, value] : *bc) {
+      TORCH_CHECK(key == "albedo" || key == band + "albedo" ||
+                      !value.requires_grad(),
+                  "DisortImpl::forward: gradients with respect to bc->", key,
+                  " are not supported");
+    }
+
+    auto self = std::dynamic_pointer_cast<DisortImpl>(weak_from_this().lock());
+    TORCH_CHECK(self != nullptr,
+                "DisortImpl::forward: gradients need a module owned by a "
+                "shared_ptr");
+    return DisortFunction::apply(self, prop, bc->at("albedo"),
+                                 temf.value_or(torch::Tensor()), *bc, outputs);
+  }
+
+  return solve_(prop, *bc, tem, outputs);
+}
+
+torch::Tensor DisortImpl::solve_(torch::Tensor prop,
+                                 std::map<std::string, torch::Tensor> const &bc,
+                                 torch::Tensor tem, int outputs,
+                                 disort_beam_cache *cache) {
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int nsun = nsun_(bc);
+
+  // the kernel visits each column once, also when only radiance is asked;
+  // the suns of a column follow each other
+  int nout = output::size(outputs);
+  auto flx = torch::zeros({nwave, ncol, nsun * ds().ntau, std::max(nout, 1)},
+                          prop.options());
+  auto index = torch::range(0, nwave * ncol - 1, 1)
+                   .view({nwave, ncol, 1, 1})
+                   .to(prop.options());
+
+  auto iter = make_iter_(flx, prop, bc, tem, index);
+  run_kernel_(iter, outputs, nsun, nullptr, nullptr, nullptr, cache);
+
+  if (bc.at("umu0").dim() == 2) {
+    flx = flx.view({nwave, ncol, nsun, ds().ntau, std::max(nout, 1)});
+  }
+
+  return flx.narrow(-1, 0, nout);
+}
+
+torch::Tensor DisortImpl::forward_albedo(
+    torch::Tensor prop, std::map<std::string, torch::Tensor> *bc,
+    torch::Tensor albedo, std::string bname,
+    torch::optional<torch::Tensor> temf) {
+  TORCH_CHECK(options.ds().flag.lamber,
+              "DisortImpl::forward_albedo: ds.lamber == false");
+  TORCH_CHECK(!options.ds().flag.spher,
+              "DisortImpl::forward_albedo: ds.spher == true");
+  TORCH_CHECK(!twostr_,
+              "DisortImpl::forward_albedo: needs c_disort, not twostr");
+  TORCH_CHECK(prop.device().is_cpu(),
+              "DisortImpl::forward_albedo: prop is not a CPU tensor");
+
+  // the surface albedo of bc is not used
+  auto bc0 = *bc;
+  auto tem = check_inputs_(prop, &bc0, bname, temf, output::FLUX);
+
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int ntau = ds().ntau;
+
+  TORCH_CHECK(nsun_(bc0) == 1,
+              "DisortImpl::forward_albedo: several suns per column are not "
+              "supported");
+  TORCH_CHECK(albedo.dim() == 1 || albedo.dim() == 3,
+              "DisortImpl::forward_albedo: albedo.dim() != 1 or 3");
+  TORCH_CHECK(albedo.dim() == 1 || (albedo.size(1) == nwave &&
+                                    albedo.size(2) == ncol),
+              "DisortImpl::forward_albedo: albedo.sizes() != (nalb, nwave, "
+              "ncol)");
+
+  // solve once over a black surface, with the response to the surface
+  auto flx = torch::zeros({nwave, ncol, ntau, 2}, prop.options());
+  auto surf = torch::empty({nwave, ncol, 4 + 2 * ntau}, prop.options());
+  auto index = torch::range(0, nwave * ncol - 1, 1)
+                   .view({nwave, ncol, 1, 1})
+                   .to(prop.options());
+
+  auto iter = make_iter_(flx, prop, bc0, tem, index);
+  run_kernel_(iter, output::FLUX, 1, surf.data_ptr());
+
+  // flux leaving a surface of each albedo, see disort_surface in cdisort.h
+  auto alb = albedo.to(prop.options());
+  if (alb.dim() == 1) alb = alb.view({-1, 1, 1});
+
+  auto fdn = surf.select(2, 0);
+  auto femit = surf.select(2, 1);
+  auto ffluor = surf.select(2, 2);
+  auto sphalb = surf.select(2, 3);
+  auto fs = (alb * (fdn - sphalb * (femit + ffluor)) + (1. - alb) * femit +
+             ffluor) /
+            (1. - alb * sphalb);
+
+  auto resp = surf.narrow(2, 4, 2 * ntau).view({nwave, ncol, ntau, 2});
+  return flx.unsqueeze(0) +
+         (fs - femit - ffluor).unsqueeze(-1).unsqueeze(-1) * resp.unsqueeze(0);
+}
+
+std::map<std::string, torch::Tensor> DisortImpl::forward_jacobian(
+    torch::Tensor prop, std::map<std::string, torch::Tensor> *bc,
+    std::string bname, torch::optional<torch::Tensor> temf) {
+  check_jacobian_("forward_jacobian", prop);
+
+  auto tem = check_inputs_(prop, bc, bname, temf, output::FLUX);
+
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int nlyr = prop.size(2);
+  int nprop = prop.size(3);
+  int ntau = ds().ntau;
+
+  TORCH_CHECK(nsun_(*bc) == 1,
+              "DisortImpl::forward_jacobian: several suns per column are not "
+              "supported");
+
+  // per column, see disort_write_jacobian
+  int nfx = ntau * 2;
+  auto flx = torch::zeros({nwave, ncol, ntau, 2}, prop.options());
+  auto jac = torch::empty({nwave, ncol, nfx * (nlyr * nprop + nlyr + 2)},
+                          prop.options());
+  auto index = torch::range(0, nwave * ncol - 1, 1)
+                   .view({nwave, ncol, 1, 1})
+                   .to(prop.options());
+
+  auto iter = make_iter_(flx, prop, *bc, tem, index);
+  run_kernel_(iter, output::FLUX, 1, nullptr, jac.data_ptr());
+
+  std::map<std::string, torch::Tensor> result;
+  result["flux"] = flx;
+  result["prop"] = jac.narrow(2, 0, nfx * nlyr * nprop)
+                       .view({nwave, ncol, ntau, 2, nlyr, nprop});
+  result["albedo"] =
+      jac.narrow(2, nfx * nlyr * nprop, nfx).view({nwave, ncol, ntau, 2});
+  result["temf"] = jac.narrow(2, nfx * (nlyr * nprop + 1), nfx * (nlyr + 1))
+                       .view({nwave, ncol, ntau, 2, nlyr + 1});
+  return result;
+}
+
+std::map<std::string, torch::Tensor> DisortImpl::vjp(
+    torch::Tensor grad, torch::Tensor prop,
+    std::map<std::string, torch::Tensor> *bc, std::string bname,
+    torch::optional<torch::Tensor> temf) {
+  check_jacobian_("vjp", prop);
+
+  auto tem = check_inputs_(prop, bc, bname, temf, output::FLUX);
+  return vjp_(grad, prop, *bc, tem);
+}
+
+std::map<std::string, torch::Tensor> DisortImpl::vjp_(
+    torch::Tensor grad, torch::Tensor prop,
+    std::map<std::string, torch::Tensor> const &bc, torch::Tensor tem,
+    disort_beam_cache *cache) {
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int nlyr = prop.size(2);
+  int nprop = prop.size(3);
+  int ntau = ds().ntau;
+
+  TORCH_CHECK(nsun_(bc) == 1,
+              "DisortImpl::vjp: several suns per column are not supported");
+  TORCH_CHECK(grad.sizes() == torch::IntArrayRef({nwave, ncol, ntau, 2}),
+              "DisortImpl::vjp: grad.sizes() != (nwave, ncol, nlvl, 2)");
+
+  // per column, see disort_write_jacobian
+  auto seed = grad.to(prop.options()).contiguous();
+  auto flx = torch::zeros({nwave, ncol, ntau, 2}, prop.options());
+  auto jac =
+      torch::empty({nwave, ncol, nlyr * nprop + nlyr + 2}, prop.options());
   auto index = torch::range(0, nwave * ncol - 1, 1)
                    .view({nwave, ncol, 1, 1})
                    .to(prop.options());
 
-  auto iter =
-      at::TensorIteratorConfig()
-          .resize_outputs(false)
-          .check_all_same_dtype(true)
-          .declare_static_shape({nwave, ncol, ds().ntau, 2},
-                                /*squash_dims=*/{2, 3})
-          .add_output(flx)
-          .add_input(prop)
-          .add_owned_input(
-              bc->at("umu0").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
-          .add_owned_input(
-              bc->at("phi0").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
-          .add_owned_input(bc->at("fbeam").view({nwave, ncol, 1, 1}))
-          .add_owned_input(bc->at("albedo").view({nwave, ncol, 1, 1}))
-          .add_owned_input(bc->at("fluor").view({nwave, ncol, 1, 1}))
-          .add_owned_input(bc->at("fisot").view({nwave, ncol, 1, 1}))
-          .add_owned_input(bc->at("temis").view({nwave, ncol, 1, 1}))
-          .add_owned_input(
-              bc->at("btemp").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
-          .add_owned_input(
-              bc->at("ttemp").view({1, ncol, 1, 1}).expand({nwave, ncol, 1, 1}))
-          .add_owned_input(tem.view({1, ncol, nlyr + 1, 1})
-                               .expand({nwave, ncol, nlyr + 1, 1}))
-          .add_input(index)
-          .build();
-
-  at::native::call_disort(flx.device().type(), iter, options.upward(),
-                          ds_.data(), ds_out_.data());
-
-  // save result tensor options
-  result_options_ = flx.options();
-
-  return flx;
+  auto iter = make_iter_(flx, prop, bc, tem, index);
+  run_kernel_(iter, output::FLUX, 1, nullptr, jac.data_ptr(),
+              seed.data_ptr(), cache);
+
+  std::map<std::string, torch::Tensor> result;
+  result["prop"] =
+      jac.narrow(2, 0, nlyr * nprop).view({nwave, ncol, nlyr, nprop});
+  result["albedo"] = jac.select(2, nlyr * nprop);
+  result["temf"] = jac.narrow(2, nlyr * nprop + 1, nlyr + 1);
+  return result;
+}
+
+void DisortImpl::check_jacobian_(std::string const &caller,
+                                 torch::Tensor const &prop) const {
+  TORCH_CHECK(options.ds().flag.lamber, "DisortImpl::", caller,
+              ": ds.lamber == false");
+  TORCH_CHECK(!options.ds().flag.spher, "DisortImpl::", caller,
+              ": ds.spher == true");
+  TORCH_CHECK(!options.ds().flag.usrtau, "DisortImpl::", caller,
+              ": ds.usrtau == true");
+  TORCH_CHECK(!twostr_, "DisortImpl::", caller,
+              ": needs c_disort, not twostr");
+  TORCH_CHECK(prop.device().is_cpu(), "DisortImpl::", caller,
+              ": prop is not a CPU tensor");
 }
 
 void print_ds_atm(std::ostream &os, disort_state const &ds) {
@@ -518,6 +1211,18 @@ void print_ds_flags(std::ostream &os, disort_state const &ds) {
   } else {
     os << "- Output uum (output_uum) = False" << std::endl;
   }
+
+  if (ds.flag.symmetric_eigen) {
+    os << "- Symmetric eigen solver (symmetric_eigen) = True" << std::endl;
+  } else {
+    os << "- Symmetric eigen solver (symmetric_eigen) = False" << std::endl;
+  }
+
+  if (ds.flag.skip_rcond) {
+    os << "- Skip condition estimate (skip_rcond) = True" << std::endl;
+  } else {
+    os << "- Skip condition estimate (skip_rcond) = False" << std::endl;
+  }
 }
 
 }  // namespace disort
@@ -2,6 +2,7 @@
 
 // C/C++
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -17,9 +18,17 @@
 #include <cdisort213/cdisort.h>
 
 #include "add_arg.h"
+#include "index.h"
+#include "planck_table.hpp"
+
+namespace at {
+struct TensorIterator;
+}  // namespace at
 
 namespace disort {
 
+class DisortPlan;
+
 struct DisortOptions {
   DisortOptions();
 
@@ -29,7 +38,9 @@ struct DisortOptions {
   //! set disort flags
   void set_flags(std::string const& flags);
 
-  //! emission function
+  //! emission function (wnumlo, wnumhi, temperature)
+  //! must not raise c_errmsg(..., DS_ERROR), see emission_func_t in cdisort.h;
+  //! a column whose emission function throws gets status DS_ERR_FATAL
   ADD_ARG(std::function<double(double, double, double)>,
           emission) = c_planck_func2;
 
@@ -68,6 +79,110 @@ struct DisortOptions {
   //! set upper wavenumber(length) at each bin
   ADD_ARG(std::vector<double>, wave_upper) = {};
 
+  //! solver state layout
+  /*!
+   * false : one disort state and output per (wave, column)
+   * true  : a pool of one disort state per thread, such that memory does
+   *         not scale with nwave * ncol. Inputs are read from the `prop`
+   *         tensor and fluxes written to the output tensor directly;
+   *         gather_flx() and gather_rad() need set_gather_buffers().
+   */
+  ADD_ARG(bool, pooled) = false;
+
+  //! radiative transfer solver
+  /*!
+   * "disort" : discrete ordinates with ds.nstr streams
+   * "twostr" : two-stream approximation (c_twostr), fluxes only. Only the
+   *            first phase function moment is used.
+   */
+  ADD_ARG(std::string, solver) = "disort";
+
+  //! order in which threads solve the columns
+  /*!
+   * "static"  : fixed blocks of columns per thread
+   * "dynamic" : idle threads take the next column
+   * "cost"    : like "dynamic", starting from the columns of highest
+   *             estimated cost (scattering layers, beam source, azimuthal
+   *             harmonics)
+   */
+  ADD_ARG(std::string, schedule) = "static";
+
+  //! engine that solves the columns on CPU
+  /*!
+   * "cdisort" : c_disort, one column at a time
+   * "batched" : `lanes` columns in lockstep (BatchedDisort) when only
+   *             fluxes are needed. Needs a Lambertian surface in
+   *             plane-parallel geometry, and has no layer cut-off below
+   *             an absorption optical depth of 10. Intensities are still
+   *             solved with c_disort, which without onlyfl includes the
+   *             radiances gathered by the default outputs. Only this
+   *             engine has kernels compiled for nstr = 4, 8, 16 and 32;
+   *             c_disort, and so "cdisort", solves any nstr the same way.
+   */
+  ADD_ARG(std::string, engine) = "cdisort";
+
+  //! number of columns solved together by the "batched" engine (4, 8, 16)
+  ADD_ARG(int, lanes) = 8;
+
+  //! tabulate `emission` in temperature for each wave bin
+  /*!
+   * Thermal sources are then interpolated from the table instead of
+   * integrating the emission function at each layer and column. Needs the
+   * planck flag and wave_lower/wave_upper.
+   */
+  ADD_ARG(bool, planck_table) = false;
+
+  //! temperature grid {tmin, tmax, dt} in K of the emission table
+  ADD_ARG(std::vector<double>, planck_tgrid) = {50., 1000., 1.};
+
+  //! number of eigensolutions cached per thread, 0 to disable the cache
+  /*!
+   * Layers with the same delta-M scaled single-scattering albedo and phase
+   * moments, in any column or wave bin, then share one eigendecomposition.
+   * Each entry takes about 3 * nstr * nstr doubles. Only used by c_disort.
+   */
+  ADD_ARG(int, eigen_cache) = 0;
+
+  //! keep the beam solution of each column from one call to the next
+  /*!
+   * A column whose optical properties, beam and albedo did not change since
+   * the last call then reuses its eigensolutions, beam source and factored
+   * matrix, and only solves for the thermal source of the new temperatures.
+   * Each column keeps about 3 * nlyr * nstr * nstr doubles. Needs solver
+   * "disort" and no pool; only used for fluxes of one sun, and their
+   * derivatives, with c_disort.
+   */
+  ADD_ARG(bool, beam_cache) = false;
+
+  //! only solve the columns whose inputs changed since the last call
+  /*!
+   * Each column keeps a fingerprint of its inputs and its last outputs;
+   * a column with bit-identical optical properties, boundary conditions
+   * and temperatures returns them without being solved. Needs no pool;
+   * only used by calls for one sun without the surface response or the
+   * flux derivatives, and columns are then solved one at a time.
+   */
+  ADD_ARG(bool, incremental) = false;
+
+  //! relative change of the inputs below which a column is not solved again
+  /*!
+   * A column whose dtauc, ssalb, phase moments, boundary conditions and
+   * temperatures each changed by at most this fraction of their magnitude
+   * since its last solve returns the outputs of that solve, see
+   * disort_relative_change. 0 solves every column. Needs no pool, and
+   * applies to the same calls as incremental.
+   */
+  ADD_ARG(double, reuse_tol) = 0.;
+
+  //! correct the fluxes of reused columns to first order
+  /*!
+   * Each solve then also computes the derivatives of the fluxes, as
+   * forward_jacobian does and at its cost, and a reused column adds them
+   * times the change of prop, albedo and temf to its up and down flux.
+   * Has the requirements of forward_jacobian.
+   */
+  ADD_ARG(bool, reuse_correct) = false;
+
   //! placeholder for disort state
   ADD_ARG(disort_state, ds);
 };
@@ -86,44 +201,56 @@ class DisortImpl : public torch::nn::Cloneable<DisortImpl> {
 
   //! disort state at one wave and one column
   /*!
+   * In pooled mode, all (n, j) refer to the first state of the pool.
+   *
    * \param n wave index
    * \param j column index
    * \return disort state
    */
   disort_state const& ds(int n = 0, int j = 0) const {
-    return ds_[n * options.ncol() + j];
+    return ds_[state_index_(n, j)];
   }
 
   //! disort state at one wave and one column
   /*!
+   * In pooled mode, all (n, j) refer to the first state of the pool.
+   *
    * \param n wave index
    * \param j column index
    * \return disort state
    */
-  disort_state& ds(int n = 0, int j = 0) { return ds_[n * options.ncol() + j]; }
+  disort_state& ds(int n = 0, int j = 0) { return ds_[state_index_(n, j)]; }
 
   //! disort output at one wave and one column
   /*!
+   * In pooled mode, all (n, j) refer to the first output of the pool.
+   *
    * \param n wave index
    * \param j column index
    * \return disort output
    */
   disort_output const& ds_out(int n = 0, int j = 0) const {
-    return ds_out_[n * options.ncol() + j];
+    return ds_out_[state_index_(n, j)];
   }
 
   //! disort output at one wave and one column
   /*!
+   * In pooled mode, all (n, j) refer to the first output of the pool.
+   *
    * \param n wave index
    * \param j column index
    * \return disort output
    */
   disort_output& ds_out(int n = 0, int j = 0) {
-    return ds_out_[n * options.ncol() + j];
+    return ds_out_[state_index_(n, j)];
   }
 
   //! disort flux outputs
   /*!
+   * The kernel writes these while it runs, so this returns the kept
+   * buffer (or the one given to set_gather_buffers) without copying.
+   * It is overwritten by the next forward call with output::GATHER.
+   *
    * Disort outputs the following 8 flux variables:
    * 0 : direct beam flux (rfldir)
    * 1 : diffuse downward flux (fldn)
@@ -134,26 +261,98 @@ class DisortImpl : public torch::nn::Cloneable<DisortImpl> {
    * 6 : mean diffuse upward intensity (uavgup)
    * 7 : mean direct beam (uavgso)
    *
-   * \param op tensor options
-   * \return disort flux outputs (nwave, ncol, nlvl = nlyr + 1, 8)
+   * \return disort flux outputs (nwave, ncol, ntau, 8),
+   *         where ntau = nlvl = nlyr + 1 unless usrtau is set, or
+   *         (nwave, ncol, nsun, ntau, 8) after a forward call with several
+   *         suns per column
    */
   torch::Tensor gather_flx() const;
 
   //! disort radiance outputs
   /*!
-   * \param op tensor options
-   * \return disort radiance outputs (nwave, ncol, nphi, ntau, numu)
+   * Like gather_flx, this returns the kept buffer without copying.
+   * It is overwritten by the next forward call with output::RAD.
+   *
+   * \return disort radiance outputs (nwave, ncol, nphi, ntau, numu), or
+   *         (nwave, ncol, nsun, nphi, ntau, numu) with several suns
    */
   torch::Tensor gather_rad() const;
 
+  //! let forward write gathered outputs into caller-owned tensors
+  /*!
+   * Both must be contiguous CPU tensors of the same dtype as `prop`.
+   * This also enables gather_flx and gather_rad with pooled states.
+   *
+   * \param flx flux outputs (nwave, ncol, ntau, 8)
+   * \param rad radiance outputs (nwave, ncol, nphi, ntau, numu)
+   */
+  void set_gather_buffers(torch::Tensor flx,
+                          torch::optional<torch::Tensor> rad = torch::nullopt);
+
+  //! disort return status of the last forward call
+  /*!
+   * 0 (DS_OK) for columns that were solved. Failed columns carry one of
+   * the DS_ERR_* codes of cdisort.h and their fluxes are set to NaN, so
+   * that only those need to be retried.
+   *
+   * \return status code (nwave, ncol) of type int32
+   */
+  torch::Tensor gather_status() const;
+
+  //! load balance of the threads in the last forward call
+  /*!
+   * - "nthreads"  : number of threads
+   * - "wall"      : wall time of the kernel in seconds
+   * - "busy_max"  : longest busy time of a thread in seconds
+   * - "busy_mean" : mean busy time of the threads in seconds
+   * - "imbalance" : busy_max / busy_mean, 1 when perfectly balanced
+   * - "idle"      : fraction of thread time not spent solving columns
+   * - "ncol_min"  : fewest columns solved by a thread
+   * - "ncol_max"  : most columns solved by a thread
+   * - "ncol_batched" : columns solved by the batched engine, see
+   *   DisortOptions::engine
+   */
+  std::map<std::string, double> schedule_stats() const;
+
+  //! use of the eigen cache in the last forward call
+  /*!
+   * Summed over all threads, see DisortOptions::eigen_cache.
+   * - "hits"     : layers whose eigensolution was taken from the cache
+   * - "misses"   : layers whose eigensolution was computed
+   * - "hit_rate" : hits / (hits + misses), 0 without lookups
+   */
+  std::map<std::string, double> eigen_cache_stats() const;
+
+  //! use of the beam cache in the last forward call
+  /*!
+   * Summed over all columns, see DisortOptions::beam_cache.
+   * - "hits"     : columns that reused their beam solution
+   * - "misses"   : columns that solved and stored it
+   * - "hit_rate" : hits / (hits + misses), 0 without lookups
+   */
+  std::map<std::string, double> beam_cache_stats() const;
+
+  //! columns solved by the last forward call
+  /*!
+   * See DisortOptions::incremental and DisortOptions::reuse_tol.
+   * - "ncol"            : number of (wave, column) pairs
+   * - "dirty"           : columns whose inputs changed and were solved
+   * - "dirty_fraction"  : dirty / ncol
+   * - "reused"          : columns that returned a solve within reuse_tol
+   * - "reused_fraction" : reused / ncol
+   */
+  std::map<std::string, double> incremental_stats() const;
+
   //! Calculate radiative flux or intensity
   /*!
    * \param prop optical properties at each level (nwave, ncol, nlyr, nprop)
    *
    * \param bc dictionary of disort boundary conditions
    *        The dimensions of each recognized key are:
-   *        - <band> + "umu0" : (ncol,), cosine of solar zenith angle
-   *        - <band> + "phi0" : (ncol,), azimuthal angle of solar beam
+   *        - <band> + "umu0" : (ncol,) or (ncol, nsun), cosine of solar
+   *          zenith angle
+   *        - <band> + "phi0" : (ncol,) or (ncol, nsun), azimuthal angle of
+   *          solar beam
    *        - <band> + "fbeam" : (nwave, ncol), solar beam flux
    *        - <band> + "albedo" : (nwave, ncol), surface albedo
    *        - <band> + "fluor" : (nwave, ncol), isotropic bottom illumination
@@ -162,6 +361,11 @@ class DisortImpl : public torch::nn::Cloneable<DisortImpl> {
    *        - "btemp" : (ncol,), bottom temperature
    *        - "ttemp" : (ncol,), top temperature
    *
+   *        With umu0 of shape (ncol, nsun), each column is solved for nsun
+   *        beam angles at once, sharing the homogeneous solution and the
+   *        factored boundary-condition matrix. phi0 of shape (ncol,) is then
+   *        used for every sun.
+   *
    *        Some keys can have a prefix band name, <band>.
    *        If the prefix is an non-empty string, a slash "/" is
    *        automatically appended to it, such that the key look like
@@ -169,27 +373,263 @@ class DisortImpl : public torch::nn::Cloneable<DisortImpl> {
    *
    * \param bname name of the radiation band
    * \param temf temperature at each level (ncol, nlvl = nlyr + 1)
-   * \return radiative flux or intensity (nwave, ncol, nlvl, nrad)
+   *
+   * \param outputs bitwise or of the output:: constants in index.h
+   *        The selected quantities are returned in this order:
+   *        - output::FLUX : upward and downward flux (IUP, IDN)
+   *        - output::DFDT : flux divergence
+   *        - output::UAVG : uavg, uavgdn, uavgup, uavgso
+   *
+   *        output::RAD writes the intensities at user angles to the
+   *        buffer of gather_rad(), and output::GATHER fills the buffer of
+   *        gather_flx(). Without output::RAD, intensities are not computed
+   *        at all.
+   *        The default keeps both buffers filled.
+   *
+   * \return selected outputs (nwave, ncol, nlvl, output::size(outputs)),
+   *         or (nwave, ncol, nsun, nlvl, output::size(outputs)) with several
+   *         suns per column
+   *
+   * If prop, the albedo in `bc` or temf requires a gradient, the fluxes are
+   * differentiable with respect to them through DisortFunction. This needs
+   * outputs output::FLUX (possibly with output::RAD and output::GATHER) and
+   * the same configuration as forward_jacobian; without output::RAD, the
+   * backward pass reuses the solution of the forward pass.
+   */
+  torch::Tensor forward(
+      torch::Tensor prop, std::map<std::string, torch::Tensor>* bc,
+      std::string bname = "",
+      torch::optional<torch::Tensor> temf = torch::nullopt,
+      int outputs = output::FLUX | output::RAD | output::GATHER);
+
+  //! Calculate radiative flux for many Lambertian surface albedos
+  /*!
+   * The atmosphere is solved once over a black surface, together with its
+   * spherical albedo and flux response to illumination from below (as
+   * c_albtrans does for ibcnd). The fluxes for each albedo then follow in
+   * closed form and agree with forward to roundoff.
+   *
+   * Needs the lamber flag, one sun per column and no spher. The albedo in
+   * `bc` is not used, and the gather buffers are left unchanged.
+   *
+   * \param prop, bc, bname, temf as in forward
+   * \param albedo surface albedos (nalb,), or (nalb, nwave, ncol)
+   * \return upward and downward flux (nalb, nwave, ncol, nlvl, 2)
+   */
+  torch::Tensor forward_albedo(
+      torch::Tensor prop, std::map<std::string, torch::Tensor>* bc,
+      torch::Tensor albedo, std::string bname = "",
+      torch::optional<torch::Tensor> temf = torch::nullopt);
+
+  //! Calculate radiative flux and its derivatives with respect to the inputs
+  /*!
+   * Each column is solved once by a linearized c_disort (see
+   * c_flux_jacobian), which also gives the analytic derivatives of the
+   * upward and downward flux at every level with respect to the optical
+   * properties of every layer, the surface albedo and the temperature at
+   * every level, at a few times the cost of the forward solve.
+   *
+   * Needs the lamber flag, one sun per column, no spher and no usrtau. The
+   * gather buffers are left unchanged. Derivatives with respect to
+   * phase function moments beyond nstr are zero, and those with respect to
+   * temf are zero without the planck flag.
+   *
+   * \param prop, bc, bname, temf as in forward
+   * \return a map of
+   *        - "flux": upward and downward flux (nwave, ncol, nlvl, 2)
+   *        - "prop": d(flux)/d(prop) (nwave, ncol, nlvl, 2, nlyr, nprop)
+   *        - "albedo": d(flux)/d(albedo) (nwave, ncol, nlvl, 2)
+   *        - "temf": d(flux)/d(temf) (nwave, ncol, nlvl, 2, nlvl)
    */
-  torch::Tensor forward(torch::Tensor prop,
-                        std::map<std::string, torch::Tensor>* bc,
-                        std::string bname = "",
-                        torch::optional<torch::Tensor> temf = torch::nullopt);
+  std::map<std::string, torch::Tensor> forward_jacobian(
+      torch::Tensor prop, std::map<std::string, torch::Tensor>* bc,
+      std::string bname = "",
+      torch::optional<torch::Tensor> temf = torch::nullopt);
+
+  //! Calculate the derivatives of a weighted sum of the fluxes
+  /*!
+   * The vector-Jacobian product of forward_jacobian, for the backward pass
+   * of DisortFunction. Each column is solved once by a linearized c_disort
+   * with a single adjoint solve for the weighted sum, instead of one per
+   * flux. Same requirements as forward_jacobian.
+   *
+   * \param grad weights of the upward and downward flux (nwave, ncol, nlvl,
+   *        2)
+   * \param prop, bc, bname, temf as in forward
+   * \return a map of
+   *        - "prop": derivatives with respect to prop (nwave, ncol, nlyr,
+   *          nprop)
+   *        - "albedo": derivatives with respect to the albedo (nwave, ncol)
+   *        - "temf": derivatives with respect to temf (nwave, ncol, nlvl)
+   */
+  std::map<std::string, torch::Tensor> vjp(
+      torch::Tensor grad, torch::Tensor prop,
+      std::map<std::string, torch::Tensor>* bc, std::string bname = "",
+      torch::optional<torch::Tensor> temf = torch::nullopt);
 
  protected:
   // This allows type erasure with default arguments
   FORWARD_HAS_DEFAULT_ARGS({2, torch::nn::AnyValue("")},
-                           {3, torch::nn::AnyValue(torch::nullopt)})
+                           {3, torch::nn::AnyValue(torch::nullopt)},
+                           {4, torch::nn::AnyValue(output::FLUX |
+                                                   output::RAD |
+                                                   output::GATHER)})
 
  private:
-  //! flat array of disort states (nwave * ncol)
+  friend class DisortPlan;
+  friend class DisortFunction;
+
+  //! validate the inputs of forward and fill in missing boundary conditions
+  /*!
+   * \return temperature at each level (ncol, nlvl), a dummy if not given
+   */
+  torch::Tensor check_inputs_(torch::Tensor prop,
+                              std::map<std::string, torch::Tensor>* bc,
+                              std::string bname,
+                              torch::optional<torch::Tensor> temf,
+                              int outputs);
+
+  //! check that the configuration supports the flux derivatives
+  /*!
+   * \param caller name of the calling method, for the error messages
+   */
+  void check_jacobian_(std::string const& caller,
+                       torch::Tensor const& prop) const;
+
+  //! build the iterator over all (wave, column) pairs
+  /*!
+   * \param flx output (nwave, ncol, ntau, nout), contiguous in (ntau, nout)
+   * \param bc boundary conditions completed by check_inputs_
+   * \param index flat column index (nwave, ncol, 1, 1)
+   */
+  at::TensorIterator make_iter_(torch::Tensor flx, torch::Tensor prop,
+                                std::map<std::string, torch::Tensor> const& bc,
+                                torch::Tensor tem, torch::Tensor index) const;
+
+  //! prepare gather buffers and workspaces, then run the kernel on `iter`
+  /*!
+   * \param nsun number of suns of each column, see forward
+   * \param surf response of each column to its surface, see forward_albedo
+   * \param jac derivatives of the fluxes of each column, see
+   *        forward_jacobian, or of their weighted sum with `seed`
+   * \param seed weights of the fluxes of each column, see vjp
+   * \param cache beam caches of the columns, see solve_
+   */
+  void run_kernel_(at::TensorIterator& iter, int outputs, int nsun = 1,
+                   void* surf = nullptr, void* jac = nullptr,
+                   void const* seed = nullptr,
+                   disort_beam_cache* cache = nullptr);
+
+  //! forward without gradients, after check_inputs_
+  /*!
+   * \param tem temperature returned by check_inputs_
+   * \param cache beam caches of the columns (nwave * ncol) used instead of
+   *        those of DisortOptions::beam_cache, or nullptr
+   */
+  torch::Tensor solve_(torch::Tensor prop,
+                       std::map<std::string, torch::Tensor> const& bc,
+                       torch::Tensor tem, int outputs,
+                       disort_beam_cache* cache = nullptr);
+
+  //! vjp after check_inputs_, see solve_
+  std::map<std::string, torch::Tensor> vjp_(
+      torch::Tensor grad, torch::Tensor prop,
+      std::map<std::string, torch::Tensor> const& bc, torch::Tensor tem,
+      disort_beam_cache* cache = nullptr);
+
+  //! number of suns of each column in the boundary conditions
+  static int nsun_(std::map<std::string, torch::Tensor> const& bc);
+
+  //! flat array of disort states (nwave * ncol, or nthreads if pooled)
   std::vector<disort_state> ds_;
 
-  //! flat array of disort outputs (nwave * ncol)
+  //! flat array of disort outputs (nwave * ncol, or nthreads if pooled)
   std::vector<disort_output> ds_out_;
 
-  //! tensor output options after running disort
-  torch::TensorOptions result_options_;
+  //! beam solution of each column, see DisortOptions::beam_cache
+  std::vector<disort_beam_cache> beam_;
+
+  //! fingerprint of the inputs each column was last solved for, 0 if it
+  //! was not (nwave * ncol), see DisortOptions::incremental
+  std::vector<uint64_t> fingerprint_;
+
+  //! whether each column was solved by the last call (nwave * ncol)
+  std::vector<int> dirty_;
+
+  //! inputs and flux derivatives of the last solve of each column, whether
+  //! a column holds one, and whether it was reused by the last call, see
+  //! DisortOptions::reuse_tol
+  torch::Tensor reuse_inp_;
+  torch::Tensor reuse_jac_;
+
+  //! inputs of the column each thread is on (nthreads, disort_ninputs)
+  torch::Tensor reuse_tmp_;
+  std::vector<int> reuse_valid_;
+  std::vector<int> reused_;
+
+  //! return code of the last disort call (nwave * ncol)
+  std::vector<int> status_;
+
+  //! busy time and number of columns of each thread in the last call
+  std::vector<double> busy_;
+  std::vector<int> ncol_done_;
+
+  //! columns of each thread solved by the batched engine in the last call
+  std::vector<int> ncol_batched_;
+
+  //! wall time of the kernel in the last call
+  double wall_ = 0.;
+
+  //! scratch workspaces reused across disort calls (one per thread)
+  std::vector<disort_workspace> ws_;
+
+  //! outputs of the suns of each thread, reused across disort calls with
+  //! several suns; the first one of a thread is a copy of a state's output
+  std::vector<std::vector<disort_output>> sun_out_;
+
+  //! quadrature and Legendre tables shared by all workspaces
+  disort_tables tables_ = {};
+
+  //! index into ds_ and ds_out_
+  int state_index_(int n, int j) const {
+    return options.pooled() ? 0 : n * options.ncol() + j;
+  }
+
+  //! allocate and initialize disort states and outputs up to `nstate`
+  void alloc_states_(int nstate);
+
+  //! release all disort states and outputs, including those of the suns
+  void free_states_();
+
+  //! make sure each of `nthreads` threads has outputs for `nsun` suns
+  void alloc_sun_outputs_(int nthreads, int nsun);
+
+  //! make sure there is one workspace for each of `nthreads` threads
+  void alloc_workspace_(int nthreads);
+
+  //! release all scratch workspaces
+  void free_workspace_();
+
+  //! gathered flux outputs (nwave, ncol, [nsun,] ntau, 8)
+  torch::Tensor flx_buf_;
+
+  //! gathered radiance outputs (nwave, ncol, [nsun,] nphi, ntau, numu)
+  torch::Tensor rad_buf_;
+
+  //! whether the gather buffers are owned by the caller
+  bool user_buffers_ = false;
+
+  //! shape of the gathered flux outputs, with a sun dimension if nsun > 1
+  std::vector<int64_t> flx_shape_(int nsun = 1) const;
+
+  //! shape of the gathered radiance outputs, with a sun dimension if nsun > 1
+  std::vector<int64_t> rad_shape_(int nsun = 1) const;
+
+  //! whether the states were allocated for the two-stream solver
+  bool twostr_ = false;
+
+  //! tabulated emission, if options.planck_table() and the planck flag
+  std::shared_ptr<PlanckTable> planck_table_;
 
   //! flag to indicate if disort memory has been allocated
   bool allocated_ = false;
@@ -1,3 +1,12 @@
+// C/C++
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
 // torch
 #include <ATen/Dispatch.h>
 #include <ATen/native/ReduceOpsUtils.h>
@@ -10,39 +19,367 @@
 
 namespace disort {
 
-void call_disort_cpu(at::TensorIterator &iter, int upward, disort_state *ds,
-                     disort_output *ds_out) {
+void call_disort_cpu(at::TensorIterator &iter, int upward, int twostr,
+                     disort_state *ds, disort_output *ds_out,
+                     disort_workspace *ws, int *status, DisortPool const *pool,
+                     DisortOutputs const &outputs,
+                     DisortEmission const &emission, DisortBatch const &batch,
+                     DisortSchedule const &schedule,
+                     DisortReuse const &reuse) {
   AT_DISPATCH_FLOATING_TYPES(iter.dtype(), "call_disort_cpu", [&] {
     auto nprop = at::native::ensure_nonempty_size(iter.input(0), -1);
-    int grain_size = iter.numel() / at::get_num_threads();
-
-    iter.for_each(
-        [&](char **data, const int64_t *strides, int64_t n) {
-          for (int i = 0; i < n; i++) {
-            auto out = reinterpret_cast<scalar_t *>(data[0] + i * strides[0]);
-            auto prop = reinterpret_cast<scalar_t *>(data[1] + i * strides[1]);
-            auto umu0 = reinterpret_cast<scalar_t *>(data[2] + i * strides[2]);
-            auto phi0 = reinterpret_cast<scalar_t *>(data[3] + i * strides[3]);
-            auto fbeam = reinterpret_cast<scalar_t *>(data[4] + i * strides[4]);
-            auto albedo =
-                reinterpret_cast<scalar_t *>(data[5] + i * strides[5]);
-            auto fluor = reinterpret_cast<scalar_t *>(data[6] + i * strides[6]);
-            auto fisot = reinterpret_cast<scalar_t *>(data[7] + i * strides[7]);
-            auto temis = reinterpret_cast<scalar_t *>(data[8] + i * strides[8]);
-            auto btemp = reinterpret_cast<scalar_t *>(data[9] + i * strides[9]);
-            auto ttemp =
-                reinterpret_cast<scalar_t *>(data[10] + i * strides[10]);
-            auto temf =
-                reinterpret_cast<scalar_t *>(data[11] + i * strides[11]);
-            auto idxf =
-                reinterpret_cast<scalar_t *>(data[12] + i * strides[12]);
-            int idx = static_cast<int>(*idxf);
-            disort_impl(out, prop, umu0, phi0, fbeam, albedo, fluor, fisot,
-                        temis, btemp, ttemp, temf, upward, ds[idx], ds_out[idx],
-                        nprop);
+    int nthreads = at::get_num_threads();
+    int grain_size = iter.numel() / nthreads;
+    auto flx8 = static_cast<scalar_t *>(outputs.flx);
+    auto rad = static_cast<scalar_t *>(outputs.rad);
+    auto surf = static_cast<scalar_t *>(outputs.surf);
+    auto jac = static_cast<scalar_t *>(outputs.jac);
+    auto seed = static_cast<scalar_t const *>(outputs.seed);
+    int nfx = seed != nullptr ? 1 : outputs.ntau * 2;
+    int njac = nfx * (ds[0].nlyr * nprop + ds[0].nlyr + 2);
+    auto reuse_inp = static_cast<scalar_t *>(reuse.inputs);
+    auto reuse_tmp = static_cast<scalar_t *>(reuse.scratch);
+    auto reuse_jac = static_cast<scalar_t *>(reuse.jac);
+    int ninp = disort_ninputs(ds[0].nlyr, nprop);
+
+    // pointers to the inputs and output of column i of a loop chunk
+    struct Column {
+      scalar_t *out, *prop, *umu0, *phi0, *fbeam, *albedo, *fluor, *fisot,
+          *temis, *btemp, *ttemp, *temf;
+      int idx;
+    };
+
+    auto column = [](char **data, const int64_t *strides, int i) {
+      Column c;
+      auto p = [&](int k) {
+        return reinterpret_cast<scalar_t *>(data[k] + i * strides[k]);
+      };
+      c.out = p(0);
+      c.prop = p(1);
+      c.umu0 = p(2);
+      c.phi0 = p(3);
+      c.fbeam = p(4);
+      c.albedo = p(5);
+      c.fluor = p(6);
+      c.fisot = p(7);
+      c.temis = p(8);
+      c.btemp = p(9);
+      c.ttemp = p(10);
+      c.temf = p(11);
+      c.idx = static_cast<int>(*p(12));
+      return c;
+    };
+
+    auto state = [&](int tid, int idx) -> disort_state & {
+      auto &ds_i = pool != nullptr ? ds[tid] : ds[idx];
+      if (pool != nullptr && ds_i.flag.planck) {
+        ds_i.wvnmlo = pool->wave_lower[idx / pool->ncol];
+        ds_i.wvnmhi = pool->wave_upper[idx / pool->ncol];
+      }
+      return ds_i;
+    };
+
+    auto emission_of = [&](int idx) {
+      auto emi = emission.func;
+      if (emi == nullptr) {
+        EmissionSource source = emission.source;
+        source.iwave = idx / emission.ncol;
+        set_emission_source(source);
+        emi = emission_thunk;
+      }
+      return emi;
+    };
+
+    int nsun = outputs.nsun;
+
+    // copy the outputs of the suns of a solved column to the gather buffers
+    auto gather = [&](Column const &c, disort_output const *outs) {
+      int idx = c.idx;
+      for (int s = 0; s < nsun; ++s) {
+        int k = idx * nsun + s;
+        if (flx8 != nullptr) {
+          disort_gather_flx(flx8 + k * outputs.ntau * 8, outputs.ntau, upward,
+                            outs[s].rad, status[idx]);
+        }
+
+        if (rad != nullptr) {
+          int nrad = outputs.nphi * outputs.ntau * outputs.numu;
+          disort_gather_rad(rad + k * nrad, nrad, outs[s], status[idx]);
+        }
+      }
+    };
+
+    auto solve = [&](Column const &c, int tid) {
+      int idx = c.idx;
+      auto &ds_i = state(tid, idx);
+      auto &ds_out_i = pool != nullptr ? ds_out[tid] : ds_out[idx];
+
+      if (outputs.dirty != nullptr) outputs.dirty[idx] = 1;
+
+      // an unchanged column still holds its outputs in ds_out_i
+      if (outputs.fingerprint != nullptr) {
+        auto key = disort_fingerprint(
+            outputs.mask, c.prop, c.umu0, c.phi0, c.fbeam, c.albedo, c.fluor,
+            c.fisot, c.temis, c.btemp, c.ttemp, c.temf, ds_i, nprop);
+        bool clean = key == outputs.fingerprint[idx];
+        outputs.fingerprint[idx] = key;
+        if (clean) {
+          outputs.dirty[idx] = 0;
+          disort_write_out(c.out, outputs.mask, outputs.ntau, upward,
+                           ds_out_i.rad, status[idx]);
+          gather(c, &ds_out_i);
+          return;
+        }
+      }
+
+      // so does a column close to its last solve
+      scalar_t *inp = nullptr;
+      if (reuse.tol > 0.) {
+        scalar_t *ref = reuse_inp + idx * ninp;
+        inp = reuse_tmp + tid * ninp;
+        disort_pack_inputs(inp, c.prop, c.umu0, c.phi0, c.fbeam, c.albedo,
+                           c.fluor, c.fisot, c.temis, c.btemp, c.ttemp, c.temf,
+                           ds_i, nprop);
+        reuse.reused[idx] =
+            reuse.valid[idx] &&
+            disort_relative_change(inp, ref, ds_i, nprop) <= reuse.tol;
+        if (reuse.reused[idx]) {
+          outputs.dirty[idx] = 0;
+          disort_write_out(c.out, outputs.mask, outputs.ntau, upward,
+                           ds_out_i.rad, status[idx]);
+          if (reuse_jac != nullptr) {
+            disort_correct_flux(c.out, outputs.mask, outputs.ntau,
+                                reuse_jac + idx * njac, inp, ref, ds_i, nprop);
           }
-        },
-        grain_size);
+          gather(c, &ds_out_i);
+
+          // its outputs are not those of its inputs
+          if (outputs.fingerprint != nullptr) outputs.fingerprint[idx] = 0;
+          return;
+        }
+      }
+
+      auto emi = emission_of(idx);
+
+      // the first sun uses the output of the column's state
+      disort_output *outs = &ds_out_i;
+      if (nsun > 1) {
+        auto &so = outputs.sun_out[tid];
+        so[0] = ds_out_i;
+        outs = so.data();
+      }
+
+      if (twostr) {
+        status[idx] = twostr_impl(c.out, outputs.mask, c.prop, c.umu0, c.phi0,
+                                  c.fbeam, c.albedo, c.fluor, c.fisot,
+                                  c.temis, c.btemp, c.ttemp, c.temf, upward,
+                                  ds_i, ds_out_i, nprop, emi);
+      } else {
+        status[idx] = disort_impl(
+            c.out, outputs.mask, c.prop, c.umu0, c.phi0, c.fbeam, c.albedo,
+            c.fluor, c.fisot, c.temis, c.btemp, c.ttemp, c.temf, upward, ds_i,
+            outs, ws[tid], nprop, outputs.umu, emi, nsun,
+            surf != nullptr ? surf + idx * (4 + 2 * outputs.ntau) : nullptr,
+            jac != nullptr         ? jac + idx * njac
+            : reuse_jac != nullptr ? reuse_jac + idx * njac
+                                   : nullptr,
+            seed != nullptr ? seed + idx * outputs.ntau * 2 : nullptr,
+            outputs.cache != nullptr ? outputs.cache + idx : nullptr);
+      }
+
+      // the emission function threw inside the solver and yielded NaN
+      if (emission.func == nullptr && emission_failed()) {
+        status[idx] = DS_ERR_FATAL;
+        int nrow = outputs.ntau * std::max(output::size(outputs.mask), 1);
+        for (int s = 0; s < nsun; ++s) {
+          disort_write_out(c.out + s * nrow, outputs.mask, outputs.ntau,
+                           upward, outs[s].rad, status[idx]);
+        }
+        if (outputs.fingerprint != nullptr) outputs.fingerprint[idx] = 0;
+      }
+
+      if (reuse.tol > 0.) {
+        std::copy(inp, inp + ninp, reuse_inp + idx * ninp);
+        reuse.valid[idx] = status[idx] == DS_OK;
+      }
+
+      gather(c, outs);
+    };
+
+    auto timed = [&](auto &&body) {
+      return [&, body](char **data, const int64_t *strides, int64_t n) {
+        int tid = at::get_thread_num();
+        auto start = std::chrono::steady_clock::now();
+
+        body(data, strides, n, tid);
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        schedule.busy[tid] += elapsed.count();
+        schedule.ncol[tid] += n;
+      };
+    };
+
+    // hand out columns in blocks of `block`, which a loop solves together
+    auto run = [&](auto &&loop, int block) {
+      if (schedule.mode == DisortSchedule::STATIC) {
+        iter.for_each(loop, std::max(grain_size, block));
+        return;
+      }
+
+      // blocks in the order they are handed out
+      int64_t numel = iter.numel();
+      int64_t ntask = (numel + block - 1) / block;
+      std::vector<int64_t> order(ntask);
+      std::iota(order.begin(), order.end(), 0);
+
+      if (schedule.mode == DisortSchedule::COST) {
+        std::vector<double> cost(ntask, 0.);
+        int64_t k = 0;
+        iter.serial_for_each(
+            [&](char **data, const int64_t *strides, int64_t n) {
+              for (int i = 0; i < n; i++, k++) {
+                auto prop =
+                    reinterpret_cast<scalar_t *>(data[1] + i * strides[1]);
+                auto fbeam =
+                    reinterpret_cast<scalar_t *>(data[4] + i * strides[4]);
+                cost[k / block] += disort_cost(prop, fbeam, ds[0], nprop);
+              }
+            },
+            {0, numel});
+
+        std::stable_sort(
+            order.begin(), order.end(),
+            [&](int64_t a, int64_t b) { return cost[a] > cost[b]; });
+      }
+
+      std::atomic<int64_t> next{0};
+      at::parallel_for(0, nthreads, 1, [&](int64_t, int64_t) {
+        for (int64_t k = next++; k < ntask; k = next++) {
+          int64_t begin = order[k] * block;
+          iter.serial_for_each(loop, {begin, std::min(begin + block, numel)});
+        }
+      });
+    };
+
+    // W columns in lockstep, padded with copies of the last one; NSTR > 0
+    // selects the solver specialized for that number of streams
+    auto run_batched = [&](auto lanes, auto nstr) {
+      constexpr int W = decltype(lanes)::value;
+      constexpr int NSTR = decltype(nstr)::value;
+      std::vector<std::unique_ptr<BatchedDisort<W, NSTR>>> engines(nthreads);
+      std::vector<std::vector<disort_radiant>> rads(nthreads);
+
+      run(timed([&](char **data, const int64_t *strides, int64_t n, int tid) {
+            auto &bd = engines[tid];
+            auto &rd = rads[tid];
+            if (bd == nullptr) {
+              bd = std::make_unique<BatchedDisort<W, NSTR>>(
+                  ds[0].nlyr, ds[0].nstr, outputs.ntau);
+              bd->planck = ds[0].flag.planck;
+              bd->usrtau = ds[0].flag.usrtau;
+              if (bd->usrtau) {
+                for (int k = 0; k < outputs.ntau; ++k) {
+                  for (int l = 0; l < W; ++l) {
+                    bd->utau[k * W + l] = ds[0].utau[k];
+                  }
+                }
+              }
+              rd.resize(W * outputs.ntau);
+            }
+
+            disort_radiant *rp[W];
+            for (int l = 0; l < W; ++l) rp[l] = rd.data() + l * outputs.ntau;
+
+            for (int64_t i = 0; i < n; i += W) {
+              int m = std::min<int64_t>(W, n - i);
+              Column cols[W];
+              bool ok[W];
+              int st[W];
+
+              for (int l = 0; l < W; ++l) {
+                auto c = column(data, strides, i + std::min(l, m - 1));
+                auto &ds_i = state(tid, c.idx);
+                cols[l] = c;
+                ok[l] = batched_set_lane(
+                    *bd, l, c.prop, c.umu0, c.fbeam, c.albedo, c.fluor,
+                    c.fisot, c.temis, c.btemp, c.ttemp, c.temf, upward, ds_i,
+                    nprop, emission_of(c.idx));
+
+                // solve() reports a throwing emission function
+                if (emission.func == nullptr && emission_failed()) {
+                  ok[l] = false;
+                }
+              }
+
+              bd->solve(rp, st);
+
+              for (int l = 0; l < m; ++l) {
+                auto const &c = cols[l];
+                if (!ok[l] || st[l] != DS_OK) {
+                  solve(c, tid);
+                  continue;
+                }
+
+                status[c.idx] = DS_OK;
+                schedule.batched[tid] += 1;
+                disort_write_out(c.out, outputs.mask, outputs.ntau, upward,
+                                 rp[l], DS_OK);
+                if (flx8 != nullptr) {
+                  disort_gather_flx(flx8 + c.idx * outputs.ntau * 8,
+                                    outputs.ntau, upward, rp[l], DS_OK);
+                }
+              }
+            }
+          }),
+          W);
+    };
+
+    // fixed-size kernels for the common stream counts, generic otherwise
+    auto run_streams = [&](auto lanes) {
+      switch (ds[0].nstr) {
+        case 4:
+          run_batched(lanes, std::integral_constant<int, 4>());
+          return;
+        case 8:
+          run_batched(lanes, std::integral_constant<int, 8>());
+          return;
+        case 16:
+          run_batched(lanes, std::integral_constant<int, 16>());
+          return;
+        case 32:
+          run_batched(lanes, std::integral_constant<int, 32>());
+          return;
+        default:
+          run_batched(lanes, std::integral_constant<int, 0>());
+      }
+    };
+
+    // intensities, several suns, the surface response, the flux
+    // derivatives, the beam cache and the outputs kept for incremental
+    // calls and reuse need c_disort
+    int lanes = twostr || rad != nullptr || nsun > 1 || surf != nullptr ||
+                        jac != nullptr || outputs.cache != nullptr ||
+                        outputs.fingerprint != nullptr || reuse.tol > 0.
+                    ? 0
+                    : batch.lanes;
+
+    switch (lanes) {
+      case 4:
+        run_streams(std::integral_constant<int, 4>());
+        return;
+      case 8:
+        run_streams(std::integral_constant<int, 8>());
+        return;
+      case 16:
+        run_streams(std::integral_constant<int, 16>());
+        return;
+    }
+
+    run(timed([&](char **data, const int64_t *strides, int64_t n, int tid) {
+          for (int i = 0; i < n; i++) solve(column(data, strides, i), tid);
+        }),
+        1);
   });
 }
 
@@ -13,7 +13,14 @@
 namespace disort {
 
 void call_disort_cuda(at::TensorIterator& iter, int rank_in_column,
-                      disort_state *ds, disort_output *ds_out) {
+                      int twostr,
+                      disort_state *ds, disort_output *ds_out,
+                      disort_workspace *ws, int *status,
+                      DisortPool const *pool, DisortOutputs const &outputs,
+                      DisortEmission const &emission,
+                      DisortBatch const &batch,
+                      DisortSchedule const &schedule,
+                      DisortReuse const &reuse) {
   at::cuda::CUDAGuard device_guard(iter.device());
 
   AT_DISPATCH_FLOATING_TYPES(iter.dtype(), "call_disort_cuda", [&] {
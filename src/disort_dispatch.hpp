@@ -1,16 +1,184 @@
 #pragma once
 
+// C/C++
+#include <vector>
+
 // torch
 #include <ATen/TensorIterator.h>
 #include <ATen/native/DispatchStub.h>
 
 // disort
 #include <cdisort213/cdisort.h>
+#include <disort/index.h>
+
+#include "planck_table.hpp"
+
+namespace disort {
+
+//! shared, read-only configuration of a run with pooled disort states
+/*!
+ * With pooled states, `ds`, `ds_out` and `ws` of the kernel are indexed by
+ * thread instead of by (wave, column), and the wave-dependent fields of the
+ * state are filled in from here before each solve.
+ */
+struct DisortPool {
+  //! number of columns
+  int ncol = 1;
+
+  //! lower and upper wavenumber(length) at each bin (nwave,)
+  double const *wave_lower = nullptr;
+  double const *wave_upper = nullptr;
+};
+
+//! outputs that the kernel writes in their final layout and orientation
+/*!
+ * `flx` and `rad` point to contiguous tensors of the same dtype as the
+ * iterator, or are nullptr when not requested.
+ */
+struct DisortOutputs {
+  //! quantities written to the iterator output, see index.h
+  int mask = output::FLUX | output::RAD | output::GATHER;
+
+  //! user polar angles (numu,)
+  double const *umu = nullptr;
+
+  //! all eight radiant quantities (nwave, ncol, [nsun,] ntau, 8)
+  void *flx = nullptr;
+
+  //! intensities at user angles (nwave, ncol, [nsun,] nphi, ntau, numu)
+  void *rad = nullptr;
+
+  //! output dimensions of one column
+  int ntau = 0;
+  int nphi = 0;
+  int numu = 0;
+
+  //! beam angles of each column, solved together by c_disort_ws_suns
+  int nsun = 1;
+
+  //! outputs of the suns of each thread (nthreads, nsun), set if nsun > 1;
+  //! the first one is overwritten with the output of the column's state
+  std::vector<disort_output> *sun_out = nullptr;
+
+  //! response of each column to its surface (nwave, ncol, 4 + 2 * ntau),
+  //! see disort_write_surface; if set, columns are solved over a black
+  //! surface by c_disort_ws_surface
+  void *surf = nullptr;
+
+  //! derivatives of the fluxes of each column (nwave, ncol,
+  //! ntau * 2 * (nlyr * nprop + nlyr + 2)), see disort_write_jacobian; if
+  //! set, columns are solved by c_disort_ws_jacobian
+  void *jac = nullptr;
+
+  //! weights of the fluxes of each column (nwave, ncol, ntau, 2); if set
+  //! with `jac`, it holds the derivatives of their weighted sum instead,
+  //! (nwave, ncol, nlyr * nprop + nlyr + 2)
+  void const *seed = nullptr;
+
+  //! beam cache of each column (nwave * ncol); if set, columns solved for
+  //! fluxes of one sun by c_disort_ws_cached reuse their beam solution
+  disort_beam_cache *cache = nullptr;
+
+  //! fingerprint of the inputs each column was last solved for (nwave *
+  //! ncol), see disort_fingerprint; if set, a column whose fingerprint is
+  //! unchanged is not solved and its outputs are rewritten from its
+  //! disort_output
+  uint64_t *fingerprint = nullptr;
+
+  //! whether each column was solved (nwave * ncol), set with `fingerprint`
+  //! or DisortReuse
+  int *dirty = nullptr;
+};
+
+//! reuse of the last solve of each column while its inputs change little
+/*!
+ * A column whose inputs changed by at most `tol` since its last solve, see
+ * disort_relative_change, is not solved; its outputs are rewritten from
+ * its disort_output, with the fluxes corrected to first order if `jac` is
+ * set.
+ */
+struct DisortReuse {
+  //! largest relative change of the inputs of a reused column, 0 to solve
+  //! every column
+  double tol = 0.;
+
+  //! inputs of the last solve of each column (nwave * ncol,
+  //! disort_ninputs), and whether the column holds one (nwave * ncol)
+  void *inputs = nullptr;
+  int *valid = nullptr;
+
+  //! inputs of the column each thread is on (nthreads, disort_ninputs)
+  void *scratch = nullptr;
+
+  //! derivatives of the fluxes at the last solve of each column (nwave *
+  //! ncol, ntau * 2 * (nlyr * nprop + nlyr + 2)), or nullptr; columns are
+  //! then solved by c_disort_ws_jacobian
+  void *jac = nullptr;
+
+  //! whether each column was reused (nwave * ncol)
+  int *reused = nullptr;
+};
+
+//! emission function that the kernel hands to disort
+struct DisortEmission {
+  //! passed to disort as is, unless nullptr
+  emission_func_t func = c_planck_func2;
+
+  //! otherwise, the source behind emission_thunk; the kernel sets the
+  //! wave bin of each column
+  EmissionSource source;
+
+  //! number of columns, to find the wave bin of a column
+  int ncol = 1;
+};
+
+//! cross-column batching of the CPU kernel, see BatchedDisort
+/*!
+ * Columns that only need fluxes are solved `lanes` at a time. Columns that
+ * fail the input checks of the batched solver are solved again one by one
+ * with c_disort.
+ */
+struct DisortBatch {
+  //! columns solved together (4, 8 or 16), or 0 to solve one at a time
+  int lanes = 0;
+};
+
+//! column scheduling of the CPU kernel and the per-thread load it records
+struct DisortSchedule {
+  //! fixed blocks of columns per thread, as in TensorIterator::for_each
+  static constexpr int STATIC = 0;
+
+  //! threads take the next column from a shared counter when idle
+  static constexpr int DYNAMIC = 1;
+
+  //! like DYNAMIC, but the columns of highest estimated cost go first
+  static constexpr int COST = 2;
+
+  int mode = STATIC;
+
+  //! busy time in seconds of each thread (nthreads,)
+  double *busy = nullptr;
+
+  //! number of columns solved by each thread (nthreads,)
+  int *ncol = nullptr;
+
+  //! number of those solved in lockstep by the batched engine (nthreads,)
+  int *batched = nullptr;
+};
+
+}  // namespace disort
 
 namespace at::native {
 
-using disort_fn = void (*)(at::TensorIterator &iter, int upward,
-                           disort_state *ds, disort_output *ds_out);
+using disort_fn = void (*)(at::TensorIterator &iter, int upward, int twostr,
+                           disort_state *ds, disort_output *ds_out,
+                           disort_workspace *ws, int *status,
+                           disort::DisortPool const *pool,
+                           disort::DisortOutputs const &outputs,
+                           disort::DisortEmission const &emission,
+                           disort::DisortBatch const &batch,
+                           disort::DisortSchedule const &schedule,
+                           disort::DisortReuse const &reuse);
 
 DECLARE_DISPATCH(disort_fn, call_disort);
 
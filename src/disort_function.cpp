@@ -0,0 +1,86 @@
+// C/C++
+#include <vector>
+
+// disort
+#include "disort_function.hpp"
+
+namespace disort {
+
+namespace {
+
+//! what the backward pass needs besides the saved inputs
+struct DisortContext : torch::CustomClassHolder {
+  std::shared_ptr<DisortImpl> disort;
+  std::map<std::string, torch::Tensor> bc;
+
+  //! beam solution of each column (nwave * ncol) left by the forward pass
+  std::vector<disort_beam_cache> cache;
+
+  ~DisortContext() {
+    for (auto& c : cache) c_disort_beam_cache_free(&c);
+  }
+};
+
+torch::optional<torch::Tensor> optional_(torch::Tensor const& t) {
+  if (t.defined()) return t;
+  return torch::nullopt;
+}
+
+}  // namespace
+
+torch::Tensor DisortFunction::forward(
+    torch::autograd::AutogradContext* ctx, std::shared_ptr<DisortImpl> disort,
+    torch::Tensor prop, torch::Tensor albedo, torch::Tensor temf,
+    std::map<std::string, torch::Tensor> bc, int outputs) {
+  TORCH_CHECK(disort != nullptr, "DisortFunction: disort module is null");
+
+  bc["albedo"] = albedo;
+  auto tem = disort->check_inputs_(prop, &bc, "", optional_(temf), outputs);
+
+  auto saved = c10::make_intrusive<DisortContext>();
+  saved->cache.resize(prop.size(0) * prop.size(1));
+  for (auto& c : saved->cache) {
+    int err = c_disort_beam_cache_alloc(&c, &disort->ds());
+    TORCH_CHECK(err == 0, "DisortFunction: failed to allocate beam cache");
+  }
+
+  auto flx = disort->solve_(prop, bc, tem, outputs, saved->cache.data());
+
+  saved->disort = disort;
+  saved->bc = std::move(bc);
+  saved->bc.erase("albedo");
+
+  ctx->saved_data["context"] = c10::IValue::make_capsule(saved);
+  ctx->save_for_backward({prop, albedo, temf});
+  return flx;
+}
+
+torch::autograd::variable_list DisortFunction::backward(
+    torch::autograd::AutogradContext* ctx,
+    torch::autograd::variable_list grad_outputs) {
+  auto vars = ctx->get_saved_variables();
+  auto prop = vars[0];
+  auto albedo = vars[1];
+  auto temf = vars[2];
+
+  auto saved = c10::static_intrusive_pointer_cast<DisortContext>(
+      ctx->saved_data["context"].toCapsule());
+
+  // the columns solved for the same inputs by the forward pass reuse their
+  // eigensolutions and factored matrix
+  auto bc = saved->bc;
+  bc["albedo"] = albedo;
+  auto tem = saved->disort->check_inputs_(prop, &bc, "", optional_(temf),
+                                          output::FLUX);
+  auto grad = saved->disort->vjp_(grad_outputs[0], prop, bc, tem,
+                                  saved->cache.data());
+
+  // temf is shared by all waves
+  torch::Tensor grad_temf;
+  if (temf.defined()) grad_temf = grad["temf"].sum(0);
+
+  return {torch::Tensor(), grad["prop"],   grad["albedo"],
+          grad_temf,       torch::Tensor(), torch::Tensor()};
+}
+
+}  // namespace disort
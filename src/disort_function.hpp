@@ -0,0 +1,57 @@
+#pragma once
+
+// C/C++
+#include <map>
+#include <memory>
+#include <string>
+
+// torch
+#include <torch/csrc/autograd/custom_function.h>
+
+// disort
+#include "disort.hpp"
+
+namespace disort {
+
+//! DisortImpl::forward of the fluxes as a differentiable torch function
+/*!
+ * The forward pass runs DisortImpl::forward and keeps the beam solution of
+ * each column (see disort_beam_cache), about 3 * nlyr * nstr * nstr
+ * doubles per column, until the function is released. For the columns the
+ * forward pass solved for fluxes only, the backward pass takes the
+ * eigensolutions and the factored matrix from there and only runs the
+ * linearized c_disort, with a single adjoint solve for the fluxes weighted
+ * by the incoming gradient (see DisortImpl::vjp). It returns the gradients
+ * with respect to prop, the surface albedo and temf, which are not
+ * differentiable themselves.
+ *
+ * DisortImpl::forward goes through this function when one of these inputs
+ * requires a gradient.
+ */
+class DisortFunction : public torch::autograd::Function<DisortFunction> {
+ public:
+  //! Calculate the upward and downward flux
+  /*!
+   * \param disort module to run, kept alive until the backward pass
+   * \param prop optical properties (nwave, ncol, nlyr, nprop)
+   * \param albedo surface albedo (nwave, ncol)
+   * \param temf temperature at each level (ncol, nlvl), or undefined
+   * \param bc boundary conditions completed by DisortImpl::forward
+   * \param outputs output::FLUX, possibly with output::RAD and
+   *        output::GATHER
+   * \return upward and downward flux (nwave, ncol, nlvl, 2)
+   */
+  static torch::Tensor forward(torch::autograd::AutogradContext* ctx,
+                               std::shared_ptr<DisortImpl> disort,
+                               torch::Tensor prop, torch::Tensor albedo,
+                               torch::Tensor temf,
+                               std::map<std::string, torch::Tensor> bc,
+                               int outputs);
+
+  //! Gradients of prop, albedo and temf from that of the fluxes
+  static torch::autograd::variable_list backward(
+      torch::autograd::AutogradContext* ctx,
+      torch::autograd::variable_list grad_outputs);
+};
+
+}  // namespace disort
@@ -1,10 +1,18 @@
 #pragma once
 
+// C/C++
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
 // disort
 #include <cdisort213/cdisort.h>
 #include <disort/index.h>
 
-#define FLX(i, m) flx[(i) * 2 + (m)]
+#include "batched_disort.h"
+
 #define PROP(i, m) prop[(i) * nprop + (m)]
 #define FBEAM (*fbeam)
 #define UMU0 (*umu0)
@@ -19,12 +27,115 @@
 
 namespace disort {
 
+//! write the quantities selected by `mask` of one column
+/*!
+ * \param out output (ntau, output::size(mask)), levels ordered as in the
+ *        input when upward
+ */
+template <typename T>
+void disort_write_out(T *out, int mask, int ntau, int upward,
+                      disort_radiant const *rad, int status) {
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  int nout = output::size(mask);
+
+  for (int i = 0; i < ntau; ++i) {
+    T *row = out + (upward ? ntau - 1 - i : i) * nout;
+    T *dst = row;
+    auto const &r = rad[i];
+
+    if (mask & output::FLUX) {
+      dst[index::IUP] = r.flup;
+      dst[index::IDN] = r.rfldir + r.rfldn;
+      dst += 2;
+    }
+
+    if (mask & output::DFDT) {
+      *dst++ = r.dfdt;
+    }
+
+    if (mask & output::UAVG) {
+      *dst++ = r.uavg;
+      *dst++ = r.uavgdn;
+      *dst++ = r.uavgup;
+      *dst++ = r.uavgso;
+    }
+
+    if (status != DS_OK) {
+      for (int k = 0; k < nout; ++k) row[k] = nan;
+    }
+  }
+}
+
+//! write the response of one column to its surface
+/*!
+ * \param surf output (4 + 2 * ntau): fdn, femit, ffluor and sphalb of
+ *        disort_surface, followed by (ntau, 2) up and down flux per unit flux
+ *        leaving the surface, levels ordered as in the input when upward
+ */
+template <typename T>
+void disort_write_surface(T *surf, int ntau, int upward,
+                          disort_surface const &sf, int status) {
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  bool ok = status == DS_OK;
+
+  surf[0] = ok ? sf.fdn : nan;
+  surf[1] = ok ? sf.femit : nan;
+  surf[2] = ok ? sf.ffluor : nan;
+  surf[3] = ok ? sf.sphalb : nan;
+
+  for (int i = 0; i < ntau; ++i) {
+    T *row = surf + 4 + (upward ? ntau - 1 - i : i) * 2;
+    row[index::IUP] = ok ? sf.up[i] : nan;
+    row[index::IDN] = ok ? sf.dn[i] : nan;
+  }
+}
+
+//! write the flux derivatives of one column
+/*!
+ * \param jac output: (ntau, 2, nlyr, nprop) derivatives of the up and down
+ *        flux with respect to prop, followed by (ntau, 2) with respect to
+ *        the albedo and (ntau, 2, nlyr + 1) with respect to temf, levels and
+ *        layers ordered as in the input when upward. Moments of prop beyond
+ *        nstr do not change the fluxes. With jc.seed, the derivatives of the
+ *        weighted sum of the fluxes, without the leading (ntau, 2).
+ */
+template <typename T>
+void disort_write_jacobian(T *jac, int nlyr, int nstr, int ntau, int nprop,
+                           int upward, disort_jacobian const &jc,
+                           int status) {
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  bool ok = status == DS_OK;
+  int nfx = jc.seed != nullptr ? 1 : ntau * 2;
+  T *alb = jac + nfx * nlyr * nprop;
+  T *tem = alb + nfx;
+
+  for (int n = 0; n < nfx; ++n) {
+    int i = n / 2, d = n % 2;
+    int k = jc.seed != nullptr ? 0 : (upward ? ntau - 1 - i : i) * 2 + d;
+    double const *src = jc.prop + n * nlyr * (nstr + 2);
+    for (int lc = 0; lc < nlyr; ++lc) {
+      T *row = jac + (k * nlyr + (upward ? nlyr - 1 - lc : lc)) * nprop;
+      row[index::IEX] = ok ? src[0] : nan;
+      if (nprop > 1) row[index::ISS] = ok ? src[1] : nan;
+      for (int m = 0; m < nprop - 2; ++m) {
+        row[index::IPM + m] = !ok ? nan : m < nstr ? src[m + 2] : 0.;
+      }
+      src += nstr + 2;
+    }
+
+    alb[k] = ok ? jc.albedo[n] : nan;
+    for (int lev = 0; lev <= nlyr; ++lev) {
+      tem[k * (nlyr + 1) + (upward ? nlyr - lev : lev)] =
+          ok ? jc.temper[n * (nlyr + 1) + lev] : nan;
+    }
+  }
+}
+
+//! set the temperature and boundary conditions of one column
 template <typename T>
-void disort_impl(T *flx, T *prop, T *umu0, T *phi0, T *fbeam, T *albedo,
-                 T *fluor, T *fisot, T *temis, T *btemp, T *ttemp, T *temf,
-                 int upward, disort_state &ds, disort_output &ds_out,
-                 int nprop) {
-  // run disort
+void disort_set_bc(T *umu0, T *phi0, T *fbeam, T *albedo, T *fluor, T *fisot,
+                   T *temis, T *btemp, T *ttemp, T *temf, int upward,
+                   disort_state &ds) {
   if (ds.flag.planck) {
     if (upward) {
       for (int i = 0; i <= ds.nlyr; ++i) {
@@ -47,6 +158,54 @@ void disort_impl(T *flx, T *prop, T *umu0, T *phi0, T *fbeam, T *albedo,
   ds.bc.temis = TEMIS;
   ds.bc.btemp = BTEMP;
   ds.bc.ttemp = TTEMP;
+}
+
+//! solve one column, return the status code of c_disort_ws
+/*!
+ * Outputs of a failed column are set to NaN. Without output::RAD in
+ * `mask`, the column is solved for fluxes only and the user angles are
+ * restored from `umu` afterwards.
+ *
+ * With nsun > 1, the column is solved for the beam angles umu0[s] and
+ * phi0[s] by c_disort_ws_suns, sun s writing to ds_out[s] and to `out`
+ * after the rows of the suns before it.
+ *
+ * With `surf`, the column is solved over a black surface by
+ * c_disort_ws_surface, which also writes its response to the surface.
+ *
+ * With `jac`, the column is solved by c_disort_ws_jacobian, which also
+ * writes the derivatives of the fluxes, or with `seed` those of the sum of
+ * the fluxes weighted by `seed`; with `cache` as well, by
+ * c_disort_ws_jacobian_cached.
+ *
+ * Otherwise, with `cache`, a column of one sun is solved by
+ * c_disort_ws_cached, which reuses the beam solution in `cache` if only
+ * the temperatures changed since it was stored.
+ *
+ * \param out output (nsun, ntau, max(output::size(mask), 1))
+ * \param mask output selection, see index.h
+ * \param ds_out outputs of disort (nsun,)
+ * \param umu user polar angles (ds.numu,)
+ * \param emi emission function, called as emi(wvnmlo, wvnmhi, temperature)
+ * \param surf response to the surface (4 + 2 * ntau), see
+ *        disort_write_surface, or nullptr
+ * \param jac derivatives of the fluxes, see disort_write_jacobian, or
+ *        nullptr
+ * \param seed weights of the up and down flux (ntau, 2), levels ordered
+ *        as in the input when upward, or nullptr
+ * \param cache beam cache of the column, or nullptr
+ */
+template <typename T>
+int disort_impl(T *out, int mask, T *prop, T *umu0, T *phi0, T *fbeam,
+                T *albedo, T *fluor, T *fisot, T *temis, T *btemp, T *ttemp,
+                T *temf, int upward, disort_state &ds, disort_output *ds_out,
+                disort_workspace &ws, int nprop, double const *umu,
+                emission_func_t emi = c_planck_func2, int nsun = 1,
+                T *surf = nullptr, T *jac = nullptr,
+                T const *seed = nullptr,
+                disort_beam_cache *cache = nullptr) {
+  disort_set_bc(umu0, phi0, fbeam, albedo, fluor, fisot, temis, btemp, ttemp,
+                temf, upward, ds);
 
   if (upward) {
     for (int i = 0; i < ds.nlyr; ++i) {
@@ -95,25 +254,363 @@ void disort_impl(T *flx, T *prop, T *umu0, T *phi0, T *fbeam, T *albedo,
     }
   }
 
-  c_disort(&ds, &ds_out, c_planck_func2);
+  // onlyfl makes disort overwrite numu and umu, which must have room for
+  // nstr angles when they are user angles
+  bool fluxes_only = !ds.flag.onlyfl && !ds.flag.output_uum &&
+                     !(mask & output::RAD) &&
+                     (!ds.flag.usrang || ds.numu >= ds.nstr);
+  int numu = ds.numu;
 
-  if (upward) {
-    for (int i = 0; i < ds.ntau; ++i) {
-      FLX(ds.ntau - 1 - i, index::IUP) = ds_out.rad[i].flup;
-      FLX(ds.ntau - 1 - i, index::IDN) =
-          ds_out.rad[i].rfldir + ds_out.rad[i].rfldn;
+  if (fluxes_only) ds.flag.onlyfl = TRUE;
+
+  int err;
+  std::vector<double> resp;
+  disort_surface sf;
+  disort_jacobian jc;
+  if (jac != nullptr) {
+    int nlvl = ds.nlyr + 1;
+    int nfx = seed != nullptr ? 1 : ds.ntau * 2;
+    resp.resize(nfx * (ds.nlyr * (ds.nstr + 2) + 1 + nlvl) +
+                (seed != nullptr ? ds.ntau * 2 : 0));
+    jc.prop = resp.data();
+    jc.albedo = jc.prop + nfx * ds.nlyr * (ds.nstr + 2);
+    jc.temper = jc.albedo + nfx;
+    jc.seed = nullptr;
+    if (seed != nullptr) {
+      jc.seed = jc.temper + nfx * nlvl;
+      for (int i = 0; i < ds.ntau; ++i) {
+        int k = upward ? ds.ntau - 1 - i : i;
+        jc.seed[i * 2] = seed[k * 2 + index::IUP];
+        jc.seed[i * 2 + 1] = seed[k * 2 + index::IDN];
+      }
+    }
+    err = cache != nullptr
+              ? c_disort_ws_jacobian_cached(&ds, ds_out, &jc, &ws, cache, emi)
+              : c_disort_ws_jacobian(&ds, ds_out, &jc, &ws, emi);
+  } else if (surf != nullptr) {
+    resp.resize(2 * ds.ntau);
+    sf.up = resp.data();
+    sf.dn = resp.data() + ds.ntau;
+    err = c_disort_ws_surface(&ds, ds_out, &sf, &ws, emi);
+  } else if (nsun > 1) {
+    std::vector<double> mu0(umu0, umu0 + nsun), ph0(phi0, phi0 + nsun);
+    err = c_disort_ws_suns(&ds, ds_out, nsun, mu0.data(), ph0.data(), &ws,
+                           emi);
+  } else if (cache != nullptr) {
+    err = c_disort_ws_cached(&ds, ds_out, &ws, cache, emi);
+  } else {
+    err = c_disort_ws(&ds, ds_out, &ws, emi);
+  }
+
+  if (fluxes_only) {
+    ds.flag.onlyfl = FALSE;
+    if (ds.flag.usrang) {
+      ds.numu = numu;
+      for (int i = 0; i < numu; ++i) ds.umu[i] = umu[i];
+    }
+  }
+
+  int nrow = ds.ntau * std::max(output::size(mask), 1);
+  for (int s = 0; s < nsun; ++s) {
+    disort_write_out(out + s * nrow, mask, ds.ntau, upward, ds_out[s].rad,
+                     err);
+  }
+
+  if (surf != nullptr) {
+    disort_write_surface(surf, ds.ntau, upward, sf, err);
+  }
+
+  if (jac != nullptr) {
+    disort_write_jacobian(jac, ds.nlyr, ds.nstr, ds.ntau, nprop, upward, jc,
+                          err);
+  }
+
+  return err;
+}
+
+//! solve one column in the two-stream approximation
+/*!
+ * Same interface as disort_impl for a state made by c_twostr_state_alloc.
+ * Only the first phase function moment (asymmetry factor) is used.
+ */
+template <typename T>
+int twostr_impl(T *out, int mask, T *prop, T *umu0, T *phi0, T *fbeam,
+                T *albedo, T *fluor, T *fisot, T *temis, T *btemp, T *ttemp,
+                T *temf, int upward, disort_state &ds, disort_output &ds_out,
+                int nprop, emission_func_t emi = c_planck_func2) {
+  disort_set_bc(umu0, phi0, fbeam, albedo, fluor, fisot, temis, btemp, ttemp,
+                temf, upward, ds);
+
+  std::vector<double> gg(ds.nlyr);
+
+  for (int i = 0; i < ds.nlyr; ++i) {
+    int lc = upward ? ds.nlyr - 1 - i : i;
+    ds.dtauc[lc] = PROP(i, index::IEX);
+    ds.ssalb[lc] = nprop > 1 ? PROP(i, index::ISS) : 0.;
+    gg[lc] = nprop > 2 ? PROP(i, index::IPM) : 0.;
+  }
+
+  int err = c_twostr_status(&ds, &ds_out, /*deltam=*/TRUE, gg.data(),
+                            /*radius=*/0., emi);
+
+  disort_write_out(out, mask, ds.ntau, upward, ds_out.rad, err);
+
+  return err;
+}
+
+//! load one column into lane `l` of a batched solver
+/*!
+ * Same inputs as disort_impl. The state `ds` only provides the wave bin of
+ * the emission function. Returns false if the temperatures would fail the
+ * input checks of c_disort.
+ */
+template <int W, int NSTR, typename T>
+bool batched_set_lane(BatchedDisort<W, NSTR> &bd, int l, T *prop, T *umu0,
+                      T *fbeam, T *albedo, T *fluor, T *fisot, T *temis,
+                      T *btemp, T *ttemp, T *temf, int upward,
+                      disort_state const &ds, int nprop,
+                      emission_func_t emi = c_planck_func2) {
+  int nlyr = bd.nlyr(), nstr = bd.nstr();
+
+  for (int i = 0; i < nlyr; ++i) {
+    int lc = upward ? nlyr - 1 - i : i;
+    bd.dtauc[lc * W + l] = PROP(i, index::IEX);
+    bd.ssalb[lc * W + l] = nprop > 1 ? PROP(i, index::ISS) : 0.;
+    for (int m = 1; m <= nstr; ++m) {
+      bd.pmom[(lc * (nstr + 1) + m) * W + l] =
+          m < nprop - 1 ? PROP(i, index::IPM + m - 1) : 0.;
+    }
+  }
+
+  bd.umu0[l] = UMU0;
+  bd.fbeam[l] = FBEAM;
+  bd.albedo[l] = ALBEDO;
+  bd.fluor[l] = FLUOR;
+  bd.fisot[l] = FISOT;
+
+  if (!bd.planck) return true;
+
+  bool ok = ds.wvnmlo >= 0. && ds.wvnmhi >= ds.wvnmlo && BTEMP >= 0. &&
+            TTEMP >= 0. && TEMIS >= 0. && TEMIS <= 1.;
+  for (int i = 0; i <= nlyr; ++i) ok = ok && TEMF(i) >= 0.;
+  if (!ok) return false;
+
+  for (int i = 0; i <= nlyr; ++i) {
+    int lev = upward ? nlyr - i : i;
+    bd.pkag[lev * W + l] = emi(ds.wvnmlo, ds.wvnmhi, TEMF(i));
+  }
+  bd.tplanck[l] = emi(ds.wvnmlo, ds.wvnmhi, TTEMP) * TEMIS;
+  bd.bplanck[l] = emi(ds.wvnmlo, ds.wvnmhi, BTEMP);
+
+  return true;
+}
+
+//! estimated relative cost of solving one column
+/*!
+ * Every column solves an eigenvalue problem per layer. Scattering layers
+ * and the beam source add particular solutions, and with a beam the
+ * azimuthal series runs over up to nstr harmonics unless only fluxes are
+ * wanted. Columns without scattering over a Lambertian surface skip all
+ * of that for the closed-form solution of c_absorption_only().
+ *
+ * \param ds state that holds the flags and dimensions of the run
+ */
+template <typename T>
+double disort_cost(T const *prop, T const *fbeam, disort_state const &ds,
+                   int nprop) {
+  double cost = ds.nlyr;
+
+  if (nprop > 1) {
+    for (int i = 0; i < ds.nlyr; ++i) {
+      if (PROP(i, index::ISS) > 0.) cost += 1.;
     }
+  }
+
+  if (cost == ds.nlyr && ds.flag.lamber && !ds.flag.spher) {
+    return 0.1 * ds.nlyr;
+  }
+
+  if (FBEAM > 0.) {
+    cost += ds.nlyr;
+    if (!ds.flag.onlyfl) cost *= ds.nstr;
+  }
+
+  return cost;
+}
+
+//! fingerprint of the inputs of one column
+/*!
+ * FNV-1a hash of the bits of the optical properties, the boundary
+ * conditions, the level temperatures and the output selection `mask`.
+ * Columns with bit-identical inputs have the same fingerprint; 0 is never
+ * returned and marks a column that was not solved yet.
+ */
+template <typename T>
+uint64_t disort_fingerprint(int mask, T const *prop, T const *umu0,
+                            T const *phi0, T const *fbeam, T const *albedo,
+                            T const *fluor, T const *fisot, T const *temis,
+                            T const *btemp, T const *ttemp, T const *temf,
+                            disort_state const &ds, int nprop) {
+  uint64_t h = 14695981039346656037ULL;
+
+  auto add = [&](void const *data, size_t nbytes) {
+    auto p = static_cast<unsigned char const *>(data);
+    for (size_t i = 0; i < nbytes; ++i) h = (h ^ p[i]) * 1099511628211ULL;
+  };
+
+  add(&mask, sizeof(mask));
+  add(prop, ds.nlyr * nprop * sizeof(T));
+  for (T const *bc : {umu0, phi0, fbeam, albedo, fluor, fisot, temis, btemp,
+                      ttemp}) {
+    add(bc, sizeof(T));
+  }
+  if (ds.flag.planck) add(temf, (ds.nlyr + 1) * sizeof(T));
+
+  return h != 0 ? h : 1;
+}
+
+//! number of inputs of one column packed by disort_pack_inputs
+inline int disort_ninputs(int nlyr, int nprop) {
+  return nlyr * nprop + 9 + nlyr + 1;
+}
+
+//! pack the inputs of one column
+/*!
+ * \param inp output (disort_ninputs(nlyr, nprop)): prop, then umu0, phi0,
+ *        fbeam, albedo, fluor, fisot, temis, btemp and ttemp, then temf,
+ *        which is zero without the planck flag (temf is not read then)
+ */
+template <typename T>
+void disort_pack_inputs(T *inp, T const *prop, T const *umu0, T const *phi0,
+                        T const *fbeam, T const *albedo, T const *fluor,
+                        T const *fisot, T const *temis, T const *btemp,
+                        T const *ttemp, T const *temf, disort_state const &ds,
+                        int nprop) {
+  inp = std::copy(prop, prop + ds.nlyr * nprop, inp);
+  for (T const *bc : {umu0, phi0, fbeam, albedo, fluor, fisot, temis, btemp,
+                      ttemp}) {
+    *inp++ = *bc;
+  }
+  if (ds.flag.planck) {
+    std::copy(temf, temf + ds.nlyr + 1, inp);
   } else {
-    for (int i = 0; i < ds.ntau; ++i) {
-      FLX(i, index::IUP) = ds_out.rad[i].flup;
-      FLX(i, index::IDN) = ds_out.rad[i].rfldir + ds_out.rad[i].rfldn;
+    std::fill(inp, inp + ds.nlyr + 1, T(0));
+  }
+}
+
+//! largest relative change of the inputs of one column
+/*!
+ * The change of each of dtauc, ssalb, the phase moments, every boundary
+ * condition and, with the planck flag, the temperatures is the largest
+ * absolute change of its values relative to their largest magnitude in
+ * `ref`. A quantity that is zero in `ref` has changed infinitely unless it
+ * is still zero.
+ *
+ * \param inp inputs of the column, see disort_pack_inputs
+ * \param ref inputs it is compared to, likewise
+ */
+template <typename T>
+double disort_relative_change(T const *inp, T const *ref,
+                              disort_state const &ds, int nprop) {
+  double change = 0.;
+
+  // n values of stride `stride` from `first`
+  auto group = [&](int first, int n, int stride) {
+    double dmax = 0., rmax = 0.;
+    for (int i = 0; i < n; ++i) {
+      int k = first + i * stride;
+      dmax = std::max(dmax, std::abs(double(inp[k]) - double(ref[k])));
+      rmax = std::max(rmax, std::abs(double(ref[k])));
+    }
+    if (dmax > 0.) {
+      change = std::max(change, rmax > 0.
+                                    ? dmax / rmax
+                                    : std::numeric_limits<double>::infinity());
+    }
+  };
+
+  group(index::IEX, ds.nlyr, nprop);
+  if (nprop > 1) group(index::ISS, ds.nlyr, nprop);
+  for (int m = index::IPM; m < nprop; ++m) group(m, ds.nlyr, nprop);
+
+  int bc = ds.nlyr * nprop;
+  for (int i = 0; i < 9; ++i) group(bc + i, 1, 1);
+  if (ds.flag.planck) group(bc + 9, ds.nlyr + 1, 1);
+
+  return change;
+}
+
+//! correct the fluxes of one column to first order in its inputs
+/*!
+ * Adds to the up and down flux in `out` their derivatives at `ref` times
+ * the change of prop, albedo and, with the planck flag, temf from `ref`
+ * to `inp`. The other quantities selected by `mask` and the other boundary
+ * conditions are not corrected.
+ *
+ * \param out output (ntau, output::size(mask)), see disort_write_out
+ * \param jac derivatives of the fluxes at `ref`, see disort_write_jacobian
+ * \param inp inputs of the column, see disort_pack_inputs
+ * \param ref inputs of `jac`, likewise
+ */
+template <typename T>
+void disort_correct_flux(T *out, int mask, int ntau, T const *jac,
+                         T const *inp, T const *ref, disort_state const &ds,
+                         int nprop) {
+  if (!(mask & output::FLUX)) return;
+
+  int nlyr = ds.nlyr;
+  int nout = output::size(mask);
+  int nfx = ntau * 2;
+  int nval = nlyr * nprop;
+  T const *alb = jac + nfx * nval;
+  T const *tem = alb + nfx;
+  T dalb = inp[nval + 3] - ref[nval + 3];
+
+  for (int k = 0; k < nfx; ++k) {
+    T df = alb[k] * dalb;
+    for (int j = 0; j < nval; ++j) {
+      df += jac[k * nval + j] * (inp[j] - ref[j]);
+    }
+    for (int lev = 0; ds.flag.planck && lev <= nlyr; ++lev) {
+      df += tem[k * (nlyr + 1) + lev] * (inp[nval + 9 + lev] -
+                                         ref[nval + 9 + lev]);
     }
+    out[(k / 2) * nout + k % 2] += df;
+  }
+}
+
+//! write all eight radiant quantities of one column
+/*!
+ * \param flx8 output (ntau, 8), levels ordered as in the input when upward
+ */
+template <typename T>
+void disort_gather_flx(T *flx8, int ntau, int upward,
+                       disort_radiant const *rad, int status) {
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  for (int i = 0; i < ntau; ++i) {
+    T *dst = flx8 + (upward ? ntau - 1 - i : i) * 8;
+    double const *src = &rad[i].rfldir;
+    for (int k = 0; k < 8; ++k) {
+      dst[k] = status == DS_OK ? src[k] : nan;
+    }
+  }
+}
+
+//! write intensities at user angles of one column
+/*!
+ * \param rad output (nphi, ntau, numu), nrad values in total
+ */
+template <typename T>
+void disort_gather_rad(T *rad, int nrad, disort_output const &ds_out,
+                       int status) {
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  for (int i = 0; i < nrad; ++i) {
+    rad[i] = status == DS_OK ? ds_out.uu[i] : nan;
   }
 }
 
 }  // namespace disort
 
-#undef FLX
 #undef PROP
 #undef FTOA
 #undef FBEAM
@@ -0,0 +1,157 @@
+// C/C++
+#include <algorithm>
+#include <iterator>
+
+// disort
+#include "disort_plan.hpp"
+
+namespace disort {
+
+DisortPlan::DisortPlan(std::shared_ptr<DisortImpl> disort, torch::Tensor prop,
+                       std::map<std::string, torch::Tensor> bc,
+                       std::string bname,
+                       torch::optional<torch::Tensor> temf, int outputs)
+    : disort_(disort), bname_(bname), outputs_(outputs) {
+  TORCH_CHECK(disort_ != nullptr, "DisortPlan: disort module is null");
+  TORCH_CHECK(prop.dim() == 4, "DisortPlan: prop.dim() != 4");
+
+  for (auto const& [key, value] : bc) bc_keys_.push_back(key);
+
+  int nwave = prop.size(0);
+  int ncol = prop.size(1);
+  int nout = output::size(outputs_);
+
+  flx_ = torch::zeros({nwave, ncol, disort_->ds().ntau, std::max(nout, 1)},
+                      prop.options());
+  index_ = torch::range(0, nwave * ncol - 1, 1)
+               .view({nwave, ncol, 1, 1})
+               .to(prop.options());
+
+  build_(prop, std::move(bc), temf);
+}
+
+void DisortPlan::build_(torch::Tensor prop,
+                        std::map<std::string, torch::Tensor> bc,
+                        torch::optional<torch::Tensor> temf) {
+  tem_ = disort_->check_inputs_(prop, &bc, bname_, temf, outputs_);
+  TORCH_CHECK(DisortImpl::nsun_(bc) == 1,
+              "DisortPlan: several suns per column are not supported");
+
+  prop_ = prop;
+  temf_ = temf.has_value() ? temf.value() : torch::Tensor();
+  bc_ = std::move(bc);
+
+  iter_ = disort_->make_iter_(flx_, prop_, bc_, tem_, index_);
+}
+
+bool DisortPlan::same_(torch::Tensor const& a, torch::Tensor const& b) {
+  return a.data_ptr() == b.data_ptr() && a.sizes() == b.sizes() &&
+         a.strides() == b.strides() && a.dtype() == b.dtype();
+}
+
+//! boundary conditions of the operands 2, 3, ... of DisortImpl::make_iter_
+static char const* const bc_operands[] = {
+    "umu0", "phi0", "fbeam", "albedo", "fluor",
+    "fisot", "temis", "btemp", "ttemp"};
+
+int DisortPlan::operand_(std::string key) const {
+  std::string prefix = bname_;
+  if (prefix.size() > 0 && prefix.back() != '/') prefix += "/";
+  if (prefix.size() > 0 && key.compare(0, prefix.size(), prefix) == 0) {
+    key = key.substr(prefix.size());
+  }
+
+  for (int i = 0; i < static_cast<int>(std::size(bc_operands)); ++i) {
+    if (key == bc_operands[i]) return 2 + i;
+  }
+  return -1;
+}
+
+bool DisortPlan::move_(int arg, torch::Tensor const& planned,
+                       torch::Tensor const& given) {
+  // the iterator must view the planned tensor itself, not a copy of it
+  if (arg < 0 || given.sizes() != planned.sizes() ||
+      given.strides() != planned.strides() ||
+      given.dtype() != planned.dtype() ||
+      iter_.data_ptr(arg) != planned.data_ptr()) {
+    return false;
+  }
+
+  moved_.emplace_back(arg, given.data_ptr());
+  return true;
+}
+
+torch::Tensor DisortPlan::run(torch::Tensor prop,
+                              std::map<std::string, torch::Tensor> const& bc,
+                              torch::optional<torch::Tensor> temf,
+                              torch::optional<torch::Tensor> out) {
+  // the module may have been reset since the plan was made
+  TORCH_CHECK(disort_->options.nwave() == flx_.size(0) &&
+                  disort_->options.ncol() == flx_.size(1) &&
+                  disort_->ds().ntau == flx_.size(2),
+              "DisortPlan::run: module dimensions changed, make a new plan");
+
+  TORCH_CHECK(prop.sizes() == prop_.sizes() && prop.dtype() == prop_.dtype(),
+              "DisortPlan::run: prop differs from the plan");
+
+  TORCH_CHECK(temf.has_value() == temf_.defined(),
+              "DisortPlan::run: temf differs from the plan");
+
+  TORCH_CHECK(bc.size() == bc_keys_.size(),
+              "DisortPlan::run: bc keys differ from the plan");
+
+  // inputs in new storage of the planned layout only move the iterator's
+  // data pointers; anything else rebuilds it
+  bool rebuild = false;
+  moved_.clear();
+
+  if (!same_(prop, prop_)) rebuild |= !move_(1, prop_, prop);
+
+  if (temf.has_value() && !same_(temf.value(), temf_)) {
+    rebuild |= !move_(11, temf_, temf.value());
+  }
+
+  for (auto const& key : bc_keys_) {
+    auto it = bc.find(key);
+    TORCH_CHECK(it != bc.end(), "DisortPlan::run: bc key '", key,
+                "' is missing");
+    if (!same_(it->second, bc_.at(key))) {
+      rebuild |= !move_(operand_(key), bc_.at(key), it->second);
+    }
+  }
+
+  int nout = output::size(outputs_);
+
+  if (out.has_value() && !same_(out.value(), flx_)) {
+    TORCH_CHECK(nout > 0, "DisortPlan::run: the plan has no output values");
+    TORCH_CHECK(out.value().sizes() == flx_.sizes() &&
+                    out.value().dtype() == flx_.dtype(),
+                "DisortPlan::run: out differs from the plan");
+    TORCH_CHECK(out.value().is_contiguous(),
+                "DisortPlan::run: out is not contiguous");
+    rebuild |= !move_(0, flx_, out.value());
+    flx_ = out.value();
+  }
+
+  if (rebuild) {
+    build_(prop, bc, temf);
+  } else if (!moved_.empty()) {
+    for (auto const& [arg, data] : moved_) {
+      iter_.unsafe_replace_operand(arg, data);
+    }
+
+    prop_ = prop;
+    if (temf.has_value()) temf_ = tem_ = temf.value();
+    for (auto const& key : bc_keys_) {
+      int arg = operand_(key);
+      bc_[key] = bc.at(key);
+      if (arg >= 2) bc_[bc_operands[arg - 2]] = bc.at(key);
+    }
+  }
+
+  disort_->run_kernel_(iter_, outputs_);
+
+  return flx_.narrow(-1, 0, nout);
+}
+
+}  // namespace disort
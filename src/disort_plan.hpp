@@ -0,0 +1,101 @@
+#pragma once
+
+// C/C++
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// torch
+#include <ATen/TensorIterator.h>
+
+// disort
+#include "disort.hpp"
+
+namespace disort {
+
+//! a validated forward call that can be replayed cheaply
+/*!
+ * A plan is built once from a representative set of inputs. It keeps the
+ * validated configuration, the completed boundary conditions, the column
+ * index and the tensor iterator of the `Disort` module it was made for.
+ *
+ * run() only checks that the inputs still have the planned shapes. An
+ * input in new storage with the planned strides and dtype only moves the
+ * data pointer of the iterator; otherwise the iterator is rebuilt and the
+ * inputs are checked again.
+ */
+class DisortPlan {
+ public:
+  //! Constructor to validate the inputs of forward once
+  /*!
+   * \param disort module to run, kept alive by the plan
+   * \param prop optical properties (nwave, ncol, nlyr, nprop)
+   * \param bc dictionary of disort boundary conditions, see forward
+   * \param bname name of the radiation band
+   * \param temf temperature at each level (ncol, nlvl = nlyr + 1)
+   * \param outputs bitwise or of the output:: constants in index.h
+   */
+  DisortPlan(std::shared_ptr<DisortImpl> disort, torch::Tensor prop,
+             std::map<std::string, torch::Tensor> bc, std::string bname = "",
+             torch::optional<torch::Tensor> temf = torch::nullopt,
+             int outputs = output::FLUX | output::RAD | output::GATHER);
+
+  //! Replay forward with new inputs of the planned shapes
+  /*!
+   * \param prop optical properties (nwave, ncol, nlyr, nprop)
+   * \param bc boundary conditions with the same keys as planned
+   * \param temf temperature at each level, given if and only if planned
+   * \param out contiguous output (nwave, ncol, nlvl, nout) to write into,
+   *        defaults to the output of the previous run
+   * \return selected outputs (nwave, ncol, nlvl, nout), a view of `out` or
+   *         of the output buffer of the plan, which the next run overwrites
+   */
+  torch::Tensor run(torch::Tensor prop,
+                    std::map<std::string, torch::Tensor> const& bc = {},
+                    torch::optional<torch::Tensor> temf = torch::nullopt,
+                    torch::optional<torch::Tensor> out = torch::nullopt);
+
+  //! module that the plan runs
+  std::shared_ptr<DisortImpl> module() const { return disort_; }
+
+  //! output selection of the plan
+  int outputs() const { return outputs_; }
+
+ private:
+  //! validate and complete the inputs, then rebuild the iterator
+  void build_(torch::Tensor prop, std::map<std::string, torch::Tensor> bc,
+              torch::optional<torch::Tensor> temf);
+
+  //! whether `a` and `b` view the same memory in the same layout
+  static bool same_(torch::Tensor const& a, torch::Tensor const& b);
+
+  //! operand of the iterator that views boundary condition `key`, or -1
+  int operand_(std::string key) const;
+
+  //! queue moving operand `arg` from `planned` to `given`; false if that
+  //! needs a new iterator
+  bool move_(int arg, torch::Tensor const& planned,
+             torch::Tensor const& given);
+
+  std::shared_ptr<DisortImpl> disort_;
+  std::string bname_;
+  int outputs_;
+
+  //! boundary condition keys given by the caller
+  std::vector<std::string> bc_keys_;
+
+  //! boundary conditions completed by DisortImpl::check_inputs_
+  std::map<std::string, torch::Tensor> bc_;
+
+  //! planned inputs and outputs, referenced by iter_
+  torch::Tensor prop_, temf_, tem_, flx_, index_;
+
+  at::TensorIterator iter_;
+
+  //! operands and data pointers queued by move_
+  std::vector<std::pair<int, void*>> moved_;
+};
+
+}  // namespace disort
@@ -11,4 +11,27 @@ constexpr int IUP = 0;
 constexpr int IDN = 1;
 }  // namespace index
 
+//! output selection of DisortImpl::forward, combined with bitwise or
+namespace output {
+//! upward and downward flux (2 values per level, IUP and IDN)
+constexpr int FLUX = 1;
+
+//! flux divergence, d (net flux) / d (optical depth) (1 value per level)
+constexpr int DFDT = 2;
+
+//! mean intensities uavg, uavgdn, uavgup and uavgso (4 values per level)
+constexpr int UAVG = 4;
+
+//! intensities at user angles, written to the radiance gather buffer
+constexpr int RAD = 8;
+
+//! all eight radiant quantities, written to the flux gather buffer
+constexpr int GATHER = 16;
+
+//! number of values per level that forward returns for `mask`
+constexpr int size(int mask) {
+  return (mask & FLUX ? 2 : 0) + (mask & DFDT ? 1 : 0) + (mask & UAVG ? 4 : 0);
+}
+}  // namespace output
+
 }  // namespace disort
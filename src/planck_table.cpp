@@ -0,0 +1,83 @@
+// C/C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// torch
+#include <ATen/Parallel.h>
+#include <c10/util/Exception.h>
+
+// disort
+#include "planck_table.hpp"
+
+namespace disort {
+
+PlanckTable::PlanckTable(
+    std::function<double(double, double, double)> emission,
+    std::vector<double> const& wave_lower,
+    std::vector<double> const& wave_upper, std::vector<double> const& tgrid)
+    : emission_(emission), wave_lower_(wave_lower), wave_upper_(wave_upper) {
+  TORCH_CHECK(wave_lower_.size() == wave_upper_.size(),
+              "PlanckTable: wave_lower.size() != wave_upper.size()");
+  TORCH_CHECK(tgrid.size() == 3, "PlanckTable: tgrid != {tmin, tmax, dt}");
+  TORCH_CHECK(tgrid[0] >= 0. && tgrid[1] > tgrid[0] && tgrid[2] > 0.,
+              "PlanckTable: invalid tgrid");
+
+  tmin_ = tgrid[0];
+  dt_ = tgrid[2];
+  ntemp_ = static_cast<int>(std::ceil((tgrid[1] - tmin_) / dt_)) + 1;
+  TORCH_CHECK(ntemp_ >= 4, "PlanckTable: fewer than 4 temperatures");
+
+  data_.resize(wave_lower_.size() * ntemp_);
+
+  at::parallel_for(0, data_.size(), ntemp_, [&](int64_t begin, int64_t end) {
+    for (int64_t k = begin; k < end; ++k) {
+      int n = k / ntemp_;
+      data_[k] = emission_(wave_lower_[n], wave_upper_[n],
+                           tmin_ + (k % ntemp_) * dt_);
+    }
+  });
+}
+
+double PlanckTable::operator()(int n, double temp) const {
+  double x = (temp - tmin_) / dt_;
+  if (!(x >= 0.) || x > ntemp_ - 1) {
+    return emission_(wave_lower_[n], wave_upper_[n], temp);
+  }
+
+  int i = std::min(static_cast<int>(x), ntemp_ - 2);
+  double s = x - i;
+
+  double const* row = data_.data() + n * ntemp_;
+  double p0 = row[std::max(i - 1, 0)];
+  double p1 = row[i];
+  double p2 = row[i + 1];
+  double p3 = row[std::min(i + 2, ntemp_ - 1)];
+
+  return p1 + 0.5 * s *
+                  (p2 - p0 +
+                   s * (2. * p0 - 5. * p1 + 4. * p2 - p3 +
+                        s * (3. * (p1 - p2) + p3 - p0)));
+}
+
+static thread_local EmissionSource emission_source;
+
+void set_emission_source(EmissionSource const& source) {
+  emission_source = source;
+}
+
+double emission_thunk(double wnumlo, double wnumhi, double temp) {
+  try {
+    if (emission_source.table != nullptr) {
+      return (*emission_source.table)(emission_source.iwave, temp);
+    }
+    return (*emission_source.func)(wnumlo, wnumhi, temp);
+  } catch (...) {
+    emission_source.failed = true;
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+bool emission_failed() { return emission_source.failed; }
+
+}  // namespace disort
@@ -0,0 +1,77 @@
+#pragma once
+
+// C/C++
+#include <functional>
+#include <vector>
+
+namespace disort {
+
+//! band-integrated emission tabulated in temperature for each wave bin
+/*!
+ * The emission function is evaluated once on a uniform temperature grid for
+ * every (wave_lower, wave_upper) bin and interpolated with cubic
+ * (Catmull-Rom) polynomials afterwards. Temperatures outside of the grid
+ * fall back to the emission function itself.
+ */
+class PlanckTable {
+ public:
+  //! Constructor to tabulate `emission` for each wave bin
+  /*!
+   * \param emission emission function (wnumlo, wnumhi, temperature)
+   * \param wave_lower lower wavenumber(length) at each bin
+   * \param wave_upper upper wavenumber(length) at each bin
+   * \param tgrid temperature grid {tmin, tmax, dt} in K
+   */
+  PlanckTable(std::function<double(double, double, double)> emission,
+              std::vector<double> const& wave_lower,
+              std::vector<double> const& wave_upper,
+              std::vector<double> const& tgrid);
+
+  //! band-integrated emission of wave bin `n` at temperature `temp`
+  double operator()(int n, double temp) const;
+
+  //! number of wave bins
+  int nwave() const { return wave_lower_.size(); }
+
+  //! number of tabulated temperatures
+  int ntemp() const { return ntemp_; }
+
+ private:
+  std::function<double(double, double, double)> emission_;
+  std::vector<double> wave_lower_, wave_upper_;
+
+  //! first temperature, spacing and size of the grid
+  double tmin_, dt_;
+  int ntemp_;
+
+  //! tabulated values (nwave, ntemp)
+  std::vector<double> data_;
+};
+
+//! emission source of the disort call running on this thread
+struct EmissionSource {
+  //! emission function of the run, unless tabulated
+  std::function<double(double, double, double)> const* func = nullptr;
+
+  //! tabulated emission and the wave bin being solved
+  PlanckTable const* table = nullptr;
+  int iwave = 0;
+
+  //! whether the emission function threw, see emission_thunk
+  bool failed = false;
+};
+
+//! set the emission source of this thread, see emission_thunk
+void set_emission_source(EmissionSource const& source);
+
+//! emission function for disort that forwards to the source of this thread
+/*!
+ * Runs inside the C solver, so no exception may leave it: a throwing
+ * emission function sets the `failed` flag of the source and yields NaN.
+ */
+double emission_thunk(double wnumlo, double wnumhi, double temp);
+
+//! whether the emission function threw since set_emission_source
+bool emission_failed();
+
+}  // namespace disort
@@ -90,6 +90,14 @@
 // Change header file for cmake
 #include <cdisort.h>
 
+/*
+ * Build with -DSYMMETRIC_EIGEN=TRUE to run all cases through the symmetric form
+ * of the reduced eigenvalue problem (see c_solve_eigen_symmetric())
+ */
+#ifndef SYMMETRIC_EIGEN
+#define SYMMETRIC_EIGEN FALSE
+#endif
+
 /*
  * Disort-specific shift macros.
  * Using unit-offset shift macros to match Fortran version
@@ -184,6 +192,8 @@ void disort_test01(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -362,6 +372,8 @@ void disort_test02(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -515,6 +527,8 @@ void disort_test03(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -639,6 +653,8 @@ void disort_test04(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -832,6 +848,8 @@ void disort_test05(void)
   ds.flag.spher   = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -957,6 +975,8 @@ void disort_test06(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -1375,6 +1395,8 @@ void disort_test07(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
 
   ds.nlyr        = 1;
 
@@ -1715,6 +1737,8 @@ void disort_test08(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -1863,6 +1887,8 @@ void disort_test09(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -2098,6 +2124,8 @@ void disort_test10(void)
   ds_good.flag.spher =ds_out.flag.spher  = FALSE;
   ds_good.flag.general_source          =ds_out.flag.general_source           = FALSE;
   ds_good.flag.output_uum              =ds_out.flag.output_uum           = FALSE;
+  ds_good.flag.symmetric_eigen         =ds_out.flag.symmetric_eigen      = SYMMETRIC_EIGEN;
+  ds_good.flag.skip_rcond              =ds_out.flag.skip_rcond           = FALSE;
   ds_good.flag.intensity_correction=ds_out.flag.intensity_correction = TRUE;
   ds_good.flag.old_intensity_correction=ds_out.flag.old_intensity_correction = TRUE;
 
@@ -2245,6 +2273,8 @@ void disort_test11(void)
   ds_good.flag.spher =ds_out.flag.spher  = FALSE;
   ds_good.flag.general_source          =ds_out.flag.general_source           = FALSE;
   ds_good.flag.output_uum              =ds_out.flag.output_uum           = FALSE;
+  ds_good.flag.symmetric_eigen         =ds_out.flag.symmetric_eigen      = SYMMETRIC_EIGEN;
+  ds_good.flag.skip_rcond              =ds_out.flag.skip_rcond           = FALSE;
   ds_good.flag.intensity_correction=ds_out.flag.intensity_correction = TRUE;
   ds_good.flag.old_intensity_correction=ds_out.flag.old_intensity_correction = TRUE;
 
@@ -2381,6 +2411,8 @@ void disort_test12(void)
   ds_good.flag.brdf_type = ds_out.flag.brdf_type = BRDF_NONE;
   ds_good.flag.general_source          =ds_out.flag.general_source           = FALSE;
   ds_good.flag.output_uum              =ds_out.flag.output_uum           = FALSE;
+  ds_good.flag.symmetric_eigen         =ds_out.flag.symmetric_eigen      = SYMMETRIC_EIGEN;
+  ds_good.flag.skip_rcond              =ds_out.flag.skip_rcond           = FALSE;
   ds_good.flag.intensity_correction=ds_out.flag.intensity_correction = TRUE;
   ds_good.flag.old_intensity_correction=ds_out.flag.old_intensity_correction = TRUE;
 
@@ -2508,6 +2540,8 @@ void disort_test13(void)
   ds.flag.spher  = FALSE;
   ds.flag.general_source           = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -2710,6 +2744,8 @@ void disort_test14(void)
   ds_ds.flag.spher  = FALSE;
   ds_ds.flag.general_source           = FALSE;
   ds_ds.flag.output_uum = FALSE;
+  ds_ds.flag.symmetric_eigen = SYMMETRIC_EIGEN;
+  ds_ds.flag.skip_rcond = FALSE;
   ds_ds.flag.intensity_correction = TRUE;
   ds_ds.flag.old_intensity_correction = TRUE;
 
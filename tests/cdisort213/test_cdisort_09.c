@@ -89,6 +89,8 @@ void run_disort_test09(int nstr, int nlyr, double ssalb) {
   ds.flag.spher = FALSE;
   ds.flag.general_source = FALSE;
   ds.flag.output_uum = FALSE;
+  ds.flag.symmetric_eigen = FALSE;
+  ds.flag.skip_rcond = FALSE;
   ds.flag.intensity_correction = TRUE;
   ds.flag.old_intensity_correction = TRUE;
 
@@ -0,0 +1,423 @@
+/******************************************************************************
+ * test_cdisort_linalg.c
+ *
+ * Test and benchmark of the dense linear algebra of the C DISORT core.
+ *
+ * Solves random general and band systems of several orders with the LINPACK
+ * routines c_sgeco()/c_sgesl() and c_sgbco()/c_sgbsl(), in both A*x = b and
+ * transpose(A)*x = b form, and checks the solutions. Solves random systems
+ * with the block structure of c_set_matrix() with c_block_factor() and
+ * c_block_solve() and compares them to a dense solve. Then times the
+ * general, block and eigenvalue solvers and c_disort() for each nstr. Build
+ * with -DDISORT_USE_LAPACK=ON to compare against the system BLAS/LAPACK.
+ *
+ * Usage:
+ *   test_cdisort_linalg [nrepeat]
+ *   Defaults: nrepeat = 1
+ *****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cdisort.h"
+
+#define NORDER 7
+#define TOL 1.e-10
+
+static const int order[NORDER] = {4, 8, 16, 32, 64, 128, 256};
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1.e-9 * t.tv_nsec;
+}
+
+static double urand(void) { return rand() / (double)RAND_MAX - 0.5; }
+
+/* Return the largest relative error of x against xtrue */
+static double max_error(int n, double const *x, double const *xtrue) {
+  int i;
+  double err = 0.;
+
+  for (i = 0; i < n; ++i) {
+    err = fmax(err, fabs(x[i] - xtrue[i]) / fabs(xtrue[i]));
+  }
+
+  return err;
+}
+
+/* Solve a random general system of order n, with and without transpose */
+static int check_general(int n) {
+  int i, j, job, nfail = 0;
+  int *ipvt = (int *)malloc(n * sizeof(int));
+  double rcond, err;
+  double *a = (double *)malloc(n * n * sizeof(double));
+  double *a0 = (double *)malloc(n * n * sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  double *x = (double *)malloc(n * sizeof(double));
+  double *z = (double *)malloc(5 * n * sizeof(double));
+
+  for (i = 0; i < n * n; ++i) a0[i] = urand();
+  for (i = 0; i < n; ++i) {
+    a0[i + i * n] += n;
+    x[i] = 1. + urand();
+  }
+
+  for (job = 0; job <= 1; ++job) {
+    for (i = 0; i < n; ++i) {
+      b[i] = 0.;
+      for (j = 0; j < n; ++j) {
+        b[i] += (job == 0 ? a0[i + j * n] : a0[j + i * n]) * x[j];
+      }
+    }
+    memcpy(a, a0, n * n * sizeof(double));
+    c_sgeco(a, n, n, ipvt, &rcond, z);
+    c_sgesl(a, n, n, ipvt, b, job);
+
+    err = max_error(n, b, x);
+    if (err > TOL || rcond <= 0.) {
+      printf("FAILED: general n = %d, job = %d, error = %g, rcond = %g\n", n,
+             job, err, rcond);
+      ++nfail;
+    }
+  }
+
+  free(ipvt);
+  free(a);
+  free(a0);
+  free(b);
+  free(x);
+  free(z);
+  return nfail;
+}
+
+/* Solve a random band system of order n with ml = mu = m */
+static int check_band(int n, int m) {
+  int i, j, job, lda = 3 * m + 1, nfail = 0;
+  int *ipvt = (int *)malloc(n * sizeof(int));
+  double rcond, err;
+  double *abd = (double *)calloc(lda * n, sizeof(double));
+  double *a0 = (double *)calloc(n * n, sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  double *x = (double *)malloc(n * sizeof(double));
+  double *z = (double *)malloc(5 * n * sizeof(double));
+
+  for (j = 0; j < n; ++j) {
+    for (i = (j > m ? j - m : 0); i < n && i <= j + m; ++i) {
+      a0[i + j * n] = urand() + (i == j ? 2. * m : 0.);
+    }
+    x[j] = 1. + urand();
+  }
+
+  for (job = 0; job <= 1; ++job) {
+    for (i = 0; i < n; ++i) {
+      b[i] = 0.;
+      for (j = 0; j < n; ++j) {
+        b[i] += (job == 0 ? a0[i + j * n] : a0[j + i * n]) * x[j];
+      }
+    }
+    /* ABD(i-j+2m+1,j) = A(i,j), see c_sgbco() */
+    memset(abd, 0, lda * n * sizeof(double));
+    for (j = 0; j < n; ++j) {
+      for (i = (j > m ? j - m : 0); i < n && i <= j + m; ++i) {
+        abd[i - j + 2 * m + j * lda] = a0[i + j * n];
+      }
+    }
+    c_sgbco(abd, lda, n, m, m, ipvt, &rcond, z);
+    c_sgbsl(abd, lda, n, m, m, ipvt, b, job);
+
+    err = max_error(n, b, x);
+    if (err > TOL || rcond <= 0.) {
+      printf("FAILED: band n = %d, m = %d, job = %d, error = %g\n", n, m, job,
+             err);
+      ++nfail;
+    }
+  }
+
+  free(ipvt);
+  free(abd);
+  free(a0);
+  free(b);
+  free(x);
+  free(z);
+  return nfail;
+}
+
+/* Random matrix with the blocks of c_set_matrix() for ds->nstr streams and
+ * ncut layers, and the same matrix stored densely in a unless it is NULL */
+static void fill_block(disort_state *ds, double *cblock, int ncut, double *a) {
+  int i, j, lc, ncblk, nrblk;
+  int nstr = ds->nstr, nn = nstr / 2, n = ncut * nstr;
+
+  /* rows (lc-1)*nstr+i of block lc couple layers lc and lc+1; the first nn
+   * rows of all but the first block are filled in by the elimination */
+  for (lc = 1; lc <= ncut; lc++) {
+    nrblk = (lc < ncut) ? 3 * nn : 2 * nn;
+    ncblk = (lc < ncut) ? 4 * nn : 2 * nn;
+    for (i = (lc == 1 ? 1 : nn + 1); i <= nrblk; i++) {
+      for (j = 1; j <= ncblk; j++) {
+        CBLOCK(i, j, lc) = urand() + (i == j ? 1. : 0.);
+        if (a != NULL) {
+          a[(lc - 1) * nstr + i - 1 + ((lc - 1) * nstr + j - 1) * n] =
+              CBLOCK(i, j, lc);
+        }
+      }
+    }
+  }
+}
+
+/* Solve a random system with the blocks of c_set_matrix() for nstr streams
+ * and ncut layers with c_block_factor()/c_block_solve(), and compare with
+ * c_sgeco()/c_sgesl() on the same matrix stored densely */
+static int check_block(int nstr, int ncut) {
+  int k, job, nfail = 0;
+  int nn = nstr / 2, n = ncut * nstr;
+  int *ipvt = (int *)malloc(n * sizeof(int));
+  int *ipvt0 = (int *)malloc(n * sizeof(int));
+  double rcond, rcond0, err;
+  double *cblock = (double *)calloc(12 * nn * nn * ncut, sizeof(double));
+  double *a = (double *)calloc(n * n, sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  double *y = (double *)malloc(n * sizeof(double));
+  double *z = (double *)malloc(5 * n * sizeof(double));
+  disort_state state, *ds = &state;
+
+  ds->nstr = nstr;
+  fill_block(ds, cblock, ncut, a);
+
+  c_sgeco(a, n, n, ipvt0, &rcond0, z);
+  c_block_factor(ds, cblock, ncut, nn, ipvt, &rcond, z);
+
+  for (job = 0; job <= 1; ++job) {
+    for (k = 0; k < n; ++k) b[k] = y[k] = 1. + urand();
+    c_sgesl(a, n, n, ipvt0, y, job);
+    c_block_solve(ds, cblock, ncut, nn, ipvt, b, job);
+
+    err = max_error(n, b, y);
+    if (err > TOL) {
+      printf("FAILED: block nstr = %d, ncut = %d, job = %d, error = %g\n",
+             nstr, ncut, job, err);
+      ++nfail;
+    }
+  }
+
+  /* both estimates of the same condition number */
+  if (!(rcond > 0.1 * rcond0 && rcond < 10. * rcond0)) {
+    printf("FAILED: block nstr = %d, ncut = %d, rcond = %g, dense %g\n",
+           nstr, ncut, rcond, rcond0);
+    ++nfail;
+  }
+
+  free(ipvt);
+  free(ipvt0);
+  free(cblock);
+  free(a);
+  free(b);
+  free(y);
+  free(z);
+  return nfail;
+}
+
+/* Microseconds per c_sgeco() and c_sgesl() of order n */
+static double time_general(int n, int nrepeat) {
+  int i, irep, nrep = nrepeat * (20 + 200000 / (n * n));
+  int *ipvt = (int *)malloc(n * sizeof(int));
+  double rcond, t, elapsed = 0.;
+  double *a = (double *)malloc(n * n * sizeof(double));
+  double *a0 = (double *)malloc(n * n * sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  double *z = (double *)malloc(5 * n * sizeof(double));
+
+  for (i = 0; i < n * n; ++i) a0[i] = urand();
+  for (i = 0; i < n; ++i) a0[i + i * n] += n;
+
+  for (irep = 0; irep < nrep; ++irep) {
+    memcpy(a, a0, n * n * sizeof(double));
+    for (i = 0; i < n; ++i) b[i] = 1.;
+    t = now();
+    c_sgeco(a, n, n, ipvt, &rcond, z);
+    c_sgesl(a, n, n, ipvt, b, 0);
+    elapsed += now() - t;
+  }
+
+  free(ipvt);
+  free(a);
+  free(a0);
+  free(b);
+  free(z);
+  return 1.e6 * elapsed / nrep;
+}
+
+/* Microseconds per c_block_factor() and c_block_solve() of 20 layers with
+ * nstr streams */
+static double time_block(int nstr, int nrepeat) {
+  int k, irep, ncut = 20, nn = nstr / 2, n = ncut * nstr;
+  int nrep = nrepeat * (10 + 20000 / (nstr * nstr));
+  int *ipvt = (int *)malloc(n * sizeof(int));
+  double t, elapsed = 0.;
+  double *cblock = (double *)calloc(12 * nn * nn * ncut, sizeof(double));
+  double *cblock0 = (double *)calloc(12 * nn * nn * ncut, sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  disort_state state, *ds = &state;
+
+  ds->nstr = nstr;
+  fill_block(ds, cblock0, ncut, NULL);
+
+  for (irep = 0; irep < nrep; ++irep) {
+    memcpy(cblock, cblock0, 12 * nn * nn * ncut * sizeof(double));
+    for (k = 0; k < n; ++k) b[k] = 1.;
+    t = now();
+    c_block_factor(ds, cblock, ncut, nn, ipvt, NULL, NULL);
+    c_block_solve(ds, cblock, ncut, nn, ipvt, b, 0);
+    elapsed += now() - t;
+  }
+
+  free(ipvt);
+  free(cblock);
+  free(cblock0);
+  free(b);
+  return 1.e6 * elapsed / nrep;
+}
+
+/* Microseconds per c_asymmetric_matrix() (sym = 0) or c_symmetric_matrix()
+ * (sym = 1) of order m; the asymmetric matrix is a product of two
+ * symmetric positive definite ones, as in c_solve_eigen(), so that its
+ * eigenvalues are real */
+static double time_eigen(int m, int sym, int nrepeat) {
+  int i, j, k, ier, irep, nrep = nrepeat * (10 + 20000 / (m * m));
+  double t, elapsed = 0.;
+  double *p = (double *)malloc(m * m * sizeof(double));
+  double *q = (double *)malloc(m * m * sizeof(double));
+  double *a0 = (double *)calloc(m * m, sizeof(double));
+  double *a = (double *)malloc(m * m * sizeof(double));
+  double *evec = (double *)malloc(m * m * sizeof(double));
+  double *eval = (double *)malloc(m * sizeof(double));
+  double *wk = (double *)malloc(10 * m * sizeof(double));
+
+  for (j = 0; j < m; ++j) {
+    for (i = j; i < m; ++i) {
+      p[i + j * m] = p[j + i * m] = urand() + (i == j ? m : 0.);
+      q[i + j * m] = q[j + i * m] = urand() + (i == j ? m : 0.);
+    }
+  }
+  for (j = 0; j < m; ++j) {
+    for (i = 0; i < m; ++i) {
+      for (k = 0; k < m; ++k) {
+        a0[i + j * m] += sym ? 0. : p[i + k * m] * q[k + j * m];
+      }
+      if (sym) a0[i + j * m] = p[i + j * m];
+    }
+  }
+
+  for (irep = 0; irep < nrep; ++irep) {
+    memcpy(a, a0, m * m * sizeof(double));
+    t = now();
+    if (sym) {
+      c_symmetric_matrix(a, eval, m, m, &ier, wk);
+    } else {
+      c_asymmetric_matrix(a, evec, eval, m, m, m, &ier, wk);
+    }
+    elapsed += now() - t;
+  }
+
+  free(p);
+  free(q);
+  free(a0);
+  free(a);
+  free(evec);
+  free(eval);
+  free(wk);
+  return 1.e6 * elapsed / nrep;
+}
+
+/* Milliseconds per c_disort() of a beam problem with nstr streams */
+static double time_disort(int nstr, int nrepeat) {
+  int lc, irep, nrep = nrepeat * (1 + 256 / nstr);
+  double t;
+  disort_state ds;
+  disort_output out;
+
+  memset(&ds, 0, sizeof(disort_state));
+  ds.flag.ibcnd = GENERAL_BC;
+  ds.flag.lamber = TRUE;
+  ds.flag.onlyfl = TRUE;
+  ds.flag.quiet = TRUE;
+  ds.nstr = nstr;
+  ds.nlyr = 20;
+  ds.nmom = nstr;
+  ds.nphase = nstr;
+  c_disort_state_alloc(&ds);
+  c_disort_out_alloc(&ds, &out);
+
+  ds.bc.umu0 = 0.6;
+  ds.bc.fbeam = M_PI;
+  ds.bc.albedo = 0.2;
+  for (lc = 0; lc < ds.nlyr; ++lc) {
+    ds.dtauc[lc] = 0.1 * (lc + 1);
+    ds.ssalb[lc] = 0.9;
+    c_getmom(HENYEY_GREENSTEIN, 0.7, ds.nmom,
+             &ds.pmom[lc * (ds.nmom_nstr + 1)]);
+  }
+
+  t = now();
+  for (irep = 0; irep < nrep; ++irep) {
+    c_disort(&ds, &out, NULL);
+  }
+  t = now() - t;
+
+  c_disort_out_free(&ds, &out);
+  c_disort_state_free(&ds);
+  return 1.e3 * t / nrep;
+}
+
+int main(int argc, char **argv) {
+  int i, nrepeat = 1, nfail = 0;
+
+  if (argc >= 2) {
+    nrepeat = atoi(argv[1]);
+  }
+
+  srand(13);
+  for (i = 0; i < NORDER; ++i) {
+    nfail += check_general(order[i]);
+  }
+  nfail += check_band(40, 1);
+  nfail += check_band(300, 1);
+  nfail += check_band(300, 70);
+  nfail += check_block(2, 1);
+  nfail += check_block(4, 5);
+  nfail += check_block(8, 40);
+  nfail += check_block(16, 12);
+  nfail += check_block(64, 3);
+
+#if defined(DISORT_USE_LAPACK)
+  printf("Linear algebra: system BLAS/LAPACK\n");
+#else
+  printf("Linear algebra: LINPACK in C\n");
+#endif
+  printf("%6s %16s %12s %12s %12s %14s\n", "order", "sgeco+sgesl[us]",
+         "block[us]", "asymtx[us]", "symtx[us]", "c_disort[ms]");
+  for (i = 0; i < NORDER; ++i) {
+    /* the block solver and c_disort() for nstr = order, whose eigen
+     * problems are of order nstr/2 */
+    int nstr = order[i];
+
+    printf("%6d %16.3f %12.3f %12.3f %12.3f %14.3f\n", nstr,
+           time_general(nstr, nrepeat),
+           nstr <= 128 ? time_block(nstr, nrepeat) : 0.,
+           time_eigen(nstr / 2, 0, nrepeat), time_eigen(nstr / 2, 1, nrepeat),
+           nstr <= 128 ? time_disort(nstr, nrepeat) : 0.);
+  }
+
+  if (nfail > 0) {
+    printf("FAILED: %d systems\n", nfail);
+    return 1;
+  }
+
+  printf("All linear systems solved.\n");
+  return 0;
+}
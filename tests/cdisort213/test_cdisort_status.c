@@ -0,0 +1,134 @@
+/******************************************************************************
+ * test_cdisort_status.c
+ *
+ * Checks that c_disort_ws() and c_self_test() report failures through their
+ * return code instead of terminating the process, and that a good column
+ * solved after a failed one gives the same answer as before.
+ *****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdisort.h"
+
+#define NSTR 4
+#define NLYR 3
+
+static void setup_column(disort_state *ds) {
+  int lc;
+
+  memset(ds, 0, sizeof(disort_state));
+
+  ds->accur = 0.;
+  ds->flag.ibcnd = GENERAL_BC;
+  ds->flag.usrtau = FALSE;
+  ds->flag.usrang = FALSE;
+  ds->flag.lamber = TRUE;
+  ds->flag.planck = TRUE;
+  ds->flag.onlyfl = TRUE;
+  ds->flag.quiet = TRUE;
+  ds->flag.intensity_correction = TRUE;
+  ds->flag.old_intensity_correction = TRUE;
+  ds->flag.brdf_type = BRDF_NONE;
+
+  ds->nstr = NSTR;
+  ds->nlyr = NLYR;
+  ds->nphase = ds->nstr;
+  ds->nmom = ds->nstr;
+  ds->nphi = 0;
+
+  c_disort_state_alloc(ds);
+
+  ds->wvnmlo = 500.;
+  ds->wvnmhi = 600.;
+  ds->bc.umu0 = 1.;
+  ds->bc.albedo = 0.2;
+  ds->bc.btemp = 300.;
+  ds->bc.temis = 1.;
+
+  for (lc = 0; lc < ds->nlyr; ++lc) {
+    ds->dtauc[lc] = 0.5;
+    ds->ssalb[lc] = 0.5;
+    c_getmom(RAYLEIGH, 0., ds->nmom, &ds->pmom[lc * (ds->nmom_nstr + 1)]);
+  }
+  for (lc = 0; lc <= ds->nlyr; ++lc) {
+    ds->temper[lc] = 250.;
+  }
+}
+
+/* An emission function that always raises a fatal error */
+static double failing_emission(double wnumlo, double wnumhi, double t) {
+  c_errmsg("failing_emission--fatal error on purpose", DS_ERROR);
+  return 0.;
+}
+
+static int check(char const *what, int got, int expected) {
+  if (got != expected) {
+    printf("FAILED: %s returned %d, expected %d\n", what, got, expected);
+    return 1;
+  }
+  printf("%s returned %d as expected\n", what, got);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int nfail = 0, err;
+  double flup;
+  disort_state ds;
+  disort_output out;
+  disort_workspace ws, small;
+
+  c_disort_workspace_alloc(&ws, NLYR, NSTR, NSTR, NLYR + 1, 1);
+  c_disort_workspace_alloc(&small, NLYR - 1, NSTR, NSTR, NLYR, 1);
+
+  /* good column */
+  setup_column(&ds);
+  c_disort_out_alloc(&ds, &out);
+  err = c_disort_ws(&ds, &out, &ws, c_planck_func2);
+  nfail += check("good column", err, DS_OK);
+  flup = out.rad[0].flup;
+
+  /* bad input: negative optical depth */
+  ds.dtauc[1] = -1.;
+  err = c_disort_ws(&ds, &out, &ws, c_planck_func2);
+  nfail += check("negative dtauc", err, DS_ERR_INPUT);
+  ds.dtauc[1] = 0.5;
+
+  /* workspace too small for ds */
+  err = c_disort_ws(&ds, &out, &small, c_planck_func2);
+  nfail += check("small workspace", err, DS_ERR_WORKSPACE);
+
+  /* fatal error raised inside the solver */
+  err = c_disort_ws(&ds, &out, &ws, failing_emission);
+  nfail += check("fatal error", err, DS_ERR_FATAL);
+
+  /* the same workspace is still usable afterwards */
+  err = c_disort_ws(&ds, &out, &ws, c_planck_func2);
+  nfail += check("good column again", err, DS_OK);
+  if (out.rad[0].flup != flup) {
+    printf("FAILED: flup changed from %g to %g\n", flup, out.rad[0].flup);
+    ++nfail;
+  }
+
+  /* the self-test reports a mismatch through its return code */
+  {
+    int prntu0[2] = {FALSE, FALSE};
+    disort_state ds_test;
+    disort_output out_test;
+
+    c_self_test(FALSE, prntu0, &ds_test, &out_test);
+    err = c_self_test(TRUE, prntu0, &ds_test, &out_test);
+    nfail += check("unsolved self-test", err, DS_ERR_FATAL);
+    err = c_self_test(2, prntu0, &ds_test, &out_test);
+    nfail += check("unknown self-test step", err, DS_ERR_INPUT);
+  }
+
+  c_disort_out_free(&ds, &out);
+  c_disort_state_free(&ds);
+  c_disort_workspace_free(&small);
+  c_disort_workspace_free(&ws);
+
+  return nfail > 0 ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/******************************************************************************
+ * test_cdisort_threads.c
+ *
+ * Thread stress test for the C DISORT core.
+ *
+ * Solves a set of columns (thermal and solar sources, Lambertian and RPV
+ * surfaces, computational and user angles) serially with c_disort(), then
+ * again from several threads at once with c_disort_ws(), one workspace per
+ * thread and one set of disort_tables shared by all of them. The concurrent
+ * results must be bit-identical to the serial ones. Build with
+ * -fsanitize=thread to check for data races.
+ *
+ * Usage:
+ *   test_cdisort_threads [nthread ncol nrepeat]
+ *   Defaults: nthread = 8, ncol = 64, nrepeat = 4
+ *****************************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdisort.h"
+
+#define NSTR 8
+#define NLYR 10
+#define NUMU 3
+
+typedef struct {
+  int first, last, nrepeat, nfail;
+  disort_output const *ref;
+  disort_tables const *tab;
+} thread_task;
+
+static const rpv_brdf_spec rpv = {0.027, 0.647, -0.169, 0., 0., 0., 1.};
+static const double umu[NUMU] = {-0.5, 0.2, 0.8};
+
+/* Fill column icol; every column differs in its optical properties */
+static void setup_column(disort_state *ds, int icol) {
+  int lc;
+
+  memset(ds, 0, sizeof(disort_state));
+
+  ds->accur = 0.;
+  ds->flag.ibcnd = GENERAL_BC;
+  ds->flag.usrtau = FALSE;
+  ds->flag.usrang = (icol % 3 == 1);
+  ds->flag.lamber = (icol % 4 != 3);
+  ds->flag.planck = (icol % 2 == 0);
+  ds->flag.onlyfl = FALSE;
+  ds->flag.quiet = TRUE;
+  ds->flag.spher = FALSE;
+  ds->flag.general_source = FALSE;
+  ds->flag.output_uum = FALSE;
+  ds->flag.symmetric_eigen = FALSE;
+  ds->flag.skip_rcond = FALSE;
+  ds->flag.intensity_correction = TRUE;
+  ds->flag.old_intensity_correction = TRUE;
+  ds->flag.brdf_type = ds->flag.lamber ? BRDF_NONE : BRDF_RPV;
+
+  ds->nstr = NSTR;
+  ds->nlyr = NLYR;
+  ds->nphase = ds->nstr;
+  ds->nmom = ds->nstr;
+  ds->ntau = 0;
+  ds->numu = ds->flag.usrang ? NUMU : 0;
+  ds->nphi = 1;
+
+  c_disort_state_alloc(ds);
+
+  if (ds->flag.brdf_type == BRDF_RPV) *ds->brdf.rpv = rpv;
+  if (ds->flag.usrang) memcpy(ds->umu, umu, NUMU * sizeof(double));
+  ds->wvnmlo = 500. + 10. * icol;
+  ds->wvnmhi = 600. + 10. * icol;
+
+  ds->bc.fbeam = (icol % 2 == 0) ? 0. : M_PI;
+  ds->bc.umu0 = 0.3 + 0.6 * (icol % 5) / 4.;
+  ds->bc.phi0 = 0.;
+  ds->bc.fisot = 0.;
+  ds->bc.fluor = 0.;
+  ds->bc.albedo = 0.1 + 0.05 * (icol % 7);
+  ds->bc.btemp = 300.;
+  ds->bc.ttemp = 0.;
+  ds->bc.temis = 1.;
+
+  ds->phi[0] = 30.;
+  for (lc = 0; lc < ds->nlyr; ++lc) {
+    ds->dtauc[lc] = 0.05 * (lc + 1) * (1. + 0.01 * icol);
+    ds->ssalb[lc] = 0.5 + 0.4 * (double)(icol % 11) / 10.;
+    c_getmom(HENYEY_GREENSTEIN, 0.7, ds->nmom,
+             &ds->pmom[lc * (ds->nmom_nstr + 1)]);
+  }
+  if (ds->flag.planck) {
+    for (lc = 0; lc <= ds->nlyr; ++lc) {
+      ds->temper[lc] = 200. + 5. * lc;
+    }
+  }
+}
+
+/* Return the number of differing output values */
+static int compare_output(disort_state const *ds, disort_output const *out,
+                          disort_output const *ref) {
+  int i, nfail = 0;
+
+  for (i = 0; i < ds->ntau; ++i) {
+    if (memcmp(&out->rad[i], &ref->rad[i], sizeof(disort_radiant)) != 0)
+      ++nfail;
+  }
+  for (i = 0; i < ds->ntau * ds->numu * ds->nphi; ++i) {
+    if (out->uu[i] != ref->uu[i]) ++nfail;
+  }
+
+  return nfail;
+}
+
+static void *run_columns(void *arg) {
+  thread_task *task = (thread_task *)arg;
+  disort_state ds;
+  disort_output out;
+  disort_workspace ws;
+  int icol, irep;
+
+  c_disort_workspace_alloc(&ws, NLYR, NSTR, NSTR, NLYR + 1, 1);
+  ws.tab = task->tab;
+
+  for (irep = 0; irep < task->nrepeat; ++irep) {
+    for (icol = task->first; icol < task->last; ++icol) {
+      setup_column(&ds, icol);
+      c_disort_out_alloc(&ds, &out);
+
+      c_disort_ws(&ds, &out, &ws, c_planck_func2);
+      task->nfail += compare_output(&ds, &out, &task->ref[icol]);
+
+      c_disort_out_free(&ds, &out);
+      c_disort_state_free(&ds);
+    }
+  }
+
+  c_disort_workspace_free(&ws);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int nthread = 8, ncol = 64, nrepeat = 4;
+  int i, icol, nfail = 0;
+  disort_state ds;
+  disort_output *ref;
+  disort_tables tab;
+  pthread_t *threads;
+  thread_task *tasks;
+
+  if (argc >= 4) {
+    nthread = atoi(argv[1]);
+    ncol = atoi(argv[2]);
+    nrepeat = atoi(argv[3]);
+  }
+
+  printf("Running %d columns on %d threads, %d times\n", ncol, nthread,
+         nrepeat);
+
+  /* Serial reference */
+  ref = (disort_output *)calloc(ncol, sizeof(disort_output));
+  for (icol = 0; icol < ncol; ++icol) {
+    setup_column(&ds, icol);
+    c_disort_out_alloc(&ds, &ref[icol]);
+    c_disort(&ds, &ref[icol], c_planck_func2);
+    c_disort_state_free(&ds);
+  }
+
+  /* Tables for the user angles of column 1, also used at the others */
+  setup_column(&ds, 1);
+  c_disort_tables_alloc(&tab, &ds);
+  c_disort_state_free(&ds);
+
+  /* Concurrent runs, each thread takes a contiguous block of columns */
+  threads = (pthread_t *)calloc(nthread, sizeof(pthread_t));
+  tasks = (thread_task *)calloc(nthread, sizeof(thread_task));
+  for (i = 0; i < nthread; ++i) {
+    tasks[i].first = (int)((long)ncol * i / nthread);
+    tasks[i].last = (int)((long)ncol * (i + 1) / nthread);
+    tasks[i].nrepeat = nrepeat;
+    tasks[i].ref = ref;
+    tasks[i].tab = &tab;
+    pthread_create(&threads[i], NULL, run_columns, &tasks[i]);
+  }
+
+  for (i = 0; i < nthread; ++i) {
+    pthread_join(threads[i], NULL);
+    nfail += tasks[i].nfail;
+  }
+
+  for (icol = 0; icol < ncol; ++icol) {
+    setup_column(&ds, icol);
+    c_disort_out_free(&ds, &ref[icol]);
+    c_disort_state_free(&ds);
+  }
+  c_disort_tables_free(&tab);
+  free(ref);
+  free(tasks);
+  free(threads);
+
+  if (nfail > 0) {
+    printf("FAILED: %d values differ from the serial run\n", nfail);
+    return 1;
+  }
+
+  printf("All threaded results agree with the serial run.\n");
+  return 0;
+}
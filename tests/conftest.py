@@ -0,0 +1,97 @@
+""" Shared fixtures of the pydisort tests."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position, redefined-outer-name
+
+import pytest
+import torch
+from pydisort import Disort, DisortOptions, scattering_moments
+
+
+@pytest.fixture(autouse=True)
+def seed():
+    """Draw the same random columns on every run."""
+    torch.manual_seed(0)
+
+
+@pytest.fixture
+def make_disort(request):
+    """Factory of Disort modules of nwave x ncol columns.
+
+    Wave bin i spans [wave * (i + 1), wave * (i + 2)], which only the
+    planck flag uses. umu and phi set the user angles if given. Any other
+    keyword calls the DisortOptions method of that name, e.g.
+    make_disort(flags, engine="batched").
+    """
+
+    def make(
+        flags,
+        nwave=1,
+        ncol=1,
+        nlyr=6,
+        nstr=8,
+        umu=None,
+        phi=None,
+        wave=100.0,
+        **options,
+    ):
+        op = DisortOptions().header(request.node.name).flags(flags)
+        op.nwave(nwave).ncol(ncol)
+        op.wave_lower([wave * (i + 1) for i in range(nwave)])
+        op.wave_upper([wave * (i + 2) for i in range(nwave)])
+        op.ds().nlyr = nlyr
+        op.ds().nmom = nstr
+        op.ds().nstr = nstr
+        op.ds().nphase = nstr
+        if umu is not None:
+            op.user_mu(umu)
+        if phi is not None:
+            op.user_phi(phi)
+        for name, value in options.items():
+            getattr(op, name)(value)
+        return Disort(op)
+
+    return make
+
+
+@pytest.fixture
+def make_columns():
+    """Factory of random columns (prop, bc, temf).
+
+    The optical thickness of prop (nwave, ncol, nlyr, 2 + nstr) is uniform
+    in [tau, tau + 1] and the single-scattering albedo uniform in ssa; the
+    phase function is Henyey-Greenstein with asymmetry g. temf (ncol,
+    nlyr + 1) is uniform in [tmin, tmin + trange].
+
+    The other keywords are the boundary conditions. Tensors are taken as
+    they are, and a number fills (ncol,) for btemp and ttemp, and
+    (nwave, ncol) otherwise.
+    """
+
+    def make(
+        nwave,
+        ncol,
+        nlyr,
+        nstr=8,
+        tau=0.01,
+        ssa=(0.0, 0.9),
+        g=0.6,
+        tmin=200.0,
+        trange=50.0,
+        **bc,
+    ):
+        prop = torch.zeros((nwave, ncol, nlyr, 2 + nstr), dtype=torch.float64)
+        prop[..., 0] = torch.rand(nwave, ncol, nlyr) + tau
+        prop[..., 1] = ssa[0] + (ssa[1] - ssa[0]) * torch.rand(
+            nwave, ncol, nlyr
+        )
+        prop[..., 2:] = scattering_moments(nstr, "henyey-greenstein", g)
+
+        for key, value in bc.items():
+            if not torch.is_tensor(value):
+                shape = (ncol,) if key in ("btemp", "ttemp") else (nwave, ncol)
+                bc[key] = torch.full(shape, value, dtype=torch.float64)
+
+        temf = tmin + trange * torch.rand(ncol, nlyr + 1, dtype=torch.float64)
+        return prop, bc, temf
+
+    return make
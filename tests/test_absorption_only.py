@@ -0,0 +1,72 @@
+""" Test the closed-form solution of pydisort for non-scattering columns."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position, redefined-outer-name
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+ANGLES = {"umu": [-0.7, -0.2, 0.3, 0.9], "phi": [0.0, 60.0]}
+
+
+@pytest.fixture
+def columns(make_columns):
+    """Absorbing columns, and the same with a trace of scattering.
+
+    The trace keeps the eigensolver and the linear system that the
+    closed form skips.
+    """
+
+    def make(nwave, ncol, nlyr):
+        _, bc, temf = make_columns(
+            nwave,
+            ncol,
+            nlyr,
+            fbeam=3.14159,
+            umu0=torch.linspace(0.3, 0.9, ncol, dtype=torch.float64),
+            albedo=0.3,
+            fisot=0.1,
+            btemp=300.0,
+            ttemp=100.0,
+            temis=0.5,
+        )
+
+        # no single-scattering albedo: every column takes the closed form
+        absorb = torch.zeros((nwave, ncol, nlyr, 1), dtype=torch.float64)
+        absorb[..., 0] = torch.rand(nwave, ncol, nlyr) + 0.01
+
+        scatter = torch.zeros((nwave, ncol, nlyr, 2), dtype=torch.float64)
+        scatter[..., 0] = absorb[..., 0]
+        scatter[..., 1] = 1.0e-12
+        return absorb, scatter, bc, temf
+
+    return make
+
+
+def test_absorption_only_fluxes(make_disort, columns):
+    nwave, ncol, nlyr = 3, 4, 20
+    absorb, scatter, bc, temf = columns(nwave, ncol, nlyr)
+
+    flags = "onlyfl,lamber,quiet,planck"
+    ds = make_disort(flags, nwave, ncol, nlyr, **ANGLES)
+    expected = ds.forward(scatter, temf=temf, **bc)
+    result = ds.forward(absorb, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+
+
+@pytest.mark.parametrize(
+    "flags", ["lamber,quiet,planck,usrang", "lamber,quiet,usrang"]
+)
+def test_absorption_only_intensities(make_disort, columns, flags):
+    nwave, ncol, nlyr = 2, 3, 12
+    absorb, scatter, bc, temf = columns(nwave, ncol, nlyr)
+
+    ref = make_disort(flags, nwave, ncol, nlyr, **ANGLES)
+    expected = ref.forward(scatter, temf=temf, **bc)
+
+    ds = make_disort(flags, nwave, ncol, nlyr, **ANGLES)
+    result = ds.forward(absorb, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert_allclose(ds.gather_rad(), ref.gather_rad(), rtol=1e-6, atol=1e-10)
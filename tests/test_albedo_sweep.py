@@ -0,0 +1,49 @@
+""" Test the closed-form surface albedo sweep of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+BC = {"fbeam": 3.14159, "fluor": 0.05, "fisot": 0.1, "btemp": 280.0}
+
+
+@pytest.mark.parametrize(
+    "flags", ["onlyfl,lamber,quiet", "lamber,quiet,planck"]
+)
+def test_albedo_sweep_matches_forward(make_disort, make_columns, flags):
+    nwave, ncol, nlyr = 2, 3, 8
+    umu0 = torch.tensor([0.9, 0.5, 0.2], dtype=torch.float64)
+    prop, bc, temf = make_columns(nwave, ncol, nlyr, umu0=umu0, **BC)
+    albedo = torch.tensor([0.0, 0.1, 0.35, 0.8, 1.0], dtype=torch.float64)
+
+    ds = make_disort(flags, nwave, ncol, nlyr)
+    result = ds.forward_albedo(prop, albedo, temf=temf, **bc)
+    assert result.shape == (len(albedo), nwave, ncol, nlyr + 1, 2)
+
+    # one solve per albedo gives the same fluxes
+    for i, a in enumerate(albedo):
+        ref = make_disort(flags, nwave, ncol, nlyr)
+        expected = ref.forward(
+            prop,
+            temf=temf,
+            albedo=torch.full((nwave, ncol), a.item(), dtype=torch.float64),
+            **bc,
+        )
+        assert_allclose(result[i], expected, rtol=1e-10, atol=1e-12)
+
+
+def test_albedo_sweep_per_column(make_disort, make_columns):
+    nwave, ncol, nlyr = 2, 2, 5
+    umu0 = torch.tensor([0.9, 0.5], dtype=torch.float64)
+    prop, bc, temf = make_columns(nwave, ncol, nlyr, umu0=umu0, **BC)
+    albedo = torch.rand(4, nwave, ncol, dtype=torch.float64)
+
+    ds = make_disort("lamber,quiet,planck", nwave, ncol, nlyr)
+    result = ds.forward_albedo(prop, albedo, temf=temf, **bc)
+
+    ref = make_disort("lamber,quiet,planck", nwave, ncol, nlyr)
+    for i in range(albedo.size(0)):
+        expected = ref.forward(prop, temf=temf, albedo=albedo[i], **bc)
+        assert_allclose(result[i], expected, rtol=1e-10, atol=1e-12)
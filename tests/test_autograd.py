@@ -0,0 +1,83 @@
+""" Test the gradients of pydisort fluxes."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import output_flux
+
+BC = {"fbeam": 3.14159, "albedo": 0.3, "fisot": 0.1, "btemp": 280.0}
+
+
+@pytest.mark.parametrize("upward", [0, 1])
+def test_gradients_match_jacobian(make_disort, make_columns, upward):
+    nwave, ncol, nlyr = 2, 2, 4
+    umu0 = torch.tensor([0.9, 0.5], dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, ssa=(0.1, 0.9), umu0=umu0, **BC
+    )
+
+    ds = make_disort("lamber,quiet,planck", nwave, ncol, nlyr, upward=upward)
+    jac = ds.forward_jacobian(prop, temf=temf, **bc)
+
+    p = prop.clone().requires_grad_(True)
+    a = bc["albedo"].clone().requires_grad_(True)
+    t = temf.clone().requires_grad_(True)
+    flx = ds.forward(p, temf=t, **dict(bc, albedo=a))
+    assert flx.grad_fn is not None
+    assert_allclose(flx.detach(), jac["flux"], rtol=1e-10)
+
+    # a weighted sum of the fluxes, as a loss would be
+    w = torch.rand_like(flx)
+    (flx * w).sum().backward()
+
+    wj = w.view(nwave, ncol, nlyr + 1, 2, 1, 1)
+    assert_allclose(p.grad, (wj * jac["prop"]).sum((2, 3)), atol=1e-10)
+    assert_allclose(a.grad, (w * jac["albedo"]).sum((2, 3)), atol=1e-10)
+    assert_allclose(
+        t.grad,
+        (wj[..., 0] * jac["temf"]).sum((0, 2, 3)),
+        rtol=1e-8,
+        atol=1e-10,
+    )
+
+
+def test_gradients_reuse_forward(make_disort, make_columns):
+    nwave, ncol, nlyr = 2, 3, 5
+    umu0 = torch.tensor([0.9, 0.5, 0.2], dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, ssa=(0.1, 0.9), umu0=umu0, **BC
+    )
+
+    ds = make_disort("lamber,quiet,planck", nwave, ncol, nlyr)
+    jac = ds.forward_jacobian(prop, temf=temf, **bc)
+
+    # fluxes only: each backward pass takes the beam solutions of the
+    # forward pass
+    p = prop.clone().requires_grad_(True)
+    flx = ds.forward(p, temf=temf, outputs=output_flux, **bc)
+    w = torch.rand_like(flx)
+    wj = w.view(nwave, ncol, nlyr + 1, 2, 1, 1)
+
+    for _ in range(2):
+        p.grad = None
+        (flx * w).sum().backward(retain_graph=True)
+        assert_allclose(p.grad, (wj * jac["prop"]).sum((2, 3)), atol=1e-10)
+
+
+def test_gradcheck(make_disort, make_columns):
+    nwave, ncol, nlyr = 1, 1, 3
+    umu0 = torch.tensor([0.9], dtype=torch.float64)
+    prop, bc, _ = make_columns(
+        nwave, ncol, nlyr, ssa=(0.1, 0.9), umu0=umu0, **BC
+    )
+    ds = make_disort("onlyfl,lamber,quiet", nwave, ncol, nlyr)
+
+    def func(tau, albedo):
+        p = torch.cat([tau.unsqueeze(-1), prop[..., 1:]], -1)
+        return ds.forward(p, **dict(bc, albedo=albedo))
+
+    tau = prop[..., 0].clone().requires_grad_(True)
+    albedo = bc["albedo"].clone().requires_grad_(True)
+    assert torch.autograd.gradcheck(func, (tau, albedo), atol=1e-6)
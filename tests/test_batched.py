@@ -0,0 +1,125 @@
+""" Test the batched cross-column engine of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position, redefined-outer-name
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import output_flux
+
+FLAGS = "onlyfl,lamber,quiet"
+
+
+@pytest.fixture
+def columns(make_columns):
+    """Beam columns with a conservative and a purely absorbing layer."""
+
+    def make(nwave, ncol, nlyr, nstr=8):
+        prop, bc, temf = make_columns(
+            nwave,
+            ncol,
+            nlyr,
+            nstr,
+            tau=0.1,
+            ssa=(0.0, 1.0),
+            fbeam=torch.rand(nwave, ncol, dtype=torch.float64),
+            umu0=torch.linspace(0.25, 0.95, ncol, dtype=torch.float64),
+            albedo=torch.rand(nwave, ncol, dtype=torch.float64),
+        )
+        prop[:, 0, 2, 1] = 1.0
+        prop[:, 1, 3, 1] = 0.0
+        return prop, bc, temf
+
+    return make
+
+
+@pytest.mark.parametrize("lanes", [4, 8, 16])
+@pytest.mark.parametrize("schedule", ["static", "dynamic", "cost"])
+def test_batched_beam(make_disort, columns, lanes, schedule):
+    # ncol is not a multiple of the number of lanes
+    nwave, ncol, nlyr = 3, 13, 6
+    prop, bc, _ = columns(nwave, ncol, nlyr)
+
+    ref = make_disort(FLAGS, nwave, ncol, engine="cdisort")
+    expected = ref.forward(prop, **bc)
+
+    ds = make_disort(
+        FLAGS, nwave, ncol, engine="batched", lanes=lanes, schedule=schedule
+    )
+    result = ds.forward(prop, **bc)
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+
+
+def test_batched_thermal(make_disort, columns):
+    nwave, ncol, nlyr = 2, 9, 6
+    prop, bc, temf = columns(nwave, ncol, nlyr)
+    bc["btemp"] = torch.full((ncol,), 300.0, dtype=torch.float64)
+    bc["ttemp"] = torch.full((ncol,), 100.0, dtype=torch.float64)
+    bc["temis"] = torch.full((ncol,), 0.5, dtype=torch.float64)
+
+    flags = FLAGS + ",planck"
+    ref = make_disort(flags, nwave, ncol, engine="cdisort")
+    expected = ref.forward(prop, temf=temf, **bc)
+    ds = make_disort(flags, nwave, ncol, engine="batched")
+    result = ds.forward(prop, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+
+
+# 4, 16 and 32 streams use the specialized kernels, 6 the generic one
+@pytest.mark.parametrize("nstr", [4, 6, 16, 32])
+def test_batched_stream_counts(make_disort, columns, nstr):
+    nwave, ncol, nlyr = 1, 11, 6
+    prop, bc, _ = columns(nwave, ncol, nlyr, nstr)
+
+    ref = make_disort(FLAGS, nwave, ncol, nstr=nstr, engine="cdisort")
+    expected = ref.forward(prop, **bc)
+    ds = make_disort(FLAGS, nwave, ncol, nstr=nstr, engine="batched")
+    result = ds.forward(prop, **bc)
+
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert ds.schedule_stats()["ncol_batched"] == nwave * ncol
+
+
+def test_batched_default_outputs(make_disort, columns):
+    nwave, ncol, nlyr = 2, 10, 6
+    prop, bc, _ = columns(nwave, ncol, nlyr)
+
+    ref = make_disort(FLAGS, nwave, ncol, engine="cdisort")
+    expected = ref.forward(prop, **bc)
+
+    # with onlyfl the default outputs gather fluxes only
+    ds = make_disort(FLAGS, nwave, ncol, engine="batched")
+    result = ds.forward(prop, **bc)
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert ds.schedule_stats()["ncol_batched"] == nwave * ncol
+
+    # without it they gather radiances, which need c_disort
+    ds = make_disort("lamber,quiet", nwave, ncol, engine="batched")
+    result = ds.forward(prop, **bc)
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert ds.schedule_stats()["ncol_batched"] == 0
+
+    # unless only the fluxes are asked for
+    result = ds.forward(prop, outputs=output_flux, **bc)
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert ds.schedule_stats()["ncol_batched"] == nwave * ncol
+
+
+def test_batched_failed_column(make_disort, columns):
+    nwave, ncol, nlyr = 1, 5, 6
+    prop, bc, _ = columns(nwave, ncol, nlyr)
+    prop[0, 2, 0, 1] = 1.5
+
+    ds = make_disort(FLAGS, nwave, ncol, engine="batched")
+    result = ds.forward(prop, **bc)
+
+    assert torch.isnan(result[0, 2]).all()
+    assert not torch.isnan(result[0, [0, 1, 3, 4]]).any()
+    assert ds.gather_status()[0, 2] == 1
+
+
+def test_batched_needs_lambertian_surface(make_disort):
+    # a BRDF surface is rejected
+    with pytest.raises(RuntimeError):
+        make_disort("onlyfl,quiet", engine="batched")
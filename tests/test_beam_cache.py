@@ -0,0 +1,56 @@
+""" Test the beam cache of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import torch
+from numpy.testing import assert_allclose
+
+FLAGS = "onlyfl,lamber,quiet,planck"
+BC = {"fbeam": 3.14159, "albedo": 0.2, "btemp": 290.0}
+
+
+def test_beam_cache_temperatures(make_disort, make_columns):
+    nwave, ncol, nlyr = 2, 4, 10
+    umu0 = torch.linspace(0.3, 0.9, ncol, dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, g=0.7, trange=60.0, umu0=umu0, **BC
+    )
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, wave=500.0, beam_cache=True)
+    ds.forward(prop, temf=temf, **bc)
+    assert ds.beam_cache_stats()["misses"] == nwave * ncol
+
+    # only the temperatures change: every column reuses its beam solution
+    ref = make_disort(FLAGS, nwave, ncol, nlyr, wave=500.0, beam_cache=False)
+    for step in range(3):
+        temf = temf + 5.0 * torch.randn(ncol, nlyr + 1, dtype=torch.float64)
+        bc["btemp"] = bc["btemp"] + 2.0 * (step + 1)
+
+        result = ds.forward(prop, temf=temf, **bc)
+        expected = ref.forward(prop, temf=temf, **bc)
+
+        assert_allclose(result, expected, rtol=1e-10, atol=1e-12)
+        stats = ds.beam_cache_stats()
+        assert stats["hits"] == nwave * ncol
+        assert stats["hit_rate"] == 1.0
+
+
+def test_beam_cache_properties(make_disort, make_columns):
+    nwave, ncol, nlyr = 1, 3, 6
+    umu0 = torch.linspace(0.3, 0.9, ncol, dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, g=0.7, trange=60.0, umu0=umu0, **BC
+    )
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, wave=500.0, beam_cache=True)
+    ds.forward(prop, temf=temf, **bc)
+
+    # a new single-scattering albedo in one column solves that column again
+    prop[0, 1, 2, 1] *= 0.5
+    result = ds.forward(prop, temf=temf, **bc)
+    ref = make_disort(FLAGS, nwave, ncol, nlyr, wave=500.0, beam_cache=False)
+    expected = ref.forward(prop, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-10, atol=1e-12)
+    assert ds.beam_cache_stats()["hits"] == ncol - 1
+    assert ds.beam_cache_stats()["misses"] == 1
@@ -0,0 +1,95 @@
+""" Test the block tridiagonal boundary-value solver of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import math
+
+import torch
+from numpy.testing import assert_allclose
+
+ANGLES = {"umu": [-0.7, 0.5], "phi": [0.0, 60.0]}
+
+# level, up and down flux of the banded solver that the block solver
+# replaced, for the column of test_block_solver_reference
+REFERENCE = [
+    [0, 7.125220296281210e00, 1.570796326794896e00],
+    [1, 7.146970210192831e00, 1.683110939500087e00],
+    [10, 7.760190113949574e00, 3.455927729682845e00],
+    [25, 8.656004659499686e00, 5.492488910399204e00],
+    [50, 1.008189280374031e01, 7.832994740627791e00],
+    [75, 1.120639614054854e01, 9.431444254582953e00],
+    [99, 1.175010237871416e01, 1.091618675318165e01],
+    [100, 1.175280056494084e01, 1.092905179049274e01],
+]
+
+
+def test_block_solver_reference(make_disort):
+    nlyr, nstr = 100, 16
+    lc = torch.arange(nlyr, dtype=torch.float64)
+    prop = torch.zeros((1, 1, nlyr, 2 + nstr), dtype=torch.float64)
+    prop[..., 0] = 0.02 * (1 + lc % 7)
+    prop[..., 1] = 0.5 + 0.1 * (lc % 5)
+    prop[..., 2:] = 0.75 ** torch.arange(1, nstr + 1, dtype=torch.float64)
+    temf = 200.0 + torch.arange(nlyr + 1, dtype=torch.float64)
+    bc = {
+        "umu0": torch.tensor([0.5], dtype=torch.float64),
+        "fbeam": torch.tensor([[math.pi]], dtype=torch.float64),
+        "albedo": torch.tensor([[0.3]], dtype=torch.float64),
+        "btemp": torch.tensor([300.0], dtype=torch.float64),
+    }
+
+    ds = make_disort("onlyfl,lamber,quiet,planck", nlyr=nlyr, nstr=nstr)
+    result = ds.forward(prop, temf=temf.unsqueeze(0), **bc)
+
+    expected = torch.tensor(REFERENCE, dtype=torch.float64)
+    level = expected[:, 0].long()
+    assert_allclose(result[0, 0, level], expected[:, 1:], rtol=1e-12)
+
+
+def test_block_solver_skip_rcond(make_disort, make_columns):
+    nlyr = 200
+    prop, bc, _ = make_columns(
+        1,
+        2,
+        nlyr,
+        ssa=(0.0, 1.0),
+        g=0.8,
+        fbeam=3.14159,
+        umu0=torch.tensor([0.3, 0.9], dtype=torch.float64),
+        albedo=0.4,
+    )
+    prop[..., 0] = 0.2 * torch.rand(1, 2, nlyr) + 0.01
+
+    flags = "lamber,quiet,usrang,intensity_correction"
+    ref = make_disort(flags, ncol=2, nlyr=nlyr, **ANGLES)
+    expected = ref.forward(prop, **bc)
+
+    ds = make_disort(flags + ",skip_rcond", ncol=2, nlyr=nlyr, **ANGLES)
+    result = ds.forward(prop, **bc)
+
+    # the condition estimate does not change the solution
+    assert_allclose(result, expected, rtol=0, atol=0)
+    assert_allclose(ds.gather_rad(), ref.gather_rad(), rtol=0, atol=0)
+
+
+def test_block_solver_energy_conservation(make_disort, make_columns):
+    nlyr = 120
+    prop, bc, _ = make_columns(
+        1,
+        2,
+        nlyr,
+        ssa=(1.0, 1.0),
+        fbeam=3.14159,
+        umu0=torch.tensor([0.5, 1.0], dtype=torch.float64),
+        albedo=1.0,
+    )
+    prop[..., 0] = 0.5 * torch.rand(1, 2, nlyr) + 0.01
+
+    ds = make_disort("onlyfl,lamber,quiet,skip_rcond", ncol=2, nlyr=nlyr)
+    ds.forward(prop, **bc)
+
+    # no absorption anywhere: zero net flux at every level
+    flx = ds.gather_flx()
+    assert_allclose(
+        flx[..., 2], flx[..., 0] + flx[..., 1], rtol=1e-6, atol=1e-10
+    )
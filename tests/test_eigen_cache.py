@@ -0,0 +1,74 @@
+""" Test the eigen cache of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position, redefined-outer-name
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import scattering_moments
+
+ANGLES = {"umu": [-0.7, 0.5], "phi": [0.0, 60.0]}
+
+
+@pytest.fixture
+def columns(make_columns):
+    """Clear-sky layers on top, random clouds below."""
+
+    def make(nwave, ncol, nlyr):
+        prop, bc, _ = make_columns(
+            nwave,
+            ncol,
+            nlyr,
+            ssa=(0.0, 1.0),
+            g=0.8,
+            fbeam=3.14159,
+            umu0=torch.linspace(0.3, 0.9, ncol, dtype=torch.float64),
+            albedo=0.2,
+        )
+        prop[..., :4, 1] = 0.9
+        prop[..., :4, 2:] = scattering_moments(8, "henyey-greenstein", 0.2)
+        return prop, bc
+
+    return make
+
+
+@pytest.mark.parametrize(
+    "flags", ["onlyfl,lamber,quiet", "lamber,quiet,usrang"]
+)
+def test_eigen_cache_identical(make_disort, columns, flags):
+    nwave, ncol, nlyr = 2, 5, 8
+    prop, bc = columns(nwave, ncol, nlyr)
+
+    ref = make_disort(flags, nwave, ncol, nlyr, eigen_cache=0, **ANGLES)
+    expected = ref.forward(prop, **bc)
+    assert ref.eigen_cache_stats()["hits"] == 0
+
+    ds = make_disort(flags, nwave, ncol, nlyr, eigen_cache=64, **ANGLES)
+    result = ds.forward(prop, **bc)
+
+    # a hit returns the same numbers as the eigensolver
+    assert_allclose(result, expected, rtol=0, atol=0)
+    if "onlyfl" not in flags:
+        assert_allclose(ds.gather_rad(), ref.gather_rad(), rtol=0, atol=0)
+
+    stats = ds.eigen_cache_stats()
+    assert stats["hits"] > 0
+    assert stats["misses"] > 0
+    assert 0.0 < stats["hit_rate"] < 1.0
+
+
+def test_eigen_cache_across_calls(make_disort, columns):
+    nwave, ncol, nlyr = 1, 3, 6
+    prop, bc = columns(nwave, ncol, nlyr)
+
+    ds = make_disort(
+        "onlyfl,lamber,quiet", nwave, ncol, nlyr, eigen_cache=64, **ANGLES
+    )
+    expected = ds.forward(prop, **bc)
+    first = ds.eigen_cache_stats()
+    result = ds.forward(prop, **bc)
+
+    # the second call finds the layers solved by the first one
+    assert_allclose(result, expected, rtol=0, atol=0)
+    assert ds.eigen_cache_stats()["hits"] > first["hits"]
+    assert ds.eigen_cache_stats()["hit_rate"] > first["hit_rate"]
@@ -0,0 +1,58 @@
+""" Test the incremental forward of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import torch
+from numpy.testing import assert_allclose
+
+FLAGS = "lamber,quiet,planck,usrang"
+OPTIONS = {"nstr": 4, "umu": [-0.7, 0.5], "phi": [0.0, 60.0], "wave": 500.0}
+BC = {"fbeam": 3.14159, "albedo": 0.2, "btemp": 290.0}
+
+
+def test_incremental_dirty_columns(make_disort, make_columns):
+    nwave, ncol, nlyr = 2, 5, 6
+    umu0 = torch.linspace(0.3, 0.9, ncol, dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, 4, trange=60.0, umu0=umu0, **BC
+    )
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, incremental=True, **OPTIONS)
+    ds.forward(prop, temf=temf, **bc)
+    assert ds.incremental_stats()["dirty"] == nwave * ncol
+
+    # nothing changed
+    ref = make_disort(FLAGS, nwave, ncol, nlyr, incremental=False, **OPTIONS)
+    result = ds.forward(prop, temf=temf, **bc)
+    expected = ref.forward(prop, temf=temf, **bc)
+    assert_allclose(result, expected, rtol=0, atol=0)
+    assert ds.incremental_stats()["dirty"] == 0
+
+    # one layer of one column, and the temperatures of another column
+    prop[1, 2, 3, 1] *= 0.5
+    temf[4] += 10.0
+
+    result = ds.forward(prop, temf=temf, **bc)
+    expected = ref.forward(prop, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=0, atol=0)
+    assert_allclose(ds.gather_rad(), ref.gather_rad(), rtol=0, atol=0)
+
+    # column 4 is dirty at every wave
+    stats = ds.incremental_stats()
+    assert stats["ncol"] == nwave * ncol
+    assert stats["dirty"] == 1 + nwave
+    assert stats["dirty_fraction"] == (1 + nwave) / (nwave * ncol)
+
+
+def test_incremental_disabled(make_disort, make_columns):
+    nwave, ncol, nlyr = 1, 3, 4
+    umu0 = torch.linspace(0.3, 0.9, ncol, dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, 4, trange=60.0, umu0=umu0, **BC
+    )
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, incremental=False, **OPTIONS)
+    ds.forward(prop, temf=temf, **bc)
+    ds.forward(prop, temf=temf, **bc)
+    assert ds.incremental_stats()["dirty_fraction"] == 1.0
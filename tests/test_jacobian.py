@@ -0,0 +1,70 @@
+""" Test the analytic flux derivatives of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+BC = {"fbeam": 3.14159, "albedo": 0.3, "fisot": 0.1, "btemp": 280.0}
+
+
+@pytest.mark.parametrize(
+    "flags", ["onlyfl,lamber,quiet", "lamber,quiet,planck"]
+)
+def test_jacobian_matches_finite_differences(make_disort, make_columns, flags):
+    nwave, ncol, nlyr = 1, 2, 4
+    umu0 = torch.tensor([0.9, 0.5], dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, ssa=(0.1, 0.9), umu0=umu0, **BC
+    )
+    h = 1.0e-6
+
+    ds = make_disort(flags, nwave, ncol, nlyr)
+    jac = ds.forward_jacobian(prop, temf=temf, **bc)
+    assert jac["prop"].shape == (nwave, ncol, nlyr + 1, 2, nlyr, 10)
+    assert jac["temf"].shape == (nwave, ncol, nlyr + 1, 2, nlyr + 1)
+
+    # the fluxes are those of forward
+    ref = make_disort(flags, nwave, ncol, nlyr)
+    assert_allclose(
+        jac["flux"], ref.forward(prop, temf=temf, **bc), rtol=1e-10
+    )
+
+    # central differences of forward in the optical properties
+    for i in range(nlyr):
+        for q in range(prop.size(-1)):
+            dp = torch.zeros_like(prop)
+            dp[..., i, q] = h
+            fp = ref.forward(prop + dp, temf=temf, **bc)
+            fm = ref.forward(prop - dp, temf=temf, **bc)
+            assert_allclose(
+                jac["prop"][..., i, q], (fp - fm) / (2 * h), atol=1e-6
+            )
+
+    # and in the surface albedo
+    fp = ref.forward(prop, temf=temf, **dict(bc, albedo=bc["albedo"] + h))
+    fm = ref.forward(prop, temf=temf, **dict(bc, albedo=bc["albedo"] - h))
+    assert_allclose(jac["albedo"], (fp - fm) / (2 * h), atol=1e-6)
+
+
+def test_jacobian_temperature(make_disort, make_columns):
+    nwave, ncol, nlyr = 2, 1, 3
+    umu0 = torch.tensor([0.9], dtype=torch.float64)
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, ssa=(0.1, 0.9), umu0=umu0, **BC
+    )
+    h = 1.0e-3
+
+    ds = make_disort("lamber,quiet,planck", nwave, ncol, nlyr)
+    jac = ds.forward_jacobian(prop, temf=temf, **bc)
+
+    ref = make_disort("lamber,quiet,planck", nwave, ncol, nlyr)
+    for lev in range(nlyr + 1):
+        dt = torch.zeros_like(temf)
+        dt[:, lev] = h
+        fp = ref.forward(prop, temf=temf + dt, **bc)
+        fm = ref.forward(prop, temf=temf - dt, **bc)
+        assert_allclose(
+            jac["temf"][..., lev], (fp - fm) / (2 * h), rtol=1e-4, atol=1e-8
+        )
@@ -0,0 +1,67 @@
+""" Test solving several solar zenith angles per column with pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+ANGLES = {"umu": [-0.7, -0.2, 0.3, 0.9], "phi": [0.0, 60.0, 150.0]}
+
+
+@pytest.mark.parametrize(
+    "flags", ["onlyfl,lamber,quiet", "lamber,quiet,planck,usrang"]
+)
+def test_multi_sun_matches_separate(make_disort, make_columns, flags):
+    nwave, ncol, nlyr = 2, 3, 8
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, fbeam=3.14159, albedo=0.2, fisot=0.1
+    )
+    umu0 = torch.tensor(
+        [[0.9, 0.5, 0.2], [1.0, 0.7, 0.3], [0.6, 0.4, 0.1]],
+        dtype=torch.float64,
+    )
+    phi0 = torch.tensor(
+        [[0.0, 30.0, 90.0], [0.0, 10.0, 20.0], [45.0, 135.0, 225.0]],
+        dtype=torch.float64,
+    )
+    nsun = umu0.size(1)
+
+    ds = make_disort(flags, nwave, ncol, nlyr, **ANGLES)
+    result = ds.forward(prop, temf=temf, umu0=umu0, phi0=phi0, **bc)
+    assert result.shape == (nwave, ncol, nsun, nlyr + 1, 2)
+
+    flx = ds.gather_flx().clone()
+    assert flx.shape == (nwave, ncol, nsun, nlyr + 1, 8)
+    if "onlyfl" not in flags:
+        rad = ds.gather_rad().clone()
+        assert rad.shape[:3] == (nwave, ncol, nsun)
+
+    # the shared homogeneous solution gives the same numbers as separate
+    # solves
+    for s in range(nsun):
+        ref = make_disort(flags, nwave, ncol, nlyr, **ANGLES)
+        expected = ref.forward(
+            prop, temf=temf, umu0=umu0[:, s], phi0=phi0[:, s], **bc
+        )
+        assert_allclose(result[:, :, s], expected, rtol=1e-12, atol=0)
+        assert_allclose(flx[:, :, s], ref.gather_flx(), rtol=1e-12, atol=0)
+        if "onlyfl" not in flags:
+            assert_allclose(rad[:, :, s], ref.gather_rad(), rtol=1e-12, atol=0)
+
+
+def test_multi_sun_shared_phi0(make_disort, make_columns):
+    nwave, ncol, nlyr = 1, 2, 6
+    prop, bc, _ = make_columns(
+        nwave, ncol, nlyr, fbeam=3.14159, albedo=0.2, fisot=0.1
+    )
+    umu0 = torch.tensor([[0.8, 0.3], [0.5, 0.25]], dtype=torch.float64)
+    phi0 = torch.tensor([10.0, 40.0], dtype=torch.float64)
+
+    ds = make_disort("lamber,quiet,usrang", nwave, ncol, nlyr, **ANGLES)
+    ds.forward(prop, umu0=umu0, phi0=phi0, **bc)
+    rad = ds.gather_rad().clone()
+
+    # a phi0 per column applies to all of its suns
+    ds.forward(prop, umu0=umu0, phi0=phi0.unsqueeze(-1).expand(-1, 2), **bc)
+    assert_allclose(ds.gather_rad(), rad, rtol=0, atol=0)
@@ -0,0 +1,72 @@
+""" Test output selection of pydisort forward."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+import numpy as np
+from numpy.testing import assert_equal, assert_allclose
+from pydisort import scattering_moments
+from pydisort import (
+    output_flux,
+    output_dfdt,
+    output_uavg,
+    output_rad,
+    output_gather,
+    iflup,
+    ifldn,
+    irfldir,
+    idfdt,
+    iuavg,
+    iuavgso,
+)
+
+FLAGS = "usrang,lamber,quiet,intensity_correction,old_intensity_correction"
+COLUMNS = {
+    "ncol": 2,
+    "nlyr": 5,
+    "umu": np.linspace(-0.9, 0.9, 8),
+    "phi": np.array([0.0, 90.0]),
+}
+
+
+def test_selected_outputs(make_disort):
+    prop = torch.zeros((1, 2, 5, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.1 * torch.arange(1, 6, dtype=torch.float64)
+    prop[..., 1] = 0.8
+    prop[..., 2:] = scattering_moments(8, "henyey-greenstein", 0.7)
+    bc = {"fbeam": torch.full((1, 2), np.pi), "umu0": torch.tensor([0.5, 0.8])}
+
+    ds = make_disort(FLAGS, **COLUMNS)
+    flx = ds.forward(prop, **bc)
+    flx8 = ds.gather_flx().clone()
+    rad = ds.gather_rad().clone()
+
+    mask = output_flux | output_dfdt | output_uavg
+    uavg = slice(iuavg, iuavgso + 1)
+    result = make_disort(FLAGS, **COLUMNS).forward(prop, outputs=mask, **bc)
+    assert_equal(result.shape, (1, 2, 6, 7))
+
+    assert_allclose(result[..., :2], flx, rtol=1e-10)
+    assert_allclose(result[..., 1], flx8[..., irfldir] + flx8[..., ifldn])
+    assert_allclose(result[..., 0], flx8[..., iflup], rtol=1e-10)
+    assert_allclose(result[..., 2], flx8[..., idfdt], rtol=1e-10)
+    assert_allclose(result[..., 3:], flx8[..., uavg], rtol=1e-10)
+
+    # radiance only, the same module after a fluxes-only call
+    ds = make_disort(FLAGS, **COLUMNS)
+    ds.forward(prop, outputs=output_flux, **bc)
+    result = ds.forward(prop, outputs=output_rad, **bc)
+    assert_equal(result.shape, (1, 2, 6, 0))
+    assert_allclose(ds.gather_rad(), rad, rtol=1e-10)
+
+    # mean intensity only
+    result = ds.forward(prop, outputs=output_uavg | output_gather, **bc)
+    assert_allclose(result, flx8[..., uavg], rtol=1e-10)
+
+    # gathered fluxes alone, without intensities
+    ds = make_disort(FLAGS, **COLUMNS)
+    ds.forward(prop, outputs=output_flux | output_gather, **bc)
+    assert_allclose(ds.gather_flx(), flx8, rtol=1e-10)
+    with pytest.raises(RuntimeError):
+        ds.gather_rad()
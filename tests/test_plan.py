@@ -0,0 +1,113 @@
+""" Test replaying forward through a DisortPlan."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import DisortPlan, scattering_moments
+from pydisort import output_flux, output_uavg
+
+FLAGS = "onlyfl,lamber,quiet,planck"
+
+
+def test_plan_matches_forward(make_disort):
+    nwave, ncol, nlyr = 4, 3, 6
+
+    prop = torch.zeros((nwave, ncol, nlyr, 2 + 8), dtype=torch.float64)
+    prop[..., 2:] = scattering_moments(8, "henyey-greenstein", 0.5)
+    temf = torch.full((ncol, nlyr + 1), 250.0, dtype=torch.float64)
+    btemp = torch.full((ncol,), 300.0, dtype=torch.float64)
+
+    ds = make_disort(FLAGS, nwave, ncol)
+    plan = DisortPlan(ds, prop, temf=temf, outputs=output_flux, btemp=btemp)
+
+    for step in range(3):
+        # update the planned tensors in place
+        prop[..., 0] = torch.rand(nwave, ncol, nlyr) + 0.1
+        prop[..., 1] = 0.5 * torch.rand(nwave, ncol, nlyr)
+        temf.copy_(200.0 + 10.0 * torch.rand(ncol, nlyr + 1))
+
+        result = plan.run(prop, temf=temf, btemp=btemp)
+        expected = make_disort(FLAGS, nwave, ncol).forward(
+            prop, temf=temf, btemp=btemp
+        )
+        assert_allclose(result, expected, rtol=1e-12, atol=0.0)
+
+    # new storage and a caller-owned output
+    out = torch.empty((nwave, ncol, nlyr + 1, 2), dtype=torch.float64)
+    result = plan.run(prop.clone(), temf=temf, out=out, btemp=btemp * 1.1)
+    assert result.data_ptr() == out.data_ptr()
+
+    expected = make_disort(FLAGS, nwave, ncol).forward(
+        prop, temf=temf, btemp=btemp * 1.1
+    )
+    assert_allclose(out, expected, rtol=1e-12, atol=0.0)
+
+
+def test_plan_checks_inputs(make_disort):
+    nwave, ncol, nlyr = 2, 2, 6
+
+    prop = torch.zeros((nwave, ncol, nlyr, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.5
+    temf = torch.full((ncol, nlyr + 1), 250.0, dtype=torch.float64)
+
+    plan = DisortPlan(
+        make_disort(FLAGS, nwave, ncol),
+        prop,
+        temf=temf,
+        outputs=output_flux | output_uavg,
+    )
+    assert plan.run(prop, temf=temf).shape == (nwave, ncol, nlyr + 1, 6)
+
+    # a different shape
+    with pytest.raises(RuntimeError):
+        plan.run(prop[:, :1], temf=temf)
+
+    # different bc keys
+    with pytest.raises(RuntimeError):
+        plan.run(prop, temf=temf, btemp=torch.ones(ncol, dtype=torch.float64))
+
+
+def test_plan_new_storage(make_disort):
+    nwave, ncol, nlyr = 3, 2, 6
+
+    prop = torch.zeros((nwave, ncol, nlyr, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.3
+    prop[..., 1] = 0.4
+    prop[..., 2:] = scattering_moments(8, "isotropic")
+    temf = torch.full((ncol, nlyr + 1), 250.0, dtype=torch.float64)
+    bc = {
+        "btemp": torch.full((ncol,), 300.0, dtype=torch.float64),
+        "umu0": torch.tensor([0.4, 0.8], dtype=torch.float64),
+    }
+
+    plan = DisortPlan(
+        make_disort(FLAGS, nwave, ncol),
+        prop,
+        temf=temf,
+        outputs=output_flux,
+        **bc,
+    )
+    first = plan.run(prop, temf=temf, **bc)
+
+    # new tensors of the planned layout; the result is the same buffer
+    prop = prop.clone()
+    prop[..., 0] = 0.6
+    temf = temf + 20.0
+    bc = {"btemp": bc["btemp"] - 10.0, "umu0": bc["umu0"].flip(0)}
+
+    result = plan.run(prop, temf=temf, **bc)
+    assert result.data_ptr() == first.data_ptr()
+
+    expected = make_disort(FLAGS, nwave, ncol).forward(prop, temf=temf, **bc)
+    assert_allclose(result, expected, rtol=1e-12, atol=0.0)
+
+    # new tensors of another layout
+    prop = prop.transpose(0, 1).contiguous().transpose(0, 1)
+    bc["umu0"] = torch.tensor([[0.5, 0.0], [0.7, 0.0]], dtype=torch.float64)
+    bc["umu0"] = bc["umu0"][:, 0]
+
+    result = plan.run(prop, temf=temf, **bc)
+    expected = make_disort(FLAGS, nwave, ncol).forward(prop, temf=temf, **bc)
+    assert_allclose(result, expected, rtol=1e-12, atol=0.0)
@@ -0,0 +1,50 @@
+""" Test the tabulated thermal emission of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import torch
+from numpy.testing import assert_allclose
+
+FLAGS = "onlyfl,lamber,quiet,planck"
+
+
+def test_planck_table(make_disort, make_columns):
+    nwave, ncol, nlyr = 4, 5, 6
+
+    # isotropic scattering
+    prop, bc, temf = make_columns(
+        nwave, ncol, nlyr, 4, tau=0.1, ssa=(0.0, 0.5), g=0.0, btemp=300.0
+    )
+
+    ref = make_disort(FLAGS, nwave, ncol, nstr=4, planck_table=False)
+    expected = ref.forward(prop, temf=temf, **bc)
+    ds = make_disort(FLAGS, nwave, ncol, nstr=4, planck_table=True)
+    result = ds.forward(prop, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-4, atol=1e-12)
+
+
+def test_planck_table_outside_grid(make_disort):
+    nwave, ncol, nlyr = 2, 3, 6
+
+    prop = torch.zeros((nwave, ncol, nlyr, 2 + 4), dtype=torch.float64)
+    prop[..., 0] = 0.5
+
+    # temperatures above the grid use the emission function directly
+    temf = torch.full((ncol, nlyr + 1), 250.0, dtype=torch.float64)
+    btemp = torch.full((ncol,), 1500.0, dtype=torch.float64)
+
+    ds = make_disort(
+        FLAGS,
+        nwave,
+        ncol,
+        nstr=4,
+        planck_table=True,
+        planck_tgrid=[100.0, 400.0, 0.5],
+    )
+    result = ds.forward(prop, temf=temf, btemp=btemp)
+
+    ref = make_disort(FLAGS, nwave, ncol, nstr=4, planck_table=False)
+    expected = ref.forward(prop, temf=temf, btemp=btemp)
+
+    assert_allclose(result, expected, rtol=1e-4, atol=1e-12)
@@ -0,0 +1,59 @@
+""" Test pooled disort states with pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import scattering_moments
+
+FLAGS = "onlyfl,lamber,quiet,planck"
+
+
+def test_pooled_matches_default(make_disort, make_columns):
+    nwave, ncol, nlyr = 7, 5, 6
+    prop, bc, temf = make_columns(
+        nwave,
+        ncol,
+        nlyr,
+        tau=0.1,
+        ssa=(0.0, 0.5),
+        trange=10.0,
+        btemp=300.0,
+        albedo=0.2,
+    )
+
+    expected = make_disort(FLAGS, nwave, ncol, pooled=False).forward(
+        prop, temf=temf, **bc
+    )
+
+    ds = make_disort(FLAGS, nwave, ncol, pooled=True)
+    result = ds.forward(prop, temf=temf, **bc)
+
+    assert_allclose(result, expected, rtol=1e-12, atol=0.0)
+    assert (ds.gather_status() == 0).all()
+
+    with pytest.raises(RuntimeError):
+        ds.gather_flx()
+
+
+def test_pooled_gather_buffers(make_disort):
+    nwave, ncol, nlyr = 3, 4, 6
+
+    prop = torch.zeros((nwave, ncol, nlyr, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.2
+    prop[..., 1] = 0.3
+    prop[..., 2:] = scattering_moments(8, "isotropic")
+    temf = torch.full((ncol, nlyr + 1), 250.0, dtype=torch.float64)
+
+    ds = make_disort(FLAGS, nwave, ncol, pooled=True)
+    flx8 = torch.empty((nwave, ncol, nlyr + 1, 8), dtype=torch.float64)
+    ds.set_gather_buffers(flx8)
+
+    result = ds.forward(prop, temf=temf)
+
+    # written in place, consistent with the up/down fluxes of forward
+    gathered = ds.gather_flx()
+    assert gathered.data_ptr() == flx8.data_ptr()
+    assert_allclose(result[..., 0], flx8[..., 2])
+    assert_allclose(result[..., 1], flx8[..., 0] + flx8[..., 1])
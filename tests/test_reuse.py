@@ -0,0 +1,134 @@
+""" Test the tolerance-based reuse of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position, redefined-outer-name
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+FLAGS = "onlyfl,lamber,quiet,planck"
+OPTIONS = {"nstr": 4, "wave": 500.0}
+BC = {"fbeam": 3.14159, "albedo": 0.2, "btemp": 290.0}
+
+
+@pytest.fixture
+def columns(make_columns):
+    """Scattering beam columns with a surface at 290 K."""
+
+    def make(nwave, ncol, nlyr):
+        umu0 = torch.linspace(0.3, 0.9, ncol, dtype=torch.float64)
+        return make_columns(
+            nwave,
+            ncol,
+            nlyr,
+            4,
+            tau=0.1,
+            ssa=(0.5, 0.9),
+            trange=60.0,
+            umu0=umu0,
+            **BC,
+        )
+
+    return make
+
+
+def test_reuse_within_tolerance(make_disort, columns):
+    nwave, ncol, nlyr = 2, 3, 5
+    prop, bc, temf = columns(nwave, ncol, nlyr)
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, reuse_tol=1.0e-2, **OPTIONS)
+    first = ds.forward(prop, temf=temf, **bc)
+    assert ds.incremental_stats()["reused"] == 0
+
+    # a small change returns the fluxes of the last solve
+    result = ds.forward(prop, temf=temf * 1.001, **bc)
+    assert_allclose(result, first, rtol=0, atol=0)
+    stats = ds.incremental_stats()
+    assert stats["reused"] == nwave * ncol
+    assert stats["dirty"] == 0
+    assert stats["reused_fraction"] == 1.0
+
+    # a large change in one column solves that column
+    prop[:, 1, :, 0] *= 1.05
+    result = ds.forward(prop, temf=temf, **bc)
+    ref = make_disort(FLAGS, nwave, ncol, nlyr, **OPTIONS)
+    expected = ref.forward(prop, temf=temf, **bc)
+    assert_allclose(result[:, 1], expected[:, 1], rtol=0, atol=0)
+    assert ds.incremental_stats()["dirty"] == nwave
+
+
+def test_reuse_drift(make_disort, columns):
+    nwave, ncol, nlyr = 1, 2, 4
+    prop, bc, temf = columns(nwave, ncol, nlyr)
+
+    ds = make_disort(FLAGS, nwave, ncol, nlyr, reuse_tol=1.0e-2, **OPTIONS)
+    ds.forward(prop, temf=temf, **bc)
+
+    # the change is measured from the last solve, not the last call
+    solved = []
+    for step in range(1, 6):
+        ds.forward(prop, temf=temf * (1.0 + 0.004 * step), **bc)
+        solved.append(ds.incremental_stats()["dirty"])
+    assert solved == [0, 0, ncol, 0, 0]
+
+
+def test_reuse_first_order(make_disort, columns):
+    nwave, ncol, nlyr = 1, 3, 5
+    prop, bc, temf = columns(nwave, ncol, nlyr)
+
+    ds = make_disort(
+        FLAGS,
+        nwave,
+        ncol,
+        nlyr,
+        reuse_tol=1.0e-2,
+        reuse_correct=True,
+        **OPTIONS,
+    )
+    first = ds.forward(prop, temf=temf, **bc)
+
+    prop[..., 0] *= 1.003
+    prop[..., 1] *= 0.998
+    temf = temf * 1.002
+    bc["albedo"] = bc["albedo"] * 1.005
+
+    result = ds.forward(prop, temf=temf, **bc)
+    assert ds.incremental_stats()["reused"] == nwave * ncol
+
+    ref = make_disort(FLAGS, nwave, ncol, nlyr, **OPTIONS)
+    expected = ref.forward(prop, temf=temf, **bc)
+    stale = (first - expected).abs().max()
+    corrected = (result - expected).abs().max()
+    assert corrected < 0.05 * stale
+
+
+def test_reuse_first_order_without_planck(make_disort, columns):
+    nwave, ncol, nlyr = 1, 3, 5
+    prop, bc, _ = columns(nwave, ncol, nlyr)
+    flags = "onlyfl,lamber,quiet"
+
+    # no temperatures: the correction must not read them
+    ds = make_disort(
+        flags,
+        nwave,
+        ncol,
+        nlyr,
+        reuse_tol=1.0e-2,
+        reuse_correct=True,
+        **OPTIONS,
+    )
+    first = ds.forward(prop, **bc)
+
+    prop[..., 0] *= 1.003
+    bc["albedo"] = bc["albedo"] * 1.005
+
+    result = ds.forward(prop, **bc)
+    assert ds.incremental_stats()["reused"] == nwave * ncol
+    assert not torch.isnan(result).any()
+
+    expected = make_disort(flags, nwave, ncol, nlyr, **OPTIONS).forward(
+        prop, **bc
+    )
+    stale = (first - expected).abs().max()
+    corrected = (result - expected).abs().max()
+    assert corrected < 0.05 * stale
@@ -0,0 +1,40 @@
+""" Test column schedules of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+
+FLAGS = "onlyfl,lamber,quiet"
+
+
+def test_schedules_agree(make_disort, make_columns):
+    nwave, ncol, nlyr = 5, 16, 8
+    prop, _, _ = make_columns(
+        nwave, ncol, nlyr, tau=0.1, ssa=(0.0, 0.0), g=0.7
+    )
+
+    # only half of the columns scatter or see the beam
+    prop[:, ::2, :, 1] = 0.9
+    fbeam = torch.zeros((nwave, ncol), dtype=torch.float64)
+    fbeam[:, 1::4] = 3.14159
+
+    results = {}
+    for schedule in ["static", "dynamic", "cost"]:
+        ds = make_disort(FLAGS, nwave, ncol, nlyr, schedule=schedule)
+        results[schedule] = ds.forward(prop, fbeam=fbeam)
+
+        stats = ds.schedule_stats()
+        assert stats["nthreads"] == torch.get_num_threads()
+        assert stats["imbalance"] >= 1.0
+        assert 0.0 <= stats["idle"] <= 1.0
+        assert stats["ncol_max"] <= nwave * ncol
+
+    assert_allclose(results["dynamic"], results["static"], rtol=0, atol=0)
+    assert_allclose(results["cost"], results["static"], rtol=0, atol=0)
+
+
+def test_unknown_schedule(make_disort):
+    with pytest.raises(RuntimeError):
+        make_disort(FLAGS, schedule="round-robin")
@@ -0,0 +1,45 @@
+""" Test per-column error status with pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import torch
+from numpy.testing import assert_equal, assert_allclose
+from pydisort import DisortOptions, Disort
+
+
+def test_bad_column():
+    op = DisortOptions().header("Status Test")
+    op.flags("onlyfl,lamber,quiet")
+    op.ncol(3)
+    op.ds().nlyr = 4
+    op.ds().nmom = 8
+    op.ds().nstr = 8
+    op.ds().nphase = 8
+
+    ds = Disort(op)
+    tau = torch.tensor([0.1, 0.2, 0.3, 0.4]).unsqueeze(-1).repeat(3, 1, 1)
+
+    # negative optical thickness in the middle column
+    tau[1, 2, 0] = -1.0
+    result = ds.forward(tau, fbeam=torch.tensor([[3.14159, 3.14159, 3.14159]]))
+    assert_equal(result.shape, (1, 3, 5, 2))
+
+    status = ds.gather_status()
+    assert_equal(status.shape, (1, 3))
+    assert_equal(status.tolist(), [[0, 1, 0]])
+
+    # the failed column is flagged with NaN, the good ones are unaffected
+    assert torch.isnan(result[0, 1]).all()
+    assert_allclose(
+        result[0, 0, :, 1],
+        torch.tensor([3.1416, 2.8426, 2.3273, 1.7241, 1.1557]),
+        atol=1e-4,
+        rtol=1e-4,
+    )
+    assert_allclose(result[0, 0], result[0, 2])
+
+    # fixing the input of the failed column clears its status
+    tau[1, 2, 0] = 0.3
+    result = ds.forward(tau, fbeam=torch.tensor([[3.14159, 3.14159, 3.14159]]))
+    assert_equal(ds.gather_status().tolist(), [[0, 0, 0]])
+    assert_allclose(result[0, 0], result[0, 1])
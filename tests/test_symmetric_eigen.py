@@ -0,0 +1,59 @@
+""" Test the symmetric eigen solver of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import pytest
+import torch
+from numpy.testing import assert_allclose
+from pydisort import scattering_moments
+
+COLUMNS = {
+    "ncol": 2,
+    "nlyr": 5,
+    "umu": [-0.8, -0.2, 0.3, 0.9],
+    "phi": [0.0, 90.0, 180.0],
+}
+
+
+@pytest.mark.parametrize("nstr", [4, 16, 32])
+def test_symmetric_eigen_intensity(make_disort, make_columns, nstr):
+    prop, bc, _ = make_columns(
+        1,
+        2,
+        5,
+        nstr,
+        tau=0.1,
+        ssa=(0.0, 0.99),
+        g=0.7,
+        fbeam=3.14159,
+        umu0=torch.tensor([0.4, 0.8], dtype=torch.float64),
+        albedo=0.2,
+    )
+
+    flags = "lamber,quiet,usrang,intensity_correction"
+    ref = make_disort(flags, nstr=nstr, **COLUMNS)
+    expected = ref.forward(prop, **bc)
+
+    ds = make_disort(flags + ",symmetric_eigen", nstr=nstr, **COLUMNS)
+    result = ds.forward(prop, **bc)
+
+    assert_allclose(result, expected, rtol=1e-9, atol=1e-12)
+    assert_allclose(ds.gather_rad(), ref.gather_rad(), rtol=1e-9, atol=1e-12)
+
+
+def test_symmetric_eigen_conservative(make_disort):
+    prop = torch.zeros((1, 2, 5, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 1.0
+    prop[..., 1] = 1.0
+    prop[..., 2:] = scattering_moments(8, "henyey-greenstein", 0.5)
+    bc = {
+        "fbeam": torch.full((1, 2), 3.14159, dtype=torch.float64),
+        "umu0": torch.tensor([0.5, 1.0], dtype=torch.float64),
+    }
+
+    flags = "onlyfl,lamber,quiet"
+    expected = make_disort(flags, **COLUMNS).forward(prop, **bc)
+    ds = make_disort(flags + ",symmetric_eigen", **COLUMNS)
+    result = ds.forward(prop, **bc)
+
+    assert_allclose(result, expected, rtol=1e-7, atol=1e-10)
@@ -0,0 +1,52 @@
+""" Test the two-stream solver mode of pydisort."""
+# pylint: disable = no-name-in-module, invalid-name,
+# import-error, wrong-import-position
+
+import torch
+from numpy.testing import assert_allclose
+from pydisort import scattering_moments
+
+FLAGS = "onlyfl,lamber,quiet"
+
+
+def test_twostr_absorbing(make_disort):
+    ncol = 3
+    prop = torch.zeros((1, ncol, 5, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.1 * torch.arange(1, 6, dtype=torch.float64)
+    bc = {
+        "fbeam": torch.full((1, ncol), 3.14159, dtype=torch.float64),
+        "umu0": torch.tensor([0.3, 0.6, 1.0], dtype=torch.float64),
+    }
+
+    ref = make_disort(FLAGS, ncol=ncol, nlyr=5, solver="disort")
+    expected = ref.forward(prop, **bc)
+
+    ds = make_disort(FLAGS, ncol=ncol, nlyr=5, solver="twostr")
+    result = ds.forward(prop, **bc)
+
+    # the direct beam is exact in both solvers
+    assert_allclose(result, expected, rtol=1e-6, atol=1e-10)
+    assert (ds.gather_status() == 0).all()
+    assert ds.options.ds().flag.onlyfl
+
+
+def test_twostr_scattering(make_disort):
+    ncol = 2
+    prop = torch.zeros((1, ncol, 5, 2 + 8), dtype=torch.float64)
+    prop[..., 0] = 0.2
+    prop[..., 1] = 0.8
+    prop[..., 2:] = scattering_moments(8, "henyey-greenstein", 0.6)
+    bc = {
+        "fbeam": torch.full((1, ncol), 3.14159, dtype=torch.float64),
+        "umu0": torch.tensor([0.5, 0.9], dtype=torch.float64),
+        "albedo": torch.full((1, ncol), 0.3, dtype=torch.float64),
+    }
+
+    ref = make_disort(FLAGS, ncol=ncol, nlyr=5, solver="disort")
+    expected = ref.forward(prop, **bc)
+    ds = make_disort(FLAGS, ncol=ncol, nlyr=5, solver="twostr")
+    result = ds.forward(prop, **bc)
+
+    # same layout, within the accuracy of two streams
+    assert result.shape == expected.shape
+    assert_allclose(result, expected, rtol=0.3, atol=0.0)